@@ -0,0 +1,153 @@
+/**
+ * Compares the attribute and index kernels of `io::attributes` with the
+ * per-element `memcpy` loops the glTF loader used before them. Inputs are
+ * generated from a fixed seed, outputs of both versions must be identical.
+ *
+ * Built with -DLOFT_VIEWER_BENCHMARKS=ON, run `attributes_bench [repetitions]`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "io/attributes.hpp"
+
+// layout of the float vertices the loader writes
+struct BenchVertex {
+    float pos[3];
+    float norm[3];
+    float uv[2];
+    float tangent[4];
+};
+
+static constexpr size_t NUM_VERTICES = 4'000'000;
+// odd, so the SIMD loops leave a tail for the scalar one
+static constexpr size_t NUM_INDICES = 12'000'001;
+
+static void reference_copy(const char* pSource, size_t sourceStride, char* pTarget, size_t targetStride,
+                           uint32_t numFloats, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        memcpy(pTarget + i * targetStride, pSource + i * sourceStride, numFloats * sizeof(float));
+    }
+}
+
+static void reference_widen(const char* pSource, size_t sourceStride, uint32_t indexSize, uint32_t* pTarget,
+                            size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        uint32_t index = 0;
+        memcpy(&index, pSource + i * sourceStride, indexSize);
+        pTarget[i] = index;
+    }
+}
+
+/**
+ * @return average milliseconds of a single run
+ */
+static double measure(uint32_t repetitions, const std::function<void()>& run) {
+    // first run only warms up the caches and the dispatch
+    run();
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < repetitions; i++) {
+        run();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+}
+
+static bool report(const std::string& name, double reference, double kernel, bool isSame) {
+    std::println("{:<24} reference {:8.2f} ms  kernel {:8.2f} ms  {:5.2f}x{}", name, reference, kernel,
+                 reference / kernel, isSame ? "" : "  OUTPUT MISMATCH");
+    return isSame;
+}
+
+static bool bench_attributes(uint32_t repetitions, std::mt19937& random) {
+    std::uniform_real_distribution<float> distribution(-100.0f, 100.0f);
+    std::vector<float> positions(NUM_VERTICES * 3);
+    std::vector<float> uvs(NUM_VERTICES * 2);
+    std::vector<float> tangents(NUM_VERTICES * 4);
+    for(auto* pValues : { &positions, &uvs, &tangents }) {
+        for(float& value : *pValues) {
+            value = distribution(random);
+        }
+    }
+
+    struct Attribute {
+        const std::vector<float>* pValues;
+        uint32_t numFloats;
+        size_t offset;
+    };
+
+    const Attribute attributes[] = {
+        { &positions, 3, offsetof(BenchVertex, pos) },
+        { &uvs, 2, offsetof(BenchVertex, uv) },
+        { &tangents, 4, offsetof(BenchVertex, tangent) },
+    };
+
+    std::vector<BenchVertex> reference(NUM_VERTICES);
+    std::vector<BenchVertex> vertices(NUM_VERTICES);
+
+    double referenceTime = measure(repetitions, [&]() {
+        for(auto& attribute : attributes) {
+            reference_copy((const char*)attribute.pValues->data(), attribute.numFloats * sizeof(float),
+                           (char*)reference.data() + attribute.offset, sizeof(BenchVertex),
+                           attribute.numFloats, NUM_VERTICES);
+        }
+    });
+
+    double kernelTime = measure(repetitions, [&]() {
+        for(auto& attribute : attributes) {
+            io::attributes::copy_floats((const char*)attribute.pValues->data(), attribute.numFloats * sizeof(float),
+                                        (char*)vertices.data() + attribute.offset, sizeof(BenchVertex),
+                                        attribute.numFloats, NUM_VERTICES);
+        }
+    });
+
+    // normals are not written by either, both stay zeroed
+    bool isSame = memcmp(reference.data(), vertices.data(), NUM_VERTICES * sizeof(BenchVertex)) == 0;
+    return report("attributes", referenceTime, kernelTime, isSame);
+}
+
+static bool bench_indices(uint32_t repetitions, std::mt19937& random, const std::string& name,
+                          uint32_t indexSize, size_t stride) {
+    std::uniform_int_distribution<uint32_t> distribution(0, 255);
+    std::vector<char> source(NUM_INDICES * stride);
+    for(char& byte : source) {
+        byte = (char)distribution(random);
+    }
+
+    std::vector<uint32_t> reference(NUM_INDICES);
+    std::vector<uint32_t> indices(NUM_INDICES);
+
+    double referenceTime = measure(repetitions, [&]() {
+        reference_widen(source.data(), stride, indexSize, reference.data(), NUM_INDICES);
+    });
+
+    double kernelTime = measure(repetitions, [&]() {
+        io::attributes::widen_indices(source.data(), stride, indexSize, indices.data(), NUM_INDICES);
+    });
+
+    return report(name, referenceTime, kernelTime, reference == indices);
+}
+
+int main(int argc, char** argv) {
+    uint32_t repetitions = argc > 1 ? (uint32_t)std::max(std::atoi(argv[1]), 1) : 20;
+    std::mt19937 random(1234);
+
+    bool isSame = bench_attributes(repetitions, random);
+    isSame &= bench_indices(repetitions, random, "8 bit indices", 1, 1);
+    isSame &= bench_indices(repetitions, random, "16 bit indices", 2, 2);
+    isSame &= bench_indices(repetitions, random, "16 bit strided indices", 2, 4);
+    isSame &= bench_indices(repetitions, random, "32 bit indices", 4, 4);
+
+    return isSame ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -26,8 +26,10 @@ struct Material {
 	int normalTexture;
 	float normalTextureBlend;
 
+	// occlusion, roughness and metallic in RGB
 	int pbrTexture;
 	float pbrTextureBlend;
+	float occlusionBlend;
 };
 
 
@@ -35,6 +37,7 @@ layout(set = 2, binding = 0) uniform Materials {
 	Material materials[128];
 } materials;
 
+// MAX_MATERIAL_TEXTURES of MaterialBuffer.h, handles of the texture storage never reach it
 layout(set = 2, binding = 1) uniform sampler2D colorTextures[128];
 // layout(set = 2, binding = 2) uniform sampler2DArray normalTextures;
 // layout(set = 2, binding = 3) uniform sampler2DArray pbrTextures;
@@ -45,12 +48,14 @@ void main() {
 	vec2 uv = inUV;
 
 	vec3 color = texture(colorTextures[material.colorTexture], uv).rgb;
-	vec3 normal = texture(colorTextures[material.normalTexture], uv).rgb;
-	normal = normalize(normal * 2.0 - 1.0);
-	vec2 pbr = texture(colorTextures[material.pbrTexture], uv).bg;
+	// Z is reconstructed, BC5 normal maps store only X and Y
+	vec2 normalXY = texture(colorTextures[material.normalTexture], uv).rg * 2.0 - 1.0;
+	vec3 normal = vec3(normalXY, sqrt(max(0.0, 1.0 - dot(normalXY, normalXY))));
+	vec3 orm = texture(colorTextures[material.pbrTexture], uv).rgb;
+	float occlusion = mix(1.0, orm.r, material.occlusionBlend);
 
 	fragColor = vec4(mix(material.albedo.rgb, color, material.colorTextureBlend), 1.0);
 	fragNormal = vec4(mix(inNormal, normalize(inTBN * normalize(normal)), material.normalTextureBlend), 1.0);
 	fragPosition = vec4(inPos, 1.0);
-	fragPbr = vec4(pbr, 0.0, 1.0);
+	fragPbr = vec4(orm.bg, occlusion, 1.0);
 }
@@ -1,9 +1,7 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
-layout(location = 2) in vec2 uv;
-layout(location = 3) in vec4 tangent;
+#include "vertex.glsl"
 
 layout(set = 0, binding = 0) uniform Camera {
 	mat4 proj;
@@ -29,14 +27,22 @@ layout( push_constant ) uniform constants
 {
 	uint transformIdx;
 	uint materialIdx;
+	// bounds of the primitive, compact positions are relative to them
+	vec4 boundsCenter;
+	vec4 boundsExtent;
 } PushConstants;
 
 
 void main() {
+	vec3 pos = decode_position(PushConstants.boundsCenter.xyz, PushConstants.boundsExtent.xyz);
+	vec3 norm = decode_normal();
+	vec4 tangent = decode_tangent();
+	vec2 uv = inUV;
+
 	vec3 bitangent = cross(norm, tangent.xyz) * tangent.w;
 	outTBN = mat3(tangent.xyz, bitangent, norm);
 
-	outPos = pos.xyz * 0.05;
+	outPos = pos * 0.05;
 	outNormal = norm.xyz;
 	outUV = uv;
     gl_Position = cam.proj * cam.view * vec4(outPos, 1.0);
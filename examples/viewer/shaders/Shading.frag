@@ -171,6 +171,7 @@ void main() {
 	float metallic = texture(inPbr, inUV).r;
 	float roughness = texture(inPbr, inUV).g;
 	roughness *= roughness;
+	float ambientOcclusion = texture(inPbr, inUV).b;
 	vec3 normal = texture(inNormal, inUV).rgb;
 	vec3 position = texture(inPosition, inUV).rgb;
 
@@ -183,7 +184,7 @@ void main() {
 	float lightIntensity = 1.5f;
 	vec3 Lo = bsdf(normal, viewDir, lightDir, color, metallic, roughness);
 
-	vec3 ambient = vec3(0.2) * color;
+	vec3 ambient = vec3(0.2) * color * ambientOcclusion;
 	vec3 prd = ambient + Lo * (1.0 - occlusion) * lightIntensity;
 
 	outColor = vec4(prd, 1.0);
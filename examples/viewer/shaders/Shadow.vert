@@ -1,14 +1,16 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
-layout(location = 2) in vec2 uv;
-layout(location = 3) in vec3 tangent;
+#include "vertex.glsl"
 
 layout( push_constant ) uniform constants {
     mat4 view;
+    // bounds of the primitive, compact positions are relative to them
+    vec4 boundsCenter;
+    vec4 boundsExtent;
 } Camera;
 
 void main() {
+    vec3 pos = decode_position(Camera.boundsCenter.xyz, Camera.boundsExtent.xyz);
     gl_Position = Camera.view * vec4(pos * 0.05, 1.0);
 }
@@ -26,8 +26,10 @@ struct Material {
     int normalTexture;
     float normalTextureBlend;
 
+    // occlusion, roughness and metallic in RGB
     int pbrTexture;
     float pbrTextureBlend;
+    float occlusionBlend;
 };
 
 layout(set = 2, binding = 0) uniform Materials {
@@ -42,12 +44,14 @@ layout(set = 2, binding = 4) uniform sampler2DArray pbrTextures;
 void main() {
     Material material = materials.materials[PushConstants.materialIdx];
     vec4 color = texture(colorTextures, vec3(inUV, material.colorTexture)).rgba;
-    vec3 normal = texture(normalTextures, vec3(inUV, materials.materials[PushConstants.materialIdx].normalTexture)).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
-    vec2 pbr = texture(pbrTextures, vec3(inUV, material.pbrTexture)).bg;
+    // Z is reconstructed, BC5 normal maps store only X and Y
+    vec2 normalXY = texture(normalTextures, vec3(inUV, materials.materials[PushConstants.materialIdx].normalTexture)).rg * 2.0 - 1.0;
+    vec3 normal = vec3(normalXY, sqrt(max(0.0, 1.0 - dot(normalXY, normalXY))));
+    vec3 orm = texture(pbrTextures, vec3(inUV, material.pbrTexture)).rgb;
+    float occlusion = mix(1.0, orm.r, material.occlusionBlend);
 
     fragColor = vec4(mix(material.albedo.rgb, color.rgb, material.colorTextureBlend), color.a);
     fragNormal = vec4(mix(inNormal, normalize(inTBN * normalize(normal)), 1.0), color.a);
     fragPosition = vec4(inPos, color.a);
-    fragPbr = vec4(mix(material.bsdf.xy, pbr, 1.0), 0.0, color.a);
+    fragPbr = vec4(mix(material.bsdf.xy, orm.bg, 1.0), occlusion, color.a);
 }
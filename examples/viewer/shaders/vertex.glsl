@@ -0,0 +1,47 @@
+// Vertex attributes of the scene meshes, see Vertex.hpp. Compact vertices
+// are decoded when compiled with COMPACT_VERTICES.
+
+#ifdef COMPACT_VERTICES
+// snorm relative to the bounds of the primitive, w is the handedness of the tangent
+layout(location = 0) in vec4 inPosition;
+// octahedral encoded
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) in vec2 inTangent;
+
+vec3 decode_octahedral(vec2 encoded) {
+	vec3 vector = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float folded = max(-vector.z, 0.0);
+	vector.xy += mix(vec2(folded), vec2(-folded), greaterThanEqual(vector.xy, vec2(0.0)));
+	return normalize(vector);
+}
+
+vec3 decode_position(vec3 boundsCenter, vec3 boundsExtent) {
+	return boundsCenter + inPosition.xyz * boundsExtent;
+}
+
+vec3 decode_normal() {
+	return decode_octahedral(inNormal);
+}
+
+vec4 decode_tangent() {
+	return vec4(decode_octahedral(inTangent), inPosition.w < 0.0 ? -1.0 : 1.0);
+}
+#else
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) in vec4 inTangent;
+
+vec3 decode_position(vec3 boundsCenter, vec3 boundsExtent) {
+	return inPosition;
+}
+
+vec3 decode_normal() {
+	return inNormal;
+}
+
+vec4 decode_tangent() {
+	return inTangent;
+}
+#endif
@@ -0,0 +1,412 @@
+#include "SceneCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+#include <span>
+#include <stdexcept>
+
+#include "file.hpp"
+
+// bumped whenever the layout of the cache or of the cached data changes
+static constexpr uint32_t CACHE_VERSION = 2;
+static constexpr char CACHE_MAGIC[8] = { 'L', 'O', 'F', 'T', 'S', 'C', 'N', '\0' };
+// sections start aligned, so they are read in place from the mapping
+static constexpr uint64_t SECTION_ALIGNMENT = 64;
+static constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+
+enum CacheMaterialFlags : uint32_t {
+    CACHE_MATERIAL_BLEND = 0x1,
+    CACHE_MATERIAL_OCCLUSION = 0x2,
+};
+
+// range of bytes of the file
+struct CacheSection {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// range of the string section
+struct CacheString {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    // layout of the geometry, it is uploaded as it is
+    uint32_t vertexSize;
+    uint32_t indexSize;
+    uint32_t numNodes;
+
+    CacheSection sources;
+    CacheSection vertices;
+    CacheSection indices;
+    CacheSection meshes;
+    CacheSection primitives;
+    CacheSection transforms;
+    CacheSection materials;
+    CacheSection textures;
+    CacheSection strings;
+};
+
+struct CacheSource {
+    CacheString path;
+    uint64_t size;
+    // ticks of the last write time, touched files are compared by their hash
+    int64_t modified;
+    uint64_t hash;
+};
+
+struct CacheMaterial {
+    uint32_t colorTexture;
+    uint32_t normalTexture;
+    uint32_t metallicRoughnessTexture;
+    uint32_t flags;
+    float albedo[4];
+    float bsdf[4];
+};
+
+struct CacheTexture {
+    CacheString name;
+    CacheString path;
+    CacheString occlusionPath;
+    uint32_t isNormal;
+    uint32_t padding;
+};
+
+/**
+ * Paths within the directory of the scene are stored relative, so the scene
+ * can be moved together with its files.
+ */
+static std::string relative_path(const SceneData& scene, const std::string& path) {
+    std::string directory = scene.directory();
+    return path.starts_with(directory) ? path.substr(directory.size()) : path;
+}
+
+static std::string absolute_path(const SceneData& scene, const std::string& path) {
+    if(path.empty() || std::filesystem::path(path).is_absolute()) {
+        return path;
+    }
+    return scene.get_absolute_path_of(path);
+}
+
+static int64_t modified_time(const std::string& path) {
+    return std::filesystem::last_write_time(path).time_since_epoch().count();
+}
+
+static bool is_source_unchanged(const std::string& path, const CacheSource& source) {
+    std::error_code error;
+    if(std::filesystem::file_size(path, error) != source.size || error) {
+        return false;
+    }
+
+    auto modified = std::filesystem::last_write_time(path, error);
+    if(error) {
+        return false;
+    }
+
+    return modified.time_since_epoch().count() == source.modified || io::file::hash(path) == source.hash;
+}
+
+/**
+ * Elements of the section, read in place from the mapping.
+ */
+template<typename T>
+static std::span<const T> read_section(const io::file::Mapping& mapping, const CacheSection& section) {
+    if(section.offset > mapping.size() || section.size > mapping.size() - section.offset ||
+       section.offset % alignof(T) != 0 || section.size % sizeof(T) != 0) {
+        throw std::runtime_error("Section is out of bounds");
+    }
+
+    return { (const T*)(mapping.data() + section.offset), section.size / sizeof(T) };
+}
+
+/**
+ * Copies the geometry into the sink, in as many spans as the sink hands out.
+ */
+static void copy_geometry(MeshSink* pSink, std::span<const Vertex> vertices, std::span<const Index> indices) {
+    pSink->reserve(vertices.size(), indices.size());
+
+    for(size_t i = 0; i < vertices.size();) {
+        std::span<Vertex> span = pSink->vertices(i, vertices.size() - i);
+        memcpy(span.data(), vertices.data() + i, span.size_bytes());
+        i += span.size();
+    }
+
+    for(size_t i = 0; i < indices.size();) {
+        std::span<Index> span = pSink->indices(i, indices.size() - i);
+        memcpy(span.data(), indices.data() + i, span.size_bytes());
+        i += span.size();
+    }
+
+    pSink->finish();
+}
+
+SceneCache::SceneCache(SceneLoader* pSource) :
+    m_pSource(pSource) {
+
+}
+
+std::string SceneCache::cache_path(const std::string& path) {
+    return std::filesystem::path(path).replace_extension(".loftscene").string();
+}
+
+const SceneData SceneCache::from_file(std::string path, MeshSink* pSink) {
+    auto cachePath = cache_path(path);
+
+    std::error_code error;
+    if(std::filesystem::exists(cachePath, error)) {
+        try {
+            auto scene = read(path, cachePath, pSink);
+            if(scene.has_value()) {
+                std::println("Loaded scene from cache {}", cachePath);
+                return std::move(*scene);
+            }
+        } catch(const std::exception& e) {
+            std::println("Failed to read scene cache {}: {}", cachePath, e.what());
+        }
+    }
+
+    // geometry is kept in the scene data, so it can be written into the cache
+    SceneData scene = m_pSource->from_file(path, nullptr);
+    try {
+        write(cachePath, scene);
+    } catch(const std::exception& e) {
+        std::println("Failed to write scene cache {}: {}", cachePath, e.what());
+    }
+
+    if(pSink != nullptr) {
+        copy_geometry(pSink, scene.vertices(), scene.indices());
+        scene.release_geometry();
+    }
+
+    return scene;
+}
+
+void SceneCache::write(const std::string& cachePath, const SceneData& scene) {
+    std::string strings;
+    auto add_string = [&](const std::string& value) {
+        CacheString string = { .offset = strings.size(), .size = value.size() };
+        strings += value;
+        return string;
+    };
+
+    std::vector<CacheSource> sources;
+    for(const auto& source : scene.sources()) {
+        sources.push_back({
+            .path = add_string(relative_path(scene, source)),
+            .size = std::filesystem::file_size(source),
+            .modified = modified_time(source),
+            .hash = io::file::hash(source),
+        });
+    }
+
+    std::vector<CacheMaterial> materials;
+    for(const auto& material : scene.materials()) {
+        CacheMaterial cached = {
+            .colorTexture = material.color_texture().value_or(NO_TEXTURE),
+            .normalTexture = material.normal_texture().value_or(NO_TEXTURE),
+            .metallicRoughnessTexture = material.metallic_roughness_texture().value_or(NO_TEXTURE),
+            .flags = (material.is_blended() ? CACHE_MATERIAL_BLEND : 0u) |
+                     (material.has_occlusion() ? CACHE_MATERIAL_OCCLUSION : 0u),
+        };
+        memcpy(cached.albedo, material.albedo(), sizeof(cached.albedo));
+        memcpy(cached.bsdf, material.bsdf(), sizeof(cached.bsdf));
+        materials.push_back(cached);
+    }
+
+    std::vector<CacheTexture> textures;
+    for(const auto& texture : scene.textures()) {
+        textures.push_back({
+            .name = add_string(texture.m_name),
+            .path = add_string(relative_path(scene, texture.m_path)),
+            .occlusionPath = add_string(relative_path(scene, texture.m_occlusionPath)),
+            .isNormal = texture.m_isNormal,
+        });
+    }
+
+    auto meshes = scene.meshes();
+
+    CacheHeader header = {
+        .version = CACHE_VERSION,
+        .vertexSize = sizeof(Vertex),
+        .indexSize = sizeof(Index),
+        .numNodes = (uint32_t)scene.num_nodes(),
+    };
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+
+    uint64_t end = sizeof(CacheHeader);
+    auto place = [&](CacheSection& section, uint64_t size) {
+        section.offset = (end + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        section.size = size;
+        end = section.offset + size;
+    };
+    place(header.sources, sources.size() * sizeof(CacheSource));
+    place(header.vertices, scene.num_vertices() * sizeof(Vertex));
+    place(header.indices, scene.num_indices() * sizeof(Index));
+    place(header.meshes, meshes.size() * sizeof(Mesh));
+    place(header.primitives, scene.primitives().size() * sizeof(Primitive));
+    place(header.transforms, scene.transforms().size() * sizeof(Transform));
+    place(header.materials, materials.size() * sizeof(CacheMaterial));
+    place(header.textures, textures.size() * sizeof(CacheTexture));
+    place(header.strings, strings.size());
+
+    // written aside and renamed, so a partially written cache is never read
+    auto tempPath = cachePath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if(!file) {
+        throw std::runtime_error(std::format("Failed to open {}", tempPath));
+    }
+
+    uint64_t written = 0;
+    auto write_bytes = [&](const void* pData, uint64_t size) {
+        file.write((const char*)pData, size);
+        written += size;
+    };
+
+    auto write_section = [&](const CacheSection& section, const void* pData) {
+        static constexpr char padding[SECTION_ALIGNMENT] = {};
+        write_bytes(padding, section.offset - written);
+        write_bytes(pData, section.size);
+    };
+
+    write_bytes(&header, sizeof(header));
+    write_section(header.sources, sources.data());
+    write_section(header.vertices, scene.vertices().data());
+    write_section(header.indices, scene.indices().data());
+    write_section(header.meshes, meshes.data());
+    write_section(header.primitives, scene.primitives().data());
+    write_section(header.transforms, scene.transforms().data());
+    write_section(header.materials, materials.data());
+    write_section(header.textures, textures.data());
+    write_section(header.strings, strings.data());
+
+    file.close();
+    if(!file) {
+        throw std::runtime_error(std::format("Failed to write {}", tempPath));
+    }
+
+    std::filesystem::rename(tempPath, cachePath);
+}
+
+std::optional<SceneData> SceneCache::read(const std::string& path, const std::string& cachePath, MeshSink* pSink) {
+    io::file::Mapping mapping(cachePath);
+
+    CacheHeader header = {};
+    if(mapping.size() < sizeof(header)) {
+        throw std::runtime_error("File is truncated");
+    }
+    memcpy(&header, mapping.data(), sizeof(header));
+
+    if(memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        throw std::runtime_error("File is not a scene cache");
+    }
+
+    // caches of other versions are replaced
+    if(header.version != CACHE_VERSION || header.vertexSize != sizeof(Vertex) || header.indexSize != sizeof(Index)) {
+        return {};
+    }
+
+    auto sources = read_section<CacheSource>(mapping, header.sources);
+    auto vertices = read_section<Vertex>(mapping, header.vertices);
+    auto indices = read_section<Index>(mapping, header.indices);
+    auto meshes = read_section<Mesh>(mapping, header.meshes);
+    auto primitives = read_section<Primitive>(mapping, header.primitives);
+    auto transforms = read_section<Transform>(mapping, header.transforms);
+    auto materials = read_section<CacheMaterial>(mapping, header.materials);
+    auto textures = read_section<CacheTexture>(mapping, header.textures);
+    auto strings = read_section<char>(mapping, header.strings);
+
+    auto read_string = [&](const CacheString& string) {
+        if(string.offset > strings.size() || string.size > strings.size() - string.offset) {
+            throw std::runtime_error("String is out of bounds");
+        }
+        return std::string(strings.data() + string.offset, string.size);
+    };
+
+    auto read_texture = [&](uint32_t idx) -> std::optional<uint32_t> {
+        if(idx == NO_TEXTURE) {
+            return {};
+        }
+        if(idx >= textures.size()) {
+            throw std::runtime_error("Texture is out of bounds");
+        }
+        return idx;
+    };
+
+    SceneData scene(header.numNodes, materials.size(), meshes.size(), primitives.size());
+    scene.set_path(path);
+
+    // the scene file itself is the first source
+    if(sources.empty() || absolute_path(scene, read_string(sources[0].path)) != path) {
+        return {};
+    }
+
+    for(const auto& source : sources) {
+        auto sourcePath = absolute_path(scene, read_string(source.path));
+        if(!is_source_unchanged(sourcePath, source)) {
+            std::println("Scene cache {} is out of date, {} changed", cachePath, sourcePath);
+            return {};
+        }
+        scene.add_source(sourcePath);
+    }
+
+    for(uint32_t i = 0; i < meshes.size(); i++) {
+        Mesh mesh = meshes[i];
+        scene.set_mesh(i, mesh);
+    }
+
+    // geometry is uploaded as it is, primitives must stay within it
+    for(uint32_t i = 0; i < primitives.size(); i++) {
+        Primitive primitive = primitives[i];
+        if(primitive.offset > indices.size() || primitive.count > indices.size() - primitive.offset ||
+           primitive.baseVertex > vertices.size()) {
+            throw std::runtime_error("Primitive is out of bounds");
+        }
+        scene.set_primitive(i, primitive);
+    }
+
+    for(const auto& transform : transforms) {
+        scene.push_transform(transform);
+    }
+
+    for(uint32_t i = 0; i < materials.size(); i++) {
+        const CacheMaterial& cached = materials[i];
+
+        float albedo[4];
+        memcpy(albedo, cached.albedo, sizeof(albedo));
+        MaterialData material(albedo);
+        material.set_bsdf(cached.bsdf);
+        material.set_alpha_blend(cached.flags & CACHE_MATERIAL_BLEND);
+        material.set_occlusion(cached.flags & CACHE_MATERIAL_OCCLUSION);
+
+        if(auto idx = read_texture(cached.colorTexture)) {
+            material.set_color_texture(*idx);
+        }
+        if(auto idx = read_texture(cached.normalTexture)) {
+            material.set_normal_texture(*idx);
+        }
+        if(auto idx = read_texture(cached.metallicRoughnessTexture)) {
+            material.set_metallic_roughness_texture(*idx);
+        }
+
+        scene.set_material(i, material);
+    }
+
+    scene.resize_textures(textures.size());
+    for(uint32_t i = 0; i < textures.size(); i++) {
+        TextureData texture(read_string(textures[i].name), absolute_path(scene, read_string(textures[i].path)),
+                            absolute_path(scene, read_string(textures[i].occlusionPath)));
+        texture.m_isNormal = textures[i].isNormal;
+        scene.set_texture(i, texture);
+    }
+
+    // without a sink the geometry is kept in the scene data
+    copy_geometry(pSink != nullptr ? pSink : &scene, vertices, indices);
+
+    return scene;
+}
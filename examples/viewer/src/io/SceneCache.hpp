@@ -0,0 +1,45 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "SceneLoader.hpp"
+
+/**
+ * Binary cache of imported scenes, written next to the scene as `.loftscene`.
+ *
+ * The cache holds the geometry in the layout it is uploaded in, together with
+ * primitives, meshes, transforms, materials and texture references. It is
+ * mapped into memory and copied straight into the sink, nothing is parsed.
+ * Scenes are imported by the source loader when the cache is missing, was
+ * written by another version, or any of the files the scene was imported
+ * from changed.
+ */
+class SceneCache : public SceneLoader {
+    SceneLoader* m_pSource;
+
+public:
+    /**
+     * @param pSource imports scenes, that are not cached yet
+     */
+    explicit SceneCache(SceneLoader* pSource);
+
+    const SceneData from_file(std::string path, MeshSink* pSink = nullptr) override;
+
+    /**
+     * Path of the cache of the scene.
+     */
+    static std::string cache_path(const std::string& path);
+
+    /**
+     * Writes the scene with its geometry into the cache. Sources of the scene
+     * are hashed, so the cache can be validated.
+     */
+    static void write(const std::string& cachePath, const SceneData& scene);
+
+    /**
+     * Reads the cached scene, the geometry is written into the sink.
+     * @return empty when the cache is out of date, throws when it is corrupted
+     */
+    static std::optional<SceneData> read(const std::string& path, const std::string& cachePath, MeshSink* pSink);
+};
@@ -1,11 +1,16 @@
 #pragma once
 
 #include "../mesh/data/SceneData.hpp"
+#include "../mesh/MeshSink.hpp"
 
 /**
  * Defines interface to load objects from file
  */
 class SceneLoader {
 public:
-    virtual const SceneData from_file(std::string path) = 0;
+    /**
+     * @param pSink destination the geometry is written into, the returned
+     *              scene data keeps the geometry itself when null
+     */
+    virtual const SceneData from_file(std::string path, MeshSink* pSink = nullptr) = 0;
 };
@@ -0,0 +1,161 @@
+#include "attributes.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LOFT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// intrinsics of all the instruction sets are available without flags
+#define LOFT_TARGET(name)
+#else
+#define LOFT_TARGET(name) __attribute__((target(name)))
+#endif
+#endif
+
+/**
+ * Copies elements of a size known at compile time, each copy becomes a few
+ * moves instead of a call to `memcpy`.
+ */
+template<size_t Size>
+static void copy_fixed(const char* pSource, size_t sourceStride, char* pTarget, size_t targetStride, size_t count) {
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        memcpy(pTarget, pSource, Size);
+        memcpy(pTarget + targetStride, pSource + sourceStride, Size);
+        memcpy(pTarget + 2 * targetStride, pSource + 2 * sourceStride, Size);
+        memcpy(pTarget + 3 * targetStride, pSource + 3 * sourceStride, Size);
+        pSource += 4 * sourceStride;
+        pTarget += 4 * targetStride;
+    }
+
+    for(; i < count; i++) {
+        memcpy(pTarget, pSource, Size);
+        pSource += sourceStride;
+        pTarget += targetStride;
+    }
+}
+
+void io::attributes::copy_floats(const char* pSource, size_t sourceStride, char* pTarget, size_t targetStride,
+                                 uint32_t numFloats, size_t count) {
+    switch(numFloats) {
+        case 0:
+            return;
+        case 2:
+            return copy_fixed<sizeof(float) * 2>(pSource, sourceStride, pTarget, targetStride, count);
+        case 3:
+            return copy_fixed<sizeof(float) * 3>(pSource, sourceStride, pTarget, targetStride, count);
+        case 4:
+            return copy_fixed<sizeof(float) * 4>(pSource, sourceStride, pTarget, targetStride, count);
+        default:
+            for(size_t i = 0; i < count; i++) {
+                memcpy(pTarget + i * targetStride, pSource + i * sourceStride, numFloats * sizeof(float));
+            }
+    }
+}
+
+#ifdef LOFT_X86
+enum class SimdLevel {
+    NONE,
+    SSE41,
+    AVX2,
+};
+
+static SimdLevel detect_simd_level() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int numIds = info[0];
+
+    __cpuid(info, 1);
+    bool hasSse41 = (info[2] & (1 << 19)) != 0;
+    // AVX2 registers must be saved by the OS as well
+    bool hasAvx = (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+    bool hasAvx2 = false;
+    if(numIds >= 7) {
+        __cpuidex(info, 7, 0);
+        hasAvx2 = hasAvx && (info[1] & (1 << 5)) != 0;
+    }
+#else
+    bool hasSse41 = __builtin_cpu_supports("sse4.1");
+    bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    return hasAvx2 ? SimdLevel::AVX2 : hasSse41 ? SimdLevel::SSE41 : SimdLevel::NONE;
+}
+
+/**
+ * @return number of widened indices, the rest is left for the scalar loop
+ */
+LOFT_TARGET("avx2")
+static size_t widen_avx2(const char* pSource, uint32_t indexSize, uint32_t* pTarget, size_t count) {
+    size_t i = 0;
+    if(indexSize == 2) {
+        for(; i + 8 <= count; i += 8) {
+            __m128i indices = _mm_loadu_si128((const __m128i*)(pSource + i * 2));
+            _mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_cvtepu16_epi32(indices));
+        }
+    } else if(indexSize == 1) {
+        for(; i + 8 <= count; i += 8) {
+            __m128i indices = _mm_loadl_epi64((const __m128i*)(pSource + i));
+            _mm256_storeu_si256((__m256i*)(pTarget + i), _mm256_cvtepu8_epi32(indices));
+        }
+    }
+
+    return i;
+}
+
+LOFT_TARGET("sse4.1")
+static size_t widen_sse41(const char* pSource, uint32_t indexSize, uint32_t* pTarget, size_t count) {
+    size_t i = 0;
+    if(indexSize == 2) {
+        for(; i + 4 <= count; i += 4) {
+            __m128i indices = _mm_loadl_epi64((const __m128i*)(pSource + i * 2));
+            _mm_storeu_si128((__m128i*)(pTarget + i), _mm_cvtepu16_epi32(indices));
+        }
+    } else if(indexSize == 1) {
+        for(; i + 4 <= count; i += 4) {
+            int32_t packed;
+            memcpy(&packed, pSource + i, sizeof(packed));
+            _mm_storeu_si128((__m128i*)(pTarget + i), _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+        }
+    }
+
+    return i;
+}
+#endif
+
+void io::attributes::widen_indices(const char* pSource, size_t sourceStride, uint32_t indexSize,
+                                   uint32_t* pTarget, size_t count) {
+    if(indexSize == 4 && sourceStride == 4) {
+        memcpy(pTarget, pSource, count * sizeof(uint32_t));
+        return;
+    }
+
+    size_t i = 0;
+#ifdef LOFT_X86
+    static const SimdLevel simdLevel = detect_simd_level();
+    if(sourceStride == indexSize) {
+        if(simdLevel == SimdLevel::AVX2) {
+            i = widen_avx2(pSource, indexSize, pTarget, count);
+        } else if(simdLevel == SimdLevel::SSE41) {
+            i = widen_sse41(pSource, indexSize, pTarget, count);
+        }
+    }
+#endif
+
+    for(; i < count; i++) {
+        const char* pIndex = pSource + i * sourceStride;
+        if(indexSize == 1) {
+            pTarget[i] = (uint8_t)*pIndex;
+        } else if(indexSize == 2) {
+            uint16_t index;
+            memcpy(&index, pIndex, sizeof(index));
+            pTarget[i] = index;
+        } else {
+            memcpy(&pTarget[i], pIndex, sizeof(uint32_t));
+        }
+    }
+}
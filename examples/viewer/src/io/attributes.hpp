@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Conversion kernels of vertex attributes and indices read from scene files.
+ */
+namespace io::attributes {
+/**
+ * Copies `count` elements of `numFloats` floats between strided arrays. The
+ * targets are usually fields of interleaved vertices.
+ */
+void copy_floats(const char* pSource, size_t sourceStride, char* pTarget, size_t targetStride,
+                 uint32_t numFloats, size_t count);
+
+/**
+ * Widens `count` unsigned indices of `indexSize` bytes to 32 bits. Tightly
+ * packed 8 and 16 bit indices are widened with AVX2 or SSE4.1 when the CPU
+ * supports them.
+ */
+void widen_indices(const char* pSource, size_t sourceStride, uint32_t indexSize, uint32_t* pTarget, size_t count);
+}
@@ -0,0 +1,114 @@
+#include "file.hpp"
+
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#if __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif _WIN32
+#include <windows.h>
+#else
+#error "Unsupported platform"
+#endif
+
+uint64_t io::file::hash(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        throw std::runtime_error(std::format("Failed to open {}", path));
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    uint64_t hash = 14695981039346656037ull;
+    while(file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        for(std::streamsize i = 0; i < file.gcount(); i++) {
+            hash = (hash ^ (uint8_t)buffer[i]) * 1099511628211ull;
+        }
+    }
+
+    return hash;
+}
+
+#ifdef __linux__
+io::file::Mapping::Mapping(const std::string& path) :
+    m_pData(nullptr),
+    m_size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error(std::format("Failed to open {}", path));
+    }
+
+    struct stat info = {};
+    if(fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error(std::format("Failed to read size of {}", path));
+    }
+
+    m_size = info.st_size;
+    if(m_size > 0) {
+        void* pData = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(pData == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error(std::format("Failed to map {}", path));
+        }
+        m_pData = (const unsigned char*)pData;
+    }
+
+    // the mapping keeps its own reference to the file
+    close(fd);
+}
+
+io::file::Mapping::~Mapping() {
+    if(m_pData != nullptr) {
+        munmap((void*)m_pData, m_size);
+    }
+}
+#elif _WIN32
+io::file::Mapping::Mapping(const std::string& path) :
+    m_pData(nullptr),
+    m_size(0),
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr) {
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(m_file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::format("Failed to open {}", path));
+    }
+
+    LARGE_INTEGER size = {};
+    if(!GetFileSizeEx(m_file, &size)) {
+        CloseHandle(m_file);
+        throw std::runtime_error(std::format("Failed to read size of {}", path));
+    }
+
+    m_size = size.QuadPart;
+    if(m_size > 0) {
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(m_mapping != nullptr) {
+            m_pData = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+
+        if(m_pData == nullptr) {
+            if(m_mapping != nullptr) {
+                CloseHandle(m_mapping);
+            }
+            CloseHandle(m_file);
+            throw std::runtime_error(std::format("Failed to map {}", path));
+        }
+    }
+}
+
+io::file::Mapping::~Mapping() {
+    if(m_pData != nullptr) {
+        UnmapViewOfFile(m_pData);
+        CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+}
+#else
+#error "Unsupported platform"
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace io::file {
+/**
+ * FNV-1a hash of the contents of the file.
+ */
+uint64_t hash(const std::string& path);
+
+/**
+ * Read only mapping of a whole file into memory.
+ */
+class Mapping {
+    const unsigned char* m_pData;
+    size_t m_size;
+#if _WIN32
+    void* m_file;
+    void* m_mapping;
+#endif
+
+public:
+    /**
+     * Throws when the file cannot be opened or mapped.
+     */
+    explicit Mapping(const std::string& path);
+
+    ~Mapping();
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    [[nodiscard]] const unsigned char* data() const {
+        return m_pData;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return m_size;
+    }
+};
+}
@@ -1,22 +1,30 @@
 #include "gltfSceneLoader.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
 #include <print>
 #include <queue>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 #define CGLTF_IMPLEMENTATION
 #include "cgltf.h"
+#include "attributes.hpp"
+#include "file.hpp"
 #include "mesh/SceneTree.h"
 #include "mesh/Transform.hpp"
 
 #include <stdexcept>
 
-inline void memcpy_stride(char *pSource, uint32_t sourceStride,
-                          char *pTarget, uint32_t targetStride,
-                          uint32_t singleSize, uint32_t count) {
-	for(int i = 0; i < count; i++) {
-		memcpy(pTarget + i * targetStride, pSource + i * sourceStride, singleSize);
-	}
-}
+// vertices or indices loaded by a single task
+static constexpr size_t IMPORT_CHUNK_SIZE = 64 * 1024;
 
 struct SceneEntityCounts {
 	uint32_t numVertices;
@@ -24,7 +32,22 @@ struct SceneEntityCounts {
 	uint32_t numPrimitives;
 };
 
-bool count_elements(cgltf_data* pData, SceneEntityCounts* pOutCounts) {
+/**
+ * Vertices and indices of a primitive within the geometry of the scene.
+ */
+struct PrimitiveRange {
+	cgltf_primitive *pPrimitive;
+	size_t vertexOffset;
+	size_t numVertices;
+	size_t indexOffset;
+	size_t numIndices;
+};
+
+/**
+ * Counts the elements and assigns each primitive its range, in the order of
+ * meshes and their primitives.
+ */
+bool count_elements(cgltf_data* pData, SceneEntityCounts* pOutCounts, std::vector<PrimitiveRange>* pOutRanges) {
 	pOutCounts->numVertices = 0;
 	pOutCounts->numIndices = 0;
 	pOutCounts->numPrimitives = 0;
@@ -32,25 +55,59 @@ bool count_elements(cgltf_data* pData, SceneEntityCounts* pOutCounts) {
 	for(int i = 0; i < pData->meshes_count; i++) {
 		pOutCounts->numPrimitives += pData->meshes[i].primitives_count;
 		for(int p = 0; p < pData->meshes[i].primitives_count; p++) {
-			pOutCounts->numIndices += pData->meshes[i].primitives[p].indices->count;
-			for(int a = 0; a < pData->meshes[i].primitives[p].attributes_count; a++) {
-				auto attr = pData->meshes[i].primitives[p].attributes[a];
-				
-				pOutCounts->numVertices += attr.data->count;
-			}
+			cgltf_primitive *pPrimitive = &pData->meshes[i].primitives[p];
+			PrimitiveRange range = {
+				.pPrimitive = pPrimitive,
+				.vertexOffset = pOutCounts->numVertices,
+				// all the attributes of a primitive have the same count
+				.numVertices = pPrimitive->attributes[0].data->count,
+				.indexOffset = pOutCounts->numIndices,
+				.numIndices = pPrimitive->indices->count,
+			};
+			pOutRanges->push_back(range);
+
+			pOutCounts->numIndices += range.numIndices;
+			pOutCounts->numVertices += range.numVertices;
 		}
 	}
 
 	return true;
 }
 
-bool load_indices(cgltf_primitive *pPrimitive, Index *pOut) {
+/**
+ * Calls `fn` for each index below `count` on all the hardware threads, the
+ * calling one included. Returns once all the calls finish.
+ */
+void parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+	std::atomic<size_t> next = 0;
+	auto work = [&] {
+		for(size_t i = next++; i < count; i = next++) {
+			fn(i);
+		}
+	};
+
+	size_t numThreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), count);
+	std::vector<std::jthread> workers;
+	for(size_t i = 1; i < numThreads; i++) {
+		workers.emplace_back(work);
+	}
+	work();
+}
+
+/**
+ * Loads `count` indices of the primitive starting at `first`.
+ */
+bool load_indices(cgltf_primitive *pPrimitive, Index *pOut, size_t first, size_t count) {
 	char *pData = (char*)pPrimitive->indices->buffer_view->buffer->data +
 						 pPrimitive->indices->buffer_view->offset +
-						 pPrimitive->indices->offset;
+						 pPrimitive->indices->offset +
+						 first * pPrimitive->indices->stride;
 
     uint32_t fileIndexSize = 0;
     switch(pPrimitive->indices->component_type) {
+        case cgltf_component_type_r_8u:
+            fileIndexSize = 1;
+            break;
         case cgltf_component_type_r_16u:
             fileIndexSize = 2;
             break;
@@ -61,61 +118,191 @@ bool load_indices(cgltf_primitive *pPrimitive, Index *pOut) {
             fileIndexSize = 4;
     }
 
-    for(uint32_t i = 0; i < pPrimitive->indices->count; i++) {
-        Index index = 0;
-        memcpy(&index, pData + i * pPrimitive->indices->stride, fileIndexSize);
-        pOut[i] = index;
-    }
-
-	/* memcpy_stride(pData, pPrimitive->indices->stride,
-                  (char*)pOut, sizeof(Index),
-                  sizeof(Index), pPrimitive->indices->count); */
+    io::attributes::widen_indices(pData, pPrimitive->indices->stride, fileIndexSize, pOut, count);
 	return true;
 }
 
-bool load_primitive(cgltf_primitive *pPrimitive, Vertex *pOut) {
-	
+/**
+ * Reads `count` vertices of the primitive starting at `first` as floats.
+ * Float attributes are copied, quantized ones of `KHR_mesh_quantization`
+ * are converted one by one.
+ */
+template<typename T>
+void read_attributes(cgltf_primitive *pPrimitive, T *pOut, size_t first, size_t count) {
+	// output might be mapped memory, attributes missing in the file must be zeroed
+	memset(pOut, 0, count * sizeof(T));
+
 	for(uint32_t a = 0; a < pPrimitive->attributes_count; a++) {
 		auto attr = pPrimitive->attributes[a];
 
-		char *pData = (char*)((char*)attr.data->buffer_view->buffer->data +
-								attr.data->buffer_view->offset +
-								attr.data->offset);
-
-		uint32_t singleSize = 0;
+		uint32_t numFloats = 0;
 		uint32_t offset = 0;
 
 		switch(attr.type) {
 			case cgltf_attribute_type_position:
-				singleSize = sizeof(float) * 3;
-				offset = offsetof(Vertex, pos);
+				numFloats = 3;
+				offset = offsetof(T, pos);
 				break;
 			case cgltf_attribute_type_normal:
-				singleSize = sizeof(float) * 3;
-				offset = offsetof(Vertex, norm);
+				numFloats = 3;
+				offset = offsetof(T, norm);
 				break;
 			case cgltf_attribute_type_texcoord:
-				singleSize = sizeof(float) * 2;
-				offset = offsetof(Vertex, uv);
+				numFloats = 2;
+				offset = offsetof(T, uv);
 				break;
             case cgltf_attribute_type_tangent:
-                singleSize = sizeof(float) * 4;
-                offset = offsetof(Vertex, tangent);
+                numFloats = 4;
+                offset = offsetof(T, tangent);
+                break;
 			default:
 				break;
 		}
 
-		memcpy_stride(pData, attr.data->stride,
-                      (char*)pOut + offset, sizeof(Vertex),
-                      singleSize, attr.data->count);
+		if(numFloats == 0) {
+			continue;
+		}
+
+		if(attr.data->component_type != cgltf_component_type_r_32f) {
+			for(size_t i = 0; i < count; i++) {
+				cgltf_accessor_read_float(attr.data, first + i, (float*)((char*)(pOut + i) + offset), numFloats);
+			}
+			continue;
+		}
+
+		char *pData = (char*)((char*)attr.data->buffer_view->buffer->data +
+								attr.data->buffer_view->offset +
+								attr.data->offset +
+								first * attr.data->stride);
 
+		io::attributes::copy_floats(pData, attr.data->stride,
+                                    (char*)pOut + offset, sizeof(T),
+                                    numFloats, count);
+	}
+}
 
+/**
+ * Loads `count` vertices of the primitive starting at `first`.
+ * @param primitive bounds compact positions are relative to
+ */
+bool load_primitive(cgltf_primitive *pPrimitive, const Primitive& primitive, Vertex *pOut, size_t first, size_t count) {
+#ifdef LOFT_COMPACT_VERTICES
+	float center[4], extent[4];
+	vertex_bounds(primitive.boundsMin, primitive.boundsMax, center, extent);
+
+	// decoded in blocks, that fit onto the stack
+	FloatVertex decoded[256];
+	for(size_t i = 0; i < count; i += 256) {
+		size_t numDecoded = std::min<size_t>(256, count - i);
+		read_attributes(pPrimitive, decoded, first + i, numDecoded);
+		for(size_t v = 0; v < numDecoded; v++) {
+			pOut[i + v] = Vertex::encode(decoded[v], center, extent);
+		}
 	}
+#else
+	read_attributes(pPrimitive, pOut, first, count);
+#endif
 
 	return true;
 }
 
-const bool load_mesh_data(cgltf_data *pData, SceneData *pOutData) {
+/**
+ * Writes vertices or indices of all the primitives into the sink. Spans of
+ * the sink are taken one at a time, as its rules require, and the parts of
+ * the primitives within a span are loaded in parallel. Each element is
+ * written by exactly one task, so the result does not depend on scheduling.
+ * @param offset, count members of the range of the written elements
+ * @param load loads elements of the range at the index
+ */
+template<typename T>
+void write_ranges(const std::vector<PrimitiveRange>& ranges, size_t total,
+				  size_t PrimitiveRange::*offset, size_t PrimitiveRange::*count,
+				  const std::function<std::span<T>(size_t, size_t)>& get_span,
+				  const std::function<void(size_t, T*, size_t, size_t)>& load) {
+	struct Chunk {
+		size_t rangeIdx;
+		// first element within the primitive
+		size_t first;
+		size_t count;
+		// first element within the span
+		size_t target;
+	};
+
+	std::vector<Chunk> chunks;
+	size_t rangeIdx = 0;
+	for(size_t first = 0; first < total;) {
+		std::span<T> span = get_span(first, total - first);
+		size_t end = first + span.size();
+
+		// ranges are ordered by their offsets
+		while(rangeIdx < ranges.size() && ranges[rangeIdx].*offset + ranges[rangeIdx].*count <= first) {
+			rangeIdx++;
+		}
+
+		chunks.clear();
+		for(size_t r = rangeIdx; r < ranges.size() && ranges[r].*offset < end; r++) {
+			size_t from = std::max(first, ranges[r].*offset);
+			size_t to = std::min(end, ranges[r].*offset + ranges[r].*count);
+			for(size_t c = from; c < to; c += IMPORT_CHUNK_SIZE) {
+				chunks.push_back({
+					.rangeIdx = r,
+					.first = c - ranges[r].*offset,
+					.count = std::min(IMPORT_CHUNK_SIZE, to - c),
+					.target = c - first,
+				});
+			}
+		}
+
+		parallel_for(chunks.size(), [&](size_t i) {
+			load(chunks[i].rangeIdx, span.data() + chunks[i].target, chunks[i].first, chunks[i].count);
+		});
+
+		first = end;
+	}
+}
+
+/**
+ * Bounding box of the positions, taken from the accessor when it has one.
+ */
+void load_bounds(cgltf_primitive *pPrimitive, Primitive *pOut) {
+    const cgltf_attribute *pAttribute = std::find_if(pPrimitive->attributes,
+                                                     pPrimitive->attributes + pPrimitive->attributes_count,
+                                                     [](const cgltf_attribute& attribute) {
+        return attribute.type == cgltf_attribute_type_position;
+    });
+    if(pAttribute == pPrimitive->attributes + pPrimitive->attributes_count) {
+        return;
+    }
+
+    // min and max of quantized positions are not normalized
+    const cgltf_accessor *pAccessor = pAttribute->data;
+    if(pAccessor->has_min && pAccessor->has_max && pAccessor->component_type == cgltf_component_type_r_32f) {
+        memcpy(pOut->boundsMin, pAccessor->min, sizeof(float) * 3);
+        memcpy(pOut->boundsMax, pAccessor->max, sizeof(float) * 3);
+        return;
+    }
+
+    for(uint32_t c = 0; c < 3; c++) {
+        pOut->boundsMin[c] = FLT_MAX;
+        pOut->boundsMax[c] = -FLT_MAX;
+    }
+
+    for(size_t i = 0; i < pAccessor->count; i++) {
+        float position[3];
+        cgltf_accessor_read_float(pAccessor, i, position, 3);
+        for(uint32_t c = 0; c < 3; c++) {
+            pOut->boundsMin[c] = std::min(pOut->boundsMin[c], position[c]);
+            pOut->boundsMax[c] = std::max(pOut->boundsMax[c], position[c]);
+        }
+    }
+}
+
+/**
+ * Loads the meshes of the scene, the geometry is written into the sink.
+ * @param ranges ranges of the primitives, see `count_elements`
+ */
+const bool load_mesh_data(cgltf_data *pData, const std::vector<PrimitiveRange>& ranges,
+                          SceneData *pOutData, MeshSink *pSink) {
     uint32_t primitiveIdx = 0;
     for(uint32_t m = 0; m < pData->meshes_count; m++) {
         Mesh mesh = Mesh {
@@ -124,69 +311,159 @@ const bool load_mesh_data(cgltf_data *pData, SceneData *pOutData) {
         };
 
         pOutData->set_mesh(m, mesh);
+        primitiveIdx += mesh.numPrimitives;
+    }
 
-		for(uint32_t p = 0; p < pData->meshes[m].primitives_count; p++) {
-			cgltf_primitive *pPrimitive = &pData->meshes[m].primitives[p];
+    // bounds of primitives without min and max are computed from all the positions,
+    // they are needed before the vertices are written, compact ones are relative to them
+    std::vector<Primitive> primitives(ranges.size());
+    parallel_for(ranges.size(), [&](size_t i) {
+        primitives[i] = {
+                .objectIdx = (uint32_t)cgltf_material_index(pData, ranges[i].pPrimitive->material),
+                .offset = (uint32_t)ranges[i].indexOffset,
+                .count = (uint32_t)ranges[i].numIndices,
+                .baseVertex = (uint32_t)ranges[i].vertexOffset,
+        };
+        load_bounds(ranges[i].pPrimitive, &primitives[i]);
+    });
 
-            auto indices = pOutData->suballoc_indices(pPrimitive->indices->count);
-			load_indices(pPrimitive, indices);
+    for(uint32_t p = 0; p < primitives.size(); p++) {
+        pOutData->set_primitive(p, primitives[p]);
+    }
 
-            auto vertices = pOutData->suballoc_vertices(pPrimitive->attributes[0].data->count);
-			load_primitive(pPrimitive, vertices);
-
-            Primitive primitive = {
-                    .objectIdx = (uint32_t)cgltf_material_index(pData, pPrimitive->material),
-                    .offset = (uint32_t)(pOutData->num_indices() - pPrimitive->indices->count),
-                    .count = (uint32_t)pPrimitive->indices->count,
-                    .baseVertex = (uint32_t)(pOutData->num_vertices() - pPrimitive->attributes[0].data->count),
-            };
-            pOutData->set_primitive(primitiveIdx++, primitive);
-		}
-	}
+    const auto& last = ranges.empty() ? PrimitiveRange {} : ranges.back();
+    write_ranges<Index>(ranges, last.indexOffset + last.numIndices,
+                        &PrimitiveRange::indexOffset, &PrimitiveRange::numIndices,
+                        [&](size_t first, size_t count) { return pSink->indices(first, count); },
+                        [&](size_t r, Index *pOut, size_t first, size_t count) {
+        load_indices(ranges[r].pPrimitive, pOut, first, count);
+    });
+    write_ranges<Vertex>(ranges, last.vertexOffset + last.numVertices,
+                         &PrimitiveRange::vertexOffset, &PrimitiveRange::numVertices,
+                         [&](size_t first, size_t count) { return pSink->vertices(first, count); },
+                         [&](size_t r, Vertex *pOut, size_t first, size_t count) {
+        load_primitive(ranges[r].pPrimitive, primitives[r], pOut, first, count);
+    });
 
 	return true;
 }
 
-bool load_pbr_metallic_roughness(cgltf_data* pData, cgltf_pbr_metallic_roughness *pInfo, MaterialData *pOut) {
-    if(pInfo->base_color_texture.texture != nullptr) {
-        pOut->set_color_texture(cgltf_texture_index(pData, pInfo->base_color_texture.texture));
+/**
+ * Textures of the scene, each distinct image or packed pair of images once
+ * per color space. Materials sample colors as sRGB and the other maps as
+ * linear, an image used both ways is uploaded as two textures.
+ */
+struct TextureTable {
+    std::map<std::tuple<std::string, std::string, bool>, uint32_t> indices;
+    std::vector<TextureData> textures;
+
+    uint32_t add(const std::string& path, bool isSrgb, const std::string& occlusionPath = "") {
+        auto [it, isInserted] = indices.emplace(std::make_tuple(path, occlusionPath, isSrgb), textures.size());
+        if(isInserted) {
+            textures.emplace_back("test", path, occlusionPath);
+        }
 
+        return it->second;
     }
+};
+
+/**
+ * Absolute paths of the images of the glTF textures, empty for embedded
+ * images. Images with the same content share the path of the first one.
+ */
+std::vector<std::string> load_texture_paths(cgltf_data *pData, const SceneData *pScene) {
+    std::vector<std::string> paths(pData->textures_count);
 
-    if(pInfo->metallic_roughness_texture.texture != nullptr) {
-        pOut->set_metallic_roughness_texture(cgltf_texture_index(pData, pInfo->metallic_roughness_texture.texture));
+    std::map<std::string, std::string> canonicalPaths;
+    // only files of the same size are hashed
+    std::unordered_map<uintmax_t, std::vector<std::string>> sizeFiles;
+    for(uint32_t ti = 0; ti < pData->textures_count; ti++) {
+        const cgltf_image *pImage = pData->textures[ti].image;
+        if(pImage == nullptr || pImage->uri == nullptr) {
+            continue;
+        }
+
+        paths[ti] = pScene->get_absolute_path_of(pImage->uri);
+        if(!canonicalPaths.emplace(paths[ti], paths[ti]).second) {
+            continue;
+        }
+
+        std::error_code error;
+        auto size = std::filesystem::file_size(paths[ti], error);
+        if(!error) {
+            sizeFiles[size].push_back(paths[ti]);
+        }
     }
 
-    return true;
+    for(const auto& [size, files] : sizeFiles) {
+        if(files.size() < 2) {
+            continue;
+        }
+
+        std::unordered_map<uint64_t, std::string> hashFiles;
+        for(const auto& file : files) {
+            auto [it, isInserted] = hashFiles.emplace(io::file::hash(file), file);
+            canonicalPaths[file] = it->second;
+        }
+    }
+
+    std::map<std::string, uint32_t> numUses;
+    for(auto& path : paths) {
+        if(!path.empty()) {
+            path = canonicalPaths[path];
+            numUses[path]++;
+        }
+    }
+
+    std::println("Num Textures: {} ({} unique images)", pData->textures_count, numUses.size());
+    return paths;
 }
 
-bool load_textures(cgltf_data *pData, SceneData *pOutData) {
-    pOutData->resize_textures(pData->textures_count);
-    std::println("Num Textures: {}", pData->textures_count);
+static std::string texture_path(cgltf_data *pData, const std::vector<std::string>& texturePaths,
+                                const cgltf_texture_view& view) {
+    return view.texture != nullptr ? texturePaths[cgltf_texture_index(pData, view.texture)] : "";
+}
 
-    for(uint32_t ti = 0; ti < pData->textures_count; ti++) {
-        std::string path = pOutData->get_absolute_path_of(pData->textures[ti].image->uri);
-        TextureData textureData = TextureData("test", path);
-        pOutData->set_texture(ti, textureData);
+bool load_pbr_metallic_roughness(cgltf_data* pData, cgltf_pbr_metallic_roughness *pInfo,
+                                 const std::vector<std::string>& texturePaths, const std::string& occlusionPath,
+                                 TextureTable *pTextures, MaterialData *pOut) {
+    auto colorPath = texture_path(pData, texturePaths, pInfo->base_color_texture);
+    if(!colorPath.empty()) {
+        pOut->set_color_texture(pTextures->add(colorPath, true));
+    }
+
+    auto metallicRoughnessPath = texture_path(pData, texturePaths, pInfo->metallic_roughness_texture);
+    if(!metallicRoughnessPath.empty()) {
+        // exporters often pack the occlusion into the same image already
+        bool isPacked = occlusionPath == metallicRoughnessPath;
+        pOut->set_metallic_roughness_texture(pTextures->add(metallicRoughnessPath, false,
+                                                            isPacked ? "" : occlusionPath));
+        pOut->set_occlusion(!occlusionPath.empty());
     }
 
     return true;
 }
 
-bool load_materials(cgltf_data *pData, SceneData *pOutData) {
+bool load_materials(cgltf_data *pData, const std::vector<std::string>& texturePaths, SceneData *pOutData) {
+    TextureTable textures;
+
     uint32_t max_texture = 0;
     for(uint32_t m = 0; m < pData->materials_count; m++) {
         cgltf_material *material = &pData->materials[m];
         auto materialData = MaterialData(new float[]{0.0f, 0.0f, 0.0f, 0.0f});
 
+        // occlusion is only kept packed with metallic and roughness
+        auto occlusionPath = texture_path(pData, texturePaths, material->occlusion_texture);
         if(material->has_pbr_metallic_roughness) {
-            load_pbr_metallic_roughness(pData, &material->pbr_metallic_roughness, &materialData);
+            load_pbr_metallic_roughness(pData, &material->pbr_metallic_roughness, texturePaths, occlusionPath,
+                                        &textures, &materialData);
         }
 
         max_texture = std::max(materialData.metallic_roughness_texture().value_or(0), max_texture);
 
-        if(material->normal_texture.texture != nullptr) {
-            materialData.set_normal_texture(cgltf_texture_index(pData, material->normal_texture.texture));
+        auto normalPath = texture_path(pData, texturePaths, material->normal_texture);
+        if(!normalPath.empty()) {
+            materialData.set_normal_texture(textures.add(normalPath, false));
         }
         max_texture = std::max(materialData.normal_texture().value_or(0), max_texture);
 
@@ -199,6 +476,11 @@ bool load_materials(cgltf_data *pData, SceneData *pOutData) {
         max_texture = std::max(materialData.color_texture().value_or(0), max_texture);
     }
 
+    pOutData->resize_textures(textures.textures.size());
+    for(uint32_t i = 0; i < textures.textures.size(); i++) {
+        pOutData->set_texture(i, textures.textures[i]);
+    }
+
     std::println("MAX TEXTURE: {}", max_texture);
 	return true;
 }
@@ -289,7 +571,29 @@ void load_nodes(cgltf_data *pData, SceneData *pOutData) {
     } */
 }
 
-const SceneData GltfSceneLoader::from_file(std::string path) {
+/**
+ * Files the scene is imported from, the glTF file first.
+ */
+void add_sources(cgltf_data *pData, const std::string& path, SceneData *pOutData) {
+    pOutData->add_source(path);
+
+    // embedded buffers and images are part of the glTF file
+    for(uint32_t i = 0; i < pData->buffers_count; i++) {
+        const char *pUri = pData->buffers[i].uri;
+        if(pUri != nullptr && strncmp(pUri, "data:", 5) != 0) {
+            pOutData->add_source(pOutData->get_absolute_path_of(pUri));
+        }
+    }
+
+    for(uint32_t i = 0; i < pData->images_count; i++) {
+        const char *pUri = pData->images[i].uri;
+        if(pUri != nullptr && strncmp(pUri, "data:", 5) != 0) {
+            pOutData->add_source(pOutData->get_absolute_path_of(pUri));
+        }
+    }
+}
+
+const SceneData GltfSceneLoader::from_file(std::string path, MeshSink* pSink) {
     cgltf_options options = {};
     cgltf_data* data = nullptr;
 
@@ -306,27 +610,33 @@ const SceneData GltfSceneLoader::from_file(std::string path) {
     }
 
 	SceneEntityCounts counts = {};
-	if(!count_elements(data, &counts)) {
+	std::vector<PrimitiveRange> ranges;
+	if(!count_elements(data, &counts, &ranges)) {
         throw std::runtime_error("Failed to count elements");
     }
 
 	SceneData scene(data->nodes_count + 1, data->materials_count,
-					counts.numVertices, counts.numIndices,
 					data->meshes_count, counts.numPrimitives);
 
     scene.set_path(path);
 
-	if(!load_mesh_data(data, &scene)) {
+    // without a sink the geometry is kept in the scene data
+    if(pSink == nullptr) {
+        pSink = &scene;
+    }
+
+    pSink->reserve(counts.numVertices, counts.numIndices);
+	if(!load_mesh_data(data, ranges, &scene, pSink)) {
 	}
+    pSink->finish();
 
-    if(!load_textures(data, &scene)) {
-        throw std::runtime_error("Failed to load textures");
-    }
+    auto texturePaths = load_texture_paths(data, &scene);
 
-	if(!load_materials(data, &scene)) {
+	if(!load_materials(data, texturePaths, &scene)) {
 	}
 
     load_nodes(data, &scene);
+    add_sources(data, path, &scene);
 
     cgltf_free(data);
 
@@ -5,5 +5,5 @@
 
 class GltfSceneLoader : public SceneLoader {
 public:
-    const SceneData from_file(std::string path) override;
+    const SceneData from_file(std::string path, MeshSink* pSink = nullptr) override;
 };
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <memory>
 #include <chrono>
+#include <format>
 
 #include <volk.h>
 
@@ -20,11 +21,14 @@
 #include "backends/imgui_impl_vulkan.h"
 #include "backends/imgui_impl_sdl2.h"
 #include "cglm/types.h"
+#include "io/SceneCache.hpp"
 #include "io/gltfSceneLoader.hpp"
 #include "io/path.hpp"
 #include "mesh/runtime/Scene.h"
 #include "resources/GpuAllocator.h"
+#include "resources/UniformAllocator.hpp"
 #include "runtime/Camera.h"
+#include "runtime/MemoryPanel.h"
 #include "scene/Light.h"
 #include "shaders/ComputePipelineBuilder.hpp"
 #include "shaders/Pipeline.hpp"
@@ -97,6 +101,8 @@ struct ParticleContext {
 	std::vector<VkDescriptorSet> compute_input_sets;
 	std::vector<VkDescriptorSet> draw_input_sets;
 
+	Buffer particle_buffer;
+
 	ParticleContext() :
         compute_pipeline(VK_NULL_HANDLE, VK_NULL_HANDLE),
         draw_pipeline(VK_NULL_HANDLE, VK_NULL_HANDLE) {
@@ -159,10 +165,18 @@ int main(int argc, char** argv) {
      */
     auto gpu = std::make_unique<Gpu>(std::move(instance), surface);
 
+    const uint32_t num_frames_in_flight = 1;
+
+    /**
+     * Constant data for shaders. The per-frame ring has one more frame than
+     * the render graph keeps in flight.
+     */
+    UniformAllocator uniforms(gpu.get(), num_frames_in_flight + 1);
+
     /**
      * Create camera for scene
      */
-    Camera camera(gpu.get(), (float)extent.width / extent.height);
+    Camera camera(gpu.get(), &uniforms, (float)extent.width / extent.height);
 
     /**
      * Swapchain is a queue storage of images to render to for the Window we opened.
@@ -171,17 +185,27 @@ int main(int argc, char** argv) {
 
 
     auto global_input_set_layout = ShaderInputSetLayoutBuilder()
-            .uniform_buffer(0)
+            .dynamic_uniform_buffer(0)
             .build(gpu.get());
 
+    // camera data is pushed into the ring every frame and selected by a dynamic offset
     auto global_input_set = ShaderInputSetBuilder()
-            .buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, camera.buffer(), 0, sizeof(mat4) * 2 + sizeof(vec4))
+            .dynamic_uniform(0, uniforms, sizeof(Camera::Data))
             .build(gpu.get(), global_input_set_layout);
 
 	std::vector<VkDescriptorSet> input_sets(1);
 
-    auto sceneData = GltfSceneLoader().from_file(argv[1]);
-	Scene scene(gpu.get(), &sceneData);
+    /**
+     * Geometry of all the scenes shares the arena. Loader writes it straight
+     * into the arena, or into staging memory when it is not host visible.
+     */
+    BufferBusWriter mesh_writer(gpu.get(), sizeof(Vertex) * 1024 * 256);
+    MeshArena mesh_arena(gpu.get(), &mesh_writer, 1024 * 1024, 4 * 1024 * 1024);
+    MeshArenaSink mesh_sink(&mesh_arena);
+    // the scene is imported once, following launches read it from the cache
+    GltfSceneLoader gltf_loader;
+    auto sceneData = SceneCache(&gltf_loader).from_file(argv[1], &mesh_sink);
+	Scene scene(gpu.get(), &uniforms, &mesh_arena, &sceneData, mesh_sink.handle());
 
     vec3 position = {20.0f, 250.0f, 50.0f};
     vec3 direction = {0.0f, 0.0f, 0.0f};
@@ -190,23 +214,6 @@ int main(int argc, char** argv) {
             Light::directional(1.0f, 1000.0f, position, direction, color)
     };
 
-    MemoryAllocationInfo memoryInfo = {
-            .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
-    };
-
-    BufferCreateInfo lightInfoBuffer = {
-            .size = sizeof(Light),
-            .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            .isExclusive = true,
-    };
-
-    Buffer light_buffer;
-    gpu->memory()->create_buffer(&lightInfoBuffer, &memoryInfo, &light_buffer);
-
-    void *pPtr;
-    gpu->memory()->map(light_buffer.allocation, &pPtr);
-    memcpy(pPtr, lights.data(), lightInfoBuffer.size);
-    gpu->memory()->unmap(light_buffer.allocation);
 
     ShaderManager shader_manager(gpu.get(), io::path::shader(""));
 
@@ -217,10 +224,10 @@ int main(int argc, char** argv) {
         .border_color(VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE)
         .build(gpu.get());
 
-	lft::rg::Builder builder(gpu.get(), ImageChain::from_swapchain(swapchain), "swapchain");
-
-	// keeps all the drawn images -> to be available for debuggers like RenderDoc
-	builder.store_all_images();
+	lft::rg::Builder builder(gpu.get(), ImageChain::from_swapchain(swapchain), "swapchain",
+			num_frames_in_flight);
+	// written every frame from CPU, the graph keeps a copy for each frame in flight
+	builder.add_host_buffer_resource("light_buffer", sizeof(Light), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
 	GBufferContext* context = new GBufferContext();
 	context->global_input_set = &global_input_set;
@@ -240,7 +247,7 @@ int main(int argc, char** argv) {
 
 		if(context->pipeline.pipeline() == VK_NULL_HANDLE) {
     		context->layout = PipelineLayoutBuilder()
-                .push_constant_range(0, sizeof(uint32_t) * 2,
+                .push_constant_range(0, sizeof(DrawConstants),
     					VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
     			.input_set(0, global_input_set_layout)
     			.input_set(1, context->input_layout)
@@ -261,12 +268,12 @@ int main(int argc, char** argv) {
             context->pipeline.set_debug_name(gpu.get(), "offscreen_pipeline");
 		}
 
-	}, [](const lft::rg::TaskRecordInfo& info, GBufferContext* context) {
+	}, [&](const lft::rg::TaskRecordInfo& info, GBufferContext* context) {
         lft::RecordingBindPoint pipeline_bind = info.recording()
             .bind_graphics_pipeline(context->pipeline)
-                .bind_descriptor_set(0, *context->global_input_set);
+                .bind_descriptor_set(0, *context->global_input_set, {camera.offset()});
 
-		context->scene->draw(info.recording(), pipeline_bind);
+		context->scene->draw(info.recording(), pipeline_bind, info.buffer_idx());
 	});
 
     task1.add_color_output("col_gbuf", VK_FORMAT_R8G8B8A8_SRGB);
@@ -294,7 +301,7 @@ int main(int argc, char** argv) {
 				ShadingContext* context) {
 				context->input_sets.resize(info.num_buffers());
 				context->input_sets[info.buffer_idx()] = ShaderInputSetBuilder()
-					.buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, light_buffer, 0, sizeof(Light))
+					.buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, info.get_buffer_resource("light_buffer").as_buffer(), 0, sizeof(Light))
 					.image(1, info.get_resource("col_gbuf").image_view, context->sampler)
 					.image(2, info.get_resource("norm_gbuf").image_view, context->sampler)
 					.image(3, info.get_resource("pos_gbuf").image_view, context->sampler)
@@ -321,7 +328,7 @@ int main(int argc, char** argv) {
 			},
 			[&](const lft::rg::TaskRecordInfo& info, ShadingContext* context) {
                 info.recording().bind_graphics_pipeline(context->pipeline)
-                    .bind_descriptor_set(0, global_input_set)
+                    .bind_descriptor_set(0, global_input_set, {camera.offset()})
                     .bind_descriptor_set(1, context->input_sets[info.buffer_idx()]);
 
                 info.recording().draw(3, 1, 0, 0);
@@ -333,6 +340,7 @@ int main(int argc, char** argv) {
 	shading_task.add_dependency("norm_gbuf");
 	shading_task.add_dependency("pos_gbuf");
 	shading_task.add_dependency("pbr_gbuf");
+	shading_task.add_dependency("light_buffer");
 
 	builder.add_task(shading_task.build());
 
@@ -343,19 +351,6 @@ int main(int argc, char** argv) {
 		vec4 color;
 	};
 
-	BufferCreateInfo particle_buffer_info = {
-	    .size = 1000 * sizeof(Particle),
-		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		.isExclusive = true,
-	};
-
-	MemoryAllocationInfo memory_info2 = {
-		.usage = MEMORY_USAGE_AUTO_PREFER_HOST
-	};
-
-	Buffer particle_buffer;
-	gpu->memory()->create_buffer(&particle_buffer_info, &memory_info2, &particle_buffer);
-
 	std::default_random_engine rndEngine((unsigned)time(nullptr));
     std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
 
@@ -390,7 +385,7 @@ int main(int argc, char** argv) {
 
 				for(uint32_t i = 0; i < info.num_buffers(); i++) {
 					context->compute_input_sets.push_back(ShaderInputSetBuilder()
-						.buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, particle_buffer, 0, 1000 * sizeof(Particle))
+						.buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, info.get_buffer_resource("particle_buffer").as_buffer(), 0, 1000 * sizeof(Particle))
 						.build(info.gpu(), context->compute_input_set_layout));
 				}
 
@@ -407,12 +402,10 @@ int main(int argc, char** argv) {
                     .bind_compute_pipeline(context->compute_pipeline)
                         .bind_descriptor_set(0, context->compute_input_sets[0]);
                 info.recording().dispatch(1000 / 256, 1, 1);
-			}).add_buffer_output("particle_buffer", 0)
+			}).add_buffer_output("particle_buffer", 1000 * sizeof(Particle),
+			    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
            	.build();
 
-	std::vector<Buffer> buffers;
-	buffers.push_back(particle_buffer);
-	builder.add_buffer_resource("particle_buffer", buffers, 1000 * sizeof(Particle));
 	builder.add_task(particle_task);
 
 	auto particle_draw_task = lft::rg::render_task<ParticleContext>(
@@ -443,15 +436,16 @@ int main(int argc, char** argv) {
     					.build();
 				}
 
+				context->particle_buffer = info.get_buffer_resource("particle_buffer").as_buffer();
 				context->draw_input_sets.resize(info.num_buffers());
 				/* context->draw_input_sets[info.buffer_idx()] = ShaderInputSetBuilder(1)
     				.buffer(0, particle_buffer, 0, 1000 * sizeof(Particle))
     				.build(info.gpu(), context->draw_input_set_layout); */
 		}, [&](const lft::rg::TaskRecordInfo& info, ParticleContext* context) {
             info.recording().bind_graphics_pipeline(context->draw_pipeline)
-                .bind_descriptor_set(0, global_input_set);
+                .bind_descriptor_set(0, global_input_set, {camera.offset()});
 
-            info.recording().bind_vertex_buffers({particle_buffer}, {0});
+            info.recording().bind_vertex_buffers({context->particle_buffer}, {0});
             info.recording().draw(10, 1, 0, 0);
 		}).add_dependency("particle_buffer")
 	    .add_dependency("shading")
@@ -504,7 +498,8 @@ int main(int argc, char** argv) {
 	imgui_task.add_color_output("swapchain", swapchain.format().format, swapchain.extent(), {0.0f, 0.0f, 0.0f, 1.0f});
 	imgui_task.add_dependency("shading");
 	imgui_task.add_dependency("particle_draw");
-	auto imgui = imgui_task.build();
+	// toggled with P, without rebuilding the graph
+	imgui_task.set_optional();
 	builder.add_task(imgui_task.build());
 
 	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
@@ -517,6 +512,12 @@ int main(int argc, char** argv) {
 
     VkFence wait_on_image_fence = gpu->create_fence(false);
 
+	MemoryPanel memory_panel(gpu.get());
+	gpu->memory()->set_budget_callback([](uint32_t heap_idx, const MemoryHeapBudget& heap) {
+	    std::cerr << std::format("GPU memory heap {} is over budget: {} / {} bytes",
+	        heap_idx, heap.usage, heap.budget) << std::endl;
+	});
+
 	bool is_open = true;
 	bool is_imgui = true;
 
@@ -540,7 +541,7 @@ int main(int argc, char** argv) {
             ImGui_ImplSDL2_NewFrame();
             ImGui::NewFrame();
 
-    		ImGui::ShowDemoWindow();
+    		memory_panel.draw();
         }
 
 		SDL_Event event;
@@ -566,6 +567,12 @@ int main(int argc, char** argv) {
 					    case SDLK_p:
 							change_imgui = !event.key.state;
     						break;
+						case SDLK_c:
+						    // stores all attachments for inspection in RenderDoc
+						    if(!event.key.state) {
+						        render_graph.request_capture();
+						    }
+						    break;
 						case SDLK_w:
 							velocity[1] = (float)event.key.state;
 							break;
@@ -582,22 +589,24 @@ int main(int argc, char** argv) {
 			}
 		}
 
+		memcpy(render_graph.map_buffer("light_buffer"), lights.data(), sizeof(Light));
+
+		// higher texture levels are streamed in as they get closer
+		scene.stream_textures(camera, (float)extent.height);
+
 		render_graph.run(imageIdx, VK_NULL_HANDLE, wait_on_image_fence);
-		swapchain.present({ render_graph.buffer(0).final_signal(imageIdx) }, imageIdx);
+		swapchain.present({ render_graph.final_signal(imageIdx) }, imageIdx);
 
+		// moves a bounded amount of memory when defragmentation was started
+		gpu->defragmenter()->update();
+
+		uniforms.next_frame();
 		camera.move(velocity);
 		camera.update();
 
-        // Implement turning ImGui task on and off
 		if(change_imgui) {
-		    if(!is_imgui) {
-				builder.add_task(imgui);
-			} else {
-			    builder.remove_task(imgui.name());
-			}
-
-			render_graph = builder.build();
 			is_imgui = !is_imgui;
+			render_graph.set_enabled("imgui", is_imgui);
 		}
 	}
 
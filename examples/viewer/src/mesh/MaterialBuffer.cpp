@@ -22,31 +22,20 @@ unsigned short *load_image_data_16(const std::string& path, int32_t *pOutWidth,
 }
 
 void MaterialBuffer::allocate_for(const SceneData *pSceneData) {
-    MemoryAllocationInfo memoryAllocationInfo = {
-            .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-    };
-
-    BufferCreateInfo materialsBufferInfo = {
-            .size = sizeof(Material) * pSceneData->num_materials(),
-            .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            .isExclusive = true,
-    };
-
-    m_gpu->memory()->create_buffer(&materialsBufferInfo, &memoryAllocationInfo,
-                                  &m_materialBuffer);
-    m_materialBuffer.set_debug_name(m_gpu, "material_buffer");
+    m_materialBuffer = m_pUniforms->allocate(sizeof(Material) * pSceneData->num_materials());
 }
 
-MaterialBuffer::MaterialBuffer(const Gpu* gpu, const SceneData *pSceneData) :
+MaterialBuffer::MaterialBuffer(const Gpu* gpu, UniformAllocator* pUniforms, const SceneData *pSceneData) :
     m_gpu(gpu),
+    m_pUniforms(pUniforms),
 
     m_materials(pSceneData->num_materials()),
     m_materialsValidity(pSceneData->num_materials(), false),
 
     m_textures(pSceneData->num_textures()),
     m_textureValidity(pSceneData->num_textures(), false),
-    m_textureStorage(gpu, pSceneData->num_textures())
+    m_textureStorage(gpu, pSceneData->num_textures(), MAX_MATERIAL_TEXTURES),
+    m_textureStreamer(&m_textureStorage)
 {
     allocate_for(pSceneData);
 
@@ -54,7 +43,7 @@ MaterialBuffer::MaterialBuffer(const Gpu* gpu, const SceneData *pSceneData) :
 }
 
 MaterialBuffer::~MaterialBuffer() {
-    vkDestroyBuffer(m_gpu->dev(), m_materialBuffer.buf, nullptr);
+    m_pUniforms->free(m_materialBuffer);
 }
 
 uint32_t MaterialBuffer::upload_texture(const TextureData& texture, VkFormat format) {
@@ -69,6 +58,7 @@ uint32_t MaterialBuffer::upload_texture(const TextureData& texture, VkFormat for
                                           format);
 
     stbi_image_free(pImageData);
+    m_textureStorage.flush();
 
     /* m_textures.reserve(idx);
     m_textures[idx] = Texture(texture.m_name, m_textureStorage.view(idx).view); */
@@ -84,33 +74,35 @@ MaterialBuffer::upload_textures(const std::vector<MaterialData>& materials,
     std::vector<uint32_t> mapping(textures.size());
     std::vector<bool> uploadFlags(textures.size(), false);
 
-    for(auto& material : materials) {
-        if (material.normal_texture().has_value() and
-            not uploadFlags[material.normal_texture().value()]) {
-            uint32_t textureIdx = material.normal_texture().value();
+    std::vector<TextureStreamer::Source> sources;
+    std::vector<uint32_t> requestTextures;
 
-            mapping[textureIdx] = upload_texture(textures[textureIdx],
-                                                 VK_FORMAT_R8G8B8A8_UNORM);
-            uploadFlags[textureIdx] = true;
+    auto request = [&](std::optional<uint32_t> textureIdx, VkFormat format, std::array<uint8_t, 4> placeholder) {
+        if(!textureIdx.has_value() || uploadFlags[textureIdx.value()]) {
+            return;
         }
 
-        if (material.color_texture().has_value() and
-            not uploadFlags[material.color_texture().value()]) {
-            uint32_t textureIdx = material.color_texture().value();
-
-            mapping[textureIdx] = upload_texture(textures[textureIdx],
-                                                 VK_FORMAT_R8G8B8A8_SRGB);
-            uploadFlags[textureIdx] = true;
-        }
+        sources.push_back({
+            .path = textures[textureIdx.value()].m_path,
+            .occlusionPath = textures[textureIdx.value()].m_occlusionPath,
+            .format = format,
+            .placeholder = placeholder,
+        });
+        requestTextures.push_back(textureIdx.value());
+        uploadFlags[textureIdx.value()] = true;
+    };
 
-        if (material.metallic_roughness_texture().has_value() and
-            not uploadFlags[material.metallic_roughness_texture().value()]) {
-            uint32_t textureIdx = material.metallic_roughness_texture().value();
+    // placeholders are a flat normal, grey color and unoccluded rough dielectric
+    for(auto& material : materials) {
+        request(material.normal_texture(), VK_FORMAT_R8G8B8A8_UNORM, {128, 128, 255, 255});
+        request(material.color_texture(), VK_FORMAT_R8G8B8A8_SRGB, {128, 128, 128, 255});
+        request(material.metallic_roughness_texture(), VK_FORMAT_R8G8B8A8_UNORM, {255, 255, 0, 255});
+    }
 
-            mapping[textureIdx] = upload_texture(textures[textureIdx],
-                                                 VK_FORMAT_R8G8B8A8_UNORM);
-            uploadFlags[textureIdx] = true;
-        }
+    // only mip tails are loaded now, the rest is streamed in when needed
+    auto handles = m_textureStreamer.add(sources);
+    for(uint32_t i = 0; i < handles.size(); i++) {
+        mapping[requestTextures[i]] = handles[i];
     }
 
     return mapping;
@@ -135,6 +127,7 @@ MaterialBuffer::upload_material_data(const MaterialData& materialData,
     } if(materialData.metallic_roughness_texture().has_value()) {
         material.pbrTexture = textureMapping[materialData.metallic_roughness_texture().value()];
         material.pbrTextureBlend = 1.0f;
+        material.occlusionBlend = materialData.has_occlusion() ? 1.0f : 0.0f;
     }
 
     set_material(distance, material);
@@ -155,12 +148,10 @@ MaterialBuffer::upload_materials_data(const std::vector<MaterialData>& materials
     uint32_t min = *std::min_element(mappings.begin(), mappings.end());
     uint32_t max = *std::max_element(mappings.begin(), mappings.end());
 
-    char *pData;
-    m_gpu->memory()->map(m_materialBuffer.allocation, (void**)&pData);
-    memcpy(pData + sizeof(Material) * min,
+    // material data stays mapped
+    memcpy((char*)m_materialBuffer.pMapped + sizeof(Material) * min,
            &m_materials[min],
            sizeof(Material) * (max - min + 1));
-    m_gpu->memory()->unmap(m_materialBuffer.allocation);
 
     return mappings;
 }
@@ -1,5 +1,6 @@
 #include "resources/Buffer.hpp"
 #include "resources/Image.hpp"
+#include "resources/UniformAllocator.hpp"
 #include "Gpu.hpp"
 #include "data/SceneData.hpp"
 #include "data/TextureData.h"
@@ -7,6 +8,10 @@
 #include "runtime/Material.h"
 #include "runtime/Texture.h"
 #include "TextureStorage.h"
+#include "TextureStreamer.h"
+
+// textures bound to the materials, shaders declare arrays of the same size
+static constexpr uint32_t MAX_MATERIAL_TEXTURES = 128;
 
 /**
  * @brief MaterialBuffer class
@@ -14,14 +19,17 @@
 class MaterialBuffer {
 public:
     const Gpu* m_gpu;
+    UniformAllocator* m_pUniforms;
 
     std::vector<Material> m_materials;
     std::vector<bool> m_materialsValidity;
-    Buffer m_materialBuffer;
+    UniformAllocation m_materialBuffer;
 
     std::vector<Texture> m_textures;
     std::vector<bool> m_textureValidity;
     TextureStorage m_textureStorage;
+    // higher levels of the textures are loaded once they are requested
+    TextureStreamer m_textureStreamer;
 
     void allocate_for(const SceneData *pSceneData);
 
@@ -35,7 +43,14 @@ public:
     }
 
     [[nodiscard]] const Buffer* material_buffer() const {
-        return &m_materialBuffer;
+        return &m_materialBuffer.buffer;
+    }
+
+    /**
+     * Offset of the material data within the material buffer
+     */
+    [[nodiscard]] VkDeviceSize material_buffer_offset() const {
+        return m_materialBuffer.offset;
     }
 
     inline const void set_material(uint32_t idx, Material material) {
@@ -47,9 +62,10 @@ public:
      * Create a new MaterialBuffer for the given Gpu and SceneData and stores the textures and material data.
      * @brief Constructor
      * @param pGpu
+     * @param pUniforms Allocator of the material data
      * @param pSceneData
      */
-    MaterialBuffer(const Gpu* gpu, const SceneData *pSceneData);
+    MaterialBuffer(const Gpu* gpu, UniformAllocator* pUniforms, const SceneData *pSceneData);
 
     /**
      * @brief Copy constructor is disabled
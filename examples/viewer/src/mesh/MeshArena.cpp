@@ -0,0 +1,304 @@
+#include "MeshArena.h"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#include "resources/Defragmenter.hpp"
+
+MeshArena::MeshArena(const Gpu* gpu, BufferBusWriter* pWriter, uint32_t maxVertices, uint32_t maxIndices) :
+    m_gpu(gpu),
+    m_pWriter(pWriter),
+    m_vertexRanges(maxVertices),
+    m_indexRanges(maxIndices) {
+    create_buffers(maxVertices, maxIndices);
+}
+
+MeshArena::~MeshArena() {
+    // pending uploads still target the buffers
+    m_gpu->uploads()->wait(m_pWriter->flush());
+    destroy_buffers();
+}
+
+void MeshArena::create_buffers(uint32_t maxVertices, uint32_t maxIndices) {
+    MemoryAllocationInfo memoryAllocationInfo = {
+            .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .category = MEMORY_CATEGORY_MESH,
+            // written without staging on UMA and resizable BAR devices
+            .isHostWritePreferred = true,
+    };
+
+    // transfer source for relocation
+    BufferCreateInfo vertexBufferInfo = {
+            .size = std::max<size_t>(maxVertices, 1) * sizeof(Vertex),
+            .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .isExclusive = true,
+    };
+    if(m_gpu->memory()->create_buffer(&vertexBufferInfo, &memoryAllocationInfo, &m_vertexBuffer)) {
+        throw std::runtime_error(std::format("Failed to allocate mesh arena for {} vertices", maxVertices));
+    }
+    m_vertexBuffer.set_debug_name(m_gpu, "mesh_arena_vertices");
+
+    // offsets of the meshes stay the same when the buffer moves
+    m_gpu->defragmenter()->track_buffer(m_vertexBuffer, vertexBufferInfo, [this](VkBuffer moved) {
+        m_pWriter->replace_target(m_vertexBuffer.buf, moved);
+        m_vertexBuffer.buf = moved;
+    });
+
+    BufferCreateInfo indexBufferInfo = {
+            .size = std::max<size_t>(maxIndices, 1) * sizeof(Index),
+            .usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .isExclusive = true,
+    };
+    if(m_gpu->memory()->create_buffer(&indexBufferInfo, &memoryAllocationInfo, &m_indexBuffer)) {
+        throw std::runtime_error(std::format("Failed to allocate mesh arena for {} indices", maxIndices));
+    }
+    m_indexBuffer.set_debug_name(m_gpu, "mesh_arena_indices");
+
+    m_gpu->defragmenter()->track_buffer(m_indexBuffer, indexBufferInfo, [this](VkBuffer moved) {
+        m_pWriter->replace_target(m_indexBuffer.buf, moved);
+        m_indexBuffer.buf = moved;
+    });
+}
+
+void MeshArena::destroy_buffers() {
+    m_gpu->defragmenter()->untrack(m_vertexBuffer.allocation);
+    m_gpu->defragmenter()->untrack(m_indexBuffer.allocation);
+
+    // frames in flight might still draw from the buffers, destruction is deferred
+    m_gpu->memory()->destroy_buffer(&m_vertexBuffer);
+    m_gpu->memory()->destroy_buffer(&m_indexBuffer);
+}
+
+void MeshArena::reclaim() {
+    uint64_t completed = m_gpu->deletion_queue()->completed_frame();
+    std::erase_if(m_pendingFrees, [&](const PendingFree& pending) {
+        if(pending.frame > completed) {
+            return false;
+        }
+
+        m_vertexRanges.free(pending.range.vertexOffset, pending.range.numVertices);
+        m_indexRanges.free(pending.range.indexOffset, pending.range.numIndices);
+        return true;
+    });
+}
+
+std::optional<MeshRange> MeshArena::try_allocate(uint32_t numVertices, uint32_t numIndices) {
+    // empty ranges take no space
+    std::optional<VkDeviceSize> vertexOffset = numVertices > 0 ?
+        m_vertexRanges.allocate(numVertices) : std::optional<VkDeviceSize>(0);
+    if(!vertexOffset.has_value()) {
+        return {};
+    }
+
+    std::optional<VkDeviceSize> indexOffset = numIndices > 0 ?
+        m_indexRanges.allocate(numIndices) : std::optional<VkDeviceSize>(0);
+    if(!indexOffset.has_value()) {
+        m_vertexRanges.free(*vertexOffset, numVertices);
+        return {};
+    }
+
+    return MeshRange {
+        .vertexOffset = (uint32_t)*vertexOffset,
+        .numVertices = numVertices,
+        .indexOffset = (uint32_t)*indexOffset,
+        .numIndices = numIndices,
+        // not drawn until finished
+        .uploadTicket = UINT64_MAX,
+    };
+}
+
+MeshHandle MeshArena::allocate(uint32_t numVertices, uint32_t numIndices) {
+    reclaim();
+
+    std::optional<MeshRange> range = try_allocate(numVertices, numIndices);
+    if(!range.has_value()) {
+        // live meshes plus the new one fit into the grown arena once packed
+        uint32_t maxVertices = max_vertices() - m_vertexRanges.free_size() + numVertices;
+        uint32_t maxIndices = max_indices() - m_indexRanges.free_size() + numIndices;
+        relocate(std::max<uint32_t>(max_vertices() * 2, maxVertices),
+                 std::max<uint32_t>(max_indices() * 2, maxIndices));
+
+        range = try_allocate(numVertices, numIndices);
+    }
+
+    MeshHandle handle;
+    if(m_freeHandles.empty()) {
+        handle = m_meshes.size();
+        m_meshes.emplace_back(range);
+    } else {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+        m_meshes[handle] = range;
+    }
+
+    return handle;
+}
+
+std::span<Vertex> MeshArena::vertices(MeshHandle handle, size_t first, size_t count) {
+    return map<Vertex>(&m_vertexBuffer, m_meshes[handle]->vertexOffset + first, count);
+}
+
+std::span<Index> MeshArena::indices(MeshHandle handle, size_t first, size_t count) {
+    return map<Index>(&m_indexBuffer, m_meshes[handle]->indexOffset + first, count);
+}
+
+void MeshArena::finish(MeshHandle handle) {
+    // upload is batched with other writes, the mesh can be drawn once the ticket is acquired
+    m_meshes[handle]->uploadTicket = m_pWriter->flush();
+}
+
+MeshHandle MeshArena::upload(const std::vector<Vertex>& vertices, const std::vector<Index>& indices) {
+    MeshHandle handle = allocate(vertices.size(), indices.size());
+    const MeshRange& range = *m_meshes[handle];
+
+    m_pWriter->write(&m_vertexBuffer, vertices.data(),
+                     range.vertexOffset * sizeof(Vertex), vertices.size() * sizeof(Vertex));
+    m_pWriter->write(&m_indexBuffer, indices.data(),
+                     range.indexOffset * sizeof(Index), indices.size() * sizeof(Index));
+
+    finish(handle);
+    return handle;
+}
+
+void MeshArena::remove(MeshHandle handle) {
+    if(handle >= m_meshes.size() || !m_meshes[handle].has_value()) {
+        throw std::runtime_error(std::format("Mesh {} is not in the arena", handle));
+    }
+
+    m_pendingFrees.push_back(PendingFree {
+        .frame = m_gpu->deletion_queue()->frame(),
+        .range = *m_meshes[handle],
+    });
+
+    m_meshes[handle].reset();
+    m_freeHandles.push_back(handle);
+}
+
+void MeshArena::compact() {
+    relocate(max_vertices(), max_indices());
+}
+
+void MeshArena::relocate(uint32_t maxVertices, uint32_t maxIndices) {
+    UploadService* uploads = m_gpu->uploads();
+
+    // data written so far must land in the old buffers before they are copied
+    UploadTicket ticket = m_pWriter->flush();
+    for(auto& mesh : m_meshes) {
+        if(mesh.has_value() && mesh->uploadTicket != UINT64_MAX) {
+            ticket = std::max(ticket, mesh->uploadTicket);
+        }
+    }
+    uploads->wait(ticket);
+
+    Buffer oldVertexBuffer = m_vertexBuffer;
+    Buffer oldIndexBuffer = m_indexBuffer;
+    m_gpu->defragmenter()->untrack(oldVertexBuffer.allocation);
+    m_gpu->defragmenter()->untrack(oldIndexBuffer.allocation);
+    create_buffers(maxVertices, maxIndices);
+
+    m_vertexRanges = RangeAllocator(maxVertices);
+    m_indexRanges = RangeAllocator(maxIndices);
+    // removed ranges are not copied, old buffers are retired as a whole
+    m_pendingFrees.clear();
+
+    std::vector<VkBufferCopy> vertexRegions;
+    std::vector<VkBufferCopy> indexRegions;
+    for(auto& mesh : m_meshes) {
+        if(!mesh.has_value()) {
+            continue;
+        }
+
+        uint32_t vertexOffset = mesh->numVertices > 0 ? *m_vertexRanges.allocate(mesh->numVertices) : 0;
+        uint32_t indexOffset = mesh->numIndices > 0 ? *m_indexRanges.allocate(mesh->numIndices) : 0;
+
+        if(mesh->numVertices > 0) {
+            vertexRegions.push_back(VkBufferCopy {
+                .srcOffset = mesh->vertexOffset * sizeof(Vertex),
+                .dstOffset = vertexOffset * sizeof(Vertex),
+                .size = mesh->numVertices * sizeof(Vertex),
+            });
+        }
+
+        if(mesh->numIndices > 0) {
+            indexRegions.push_back(VkBufferCopy {
+                .srcOffset = mesh->indexOffset * sizeof(Index),
+                .dstOffset = indexOffset * sizeof(Index),
+                .size = mesh->numIndices * sizeof(Index),
+            });
+        }
+
+        mesh->vertexOffset = vertexOffset;
+        mesh->indexOffset = indexOffset;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = m_gpu->graphics_command_pool(),
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    if(vkAllocateCommandBuffers(m_gpu->dev(), &allocInfo, &commandBuffer)) {
+        throw std::runtime_error("Failed to allocate mesh arena command buffer");
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // takes ownership of the uploaded ranges, the upload already finished
+    uploads->acquire(commandBuffer, ticket);
+
+    if(!vertexRegions.empty()) {
+        vkCmdCopyBuffer(commandBuffer, oldVertexBuffer.buf, m_vertexBuffer.buf,
+                        vertexRegions.size(), vertexRegions.data());
+    }
+
+    if(!indexRegions.empty()) {
+        vkCmdCopyBuffer(commandBuffer, oldIndexBuffer.buf, m_indexBuffer.buf,
+                        indexRegions.size(), indexRegions.data());
+    }
+
+    VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkCommandBufferSubmitInfoKHR commandBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR,
+            .commandBuffer = commandBuffer,
+    };
+
+    VkSubmitInfo2 submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+    };
+
+    VkFence fence = m_gpu->create_fence(false);
+    m_gpu->enqueue_graphics(&submitInfo, fence);
+    uint64_t frame = m_gpu->deletion_queue()->next_frame();
+    vkWaitForFences(m_gpu->dev(), 1, &fence, VK_TRUE, UINT64_MAX);
+    m_gpu->deletion_queue()->collect(frame);
+
+    vkDestroyFence(m_gpu->dev(), fence, nullptr);
+    vkFreeCommandBuffers(m_gpu->dev(), m_gpu->graphics_command_pool(), 1, &commandBuffer);
+
+    // frames in flight might still draw from the old buffers, destruction is deferred
+    m_gpu->memory()->destroy_buffer(&oldVertexBuffer);
+    m_gpu->memory()->destroy_buffer(&oldIndexBuffer);
+}
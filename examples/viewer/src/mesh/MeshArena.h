@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "Gpu.hpp"
+#include "resources/Buffer.hpp"
+#include "resources/BufferBusWriter.h"
+#include "resources/RangeAllocator.hpp"
+#include "resources/UploadService.hpp"
+#include "MeshSink.hpp"
+#include "Vertex.hpp"
+
+typedef uint32_t MeshHandle;
+
+/**
+ * Range of a mesh within the arena buffers, in vertices and indices.
+ */
+struct MeshRange {
+    uint32_t vertexOffset;
+    uint32_t numVertices;
+    uint32_t indexOffset;
+    uint32_t numIndices;
+    // submission finishing upload of the mesh
+    UploadTicket uploadTicket;
+};
+
+/**
+ * Shared vertex and index buffer of all the meshes. Meshes are ranges of
+ * them, so a whole frame is drawn with a single vertex and index buffer bind.
+ *
+ * Ranges are addressed through handles, because compaction moves them.
+ * Arena grows when no free range is large enough, the growth compacts it
+ * as well. The buffers themselves can be moved by the defragmenter.
+ */
+class MeshArena {
+private:
+    struct PendingFree {
+        // deletion queue frame after which the range is not used by GPU anymore
+        uint64_t frame;
+        MeshRange range;
+    };
+
+    const Gpu* m_gpu;
+    BufferBusWriter* m_pWriter;
+
+    Buffer m_vertexBuffer;
+    Buffer m_indexBuffer;
+
+    RangeAllocator m_vertexRanges;
+    RangeAllocator m_indexRanges;
+
+    // indexed by handle, empty for removed meshes
+    std::vector<std::optional<MeshRange>> m_meshes;
+    std::vector<MeshHandle> m_freeHandles;
+    std::vector<PendingFree> m_pendingFrees;
+
+    void create_buffers(uint32_t maxVertices, uint32_t maxIndices);
+
+    void destroy_buffers();
+
+    /**
+     * Returns ranges removed before the last completed frame back to the allocators.
+     */
+    void reclaim();
+
+    /**
+     * Moves all the meshes into new buffers of the given capacity, packed
+     * at their start. Blocks until the copy finishes.
+     */
+    void relocate(uint32_t maxVertices, uint32_t maxIndices);
+
+    std::optional<MeshRange> try_allocate(uint32_t numVertices, uint32_t numIndices);
+
+    template<typename T>
+    std::span<T> map(const Buffer* pTarget, size_t first, size_t count) {
+        void* pData = nullptr;
+        size_t size = m_pWriter->map(pTarget, first * sizeof(T), count * sizeof(T), &pData, sizeof(T));
+        return { (T*)pData, size / sizeof(T) };
+    }
+
+public:
+    GET(m_vertexBuffer, vertex_buffer);
+    GET(m_indexBuffer, index_buffer);
+    GET(m_vertexRanges.size(), max_vertices);
+    GET(m_indexRanges.size(), max_indices);
+
+    /**
+     * @param pWriter writer the meshes are uploaded with
+     */
+    MeshArena(const Gpu* gpu, BufferBusWriter* pWriter, uint32_t maxVertices, uint32_t maxIndices);
+
+    ~MeshArena();
+
+    // Forbid copy, the buffers are owned
+    MeshArena(const MeshArena&) = delete;
+
+    /**
+     * Reserves ranges for a mesh. It is drawn only after its data is written and `finish`ed.
+     */
+    MeshHandle allocate(uint32_t numVertices, uint32_t numIndices);
+
+    /**
+     * Memory for vertices of the mesh, see `MeshSink::vertices`.
+     */
+    std::span<Vertex> vertices(MeshHandle handle, size_t first, size_t count);
+
+    std::span<Index> indices(MeshHandle handle, size_t first, size_t count);
+
+    /**
+     * Submits upload of the written data.
+     */
+    void finish(MeshHandle handle);
+
+    MeshHandle upload(const std::vector<Vertex>& vertices, const std::vector<Index>& indices);
+
+    /**
+     * Ranges of the mesh are reused once the frames submitted so far finish.
+     */
+    void remove(MeshHandle handle);
+
+    /**
+     * Moves the meshes to the start of the buffers, so the free space becomes
+     * a single range. Blocks until the copy finishes.
+     */
+    void compact();
+
+    [[nodiscard]] const MeshRange& range(MeshHandle handle) const {
+        return *m_meshes[handle];
+    }
+
+    /**
+     * Upload of the mesh finished and the graphics queue can draw it.
+     */
+    [[nodiscard]] bool is_ready(MeshHandle handle) const {
+        return m_gpu->uploads()->is_acquired(m_meshes[handle]->uploadTicket);
+    }
+};
+
+/**
+ * Lets a loader write a single mesh straight into the arena.
+ */
+class MeshArenaSink : public MeshSink {
+    MeshArena* m_pArena;
+    MeshHandle m_handle;
+
+public:
+    GET(m_handle, handle);
+
+    explicit MeshArenaSink(MeshArena* pArena) :
+        m_pArena(pArena), m_handle(UINT32_MAX) {
+
+    }
+
+    void reserve(size_t numVertices, size_t numIndices) override {
+        m_handle = m_pArena->allocate(numVertices, numIndices);
+    }
+
+    std::span<Vertex> vertices(size_t first, size_t count) override {
+        return m_pArena->vertices(m_handle, first, count);
+    }
+
+    std::span<Index> indices(size_t first, size_t count) override {
+        return m_pArena->indices(m_handle, first, count);
+    }
+
+    void finish() override {
+        m_pArena->finish(m_handle);
+    }
+};
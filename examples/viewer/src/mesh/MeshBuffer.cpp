@@ -1,5 +0,0 @@
-//
-// Created by martin on 4/2/24.
-//
-
-#include "MeshBuffer.h"
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "Vertex.hpp"
+
+/**
+ * Destination of geometry produced by a scene loader. Loader reserves the
+ * exact number of vertices and indices up front and then writes into spans
+ * of the destination, so the geometry does not need to be kept in memory.
+ */
+class MeshSink {
+public:
+    virtual ~MeshSink() = default;
+
+    virtual void reserve(size_t numVertices, size_t numIndices) = 0;
+
+    /**
+     * Memory for vertices starting at `first`. Data must be written before
+     * the next call to the sink.
+     * @return span of at most `count` vertices, might be shorter
+     */
+    virtual std::span<Vertex> vertices(size_t first, size_t count) = 0;
+
+    /**
+     * Memory for indices starting at `first`, same rules as for `vertices`.
+     */
+    virtual std::span<Index> indices(size_t first, size_t count) = 0;
+
+    /**
+     * Called once all the geometry is written.
+     */
+    virtual void finish() {}
+};
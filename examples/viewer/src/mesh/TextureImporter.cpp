@@ -0,0 +1,194 @@
+#include "TextureImporter.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <stdexcept>
+#include <thread>
+
+#include "stb_image.h"
+
+// images are always decoded into RGBA
+static constexpr int32_t NUM_CHANNELS = 4;
+
+TextureImporter::TextureImporter(TextureStorage* pStorage, uint32_t numThreads, size_t maxQueuedBytes) :
+    m_pStorage(pStorage),
+    m_numThreads(numThreads),
+    m_maxQueuedBytes(maxQueuedBytes),
+    m_queuedBytes(0),
+    m_isStopped(false),
+    m_nextRequest(0) {
+    if(m_numThreads == 0) {
+        // the calling thread uploads
+        m_numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+}
+
+bool TextureImporter::reserve(size_t size) {
+    std::unique_lock lock(m_mutex);
+    // a single image larger than the queue still passes once the queue is empty
+    m_spaceCondition.wait(lock, [&] {
+        return m_isStopped || m_queuedBytes == 0 || m_queuedBytes + size <= m_maxQueuedBytes;
+    });
+    if(m_isStopped) {
+        return false;
+    }
+
+    m_queuedBytes += size;
+    return true;
+}
+
+TextureImporter::Decoded TextureImporter::decode_request(const Request& request, uint32_t requestIdx) {
+    Decoded decoded = {
+        .requestIdx = requestIdx,
+        .pData = { nullptr, stbi_image_free },
+        .width = 0,
+        .height = 0,
+        .size = 0,
+    };
+
+    auto compressedPath = lft::ktx2::compressed_path(request.path, request.occlusionPath);
+    std::error_code error;
+    if(m_pStorage->is_compression_supported() && std::filesystem::exists(compressedPath, error)) {
+        decoded.size = std::filesystem::file_size(compressedPath, error);
+        if(error) {
+            decoded.size = 0;
+            decoded.error = std::format("Failed to read texture {}: {}", compressedPath, error.message());
+            return decoded;
+        }
+
+        if(!reserve(decoded.size)) {
+            return decoded;
+        }
+
+        try {
+            decoded.compressed = lft::ktx2::read(compressedPath, request.firstLevel);
+        } catch(const std::exception& e) {
+            decoded.error = e.what();
+        }
+        return decoded;
+    }
+
+    // header only, so the decoded size is known before the space is taken
+    int32_t width, height, numChannels;
+    if(stbi_info(request.path.c_str(), &width, &height, &numChannels)) {
+        decoded.size = (size_t)width * height * NUM_CHANNELS;
+    }
+
+    if(!reserve(decoded.size)) {
+        return decoded;
+    }
+
+    decoded.pData.reset(stbi_load(request.path.c_str(), &width, &height, &numChannels, NUM_CHANNELS));
+    if(decoded.pData == nullptr) {
+        decoded.error = std::format("Failed to load texture {}: {}", request.path, stbi_failure_reason());
+        return decoded;
+    }
+
+    if(!request.occlusionPath.empty()) {
+        try {
+            pack_occlusion(decoded.pData.get(), width, height, request.occlusionPath);
+        } catch(const std::exception& e) {
+            decoded.error = e.what();
+            return decoded;
+        }
+    }
+
+    decoded.width = width;
+    decoded.height = height;
+    return decoded;
+}
+
+void TextureImporter::pack_occlusion(unsigned char* pData, uint32_t width, uint32_t height,
+                                     const std::string& occlusionPath) {
+    int32_t occlusionWidth, occlusionHeight, numChannels;
+    std::unique_ptr<unsigned char, void(*)(void*)> pOcclusion(
+            stbi_load(occlusionPath.c_str(), &occlusionWidth, &occlusionHeight, &numChannels, NUM_CHANNELS),
+            stbi_image_free);
+    if(pOcclusion == nullptr) {
+        throw std::runtime_error(std::format("Failed to load occlusion {}: {}", occlusionPath,
+                                             stbi_failure_reason()));
+    }
+
+    for(uint32_t y = 0; y < height; y++) {
+        uint32_t occlusionY = (uint64_t)y * occlusionHeight / height;
+        for(uint32_t x = 0; x < width; x++) {
+            uint32_t occlusionX = (uint64_t)x * occlusionWidth / width;
+            pData[((size_t)y * width + x) * NUM_CHANNELS] =
+                    pOcclusion.get()[((size_t)occlusionY * occlusionWidth + occlusionX) * NUM_CHANNELS];
+        }
+    }
+}
+
+void TextureImporter::decode(const std::vector<Request>& requests) {
+    for(uint32_t idx = m_nextRequest++; idx < requests.size(); idx = m_nextRequest++) {
+        Decoded decoded = decode_request(requests[idx], idx);
+
+        std::lock_guard lock(m_mutex);
+        if(m_isStopped) {
+            return;
+        }
+
+        m_decoded.push_back(std::move(decoded));
+        m_decodedCondition.notify_one();
+    }
+}
+
+void TextureImporter::stop() {
+    std::lock_guard lock(m_mutex);
+    m_isStopped = true;
+    m_spaceCondition.notify_all();
+}
+
+std::vector<TextureHandle> TextureImporter::import(const std::vector<Request>& requests) {
+    std::vector<TextureHandle> handles(requests.size());
+
+    m_decoded.clear();
+    m_queuedBytes = 0;
+    m_isStopped = false;
+    m_nextRequest = 0;
+
+    std::vector<std::jthread> workers;
+    for(uint32_t i = 0; i < std::min<size_t>(m_numThreads, requests.size()); i++) {
+        workers.emplace_back([this, &requests] { decode(requests); });
+    }
+
+    try {
+        for(size_t numUploaded = 0; numUploaded < requests.size(); numUploaded++) {
+            Decoded decoded = { .pData = { nullptr, stbi_image_free } };
+            {
+                std::unique_lock lock(m_mutex);
+                m_decodedCondition.wait(lock, [this] { return !m_decoded.empty(); });
+                decoded = std::move(m_decoded.front());
+                m_decoded.pop_front();
+            }
+
+            if(!decoded.error.empty()) {
+                throw std::runtime_error(decoded.error);
+            }
+
+            // copied into staging memory, the earlier textures are transferred meanwhile
+            if(decoded.compressed) {
+                handles[decoded.requestIdx] = m_pStorage->upload(*decoded.compressed);
+            } else {
+                handles[decoded.requestIdx] = m_pStorage->upload(decoded.pData.get(),
+                                                                 decoded.width, decoded.height,
+                                                                 (size_t)decoded.width * decoded.height * NUM_CHANNELS,
+                                                                 requests[decoded.requestIdx].format);
+            }
+
+            std::lock_guard lock(m_mutex);
+            m_queuedBytes -= decoded.size;
+            m_spaceCondition.notify_all();
+        }
+    } catch(...) {
+        stop();
+        workers.clear();
+        m_decoded.clear();
+        throw;
+    }
+
+    m_pStorage->flush();
+
+    return handles;
+}
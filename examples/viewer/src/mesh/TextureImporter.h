@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <volk.h>
+
+#include "TextureStorage.h"
+
+/**
+ * Decodes texture files on a pool of worker threads and uploads them into a
+ * texture storage, while the following ones are still being decoded.
+ *
+ * Decoded images wait for the upload in a queue bounded by their size, so the
+ * workers stop once they get too far ahead of the transfers.
+ *
+ * When the GPU samples BC formats, a `.ktx2` file next to the image, written
+ * by `loft-texc`, is read instead of decoding the image.
+ */
+class TextureImporter {
+public:
+    struct Request {
+        std::string path;
+        // packed into the red channel, empty when there is none
+        std::string occlusionPath;
+        VkFormat format;
+        // levels of a precompressed texture above it are not loaded
+        uint32_t firstLevel = 0;
+    };
+
+private:
+    struct Decoded {
+        uint32_t requestIdx;
+        std::unique_ptr<unsigned char, void(*)(void*)> pData;
+        uint32_t width;
+        uint32_t height;
+        // precompressed texture used instead of the decoded image
+        std::optional<lft::ktx2::Texture> compressed;
+        // bytes taken in the queue, released once uploaded
+        size_t size;
+        std::string error;
+    };
+
+    TextureStorage* m_pStorage;
+    uint32_t m_numThreads;
+    size_t m_maxQueuedBytes;
+
+    std::mutex m_mutex;
+    // signaled when an image is decoded
+    std::condition_variable m_decodedCondition;
+    // signaled when the queue has space for more images
+    std::condition_variable m_spaceCondition;
+    std::deque<Decoded> m_decoded;
+    size_t m_queuedBytes;
+    bool m_isStopped;
+
+    std::atomic<uint32_t> m_nextRequest;
+
+    /**
+     * Worker loop, decodes requests until all are taken or the import stops.
+     */
+    void decode(const std::vector<Request>& requests);
+
+    Decoded decode_request(const Request& request, uint32_t requestIdx);
+
+    /**
+     * Waits until the queue has space for the bytes and takes it.
+     * @return false when the import was stopped meanwhile
+     */
+    bool reserve(size_t size);
+
+    void stop();
+
+public:
+    /**
+     * @param numThreads number of decoding threads, 0 for one less than there are cores
+     * @param maxQueuedBytes size of decoded images waiting for the upload
+     */
+    explicit TextureImporter(TextureStorage* pStorage, uint32_t numThreads = 0,
+                             size_t maxQueuedBytes = 256 * 1024 * 1024);
+
+    TextureImporter(const TextureImporter&) = delete;
+
+    /**
+     * Writes the red channel of the occlusion image into the red channel of
+     * the RGBA image, sampling the nearest texel when the sizes differ.
+     * Throws when the occlusion image fails to load.
+     */
+    static void pack_occlusion(unsigned char* pData, uint32_t width, uint32_t height,
+                               const std::string& occlusionPath);
+
+    /**
+     * Decodes and uploads the textures, blocks until all of them are recorded
+     * into the storage.
+     * @return handles in order of the requests
+     */
+    std::vector<TextureHandle> import(const std::vector<Request>& requests);
+};
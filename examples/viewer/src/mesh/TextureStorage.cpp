@@ -1,11 +1,426 @@
 #include "TextureStorage.h"
+#include "io/path.hpp"
+#include "shaders/SpirvShaderBuilder.hpp"
+
+#include <algorithm>
+
+static ImageCreateInfo texture_image_info(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format) {
+    return ImageCreateInfo {
+            .extent = {
+                    width, height
+            },
+            .format = format,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .arrayLayers = 1,
+            .mipLevels = mipLevels,
+    };
+}
+
+static uint32_t num_mip_levels(uint32_t width, uint32_t height) {
+    return std::floor(std::log2(std::max(width, height))) + 1;
+}
+
+/**
+ * Bytes of a 4x4 block of block compressed formats, 0 for the others.
+ */
+static size_t block_size(VkFormat format) {
+    switch(format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Bytes of all the levels of the image. Uncompressed textures are all RGBA8.
+ */
+static size_t image_size(const ImageCreateInfo& info) {
+    size_t blockSize = block_size(info.format);
+
+    size_t size = 0;
+    for(uint32_t level = 0; level < info.mipLevels; level++) {
+        size_t width = std::max(info.extent.width >> level, 1u);
+        size_t height = std::max(info.extent.height >> level, 1u);
+        size += blockSize > 0 ? ((width + 3) / 4) * ((height + 3) / 4) * blockSize : width * height * 4;
+    }
+
+    return size;
+}
+
+static bool is_same_class(const ImageCreateInfo& a, const ImageCreateInfo& b) {
+    return a.format == b.format && a.extent.width == b.extent.width && a.extent.height == b.extent.height &&
+           a.mipLevels == b.mipLevels && a.arrayLayers == b.arrayLayers && a.usage == b.usage &&
+           a.flags == b.flags;
+}
 
 TextureStorage::~TextureStorage() {
-    for(auto view : m_views) {
-        vkDestroyImageView(m_gpu->dev(), view.view, nullptr);
+    // nothing may be recorded for the images once they are retired
+    flush();
+
+    for(uint32_t i = 0; i < m_images.size(); i++) {
+        if(m_textures[i]) {
+            unload(i);
+        }
+    }
+
+    // images still being written are destroyed once the frames and uploads finish
+    for(auto& pooled : m_pool) {
+        destroy_pooled(pooled);
+    }
+    m_pool.clear();
+
+    // the pipeline keeps its own copy of the code
+    vkDestroyShaderModule(m_gpu->dev(), m_downsampleShader.module(), nullptr);
+}
+
+Shader TextureStorage::load_downsample_shader(const Gpu* gpu) {
+    return SpirvShaderBuilder(gpu).from_file(io::path::shader("Downsample.comp.spirv"));
+}
+
+ImageCreateInfo TextureStorage::generated_image_info(uint32_t width, uint32_t height, VkFormat format) const {
+    ImageCreateInfo info = texture_image_info(width, height, num_mip_levels(width, height), format);
+    if(info.mipLevels == 1 || !m_mipmapGenerator.is_downsampled(format)) {
+        return info;
+    }
+
+    info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    // levels are stored through UNORM views, sRGB formats rarely support storage themselves
+    if(format == VK_FORMAT_R8G8B8A8_SRGB) {
+        info.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+    }
+
+    return info;
+}
+
+void TextureStorage::move_image(TextureHandle handle, VkImage image, VkFormat format) {
+    m_images[handle].img = image;
+
+    // graphics queue is idle while images are moved
+    vkDestroyImageView(m_gpu->dev(), m_views[handle].view, nullptr);
+    m_views[handle] = m_images[handle].create_view(m_gpu, format, {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = m_images[handle].m_level_count,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    }, VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    if(m_onMoved) {
+        m_onMoved(handle);
+    }
+}
+
+void TextureStorage::create_image(const ImageCreateInfo& info, Image* pImage, ImageView* pView) {
+    m_residentBytes += image_size(info);
+
+    uint64_t completedFrame = m_gpu->deletion_queue()->completed_frame();
+    auto pooled = std::ranges::find_if(m_pool, [&](PooledImage& image) {
+        return is_same_class(image.info, info) && is_written(image) && image.frame <= completedFrame;
+    });
+
+    if(pooled != m_pool.end()) {
+        // previous contents are discarded by the writes
+        *pImage = pooled->image;
+        *pView = pooled->view;
+        m_pooledBytes -= image_size(pooled->info);
+        m_pool.erase(pooled);
+
+        m_frameStats.numReused++;
+        return;
+    }
+
+    MemoryAllocationInfo memoryInfo = {
+            .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .category = MEMORY_CATEGORY_TEXTURE
+    };
+
+    ImageCreateInfo imageInfo = info;
+    if(m_gpu->memory()->create_image(&imageInfo, &memoryInfo, pImage)) {
+        throw std::runtime_error("Failed to create texture image");
+    }
+
+    *pView = pImage->create_view(m_gpu, info.format, {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = info.mipLevels,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    }, VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    m_frameStats.numCreated++;
+}
+
+void TextureStorage::track(TextureHandle handle) {
+    m_gpu->defragmenter()->track_image(m_images[handle], m_infos[handle],
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                       [this, handle, format = m_infos[handle].format](VkImage moved) {
+        move_image(handle, moved, format);
+    });
+}
+
+void TextureStorage::retire(const Image& image, const ImageView& view, const ImageCreateInfo& info) {
+    // pooled images stay where they are
+    m_gpu->defragmenter()->untrack(image.allocation);
+
+    size_t size = image_size(info);
+    m_residentBytes -= size;
+    m_pooledBytes += size;
+
+    m_pool.push_back(PooledImage {
+        .image = image,
+        .view = view,
+        .info = info,
+        .frame = m_gpu->uploads()->is_acquired(m_ticket) ? m_gpu->deletion_queue()->frame() : UINT64_MAX,
+        .ticket = m_ticket,
+        .generation = m_generation,
+    });
+}
+
+bool TextureStorage::is_written(PooledImage& image) {
+    if(!m_gpu->uploads()->is_acquired(image.ticket) || !m_mipmapGenerator.is_complete(image.generation)) {
+        return false;
+    }
+
+    // the upload was acquired by a frame submitted after the image was retired
+    if(image.frame == UINT64_MAX) {
+        image.frame = m_gpu->deletion_queue()->frame();
+    }
+
+    return true;
+}
+
+void TextureStorage::destroy_pooled(PooledImage& image) {
+    m_pooledBytes -= image_size(image.info);
+
+    m_gpu->deletion_queue()->push([dev = m_gpu->dev(), view = image.view.view]() {
+        vkDestroyImageView(dev, view, nullptr);
+    });
+    // memory of the image is freed once the frames finish as well
+    m_gpu->memory()->destroy_image(&image.image);
+}
+
+void TextureStorage::trim_pool(size_t size) {
+    // retired in order, the oldest are first
+    std::erase_if(m_pool, [this, size](PooledImage& image) {
+        if(m_pooledBytes <= size || !is_written(image)) {
+            return false;
+        }
+
+        destroy_pooled(image);
+        return true;
+    });
+}
+
+void TextureStorage::write_generated(const Image& image, unsigned char* pData, const ImageCreateInfo& info,
+                                     size_t size) {
+    VkBufferImageCopy region = {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+            },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = {
+                    info.extent.width, info.extent.height, 1
+            }
+    };
+
+    m_writer.write(&image, region, pData, size);
+    m_hasPendingWrites = true;
+
+    // single level images are done once written
+    if(info.mipLevels == 1) {
+        return;
+    }
+
+    // generated on the graphics queue once the base level arrives
+    m_mipmapGenerator.downsample(image, info.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 info.extent, info.mipLevels);
+    if(m_mipmapGenerator.num_queued() >= MIPMAP_BATCH_SIZE) {
+        flush();
+    }
+}
+
+void TextureStorage::write_levels(const Image& image, const lft::ktx2::Texture& texture) {
+    for(uint32_t i = 0; i < texture.levels.size(); i++) {
+        VkBufferImageCopy region = {
+                .bufferOffset = 0,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = i,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                },
+                .imageOffset = { 0, 0, 0 },
+                .imageExtent = {
+                        std::max(texture.width >> i, 1u), std::max(texture.height >> i, 1u), 1
+                }
+        };
+
+        auto level = texture.level(i);
+        m_writer.write(&image, region, level.data(), level.size());
+    }
+    m_hasPendingWrites = true;
+}
+
+TextureHandle TextureStorage::push(const ImageCreateInfo& info) {
+    TextureHandle handle = pop_handle();
+
+    m_infos[handle] = info;
+    m_sizes[handle] = image_size(info);
+    m_lastUsed[handle] = 0;
+    create_image(info, &m_images[handle], &m_views[handle]);
+
+    return handle;
+}
+
+TextureStorage::Replacement& TextureStorage::push_replacement(TextureHandle handle, const ImageCreateInfo& info) {
+    assert(m_textures[handle]);
+
+    Replacement replacement = {
+        .handle = handle,
+        .info = info,
+        .ticket = 0,
+    };
+    create_image(info, &replacement.image, &replacement.view);
+
+    return m_replacements.emplace_back(replacement);
+}
+
+TextureHandle TextureStorage::upload(unsigned char* pData, uint32_t width, uint32_t height, size_t size, VkFormat format) {
+    TextureHandle handle = push(generated_image_info(width, height, format));
+
+    write_generated(m_images[handle], pData, m_infos[handle], size);
+    track(handle);
+
+    return handle;
+}
+
+TextureHandle TextureStorage::upload(const lft::ktx2::Texture& texture) {
+    // KTX2 stores the values of Vulkan formats
+    TextureHandle handle = push(texture_image_info(texture.width, texture.height, texture.levels.size(),
+                                                   (VkFormat)texture.format));
+
+    write_levels(m_images[handle], texture);
+    track(handle);
+
+    return handle;
+}
+
+void TextureStorage::replace(TextureHandle handle, unsigned char* pData, uint32_t width, uint32_t height, size_t size,
+                             VkFormat format) {
+    auto& replacement = push_replacement(handle, generated_image_info(width, height, format));
+    write_generated(replacement.image, pData, replacement.info, size);
+}
+
+void TextureStorage::replace(TextureHandle handle, const lft::ktx2::Texture& texture) {
+    auto& replacement = push_replacement(handle, texture_image_info(texture.width, texture.height,
+                                                                    texture.levels.size(),
+                                                                    (VkFormat)texture.format));
+    write_levels(replacement.image, texture);
+}
+
+void TextureStorage::flush() {
+    UploadTicket ticket = m_writer.flush();
+    for(auto& replacement : m_replacements) {
+        if(replacement.ticket == 0) {
+            replacement.ticket = ticket;
+        }
+    }
+
+    m_ticket = std::max(m_ticket, ticket);
+    m_generation = std::max(m_generation, m_mipmapGenerator.flush(ticket));
+    m_hasPendingWrites = false;
+}
+
+void TextureStorage::update() {
+    // retired images are stamped with the ticket and generation of their writes
+    if(m_hasPendingWrites) {
+        flush();
+    }
+
+    std::erase_if(m_replacements, [this](Replacement& replacement) {
+        if(replacement.ticket == 0 || !m_gpu->uploads()->is_acquired(replacement.ticket)) {
+            return false;
+        }
+
+        TextureHandle handle = replacement.handle;
+        retire(m_images[handle], m_views[handle], m_infos[handle]);
+
+        m_images[handle] = replacement.image;
+        m_views[handle] = replacement.view;
+        m_infos[handle] = replacement.info;
+        m_sizes[handle] = image_size(replacement.info);
+        track(handle);
+
+        if(m_onMoved) {
+            m_onMoved(handle);
+        }
+        return true;
+    });
+
+    // the pool only takes memory left over by the textures
+    trim_pool(m_budget - std::min(m_budget, m_residentBytes));
+
+    m_stats = m_frameStats;
+    m_stats.residentBytes = m_residentBytes;
+    m_stats.pooledBytes = m_pooledBytes;
+    m_frameStats = {};
+    m_frame++;
+}
+
+std::vector<TextureHandle> TextureStorage::least_recently_used() const {
+    std::vector<TextureHandle> handles;
+    for(TextureHandle handle = 0; handle < m_textures.size(); handle++) {
+        if(m_textures[handle] && m_lastUsed[handle] != m_frame) {
+            handles.push_back(handle);
+        }
     }
 
-    for(auto image : m_images) {
-        vkDestroyImage(m_gpu->dev(), image.img, nullptr);
+    std::ranges::stable_sort(handles, [this](TextureHandle a, TextureHandle b) {
+        return m_lastUsed[a] < m_lastUsed[b];
+    });
+
+    return handles;
+}
+
+void TextureStorage::unload(TextureHandle handle) {
+    if(m_hasPendingWrites) {
+        flush();
     }
-}
\ No newline at end of file
+
+    std::erase_if(m_replacements, [this, handle](Replacement& replacement) {
+        if(replacement.handle != handle) {
+            return false;
+        }
+
+        retire(replacement.image, replacement.view, replacement.info);
+        return true;
+    });
+
+    retire(m_images[handle], m_views[handle], m_infos[handle]);
+    m_images[handle] = Image();
+    m_views[handle] = ImageView();
+    m_sizes[handle] = 0;
+    m_textures[handle] = false;
+}
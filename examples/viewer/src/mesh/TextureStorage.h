@@ -4,49 +4,160 @@
 #include "Gpu.hpp"
 #include "resources/ImageBusWriter.h"
 #include "resources/MipmapGenerator.h"
+#include "resources/Defragmenter.hpp"
+#include "shaders/Shader.hpp"
+#include "Ktx2.hpp"
+#include <algorithm>
 #include <assert.h>
 #include <cmath>
+#include <functional>
 #include <stdexcept>
 
 typedef uint32_t TextureHandle;
 
+// generations of mip levels recorded into a single submission
+static constexpr size_t MIPMAP_BATCH_SIZE = 32;
+
 /**
- * Dynamic texture storage, that can constantly be written to
+ * Dynamic texture storage, that can constantly be written to.
+ *
+ * Handles are recycled and the storage grows when all of them are taken, up
+ * to the number of textures the descriptors can hold.
+ * Images of unloaded or replaced textures are pooled by their class, format,
+ * extent and number of levels, and reused by the next texture of the same
+ * class. The pool only takes memory left over by the budget.
  */
 class TextureStorage {
+public:
+    /**
+     * Usage of the storage in a single frame.
+     */
+    struct Stats {
+        // textures marked as used
+        uint32_t numUsed;
+        size_t usedBytes;
+        size_t residentBytes;
+        size_t pooledBytes;
+        // images allocated and taken from the pool
+        uint32_t numCreated;
+        uint32_t numReused;
+    };
+
 private:
+    // image written while the texture keeps using its old one
+    struct Replacement {
+        TextureHandle handle;
+        Image image;
+        ImageView view;
+        ImageCreateInfo info;
+        // 0 until the writes are flushed
+        UploadTicket ticket;
+    };
+
     const Gpu* m_gpu;
+    // handles are indices into descriptor arrays of this size
+    uint32_t m_maxTextures;
     std::vector<uint32_t> m_textures;
     std::vector<Image> m_images;
     std::vector<ImageView> m_views;
+    std::vector<ImageCreateInfo> m_infos;
+
+    std::vector<Replacement> m_replacements;
+
+    // image of a retired texture waiting for reuse
+    struct PooledImage {
+        Image image;
+        ImageView view;
+        ImageCreateInfo info;
+        // frame the image was retired in, UINT64_MAX until its upload is acquired
+        uint64_t frame;
+        // upload and mip generation of the last writes into the image
+        UploadTicket ticket;
+        uint64_t generation;
+    };
+
+    std::vector<PooledImage> m_pool;
+
+    // bytes of the image of each texture
+    std::vector<size_t> m_sizes;
+    // frame each texture was last used in
+    std::vector<uint64_t> m_lastUsed;
+
+    size_t m_budget;
+    // images of textures and their replacements
+    size_t m_residentBytes;
+    size_t m_pooledBytes;
 
-    TextureHandle m_idx = 0;
+    // writes were recorded since the last flush
+    bool m_hasPendingWrites;
+    // upload and mip generation of the last flush
+    UploadTicket m_ticket;
+    uint64_t m_generation;
 
+    uint64_t m_frame;
+    Stats m_frameStats;
+    Stats m_stats;
+
+    Shader m_downsampleShader;
     ImageBusWriter m_writer;
+    MipmapGenerator m_mipmapGenerator;
 
-    Image create_image(VkExtent2D extent, VkFormat format, uint32_t arrayLayers, uint32_t mipLevels) {
-        MemoryAllocationInfo memoryAllocationInfo = {
-                .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE
-        };
-
-        ImageCreateInfo imageInfo = {
-                .extent = extent,
-                .format = format,
-                .usage = VK_IMAGE_USAGE_SAMPLED_BIT |
-                         VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                         VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .arrayLayers = arrayLayers,
-                .mipLevels = mipLevels
-        };
+    // called after an image was moved or replaced and got a new view
+    std::function<void(TextureHandle)> m_onMoved;
 
-        Image image;
+    void move_image(TextureHandle handle, VkImage image, VkFormat format);
 
-        m_gpu->memory()->create_image(&imageInfo, &memoryAllocationInfo,
-                                     &image);
+    static Shader load_downsample_shader(const Gpu* gpu);
 
-        return image;
-    }
+    /**
+     * Image of a texture with all its levels generated from the base one.
+     */
+    [[nodiscard]] ImageCreateInfo generated_image_info(uint32_t width, uint32_t height, VkFormat format) const;
+
+    /**
+     * Creates image with a view of all its levels, or takes a finished one
+     * of the same class from the pool.
+     */
+    void create_image(const ImageCreateInfo& info, Image* pImage, ImageView* pView);
+
+    /**
+     * Hands the image of the texture to the defragmenter.
+     */
+    void track(TextureHandle handle);
+
+    /**
+     * Moves the image into the pool, it is reused once the frames using it finish.
+     * Writes into the image must be flushed.
+     */
+    void retire(const Image& image, const ImageView& view, const ImageCreateInfo& info);
+
+    /**
+     * Upload of the pooled image was acquired and its mip levels were generated,
+     * nothing is going to be recorded for it anymore.
+     */
+    bool is_written(PooledImage& image);
+
+    /**
+     * Destroys written pooled images, oldest first, until the pool takes at
+     * most `size` bytes.
+     */
+    void trim_pool(size_t size);
+
+    void destroy_pooled(PooledImage& image);
+
+    /**
+     * Writes the base level, the others are generated from it.
+     */
+    void write_generated(const Image& image, unsigned char* pData, const ImageCreateInfo& info, size_t size);
+
+    /**
+     * Writes all the levels of a block compressed texture.
+     */
+    void write_levels(const Image& image, const lft::ktx2::Texture& texture);
+
+    TextureHandle push(const ImageCreateInfo& info);
+
+    Replacement& push_replacement(TextureHandle handle, const ImageCreateInfo& info);
 
 public:
     [[nodiscard]] const Image& image(uint32_t idx) const {
@@ -59,106 +170,169 @@ public:
 
     TextureStorage(const TextureStorage&) = delete;
 
-    TextureStorage(const Gpu* gpu, uint32_t numTextures) :
+    /**
+     * Block compressed textures can be uploaded.
+     */
+    [[nodiscard]] bool is_compression_supported() const {
+        return m_gpu->is_texture_compression_bc_enabled();
+    }
+
+    /**
+     * Views of moved or replaced textures change, descriptor sets using them
+     * must be rewritten.
+     */
+    void set_moved_callback(std::function<void(TextureHandle)> onMoved) {
+        m_onMoved = std::move(onMoved);
+    }
+
+    /**
+     * @param numTextures number of handles reserved up front
+     * @param maxTextures number of handles the storage never grows over
+     * @param budget bytes of texture memory, see `least_recently_used`
+     */
+    TextureStorage(const Gpu* gpu, uint32_t numTextures, uint32_t maxTextures,
+                   size_t budget = 512 * 1024 * 1024) :
             m_gpu(gpu),
+            m_maxTextures(maxTextures),
+            m_textures(numTextures, false),
             m_images(numTextures),
             m_views(numTextures),
-            m_textures(numTextures, false),
-            m_writer(gpu, nullptr, {2048, 2048}, 8, 1)
+            m_infos(numTextures),
+            m_sizes(numTextures, 0),
+            m_lastUsed(numTextures, 0),
+            m_budget(budget),
+            m_residentBytes(0),
+            m_pooledBytes(0),
+            m_hasPendingWrites(false),
+            m_ticket(0),
+            m_generation(0),
+            m_frame(1),
+            m_frameStats(),
+            m_stats(),
+            m_downsampleShader(load_downsample_shader(gpu)),
+            m_writer(gpu, 64 * 1024 * 1024, 4),
+            m_mipmapGenerator(gpu, &m_downsampleShader)
     {
         assert(gpu != nullptr);
         assert(numTextures > 0);
+
+        if(numTextures > maxTextures) {
+            throw std::runtime_error("Not enough texture descriptors for all the textures");
+        }
     }
 
     ~TextureStorage();
 
+    /**
+     * Takes the lowest free handle, the storage grows when there is none.
+     * Throws when all the handles the descriptors can hold are taken.
+     */
     TextureHandle pop_handle() {
-        if(m_idx >= m_textures.size()) {
-            throw std::runtime_error("Not enough space in texture storage");
+        auto found = std::find(m_textures.begin(), m_textures.end(), false);
+        if(found != m_textures.end()) {
+            *found = true;
+            return std::distance(m_textures.begin(), found);
         }
 
-        TextureHandle handle = m_idx;
-        m_textures[handle] = true;
-        m_idx++;
+        if(m_textures.size() >= m_maxTextures) {
+            throw std::runtime_error("Not enough texture descriptors for another texture");
+        }
 
-        return handle;
+        m_textures.push_back(true);
+        m_images.emplace_back();
+        m_views.emplace_back();
+        m_infos.emplace_back();
+        m_sizes.push_back(0);
+        m_lastUsed.push_back(0);
+        return m_textures.size() - 1;
     }
 
     /**
-     * Pushes new image into the storage and returns it's handle
+     * Number of handles, including the free ones.
+     */
+    [[nodiscard]] uint32_t capacity() const {
+        return m_textures.size();
+    }
+
+    [[nodiscard]] bool is_loaded(TextureHandle handle) const {
+        return handle < m_textures.size() && m_textures[handle];
+    }
+
+    [[nodiscard]] size_t budget() const {
+        return m_budget;
+    }
+
+    [[nodiscard]] size_t resident_bytes() const {
+        return m_residentBytes;
+    }
+
+    /**
+     * Usage of the last finished frame.
+     */
+    [[nodiscard]] const Stats& stats() const {
+        return m_stats;
+    }
+
+    /**
+     * Marks the texture as sampled in the current frame.
+     */
+    void use(TextureHandle handle) {
+        if(m_lastUsed[handle] == m_frame) {
+            return;
+        }
+
+        m_lastUsed[handle] = m_frame;
+        m_frameStats.numUsed++;
+        m_frameStats.usedBytes += m_sizes[handle];
+    }
+
+    /**
+     * Loaded textures not used in the current frame, the ones used longest
+     * ago first. Owners of the textures evict them in this order to stay
+     * within the budget.
+     */
+    [[nodiscard]] std::vector<TextureHandle> least_recently_used() const;
+
+    /**
+     * Pushes new image into the storage and returns it's handle.
+     * Upload and mip generation are batched, see `flush`.
      * @param pData Data to be send
      * @param width Width of the image
      * @param height Height of the image
      * @return Returns handle to the newly added image
      */
-    TextureHandle upload(unsigned char* pData, uint32_t width, uint32_t height, size_t size, VkFormat format) {
-        TextureHandle handle = pop_handle();
-
-        uint32_t mipmapLevels = std::floor(std::log2(std::max(width, height))) + 1;
-
-        VkBufferImageCopy region = {
-                .bufferOffset = 0,
-                .bufferRowLength = 0,
-                .bufferImageHeight = 0,
-                .imageSubresource = {
-                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                        .mipLevel = 0,
-                        .baseArrayLayer = 0,
-                        .layerCount = 1,
-                },
-                .imageOffset = { 0, 0, 0 },
-                .imageExtent = {
-                        (uint32_t)width, (uint32_t)height, 1
-                }
-        };
-
-        ImageCreateInfo imageCreateInfo = {
-                .extent = {
-                        width, height
-                },
-                .format = format,
-                .usage = VK_IMAGE_USAGE_SAMPLED_BIT |
-                         VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                         VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .arrayLayers = 1,
-                .mipLevels = mipmapLevels,
-        };
-
-        MemoryAllocationInfo memoryInfo = {
-                .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE
-        };
-
-        m_gpu->memory()->create_image(&imageCreateInfo, &memoryInfo, &m_images[handle]);
-        m_views[handle] = m_images[handle].create_view(m_gpu, format, {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = mipmapLevels,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        });
-
-        m_writer.set_target(&m_images[handle]);
-        m_writer.write(region, pData, size);
-        m_writer.flush();
-
-        const VkExtent2D extent = {width, height};
-        const VkImageSubresourceRange subresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = mipmapLevels,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        };
-
-        MipmapGenerator mipmapGenerator(m_gpu);
-        mipmapGenerator.generate(m_images[handle], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                 extent, subresource);
-
-        return handle;
-    }
+    TextureHandle upload(unsigned char* pData, uint32_t width, uint32_t height, size_t size, VkFormat format);
 
-    void unload(TextureHandle handle) {
+    /**
+     * Pushes block compressed image with all of its mip levels precomputed.
+     * Levels are written as they are, nothing is generated on the GPU.
+     * @return Returns handle to the newly added image
+     */
+    TextureHandle upload(const lft::ktx2::Texture& texture);
 
-    }
+    /**
+     * Writes a new image for the texture, the texture keeps its current
+     * image until the new one is owned by the graphics queue, see `update`.
+     */
+    void replace(TextureHandle handle, unsigned char* pData, uint32_t width, uint32_t height, size_t size,
+                 VkFormat format);
+
+    void replace(TextureHandle handle, const lft::ktx2::Texture& texture);
+
+    /**
+     * Records pending writes and submits generation of their mip levels.
+     * Textures are ready for the frames submitted afterwards.
+     */
+    void flush();
+
+    /**
+     * Swaps in replaced images acquired by the graphics queue and ends the
+     * frame of usage stats. Should be called once per frame before recording.
+     */
+    void update();
+
+    /**
+     * Releases the image of the texture into the pool, the handle can be reused.
+     */
+    void unload(TextureHandle handle);
 };
@@ -0,0 +1,353 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <print>
+
+#include "TextureImporter.h"
+#include "stb_image.h"
+
+// larger dimension of the mip tail of precompressed textures
+static constexpr uint32_t TAIL_EXTENT = 64;
+// levels loaded finer than estimated, texture coordinates might repeat over the surface
+static constexpr uint32_t LOD_BIAS = 1;
+// loads adding levels in flight at once
+static constexpr uint32_t MAX_LOADS_IN_FLIGHT = 4;
+// images are always decoded into RGBA
+static constexpr int32_t NUM_CHANNELS = 4;
+
+TextureStreamer::TextureStreamer(TextureStorage* pStorage, uint32_t numWorkers) :
+    m_pStorage(pStorage),
+    m_residentBytes(0),
+    m_loadingBytes(0),
+    m_evictingBytes(0),
+    m_numLoading(0),
+    m_frame(1) {
+    for(uint32_t i = 0; i < std::max(numWorkers, 1u); i++) {
+        m_workers.emplace_back([this](std::stop_token stopToken) { work(stopToken); });
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    // loads in flight are dropped
+    m_workers.clear();
+}
+
+std::vector<TextureHandle> TextureStreamer::add(const std::vector<Source>& sources) {
+    std::vector<TextureHandle> handles(sources.size());
+
+    std::vector<TextureImporter::Request> requests;
+    std::vector<uint32_t> requestSources;
+
+    uint32_t firstTexture = m_textures.size();
+    for(uint32_t i = 0; i < sources.size(); i++) {
+        const Source& source = sources[i];
+        Texture texture = {
+            .source = source,
+            .extent = 1,
+            .loadingLevel = NO_LEVEL,
+            .requestedFrame = 0,
+            .isFailed = false,
+        };
+
+        auto compressedPath = lft::ktx2::compressed_path(source.path, source.occlusionPath);
+        std::error_code error;
+        if(m_pStorage->is_compression_supported() && std::filesystem::exists(compressedPath, error)) {
+            auto header = lft::ktx2::read_header(compressedPath);
+            texture.compressedPath = compressedPath;
+            texture.extent = std::max(header.width, header.height);
+            texture.tailLevel = lft::ktx2::first_level_within(header, TAIL_EXTENT);
+
+            texture.sizes.resize(texture.tailLevel + 1);
+            size_t size = 0;
+            for(uint32_t level = header.levels.size(); level-- > 0;) {
+                size += header.levels[level].size;
+                if(level <= texture.tailLevel) {
+                    texture.sizes[level] = size;
+                }
+            }
+
+            // only the tail is read, in parallel
+            requests.push_back({
+                .path = source.path,
+                .occlusionPath = source.occlusionPath,
+                .format = source.format,
+                .firstLevel = texture.tailLevel,
+            });
+            requestSources.push_back(i);
+        } else {
+            // the whole image with its mip levels, or the placeholder
+            int32_t width = 1, height = 1, numChannels;
+            texture.isFailed = !stbi_info(source.path.c_str(), &width, &height, &numChannels);
+            texture.extent = std::max(width, height);
+            texture.tailLevel = 1;
+            texture.sizes = { (size_t)width * height * NUM_CHANNELS * 4 / 3, NUM_CHANNELS };
+
+            std::array<uint8_t, 4> placeholder = source.placeholder;
+            handles[i] = m_pStorage->upload(placeholder.data(), 1, 1, placeholder.size(), source.format);
+        }
+
+        texture.residentLevel = texture.tailLevel;
+        texture.wantedLevel = texture.tailLevel;
+        texture.requestedLevel = texture.tailLevel;
+        m_residentBytes += texture.sizes[texture.tailLevel];
+
+        m_textures.push_back(std::move(texture));
+    }
+
+    auto tailHandles = TextureImporter(m_pStorage).import(requests);
+    for(uint32_t i = 0; i < tailHandles.size(); i++) {
+        handles[requestSources[i]] = tailHandles[i];
+    }
+
+    for(uint32_t i = 0; i < sources.size(); i++) {
+        m_textures[firstTexture + i].handle = handles[i];
+        if(handles[i] >= m_handleTextures.size()) {
+            m_handleTextures.resize(handles[i] + 1, NO_TEXTURE);
+        }
+        m_handleTextures[handles[i]] = firstTexture + i;
+    }
+
+    m_pStorage->flush();
+
+    return handles;
+}
+
+void TextureStreamer::request(TextureHandle handle, float screenSize) {
+    if(m_pStorage->is_loaded(handle)) {
+        m_pStorage->use(handle);
+    }
+
+    // textures uploaded directly into the storage are not streamed
+    if(handle >= m_handleTextures.size() || m_handleTextures[handle] == NO_TEXTURE) {
+        return;
+    }
+
+    Texture& texture = m_textures[m_handleTextures[handle]];
+
+    uint32_t level = 0;
+    if(texture.compressedPath.empty()) {
+        // anything larger than the placeholder loads the whole image
+        level = screenSize >= 1.0f ? 0 : texture.tailLevel;
+    } else {
+        float ratio = std::log2(texture.extent / std::max(screenSize, 1.0f)) - LOD_BIAS;
+        level = std::min((uint32_t)std::max(ratio, 0.0f), texture.tailLevel);
+    }
+
+    if(texture.requestedFrame != m_frame) {
+        texture.wantedLevel = texture.tailLevel;
+        texture.requestedFrame = m_frame;
+    }
+    texture.wantedLevel = std::min(texture.wantedLevel, level);
+}
+
+TextureStreamer::Loaded TextureStreamer::load(const Load& request) {
+    Loaded loaded = {
+        .textureIdx = request.textureIdx,
+        .level = request.level,
+        .pData = { nullptr, stbi_image_free },
+        .width = 0,
+        .height = 0,
+    };
+
+    try {
+        if(!request.compressedPath.empty()) {
+            loaded.compressed = lft::ktx2::read(request.compressedPath, request.level);
+            return loaded;
+        }
+
+        int32_t width, height, numChannels;
+        loaded.pData.reset(stbi_load(request.path.c_str(), &width, &height, &numChannels, NUM_CHANNELS));
+        if(loaded.pData == nullptr) {
+            loaded.error = std::format("Failed to load texture {}: {}", request.path, stbi_failure_reason());
+            return loaded;
+        }
+
+        if(!request.occlusionPath.empty()) {
+            TextureImporter::pack_occlusion(loaded.pData.get(), width, height, request.occlusionPath);
+        }
+
+        loaded.width = width;
+        loaded.height = height;
+    } catch(const std::exception& e) {
+        loaded.error = e.what();
+    }
+
+    return loaded;
+}
+
+void TextureStreamer::work(std::stop_token stopToken) {
+    while(true) {
+        Load request;
+        {
+            std::unique_lock lock(m_mutex);
+            if(!m_loadCondition.wait(lock, stopToken, [this] { return !m_loads.empty(); })) {
+                return;
+            }
+
+            request = std::move(m_loads.front());
+            m_loads.pop_front();
+        }
+
+        Loaded loaded = load(request);
+
+        std::lock_guard lock(m_mutex);
+        m_loaded.push_back(std::move(loaded));
+    }
+}
+
+void TextureStreamer::set_resident(Texture& texture, uint32_t level) {
+    m_residentBytes = m_residentBytes - texture.sizes[texture.residentLevel] + texture.sizes[level];
+    texture.residentLevel = level;
+}
+
+void TextureStreamer::start_load(uint32_t textureIdx, uint32_t level, bool isUrgent) {
+    Texture& texture = m_textures[textureIdx];
+    texture.loadingLevel = level;
+
+    Load request = {
+        .textureIdx = textureIdx,
+        .level = level,
+        .path = texture.source.path,
+        .occlusionPath = texture.source.occlusionPath,
+        .compressedPath = texture.compressedPath,
+    };
+
+    std::lock_guard lock(m_mutex);
+    if(isUrgent) {
+        m_loads.push_front(std::move(request));
+    } else {
+        m_loads.push_back(std::move(request));
+    }
+    m_loadCondition.notify_one();
+}
+
+void TextureStreamer::evict(uint32_t textureIdx) {
+    Texture& texture = m_textures[textureIdx];
+
+    if(texture.compressedPath.empty()) {
+        // placeholder needs no loading
+        std::array<uint8_t, 4> placeholder = texture.source.placeholder;
+        m_pStorage->replace(texture.handle, placeholder.data(), 1, 1, placeholder.size(), texture.source.format);
+        set_resident(texture, texture.tailLevel);
+        return;
+    }
+
+    m_evictingBytes += texture.sizes[texture.residentLevel] - texture.sizes[texture.tailLevel];
+    start_load(textureIdx, texture.tailLevel, true);
+}
+
+bool TextureStreamer::make_room(size_t size) {
+    auto fits = [&] {
+        return m_residentBytes + m_loadingBytes + size <= m_pStorage->budget() + m_evictingBytes;
+    };
+
+    if(fits()) {
+        return true;
+    }
+
+    // textures with more than their tail, the one used longest ago first
+    for(TextureHandle handle : m_pStorage->least_recently_used()) {
+        if(handle >= m_handleTextures.size() || m_handleTextures[handle] == NO_TEXTURE) {
+            continue;
+        }
+
+        const Texture& texture = m_textures[m_handleTextures[handle]];
+        if(texture.loadingLevel != NO_LEVEL || texture.residentLevel >= texture.tailLevel) {
+            continue;
+        }
+
+        evict(m_handleTextures[handle]);
+        if(fits()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TextureStreamer::apply(Loaded& loaded) {
+    Texture& texture = m_textures[loaded.textureIdx];
+
+    size_t residentSize = texture.sizes[texture.residentLevel];
+    size_t loadedSize = texture.sizes[loaded.level];
+    if(loadedSize > residentSize) {
+        m_loadingBytes -= loadedSize - residentSize;
+        m_numLoading--;
+    } else {
+        m_evictingBytes -= residentSize - loadedSize;
+    }
+    texture.loadingLevel = NO_LEVEL;
+
+    if(!loaded.error.empty()) {
+        std::println("Failed to stream texture: {}", loaded.error);
+        texture.isFailed = true;
+        return;
+    }
+
+    if(loaded.compressed) {
+        m_pStorage->replace(texture.handle, *loaded.compressed);
+    } else {
+        m_pStorage->replace(texture.handle, loaded.pData.get(), loaded.width, loaded.height,
+                            (size_t)loaded.width * loaded.height * NUM_CHANNELS, texture.source.format);
+    }
+
+    set_resident(texture, loaded.level);
+}
+
+void TextureStreamer::update() {
+    std::deque<Loaded> loaded;
+    {
+        std::lock_guard lock(m_mutex);
+        loaded.swap(m_loaded);
+    }
+
+    for(auto& result : loaded) {
+        apply(result);
+    }
+
+    // requests of this frame become the targets
+    std::vector<uint32_t> candidates;
+    for(uint32_t i = 0; i < m_textures.size(); i++) {
+        Texture& texture = m_textures[i];
+        if(texture.requestedFrame == m_frame) {
+            texture.requestedLevel = texture.wantedLevel;
+        }
+
+        if(texture.requestedFrame == m_frame && texture.requestedLevel < texture.residentLevel &&
+           texture.loadingLevel == NO_LEVEL && !texture.isFailed) {
+            candidates.push_back(i);
+        }
+    }
+
+    // textures furthest from their request first
+    std::ranges::sort(candidates, [this](uint32_t a, uint32_t b) {
+        const Texture& textureA = m_textures[a];
+        const Texture& textureB = m_textures[b];
+        return textureA.residentLevel - textureA.requestedLevel > textureB.residentLevel - textureB.requestedLevel;
+    });
+
+    for(uint32_t idx : candidates) {
+        if(m_numLoading >= MAX_LOADS_IN_FLIGHT) {
+            break;
+        }
+
+        Texture& texture = m_textures[idx];
+        size_t size = texture.sizes[texture.requestedLevel] - texture.sizes[texture.residentLevel];
+        // smaller loads might still fit
+        if(!make_room(size)) {
+            continue;
+        }
+
+        m_loadingBytes += size;
+        m_numLoading++;
+        start_load(idx, texture.requestedLevel, false);
+    }
+
+    m_pStorage->flush();
+    m_pStorage->update();
+
+    m_frame++;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <volk.h>
+
+#include "Ktx2.hpp"
+#include "TextureStorage.h"
+
+/**
+ * Streams mip levels of textures in and out of a texture storage.
+ *
+ * Only the mip tail of each texture is loaded at first. Higher levels are
+ * requested every frame by the size of the texture on the screen, files are
+ * read and decoded by background workers and their results are written as
+ * replacement images of the textures. Textures over the budget of the storage
+ * drop back to their tail, starting with the ones it saw used longest ago.
+ *
+ * Images without a precompressed KTX2 file can only be decoded whole, their
+ * tail is a single texel placeholder.
+ */
+class TextureStreamer {
+public:
+    struct Source {
+        std::string path;
+        // packed into the red channel, empty when there is none
+        std::string occlusionPath;
+        VkFormat format;
+        // texel shown until the image is loaded
+        std::array<uint8_t, 4> placeholder;
+    };
+
+private:
+    static constexpr uint32_t NO_LEVEL = UINT32_MAX;
+    static constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+
+    struct Texture {
+        TextureHandle handle;
+        Source source;
+        // KTX2 file with precomputed levels, empty when the image is decoded whole
+        std::string compressedPath;
+
+        // larger dimension of the base level
+        uint32_t extent;
+        // bytes of the image starting at each level, up to the tail. Images
+        // decoded whole have only the whole image and the placeholder.
+        std::vector<size_t> sizes;
+        uint32_t tailLevel;
+
+        uint32_t residentLevel;
+        // level being loaded, `NO_LEVEL` when none is
+        uint32_t loadingLevel;
+        // finest level requested in the current frame
+        uint32_t wantedLevel;
+        // finest level requested in the last frame the texture was requested in
+        uint32_t requestedLevel;
+        uint64_t requestedFrame;
+
+        // failed to load, stays with its tail
+        bool isFailed;
+    };
+
+    struct Load {
+        uint32_t textureIdx;
+        uint32_t level;
+        std::string path;
+        std::string occlusionPath;
+        std::string compressedPath;
+    };
+
+    struct Loaded {
+        uint32_t textureIdx;
+        uint32_t level;
+        std::optional<lft::ktx2::Texture> compressed;
+        std::unique_ptr<unsigned char, void(*)(void*)> pData;
+        uint32_t width;
+        uint32_t height;
+        std::string error;
+    };
+
+    TextureStorage* m_pStorage;
+
+    std::vector<Texture> m_textures;
+    // texture index of each handle, `NO_TEXTURE` for those not streamed
+    std::vector<uint32_t> m_handleTextures;
+
+    size_t m_residentBytes;
+    // bytes the loads in flight are going to add
+    size_t m_loadingBytes;
+    // bytes the evictions in flight are going to free
+    size_t m_evictingBytes;
+    // loads adding levels in flight, evictions are not limited
+    uint32_t m_numLoading;
+    uint64_t m_frame;
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_loadCondition;
+    std::deque<Load> m_loads;
+    std::deque<Loaded> m_loaded;
+    // declared last, so the workers stop before the queues are destroyed
+    std::vector<std::jthread> m_workers;
+
+    void work(std::stop_token stopToken);
+
+    static Loaded load(const Load& request);
+
+    /**
+     * Queues load of the texture starting at the level.
+     * @param isUrgent loaded before the other queued loads
+     */
+    void start_load(uint32_t textureIdx, uint32_t level, bool isUrgent);
+
+    /**
+     * Evicts textures, that were not used in this frame, until `size` more
+     * bytes fit into the budget.
+     * @return false when not enough textures could be evicted
+     */
+    bool make_room(size_t size);
+
+    /**
+     * Drops the texture back to its tail.
+     */
+    void evict(uint32_t textureIdx);
+
+    void apply(Loaded& loaded);
+
+    void set_resident(Texture& texture, uint32_t level);
+
+public:
+    /**
+     * Streamed levels are kept within the budget of the storage.
+     * @param numWorkers number of threads reading and decoding files
+     */
+    explicit TextureStreamer(TextureStorage* pStorage, uint32_t numWorkers = 2);
+
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&) = delete;
+
+    /**
+     * Makes the mip tails of the textures resident, blocks until they are
+     * recorded into the storage.
+     * @return handles in order of the sources
+     */
+    std::vector<TextureHandle> add(const std::vector<Source>& sources);
+
+    /**
+     * Requests the texture for the current frame and marks it as used.
+     * @param screenSize size in pixels the texture covers on the screen
+     */
+    void request(TextureHandle handle, float screenSize);
+
+    /**
+     * Uploads finished loads, starts new ones for the requests of the frame
+     * and swaps in images acquired by the graphics queue.
+     */
+    void update();
+
+    [[nodiscard]] size_t resident_bytes() const {
+        return m_residentBytes;
+    }
+};
@@ -2,13 +2,15 @@
 
 #include "resources/BufferBusWriter.h"
 #include "resources/Buffer.hpp"
+#include "resources/UniformAllocator.hpp"
 
 namespace lft::scene {
 
 class TransformBuffer {
     const Gpu* m_gpu;
+    UniformAllocator* m_uniforms;
 
-    Buffer m_transform_buffer;
+    UniformAllocation m_transform_buffer;
 
     /* always ready buffer writer */
     BufferBusWriter m_writer;
@@ -16,7 +18,11 @@ class TransformBuffer {
     void allocate_buffer(size_t num_transforms);
 
 public:
-    TransformBuffer(const Gpu* gpu, size_t num_transforms);
+    TransformBuffer(const Gpu* gpu, UniformAllocator* uniforms, size_t num_transforms);
+
+    ~TransformBuffer();
+
+    TransformBuffer(const TransformBuffer& other) = delete;
 };
 
 }
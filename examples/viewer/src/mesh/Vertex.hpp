@@ -2,6 +2,10 @@
 
 #include "shaders/VertexBinding.h"
 #include "shaders/VertexAttribute.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 
 typedef unsigned int Index;
@@ -10,6 +14,146 @@ struct VertexInput {
 
 };
 
+/**
+ * Attributes of a vertex as floats, as they are read from scene files.
+ */
+struct FloatVertex {
+	float pos[3];
+	float norm[3];
+	float uv[2];
+
+    float tangent[4];
+};
+
+/**
+ * Center and half extent of the bounds of a primitive. Compact vertex
+ * positions are relative to them, the same values are pushed to the shaders.
+ */
+inline void vertex_bounds(const float boundsMin[3], const float boundsMax[3], float center[4], float extent[4]) {
+    for(uint32_t c = 0; c < 3; c++) {
+        center[c] = (boundsMin[c] + boundsMax[c]) * 0.5f;
+        extent[c] = (boundsMax[c] - boundsMin[c]) * 0.5f;
+        // flat primitives keep all their positions at the center
+        if(!(extent[c] > 0.0f)) {
+            extent[c] = 1.0f;
+        }
+    }
+    center[3] = 0.0f;
+    extent[3] = 1.0f;
+}
+
+#ifdef LOFT_COMPACT_VERTICES
+/**
+ * Quantized vertex. Positions are 16 bit relative to the bounds of their
+ * primitive, normals and tangents are octahedral encoded and texture
+ * coordinates are half floats. Shaders decode them when compiled with
+ * `COMPACT_VERTICES`.
+ */
+struct Vertex : VertexInput {
+    // w is the handedness of the tangent
+    int16_t pos[4];
+    int16_t norm[2];
+    uint16_t uv[2];
+    int16_t tangent[2];
+
+    static inline std::vector<VertexBinding> bindings() {
+        return {
+                {
+                        .binding = 0,
+                        .stride = sizeof(Vertex),
+                        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+                }
+        };
+    }
+
+    static inline std::vector<VertexAttribute> attributes() {
+        return {
+            { 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(Vertex, pos) },
+            { 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(Vertex, norm) },
+            { 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(Vertex, uv) },
+            { 3, 0, VK_FORMAT_R16G16_SNORM, offsetof(Vertex, tangent) }
+        };
+    }
+
+    static inline int16_t to_snorm(float value) {
+        return (int16_t)std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+    }
+
+    static inline uint16_t to_half(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        uint16_t sign = (bits >> 16) & 0x8000;
+        int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if(exponent >= 31) {
+            // overflow saturates to infinity, NaN stays NaN
+            return sign | 0x7c00 | (((bits & 0x7f800000) == 0x7f800000 && mantissa != 0) ? 0x200 : 0);
+        }
+        if(exponent <= 0) {
+            if(exponent < -10) {
+                return sign;
+            }
+            // subnormal, the implicit bit is shifted into the mantissa
+            mantissa |= 0x800000;
+            uint32_t shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t middle = 1u << (shift - 1);
+            half += rest > middle || (rest == middle && (half & 1));
+            return sign | half;
+        }
+
+        // round to nearest even, a carry into the exponent is correct
+        uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1fff;
+        half += rest > 0x1000 || (rest == 0x1000 && (half & 1));
+        return sign | half;
+    }
+
+    /**
+     * Maps the unit vector onto an octahedron unfolded into a square.
+     */
+    static inline void to_octahedral(const float vector[3], int16_t out[2]) {
+        float length = std::abs(vector[0]) + std::abs(vector[1]) + std::abs(vector[2]);
+        if(length == 0.0f) {
+            out[0] = 0;
+            out[1] = 0;
+            return;
+        }
+
+        float x = vector[0] / length;
+        float y = vector[1] / length;
+        if(vector[2] < 0.0f) {
+            float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+
+        out[0] = to_snorm(x);
+        out[1] = to_snorm(y);
+    }
+
+    /**
+     * @param center, extent bounds of the primitive, see `vertex_bounds`
+     */
+    static inline Vertex encode(const FloatVertex& vertex, const float center[4], const float extent[4]) {
+        Vertex result = {};
+        for(uint32_t c = 0; c < 3; c++) {
+            result.pos[c] = to_snorm((vertex.pos[c] - center[c]) / extent[c]);
+        }
+        result.pos[3] = vertex.tangent[3] < 0.0f ? -32767 : 32767;
+
+        to_octahedral(vertex.norm, result.norm);
+        to_octahedral(vertex.tangent, result.tangent);
+        result.uv[0] = to_half(vertex.uv[0]);
+        result.uv[1] = to_half(vertex.uv[1]);
+        return result;
+    }
+};
+#else
 struct Vertex : VertexInput {
 	float pos[3];
 	float norm[3];
@@ -36,3 +180,4 @@ struct Vertex : VertexInput {
         };
     }
 };
+#endif
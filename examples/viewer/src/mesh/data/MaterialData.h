@@ -22,6 +22,8 @@ private:
     float m_pbrTextureBlend;
 
     bool m_isBlend;
+    // metallic roughness texture has occlusion in its red channel
+    bool m_hasOcclusion;
 
 public:
     [[nodiscard]] inline std::optional<uint32_t> color_texture() const {
@@ -51,10 +53,26 @@ public:
         return &m_bsdf[0];
     }
 
+    void set_bsdf(const float bsdf[4]) {
+        m_bsdf[0] = bsdf[0];
+        m_bsdf[1] = bsdf[1];
+        m_bsdf[2] = bsdf[2];
+        m_bsdf[3] = bsdf[3];
+    }
+
     [[nodiscard]] inline const bool is_blended() const {
         return m_isBlend;
     }
 
+    [[nodiscard]] inline bool has_occlusion() const {
+        return m_hasOcclusion;
+    }
+
+    inline MaterialData& set_occlusion(bool value) {
+        m_hasOcclusion = value;
+        return *this;
+    }
+
 
     inline MaterialData& set_alpha_blend(bool value) {
         this->m_isBlend = value;
@@ -77,7 +95,8 @@ public:
     }
 
     MaterialData() :
-            m_isBlend(false) {
+            m_isBlend(false),
+            m_hasOcclusion(false) {
 
     }
 
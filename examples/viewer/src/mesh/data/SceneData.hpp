@@ -11,6 +11,7 @@
 #include "MaterialData.h"
 #include "TextureData.h"
 #include "../Vertex.hpp"
+#include "../MeshSink.hpp"
 #include "mesh/Transform.hpp"
 
 struct Mesh {
@@ -23,6 +24,10 @@ struct Primitive {
 	unsigned int offset;
 	unsigned int count;
 	unsigned int baseVertex;
+
+	// bounding box of the positions, estimates the size on screen
+	float boundsMin[3];
+	float boundsMax[3];
 };
 
 struct SceneNode {
@@ -39,7 +44,11 @@ struct SceneNode {
     }
 };
 
-class SceneData {
+/**
+ * Scene loaded from a file. Geometry is kept in it only when the loader
+ * was not given another sink.
+ */
+class SceneData : public MeshSink {
 	std::string m_dir;
 	std::string m_filename;
 
@@ -59,6 +68,9 @@ class SceneData {
     std::vector<Transform> m_transforms;
 	uint32_t m_numMeshes;
 
+	// files the scene was imported from, a cached scene is valid while they do not change
+	std::vector<std::string> m_sources;
+
 public:
 	REF(m_vertices, vertices);
 	GET(m_numVertices, num_vertices);
@@ -80,24 +92,43 @@ public:
     REF(m_primitives, primitives);
     REF(m_transforms, transforms);
 
-	SceneData(uint32_t numNodes, uint32_t numMaterials, uint32_t numVertices,
-			  uint32_t numIndices, uint32_t numMeshes, uint32_t numPrimitives);
+    REF(m_sources, sources);
+    GET(m_dir, directory);
+
+	SceneData(uint32_t numNodes, uint32_t numMaterials,
+			  uint32_t numMeshes, uint32_t numPrimitives);
+
+    inline SceneData& add_source(std::string path) {
+        m_sources.push_back(std::move(path));
+        return *this;
+    }
 
     inline uint32_t push_transform(Transform transform) {
         m_transforms.push_back(transform);
         return m_transforms.size() - 1;
     }
 
-	inline Vertex* suballoc_vertices(size_t numVertices) {
-		auto result = m_vertices.data() + m_numVertices;
-		m_numVertices += numVertices;
-		return result;
+	void reserve(size_t numVertices, size_t numIndices) override {
+		m_vertices.resize(numVertices);
+		m_numVertices = numVertices;
+		m_indices.resize(numIndices);
+		m_numIndices = numIndices;
+	}
+
+	std::span<Vertex> vertices(size_t first, size_t count) override {
+		return { m_vertices.data() + first, count };
+	}
+
+	std::span<Index> indices(size_t first, size_t count) override {
+		return { m_indices.data() + first, count };
 	}
 
-	inline Index* suballoc_indices(size_t numIndices) {
-		auto result = m_indices.data() + m_numIndices;
-		m_numIndices += numIndices;
-		return result;
+	/**
+	 * Frees the geometry kept in the scene, once it was written into another sink.
+	 */
+	void release_geometry() {
+		m_vertices = {};
+		m_indices = {};
 	}
 
 	inline SceneData& set_path(std::string path) {
@@ -158,7 +189,7 @@ public:
     }
 
 
-    std::string get_absolute_path_of(std::string relativePath) {
+    std::string get_absolute_path_of(std::string relativePath) const {
         return m_dir + relativePath;
     }
 
@@ -10,6 +10,8 @@
 struct TextureData {
     std::string m_name;
     std::string m_path;
+    // occlusion image packed into the red channel, empty when there is none
+    std::string m_occlusionPath;
     bool m_isNormal;
 
     TextureData() :
@@ -17,9 +19,10 @@ struct TextureData {
 
     }
 
-    TextureData(std::string name, std::string path) :
+    TextureData(std::string name, std::string path, std::string occlusionPath = "") :
             m_name(std::move(name)),
             m_path(std::move(path)),
+            m_occlusionPath(std::move(occlusionPath)),
             m_isNormal(false) {
 
     }
@@ -10,8 +10,10 @@ struct Material {
     int normalTexture;
     float normalTextureBlend;
 
+    // occlusion, roughness and metallic in RGB
     int pbrTexture;
     float pbrTextureBlend;
+    float occlusionBlend;
 
-    int padding[2];
+    int padding;
 };
@@ -4,7 +4,10 @@
 
 #include "Scene.h"
 #include "SamplerBuilder.hpp"
+#include "resources/UploadService.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 VkDescriptorSetLayout create_layout(const Gpu* gpu) {
@@ -12,21 +15,18 @@ VkDescriptorSetLayout create_layout(const Gpu* gpu) {
             /* material buffer */
             .binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
                     /* color texture */
-            .binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 128, VK_SHADER_STAGE_FRAGMENT_BIT)
+            .binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_MATERIAL_TEXTURES, VK_SHADER_STAGE_FRAGMENT_BIT)
             .build(gpu);
 }
 
-Scene::Scene(const Gpu* gpu, const SceneData* pSceneData) :
+Scene::Scene(const Gpu* gpu, UniformAllocator* pUniforms, MeshArena* pMeshes, const SceneData* pSceneData) :
     m_gpu(gpu),
-    m_materialBuffer(gpu, pSceneData),
-    m_transform_buffer(gpu, 100),
-    m_bufferWriter(gpu, sizeof(Vertex) * 1024 * 256),
-    m_textureWriter(gpu, nullptr, {1024, 1024}, 8, 8),
+    m_pMeshes(pMeshes),
+    m_materialBuffer(gpu, pUniforms, pSceneData),
+    m_transform_buffer(gpu, pUniforms, 100),
     m_descriptorSetLayout(create_layout(gpu)),
-    m_textureInputSet(VK_NULL_HANDLE)
+    m_inputVersion(1)
 {
-    m_textureInputSet = ShaderInputSet(gpu, m_descriptorSetLayout);
-
     const float min_lod = 0.0f;
     const float max_lod = (float)std::floor(std::log2(1024)) + 1;
 
@@ -37,78 +37,185 @@ Scene::Scene(const Gpu* gpu, const SceneData* pSceneData) :
         .lod(min_lod, max_lod)
         .build(m_gpu);
 
-    m_meshBuffers.emplace_back(MeshBuffer(m_gpu, &m_bufferWriter, 
-                               pSceneData->vertices(), pSceneData->indices()),
-                               pSceneData->primitives());
+    // geometry is not kept in the scene data when loaded into a sink
+    if(!pSceneData->vertices().empty()) {
+        m_meshScenes.emplace_back(m_pMeshes->upload(pSceneData->vertices(), pSceneData->indices()),
+                                  pSceneData->primitives());
+    }
+
+    // moved and streamed textures get new views
+    m_materialBuffer.m_textureStorage.set_moved_callback([this](TextureHandle) {
+        m_inputVersion++;
+    });
+}
+
+void Scene::write_input_set(uint32_t bufferIdx) {
+    const TextureStorage& storage = m_materialBuffer.m_textureStorage;
 
-    std::vector<VkDescriptorImageInfo> imageWriters(/* pSceneData->num_textures() + 1 */128);
-    for(int i = 0; i < 128; i++) {
+    // free handles of the storage get any loaded texture
+    VkImageView fallback = VK_NULL_HANDLE;
+    for(TextureHandle handle = 0; handle < storage.capacity() && fallback == VK_NULL_HANDLE; handle++) {
+        if(storage.is_loaded(handle)) {
+            fallback = storage.view(handle).view;
+        }
+    }
+
+    std::vector<VkDescriptorImageInfo> imageWriters(MAX_MATERIAL_TEXTURES);
+    for(uint32_t i = 0; i < MAX_MATERIAL_TEXTURES; i++) {
+        TextureHandle handle = i % storage.capacity();
         imageWriters[i] = {
                 .sampler = m_textureSampler,
-                .imageView = m_materialBuffer.m_textureStorage.view(i % pSceneData->num_textures()).view,
+                .imageView = storage.is_loaded(handle) ? storage.view(handle).view : fallback,
                 .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
         };
     }
 
     ShaderInputSetWriter writer(m_gpu);
-    writer.write_buffer(m_textureInputSet, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, {
+    writer.write_buffer(m_inputSets[bufferIdx], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, {
             {
                     .buffer = m_materialBuffer.material_buffer()->buf,
-                    .offset = 0,
+                    .offset = m_materialBuffer.material_buffer_offset(),
                     .range = m_materialBuffer.material_buffer_size()
             }
     })
-    .write_images(m_textureInputSet, 1, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageWriters)
+    .write_images(m_inputSets[bufferIdx], 1, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageWriters)
     .write();
 }
 
+Scene::Scene(const Gpu* gpu, UniformAllocator* pUniforms, MeshArena* pMeshes, const SceneData* pSceneData,
+             MeshHandle mesh) :
+    Scene(gpu, pUniforms, pMeshes, pSceneData) {
+    m_meshScenes.emplace_back(mesh, pSceneData->primitives());
+}
+
 void Scene::add_scene_data(const SceneData *pData) {
-    m_meshBuffers.emplace_back(MeshBuffer(m_gpu, &m_bufferWriter, pData->vertices(), pData->indices()),
-                                         pData->primitives());
+    m_meshScenes.emplace_back(m_pMeshes->upload(pData->vertices(), pData->indices()),
+                              pData->primitives());
 
-    // m_meshBuffers[m_meshBuffers.size() - 1].remap_materials(materialIds);
+    // m_meshScenes[m_meshScenes.size() - 1].remap_materials(materialIds);
 
-    ShaderInputSetWriter writer(m_gpu);
-    writer.write_buffer(m_textureInputSet, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, {
-            {
-                .buffer = m_materialBuffer.material_buffer()->buf,
-                .offset = 0,
-                .range = m_materialBuffer.material_buffer_size()
+    m_inputVersion++;
+}
+
+void Scene::stream_textures(const Camera& camera, float viewportHeight) {
+    const Camera::Data& matrices = camera.matrices();
+    // pixels covered by a unit of size at a unit of distance
+    const float scale = matrices.projection[1][1] * viewportHeight * 0.5f;
+    const float near = 0.1f;
+
+    std::vector<float> materialSizes(m_materialBuffer.m_materials.size(), 0.0f);
+    for(auto& meshScene : m_meshScenes) {
+        for(auto& primitive : meshScene.primitives()) {
+            if(primitive.objectIdx >= materialSizes.size()) {
+                continue;
             }
-    })
-    .write();
+
+            float center[3], radius = 0.0f;
+            for(uint32_t c = 0; c < 3; c++) {
+                center[c] = (primitive.boundsMin[c] + primitive.boundsMax[c]) * 0.5f;
+                float half = (primitive.boundsMax[c] - primitive.boundsMin[c]) * 0.5f;
+                radius += half * half;
+            }
+            radius = std::sqrt(radius);
+
+            float viewCenter[3], distance = 0.0f;
+            for(uint32_t r = 0; r < 3; r++) {
+                viewCenter[r] = matrices.view[0][r] * center[0] + matrices.view[1][r] * center[1] +
+                                matrices.view[2][r] * center[2] + matrices.view[3][r];
+                distance += viewCenter[r] * viewCenter[r];
+            }
+
+            // whole bounding sphere is behind the camera
+            if(viewCenter[2] - radius > 0.0f) {
+                continue;
+            }
+
+            distance = std::max(std::sqrt(distance) - radius, near);
+            materialSizes[primitive.objectIdx] = std::max(materialSizes[primitive.objectIdx],
+                                                          2.0f * radius * scale / distance);
+        }
+    }
+
+    TextureStreamer& streamer = m_materialBuffer.m_textureStreamer;
+    for(uint32_t m = 0; m < materialSizes.size(); m++) {
+        const Material& material = m_materialBuffer.m_materials[m];
+        if(materialSizes[m] <= 0.0f || !m_materialBuffer.m_materialsValidity[m]) {
+            continue;
+        }
+
+        if(material.colorTextureBlend > 0.0f) {
+            streamer.request(material.colorTexture, materialSizes[m]);
+        }
+        if(material.normalTextureBlend > 0.0f) {
+            streamer.request(material.normalTexture, materialSizes[m]);
+        }
+        if(material.pbrTextureBlend > 0.0f) {
+            streamer.request(material.pbrTexture, materialSizes[m]);
+        }
+    }
+
+    streamer.update();
 }
 
-void Scene::draw(const lft::Recording& recording, const lft::RecordingBindPoint bind_point) {
-    auto descriptorSet = m_textureInputSet.descriptor_set();
+void Scene::draw(const lft::Recording& recording, const lft::RecordingBindPoint bind_point, uint32_t bufferIdx) {
+    while(m_inputSets.size() <= bufferIdx) {
+        m_inputSets.emplace_back(m_gpu, m_descriptorSetLayout);
+        m_inputSetVersions.push_back(0);
+    }
+
+    // the last frame recorded into the buffer has finished, its set is free
+    if(m_inputSetVersions[bufferIdx] != m_inputVersion) {
+        write_input_set(bufferIdx);
+        m_inputSetVersions[bufferIdx] = m_inputVersion;
+    }
+
+    auto descriptorSet = m_inputSets[bufferIdx].descriptor_set();
     bind_point.bind_descriptor_set(2, descriptorSet);
 
-    for(auto& meshBuffer : m_meshBuffers) {
-        size_t offsets[] = {0};
-        recording.bind_vertex_buffers({meshBuffer.vertex_buffer()}, {0});
-        recording.bind_index_buffer(meshBuffer.index_buffer(), 0, VK_INDEX_TYPE_UINT32);
+    recording.bind_vertex_buffers({m_pMeshes->vertex_buffer()}, {0});
+    recording.bind_index_buffer(m_pMeshes->index_buffer(), 0, VK_INDEX_TYPE_UINT32);
 
-        for(auto& primitive : meshBuffer.primitives()) {
-            uint32_t constants[2] = {0, primitive.objectIdx};
+    for(auto& meshScene : m_meshScenes) {
+        // skip meshes not yet owned by the graphics queue
+        if(!m_pMeshes->is_ready(meshScene.mesh())) {
+            continue;
+        }
+
+        const MeshRange& range = m_pMeshes->range(meshScene.mesh());
+        for(auto& primitive : meshScene.primitives()) {
+            DrawConstants constants = {
+                .transformIdx = 0,
+                .materialIdx = primitive.objectIdx,
+            };
+            vertex_bounds(primitive.boundsMin, primitive.boundsMax, constants.boundsCenter, constants.boundsExtent);
             bind_point.push_constants(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                    0, sizeof(uint32_t) * 2, constants);
-            recording.draw_indexed(primitive.count, 1, primitive.offset, primitive.baseVertex, 0);
+                    0, sizeof(constants), &constants);
+            recording.draw_indexed(primitive.count, 1, range.indexOffset + primitive.offset,
+                                   range.vertexOffset + primitive.baseVertex, 0);
         }
     }
 }
 
 void Scene::draw_depth(const lft::Recording& recording, const lft::RecordingBindPoint bind_point,
         mat4 transform) {
-    for(auto& meshBuffer : m_meshBuffers) {
-        size_t offsets[] = {0};
+    recording.bind_vertex_buffers({m_pMeshes->vertex_buffer()}, {0});
+    recording.bind_index_buffer(m_pMeshes->index_buffer(), 0, VK_INDEX_TYPE_UINT32);
 
-        recording.bind_vertex_buffers({meshBuffer.vertex_buffer()}, {0});
-        recording.bind_index_buffer(meshBuffer.index_buffer(), 0, VK_INDEX_TYPE_UINT32);
+    for(auto& meshScene : m_meshScenes) {
+        // skip meshes not yet owned by the graphics queue
+        if(!m_pMeshes->is_ready(meshScene.mesh())) {
+            continue;
+        }
 
-        for(auto& primitive : meshBuffer.primitives()) {
+        const MeshRange& range = m_pMeshes->range(meshScene.mesh());
+        for(auto& primitive : meshScene.primitives()) {
+            DepthDrawConstants constants = {};
+            glm_mat4_copy(transform, constants.transform);
+            vertex_bounds(primitive.boundsMin, primitive.boundsMax, constants.boundsCenter, constants.boundsExtent);
             bind_point.push_constants(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                    0, sizeof(mat4), transform);
-            recording.draw_indexed(primitive.count, 1, primitive.offset, primitive.baseVertex, 0);
+                    0, sizeof(constants), &constants);
+            recording.draw_indexed(primitive.count, 1, range.indexOffset + primitive.offset,
+                                   range.vertexOffset + primitive.baseVertex, 0);
         }
     }
 }
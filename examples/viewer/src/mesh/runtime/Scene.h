@@ -6,21 +6,43 @@
 #include "Recording.hpp"
 #include "mesh/data/SceneData.hpp"
 #include "mesh/TextureStorage.h"
-#include "mesh/MeshBuffer.h"
+#include "mesh/MeshArena.h"
 #include "shaders/ShaderInputSet.h"
 #include "shaders/ShaderInputSetLayoutBuilder.hpp"
 #include "Material.h"
 #include "mesh/MaterialBuffer.h"
 #include "mesh/Transform.hpp"
 #include "mesh/TransformBuffer.hpp"
+#include "runtime/Camera.h"
 
 struct SceneObject {
     uint32_t m_transformIdx;
     uint32_t m_materialIdx;
 };
 
+/**
+ * Push constants of a primitive drawn by `Scene::draw`.
+ */
+struct DrawConstants {
+    uint32_t transformIdx;
+    uint32_t materialIdx;
+    uint32_t padding[2];
+    // bounds of the primitive, compact vertex positions are relative to them
+    float boundsCenter[4];
+    float boundsExtent[4];
+};
+
+/**
+ * Push constants of a primitive drawn by `Scene::draw_depth`.
+ */
+struct DepthDrawConstants {
+    mat4 transform;
+    float boundsCenter[4];
+    float boundsExtent[4];
+};
+
 class MeshScene {
-    MeshBuffer m_buffer;
+    MeshHandle m_mesh;
     std::vector<Primitive> m_primitives;
 
 public:
@@ -28,21 +50,15 @@ public:
         return m_primitives;
     }
 
-    inline const Buffer& vertex_buffer() const {
-        return m_buffer.vertex_buffer();
-    }
-    inline const Buffer& index_buffer() const {
-        return m_buffer.index_buffer();
+    /**
+     * Ranges of the mesh in the arena, primitives are relative to them.
+     */
+    inline MeshHandle mesh() const {
+        return m_mesh;
     }
 
-    MeshScene(MeshScene&& meshScene)  noexcept :
-            m_buffer(std::move(meshScene.m_buffer)),
-            m_primitives(std::move(meshScene.m_primitives)) {
-
-    }
-
-    MeshScene(MeshBuffer buffer, const std::vector<Primitive>& primitives) :
-            m_buffer(std::move(buffer)), m_primitives(std::move(primitives)) {
+    MeshScene(MeshHandle mesh, const std::vector<Primitive>& primitives) :
+            m_mesh(mesh), m_primitives(primitives) {
 
     }
 
@@ -60,7 +76,9 @@ class Scene {
 private:
     const Gpu* m_gpu;
 
-    std::vector<MeshScene> m_meshBuffers;
+    // geometry of all the meshes, drawn with a single bind
+    MeshArena* m_pMeshes;
+    std::vector<MeshScene> m_meshScenes;
 
     /* material buffer */
     MaterialBuffer m_materialBuffer;
@@ -70,10 +88,11 @@ private:
     Buffer m_lightBuffer;
     uint32_t m_numLights;
 
-    ShaderInputSet m_textureInputSet;
-
-    BufferBusWriter m_bufferWriter;
-    ImageBusWriter m_textureWriter;
+    // one for each buffer of the render graph, rewritten before the buffer
+    // records after the textures changed
+    std::vector<ShaderInputSet> m_inputSets;
+    std::vector<uint64_t> m_inputSetVersions;
+    uint64_t m_inputVersion;
 
     VkSampler m_textureSampler;
 
@@ -81,8 +100,19 @@ private:
 
     std::vector<uint32_t> load_materials(const SceneData* pData);
 
+    void write_input_set(uint32_t bufferIdx);
+
 public:
-    Scene(const Gpu* gpu, const SceneData *pData);
+    Scene(const Gpu* gpu, UniformAllocator* pUniforms, MeshArena* pMeshes, const SceneData *pData);
+
+    // Forbid copy, textures notify the scene through a pointer to it
+    Scene(const Scene&) = delete;
+
+    /**
+     * Scene with geometry the loader already wrote into the arena as `mesh`.
+     */
+    Scene(const Gpu* gpu, UniformAllocator* pUniforms, MeshArena* pMeshes, const SceneData *pData,
+          MeshHandle mesh);
 
     uint32_t push_material(const SceneData *pData, const MaterialData& material);
 
@@ -90,7 +120,16 @@ public:
 
     void add_scene_data(const SceneData *pData);
 
-    void draw(const lft::Recording& recording, const lft::RecordingBindPoint bind_point);
+    /**
+     * @param bufferIdx buffer of the render graph the draw is recorded for
+     */
+    void draw(const lft::Recording& recording, const lft::RecordingBindPoint bind_point, uint32_t bufferIdx);
+
+    /**
+     * Requests levels of the textures by the size of their materials on the
+     * screen and streams them in. Called once per frame before recording.
+     */
+    void stream_textures(const Camera& camera, float viewportHeight);
 
     void draw_depth(const lft::Recording& recording, const lft::RecordingBindPoint bind_point, mat4 transform);
 
@@ -99,6 +138,6 @@ public:
                 /* material buffer */
                 .uniform_buffer(0, VK_SHADER_STAGE_FRAGMENT_BIT)
                 /* color texture */
-                .n_images(1, 128, VK_SHADER_STAGE_FRAGMENT_BIT);
+                .n_images(1, MAX_MATERIAL_TEXTURES, VK_SHADER_STAGE_FRAGMENT_BIT);
     }
 };
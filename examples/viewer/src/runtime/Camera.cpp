@@ -5,10 +5,9 @@
 #include "Camera.h"
 
 #include <utility>
-#include "resources/GpuAllocator.h"
 
-Camera::Camera(const Gpu* gpu, float aspect):
-        m_gpu(gpu)/* , m_resource("camera", VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) */ {
+Camera::Camera(const Gpu* gpu, UniformAllocator* pUniforms, float aspect):
+        m_gpu(gpu), m_pUniforms(pUniforms)/* , m_resource("camera", VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) */ {
 
     glm_mat4_identity(data.view);
     glm_mat4_identity(data.projection);
@@ -18,32 +17,14 @@ Camera::Camera(const Gpu* gpu, float aspect):
     glm_lookat(eye, center, up, data.view);
     glm_perspective(glm_rad(60.0f), aspect, 0.1f, 1000.0f, data.projection);
 
-	MemoryAllocationInfo allocInfo = {
-		.usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
-		.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-	};
-
-    BufferCreateInfo bufferInfo = {
-            .size = sizeof(data),
-            .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            .isExclusive = true
-    };
-
-    m_gpu->memory()->create_buffer(&bufferInfo, &allocInfo, &m_buffer);
-
-    void *pData = nullptr;
-    m_gpu->memory()->map(m_buffer.allocation, &pData);
-
-    memcpy(pData, &data, sizeof(data));
-
-    m_gpu->memory()->unmap(m_buffer.allocation);
-
     /* m_resource.set_offset(0)
             .set_size(sizeof(data)); */
 
     glm_quat(m_rotation, 0, 0.0f, 0.0f, 1.0f);
     glm_vec3_copy(center, m_position);
     glm_vec3_copy(center, data.position);
+
+    m_offset = m_pUniforms->push(data);
 }
 
 void Camera::update() {
@@ -52,10 +33,7 @@ void Camera::update() {
     glm_quat_rotate(data.view, m_rotation, data.view);
     glm_translate(data.view, m_position);
 
-    void *pData;
-    m_gpu->memory()->map(m_buffer.allocation, &pData);
-    memcpy(pData, &data, sizeof(data));
-    m_gpu->memory()->unmap(m_buffer.allocation);
+    m_offset = m_pUniforms->push(data);
 }
 
 void Camera::move(vec3 velocity)  {
@@ -2,33 +2,48 @@
 
 #include <cstring>
 #include "Gpu.hpp"
+#include "resources/UniformAllocator.hpp"
 #include "cglm/mat4.h"
 #include "cglm/cglm.h"
 
 class Camera {
-private:
-    const Gpu* m_gpu;
-
-    struct {
+public:
+    struct Data {
         mat4 projection;
         mat4 view;
         vec4 position;
-    } data;
+    };
 
-    Buffer m_buffer;
+private:
+    const Gpu* m_gpu;
+    UniformAllocator* m_pUniforms;
+
+    Data data;
+
+    // offset of this frame's data in the uniform ring
+    uint32_t m_offset;
 
     vec3 m_position;
     vec4 m_rotation;
 
 public:
-    [[nodiscard]] inline const Buffer& buffer() const {
-        return m_buffer;
-    }
+    /**
+     * Dynamic offset to bind the uniform ring with.
+     */
+    GET(m_offset, offset);
+
+    /**
+     * Matrices of the last update.
+     */
+    REF(data, matrices);
 
     // BufferResourceLayout m_resource;
 
-    Camera(const Gpu* gpu, float aspect);
+    Camera(const Gpu* gpu, UniformAllocator* pUniforms, float aspect);
 
+    /**
+     * Pushes camera data for the next frame into the uniform ring.
+     */
     void update();
 
     void move(vec3 velocity);
@@ -0,0 +1,64 @@
+#include "MemoryPanel.h"
+
+#include "imgui.h"
+#include "resources/Defragmenter.hpp"
+
+static float to_mib(VkDeviceSize size) {
+    return (float)size / (1024.0f * 1024.0f);
+}
+
+void MemoryPanel::draw() const {
+    auto statistics = m_gpu->memory()->statistics();
+
+    ImGui::Begin("GPU Memory");
+
+    ImGui::Text("Budget: %s", m_gpu->is_memory_budget_enabled() ?
+        "VK_EXT_memory_budget" : "estimated");
+
+    for(uint32_t heap_idx = 0; heap_idx < statistics.heaps.size(); heap_idx++) {
+        auto& heap = statistics.heaps[heap_idx];
+        float fraction = heap.budget == 0 ? 0.0f : (float)heap.usage / (float)heap.budget;
+
+        ImGui::Text("Heap %u (%s)", heap_idx, heap.is_device_local ? "device" : "host");
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.1f / %.1f MiB", to_mib(heap.usage), to_mib(heap.budget));
+        ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f), overlay);
+        ImGui::Text("Peak: %.1f MiB", to_mib(heap.peak_usage));
+    }
+
+    if(ImGui::BeginTable("categories", 5)) {
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("MiB");
+        ImGui::TableSetupColumn("Peak count");
+        ImGui::TableSetupColumn("Peak MiB");
+        ImGui::TableHeadersRow();
+
+        for(uint32_t category = 0; category < MEMORY_CATEGORY_COUNT; category++) {
+            auto& stats = statistics.categories[category];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(memory_category_name((MemoryCategory)category));
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", stats.allocation_count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", to_mib(stats.size));
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", stats.peak_allocation_count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", to_mib(stats.peak_size));
+        }
+
+        ImGui::EndTable();
+    }
+
+    Defragmenter* defragmenter = m_gpu->defragmenter();
+    if(defragmenter->is_running()) {
+        ImGui::Text("Defragmenting...");
+    } else if(ImGui::Button("Defragment")) {
+        defragmenter->start();
+    }
+    ImGui::Text("Moved resources: %u", defragmenter->num_moved());
+
+    ImGui::End();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Gpu.hpp"
+
+/**
+ * ImGui window with usage of GPU memory heaps and allocations by category.
+ */
+class MemoryPanel {
+private:
+    const Gpu* m_gpu;
+
+public:
+    explicit MemoryPanel(const Gpu* gpu) :
+    m_gpu(gpu) {
+
+    }
+
+    /**
+     * Must be called between ImGui::NewFrame and ImGui::Render.
+     */
+    void draw() const;
+};
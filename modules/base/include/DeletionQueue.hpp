@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include "resources/UploadService.hpp"
+
+class Gpu;
+
+/**
+ * Defers destruction of GPU objects until submissions, that might still use
+ * them, are finished. Frames number submissions to the graphics queue in
+ * order, rendered frames as well as side submissions like mip generation or
+ * copies. Each entry also waits for the uploads recorded before it was
+ * retired, those run on the transfer queue.
+ *
+ * Objects can be retired from any thread.
+ */
+class DeletionQueue {
+private:
+    struct Entry {
+        // last frame submitted before the object was retired
+        uint64_t frame;
+        // last upload recorded before the object was retired
+        UploadTicket ticket;
+        std::function<void()> destroy;
+    };
+
+    const Gpu* m_gpu;
+
+    mutable std::mutex m_mutex;
+    std::deque<Entry> m_entries;
+    uint64_t m_frame = 0;
+    uint64_t m_completedFrame = 0;
+
+public:
+    explicit DeletionQueue(const Gpu* gpu);
+
+    // Forbid copy, the entries are owned
+    DeletionQueue(const DeletionQueue&) = delete;
+
+    [[nodiscard]] uint64_t frame() const;
+
+    /**
+     * Last frame known to be finished by the GPU.
+     */
+    [[nodiscard]] uint64_t completed_frame() const;
+
+    /**
+     * Retires an object. It is destroyed once all the frames submitted and
+     * uploads recorded so far finish.
+     */
+    void push(std::function<void()> destroy);
+
+    /**
+     * Marks a submission to the graphics queue. Returns its number, to be
+     * passed to `collect` once the submission's fence is signaled.
+     */
+    uint64_t next_frame();
+
+    /**
+     * Destroys objects retired before the frame was submitted, whose uploads
+     * are complete. A signaled fence finishes all the earlier submissions of
+     * the queue too.
+     */
+    void collect(uint64_t finished_frame);
+
+    /**
+     * Destroys all retired objects. Device must be idle.
+     */
+    void flush();
+};
@@ -3,6 +3,7 @@
 #include "result.hpp"
 #include "props.hpp"
 #include "Instance.hpp"
+#include "DeletionQueue.hpp"
 #include "resources/GpuAllocator.h"
 
 #include <vector>
@@ -10,6 +11,13 @@
 #include <optional>
 #include <stdexcept>
 
+class UploadService;
+class Defragmenter;
+
+namespace lft {
+class FrameArena;
+}
+
 /**
  * Abstract interface for a GPU
  */
@@ -37,6 +45,9 @@ private:
 
     VkCommandBuffer m_tracyCommandBuffer;
 
+    bool m_isMemoryBudgetEnabled = false;
+    bool m_isTextureCompressionBCEnabled = false;
+
     std::vector<int32_t> get_queues(std::optional<VkSurfaceKHR> surface);
 
     Result create_logical_device(std::optional<VkSurfaceKHR> surface);
@@ -45,7 +56,11 @@ private:
 
     Result create_descriptor_pool();
 
+    std::unique_ptr<DeletionQueue> m_pDeletionQueue;
     std::unique_ptr<GpuAllocator> m_pAllocator;
+    std::unique_ptr<UploadService> m_pUploadService;
+    std::unique_ptr<Defragmenter> m_pDefragmenter;
+    std::unique_ptr<lft::FrameArena> m_pFrameArena;
 
 public:
 	GET(m_gpu, gpu);
@@ -65,8 +80,40 @@ public:
 
     GET(m_tracyCommandBuffer, tracy_cmd_buf);
 
+    /**
+     * VK_EXT_memory_budget is enabled, the allocator reports real heap budgets.
+     */
+    GET(m_isMemoryBudgetEnabled, is_memory_budget_enabled);
+
+    /**
+     * BC1-7 formats can be sampled, compressed textures are preferred.
+     */
+    GET(m_isTextureCompressionBCEnabled, is_texture_compression_bc_enabled);
+
     GET(m_pAllocator.get(), memory);
 
+    /**
+     * Objects that might still be in use by the GPU are retired here instead
+     * of being destroyed right away.
+     */
+    GET(m_pDeletionQueue.get(), deletion_queue);
+
+    /**
+     * Batches uploads of all the writers into transfer queue submissions.
+     */
+    GET(m_pUploadService.get(), uploads);
+
+    /**
+     * Moves tracked resources to release fragmented memory.
+     */
+    GET(m_pDefragmenter.get(), defragmenter);
+
+    /**
+     * Memory for CPU temporaries of the frame being recorded, reset when the
+     * frame starts again.
+     */
+    GET(m_pFrameArena.get(), frame_arena);
+
 	explicit
 	Gpu(std::unique_ptr<const Instance> instance, std::optional<VkSurfaceKHR> surface);
 
@@ -85,10 +132,15 @@ public:
 		return m_transferQueueIdx;
 	}
 
+	inline uint32_t graphics_queue_idx() const {
+		return m_graphicsQueueIdx;
+	}
+
 
     void enqueue_present(VkPresentInfoKHR *pPresentInfo) const;
     void enqueue_graphics(VkSubmitInfo2 *pSubmitInfo, VkFence fence) const;
     void enqueue_transfer(VkSubmitInfo *pSubmitInfo, VkFence fence) const;
+    void enqueue_transfer(VkSubmitInfo2 *pSubmitInfo, VkFence fence) const;
 
     inline VkSemaphore create_semaphore() const {
         VkSemaphoreCreateInfo semaphore_info = {
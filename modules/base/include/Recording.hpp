@@ -1,8 +1,11 @@
 #pragma once
 
+#include <initializer_list>
+#include <memory_resource>
 #include <optional>
 #include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include "shaders/Pipeline.hpp"
 
@@ -28,6 +31,15 @@ public:
             VkDescriptorSet descriptor_set
     ) const;
 
+    /**
+     * Binds descriptor set with dynamic uniform buffers at the given offsets.
+     */
+    const RecordingBindPoint& bind_descriptor_set(
+            uint32_t set,
+            VkDescriptorSet descriptor_set,
+            std::initializer_list<uint32_t> dynamic_offsets
+    ) const;
+
 
     const RecordingBindPoint& bind_descriptor_sets(
 	    uint32_t first_set,
@@ -44,11 +56,17 @@ class Recording {
 private:
     VkCommandBuffer m_cmdbuf;
     std::optional<RecordingBindPoint> m_latest_graphics_pipeline;
+    // temporaries of the recorded commands
+    std::pmr::memory_resource* m_arena;
 
 public:
     GET(m_cmdbuf, cmdbuf);
+    GET(m_arena, arena);
 
-    Recording(VkCommandBuffer cmdbuf) : m_cmdbuf(cmdbuf) {}
+    Recording(VkCommandBuffer cmdbuf,
+              std::pmr::memory_resource* arena = std::pmr::get_default_resource()) :
+        m_cmdbuf(cmdbuf),
+        m_arena(arena) {}
 
     /**
      * Binds pipeline. Will bind all the descriptor sets, etc. to it after.
@@ -86,14 +104,14 @@ public:
     }
 
     inline const Recording& bind_vertex_buffers(
-            const std::vector<Buffer> buffers, 
-            std::vector<std::size_t> offsets
+            std::initializer_list<Buffer> buffers,
+            std::initializer_list<VkDeviceSize> offsets
     ) const {
-        std::vector<VkBuffer> vertex_buffers(buffers.size());
+        std::pmr::vector<VkBuffer> vertex_buffers(buffers.size(), m_arena);
         std::transform(buffers.begin(), buffers.end(), vertex_buffers.begin(),
                 [](const Buffer& buffer) { return buffer.buf; });
 
-        vkCmdBindVertexBuffers(m_cmdbuf, 0, vertex_buffers.size(), vertex_buffers.data(), offsets.data());
+        vkCmdBindVertexBuffers(m_cmdbuf, 0, vertex_buffers.size(), vertex_buffers.data(), offsets.begin());
         return *this;
     }
 
@@ -1,37 +1,129 @@
 #pragma once
 
 #include "Gpu.hpp"
+#include "resources/UploadService.hpp"
 
+#include <optional>
 #include <vector>
 
 /**
- * Writes data to a buffer by using a staging buffer
+ * Writes data to a buffer by using a staging buffer.
+ *
+ * Staging buffer is split into a ring of segments. Filled segment is recorded
+ * into the upload service and writing continues into the next one, so CPU
+ * waits only when it catches up with the transfers still in flight.
+ *
+ * Targets in host visible memory are written directly, the staging buffer is
+ * created only once some target needs it.
  */
 class BufferBusWriter {
 private:
+    struct Segment {
+        size_t offset;
+        size_t usedSize;
+        // ticket of the last upload from the segment
+        UploadTicket ticket;
+        // target and region, adjacent regions to the same target are merged
+        std::vector<std::pair<VkBuffer, VkBufferCopy>> writes;
+    };
+
     const Gpu* m_gpu;
 
     Buffer m_stagingBuffer;
     size_t m_busSize;
-	VkCommandBuffer m_stagingCommandBuffer;
+    size_t m_segmentSize;
 
     void *m_pData;
-    size_t m_unflushedSize;
 
-	uint32_t m_numWrites;
-	std::vector<std::pair<Buffer*, VkBufferCopy>> m_writes;
+    std::vector<Segment> m_segments;
+    uint32_t m_segmentIdx;
+
+    // ticket of the last upload recorded by the writer
+    UploadTicket m_lastTicket;
+
+    // host visible target range handed out by `map`, flushed once written
+    struct MappedRange {
+        GpuAllocation allocation;
+        size_t offset;
+        size_t size;
+    };
+    std::optional<MappedRange> m_mappedRange;
 
-	VkFence m_fence;
+    /**
+     * Stage written data is going to be read in by the consumer.
+     */
+    VkPipelineStageFlags2KHR m_dstStage;
+    VkAccessFlags2KHR m_dstAccess;
 
-	int create_staging_command_buffer();
 	int create_staging_buffer(size_t size);
 
+    /**
+     * Copies data right into the target when its memory is host visible.
+     */
+    bool write_direct(const Buffer* pTarget, const void *pData, size_t offset, size_t size);
+
+    /**
+     * Makes the current segment ready for writing, waiting for its last upload.
+     * Moves to the next segment when less than `minSize` bytes are left.
+     */
+    void acquire_segment(size_t minSize = 1);
+
+    /**
+     * Schedules copy of a staging range, merges it with the previous one when adjacent.
+     */
+    void record_region(Segment& segment, VkBuffer target, size_t srcOffset, size_t dstOffset, size_t size);
+
+    void flush_mapped_range();
+
 public:
-    BufferBusWriter(const Gpu* gpu, size_t size);
+    /**
+     * @param size size of the whole staging buffer
+     * @param numSegments number of segments the staging buffer is split into
+     * @param dstStage stages the written buffers are used in
+     * @param dstAccess accesses the written buffers are used with
+     */
+    BufferBusWriter(const Gpu* gpu, size_t size, uint32_t numSegments = 3,
+                    VkPipelineStageFlags2KHR dstStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+                    VkAccessFlags2KHR dstAccess = VK_ACCESS_2_MEMORY_READ_BIT_KHR);
     ~BufferBusWriter();
 
-    void write(Buffer* pTarget, void *pData, size_t offset, size_t size);
-    void flush();
+    // Forbid copy, the staging buffer is owned
+    BufferBusWriter(const BufferBusWriter&) = delete;
+
+    /**
+     * Copies data into staging memory and schedules transfer to the target.
+     * Full segments are recorded into the upload service right away.
+     * Host visible targets are written immediately, they must not be in use by the GPU.
+     */
+    void write(const Buffer* pTarget, const void *pData, size_t offset, size_t size);
+
+    /**
+     * Exposes memory data of a target range can be produced in, without an
+     * intermediate copy. It is the target memory itself when host visible,
+     * otherwise staging memory uploaded the same way as by `write`.
+     * Data must be written before the next call to the writer.
+     * @param elementSize returned size is a multiple of it, must fit into a segment,
+     * staging memory at `ppData` is aligned to it
+     * @return number of bytes available at `ppData`, might be less than `size`,
+     * 0 only when `size` is less than an element
+     */
+    size_t map(const Buffer* pTarget, size_t offset, size_t size, void** ppData, size_t elementSize = 1);
+
+    /**
+     * Redirects writes not recorded yet from a buffer to its replacement,
+     * used when the target is moved.
+     */
+    void replace_target(VkBuffer from, VkBuffer to);
+
+    /**
+     * Records pending writes into the upload service, that submits them
+     * together with uploads of other writers.
+     * @return ticket of the upload finishing the writes
+     */
+    UploadTicket flush();
 
+    /**
+     * Submits pending writes and waits for all of them.
+     */
     void wait();
 };
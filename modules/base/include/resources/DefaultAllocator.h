@@ -2,15 +2,45 @@
 
 #include "resources/GpuAllocator.h"
 
+#include <mutex>
+
 #include "vk_mem_alloc.h"
 
+class DeletionQueue;
+
 class DefaultAllocator : public GpuAllocator {
 private:
     VmaAllocator m_allocator;
+    DeletionQueue* m_pDeletionQueue;
+
+    // statistics are shared by threads creating resources
+    std::mutex m_statisticsMutex;
+    std::array<MemoryCategoryStatistics, MEMORY_CATEGORY_COUNT> m_categories{};
+    std::vector<VkDeviceSize> m_peakUsages;
+    std::vector<bool> m_isOverBudget;
+    BudgetExceededCallback m_budgetCallback;
+
+    // null when no defragmentation is running
+    VmaDefragmentationContext m_defragmentation;
+    VmaDefragmentationPassMoveInfo m_defragmentationPass;
+
+    void track_allocation(VmaAllocation allocation, MemoryCategory category);
+
+    void untrack_allocation(VmaAllocation allocation);
+
+    /**
+     * Updates peak usages. Returns heaps that went over budget since the last check.
+     */
+    std::vector<std::pair<uint32_t, MemoryHeapBudget>> check_budgets();
 
 public:
     explicit DefaultAllocator(Gpu *pGpu);
 
+    ~DefaultAllocator() override;
+
+    // Forbid copy, the VMA allocator is owned
+    DefaultAllocator(const DefaultAllocator&) = delete;
+
     int create_image(ImageCreateInfo *pImageInfo,
 					 MemoryAllocationInfo *pAllocInfo,
 					 Image *pOut) override;
@@ -19,12 +49,9 @@ public:
 					  MemoryAllocationInfo *pAllocInfo,
 					  Buffer *pOut) override;
 
-    void destroy_buffer(Buffer *pBuffer) override {
-
-    }
-    void destroy_image(Image *pImage) override {
+    void destroy_buffer(Buffer *pBuffer) override;
 
-    }
+    void destroy_image(Image *pImage) override;
 
     inline void map(GpuAllocation& allocation, void **pData) override {
         vmaMapMemory(m_allocator, allocation.allocation, pData);
@@ -38,4 +65,27 @@ public:
 		vmaFlushAllocation(m_allocator, allocation.allocation, offset, size);
         return vmaInvalidateAllocation(m_allocator, allocation.allocation, offset, size);
 	}
+
+    void* mapped_data(const GpuAllocation& allocation) override;
+
+    MemoryStatistics statistics() override;
+
+    void set_budget_callback(BudgetExceededCallback callback) override {
+        std::lock_guard lock(m_statisticsMutex);
+        m_budgetCallback = std::move(callback);
+    }
+
+    bool begin_defragmentation(VkDeviceSize maxBytesPerPass) override;
+
+    std::vector<DefragmentationMove> begin_defragmentation_pass() override;
+
+    bool end_defragmentation_pass(const std::vector<DefragmentationMove>& moves) override;
+
+    VkDeviceSize end_defragmentation() override;
+
+    VkResult create_moved_buffer(const BufferCreateInfo *pBufferInfo,
+                                 const DefragmentationMove& move, VkBuffer *pOut) override;
+
+    VkResult create_moved_image(const ImageCreateInfo *pImageInfo,
+                                const DefragmentationMove& move, VkImage *pOut) override;
 };
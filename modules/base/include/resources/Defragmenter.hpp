@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <volk.h>
+
+#include "props.hpp"
+#include "resources/Buffer.hpp"
+#include "resources/GpuAllocator.h"
+#include "resources/Image.hpp"
+
+class Gpu;
+
+/**
+ * Called with the resource recreated in the new place of a moved allocation.
+ * The old one stays valid for frames submitted before the call.
+ */
+typedef std::function<void(VkBuffer buffer)> BufferMovedCallback;
+typedef std::function<void(VkImage image)> ImageMovedCallback;
+
+/**
+ * Incrementally moves allocations to release sparsely used memory blocks.
+ *
+ * Only tracked resources are moved, their owners are told about the new
+ * handles through callbacks. Mapped allocations stay in place, the host
+ * writes into them directly. Each `update` moves a bounded number of bytes
+ * and waits for the copy, so nothing is written to the old resources after
+ * they are copied. Old resources are destroyed and their memory reused once
+ * the frames submitted before the move finish.
+ *
+ * Copies run on the graphics queue, the tracked resources are owned by it.
+ */
+class Defragmenter {
+private:
+    struct TrackedBuffer {
+        VkBuffer buffer;
+        BufferCreateInfo info;
+        BufferMovedCallback onMoved;
+    };
+
+    struct TrackedImage {
+        VkImage image;
+        ImageCreateInfo info;
+        // layout the image is kept in between uses
+        VkImageLayout layout;
+        ImageMovedCallback onMoved;
+    };
+
+    // pass whose old resources might still be used by frames in flight
+    struct RetiringPass {
+        uint64_t frame;
+        std::vector<DefragmentationMove> moves;
+        std::vector<VkBuffer> buffers;
+        std::vector<VkImage> images;
+    };
+
+    const Gpu* m_gpu;
+    VkDeviceSize m_maxBytesPerPass;
+
+    std::unordered_map<VmaAllocation, TrackedBuffer> m_buffers;
+    std::unordered_map<VmaAllocation, TrackedImage> m_images;
+
+    bool m_isRunning;
+    std::optional<RetiringPass> m_retiringPass;
+    // resources moved since the start
+    uint32_t m_numMoved;
+
+    VkCommandBuffer m_commandBuffer;
+    VkFence m_fence;
+
+    /**
+     * Records copy of a tracked resource into its new place.
+     * @return false when the resource could not be recreated
+     */
+    bool record_buffer_move(const DefragmentationMove& move, TrackedBuffer& tracked, VkBuffer* pOut);
+    bool record_image_move(const DefragmentationMove& move, TrackedImage& tracked, VkImage* pOut);
+
+    /**
+     * Moves allocations proposed by the next pass.
+     * @return false when there is nothing left to move
+     */
+    bool run_pass();
+
+    /**
+     * Destroys old resources of the retiring pass and ends it.
+     */
+    void end_pass();
+
+public:
+    GET(m_isRunning, is_running);
+    GET(m_numMoved, num_moved);
+
+    /**
+     * @param maxBytesPerPass bound of bytes moved by a single `update`
+     */
+    Defragmenter(const Gpu* gpu, VkDeviceSize maxBytesPerPass = 16 * 1024 * 1024);
+
+    ~Defragmenter();
+
+    // Forbid copy, the command buffer is owned
+    Defragmenter(const Defragmenter&) = delete;
+
+    /**
+     * Lets the buffer be moved. `info` must describe how the buffer was created.
+     */
+    void track_buffer(const Buffer& buffer, const BufferCreateInfo& info, BufferMovedCallback onMoved);
+
+    /**
+     * Lets the image be moved. Image must be in `layout` whenever `update` is called.
+     * Images are swapped with the graphics queue idle, so the callback can
+     * update descriptor sets referencing the image.
+     */
+    void track_image(const Image& image, const ImageCreateInfo& info, VkImageLayout layout,
+                     ImageMovedCallback onMoved);
+
+    /**
+     * Call before destroying a tracked resource.
+     */
+    void untrack(const GpuAllocation& allocation);
+
+    /**
+     * Starts defragmentation, done over the following updates.
+     */
+    void start();
+
+    /**
+     * Runs the next pass of a started defragmentation. Call once per frame,
+     * outside of command buffer recording.
+     */
+    void update();
+};
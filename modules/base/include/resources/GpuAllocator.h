@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <vector>
+
 #include "Image.hpp"
 #include "Buffer.hpp"
 #include "GpuAllocation.h"
@@ -20,19 +24,84 @@ struct ImageCreateInfo {
 
     uint32_t arrayLayers;
     uint32_t mipLevels;
+
+    // like mutable format for views of another format
+    VkImageCreateFlags flags;
 };
 
 enum MemoryUsage {
     MEMORY_USAGE_AUTO = 0,
     MEMORY_USAGE_AUTO_PREFER_DEVICE = 1,
-    MEMORY_USAGE_AUTO_PREFER_HOST = 2
+    MEMORY_USAGE_AUTO_PREFER_HOST = 2,
+    // only for transient attachments, fails on devices without lazily allocated memory
+    MEMORY_USAGE_GPU_LAZILY_ALLOCATED = 3
+};
+
+/**
+ * What the memory is used for. Only affects statistics.
+ */
+enum MemoryCategory {
+    MEMORY_CATEGORY_OTHER = 0,
+    // images and buffers allocated by the render graph
+    MEMORY_CATEGORY_ATTACHMENT = 1,
+    MEMORY_CATEGORY_TEXTURE = 2,
+    MEMORY_CATEGORY_MESH = 3,
+    MEMORY_CATEGORY_STAGING = 4,
+    MEMORY_CATEGORY_UNIFORM = 5,
+    MEMORY_CATEGORY_COUNT = 6
 };
 
+const char* memory_category_name(MemoryCategory category);
+
 struct MemoryAllocationInfo {
     MemoryUsage usage;
 	VkMemoryPropertyFlags requiredFlags;
+	MemoryCategory category = MEMORY_CATEGORY_OTHER;
+	// buffer is placed into device local memory visible to host when the
+	// device has some (UMA, resizable BAR) and stays mapped, see `mapped_data`
+	bool isHostWritePreferred = false;
+};
+
+struct MemoryHeapBudget {
+    // bytes allocated from the heap by the whole process
+    VkDeviceSize usage;
+    // bytes the process can allocate from the heap without hurting performance
+    VkDeviceSize budget;
+    VkDeviceSize peak_usage;
+    bool is_device_local;
+};
+
+struct MemoryCategoryStatistics {
+    uint32_t allocation_count;
+    uint32_t peak_allocation_count;
+    VkDeviceSize size;
+    VkDeviceSize peak_size;
+};
+
+struct MemoryStatistics {
+    std::vector<MemoryHeapBudget> heaps;
+    std::array<MemoryCategoryStatistics, MEMORY_CATEGORY_COUNT> categories;
+};
+
+/**
+ * Allocation moved by a defragmentation pass. The resource bound to it is
+ * recreated on `destination` and its content copied there. Once the pass
+ * ends, `allocation` keeps its handle but refers to the new place.
+ */
+struct DefragmentationMove {
+    GpuAllocation allocation;
+    // temporary allocation the new resource is bound to
+    GpuAllocation destination;
+    // set to keep the allocation in place
+    bool isIgnored;
 };
 
+/**
+ * Called after an allocation pushed usage of the heap over its budget.
+ * Not called again for the same heap until its usage drops under the budget.
+ */
+typedef std::function<void(uint32_t heap_idx, const MemoryHeapBudget& heap)> BudgetExceededCallback;
+
 class Gpu;
 /**
  * Allocating of memory
@@ -41,6 +110,8 @@ class GpuAllocator {
 protected:
 
 public:
+    virtual ~GpuAllocator() = default;
+
     virtual int create_buffer(BufferCreateInfo *pBufferInfo, 
 							  MemoryAllocationInfo *pAllocInfo, Buffer *pOut) = 0;
     virtual int create_image(ImageCreateInfo *pImageInfo,
@@ -49,9 +120,60 @@ public:
     virtual void map(GpuAllocation& allocation, void **pData) = 0;
     virtual void unmap(GpuAllocation& allocation) = 0;
 
+    /**
+     * Frees the resource once the frames submitted so far are finished.
+     */
     virtual void destroy_buffer(Buffer *pBuffer) = 0;
     virtual void destroy_image(Image *pImage) = 0;
 
 	virtual VkResult flush(GpuAllocation& allocation,
 						   size_t offset, size_t size) = 0;
+
+    /**
+     * Pointer to persistently mapped memory of the allocation, data can be
+     * written there directly. Null when the memory is not host visible.
+     */
+    virtual void* mapped_data(const GpuAllocation& allocation) = 0;
+
+    /**
+     * Usage and budget of each memory heap with allocation counts by category.
+     * Budget is exact when VK_EXT_memory_budget is enabled, estimated otherwise.
+     */
+    virtual MemoryStatistics statistics() = 0;
+
+    virtual void set_budget_callback(BudgetExceededCallback callback) = 0;
+
+    /**
+     * Starts moving allocations to release sparsely used memory blocks.
+     * @param maxBytesPerPass bound of the bytes moved by a single pass
+     * @return false when a defragmentation is already running
+     */
+    virtual bool begin_defragmentation(VkDeviceSize maxBytesPerPass) = 0;
+
+    /**
+     * Moves proposed by the next pass. Moves not ignored must be done by the
+     * time the pass ends. Empty when there is nothing left to move.
+     */
+    virtual std::vector<DefragmentationMove> begin_defragmentation_pass() = 0;
+
+    /**
+     * Old resources of the moved allocations must be destroyed and not used by the GPU anymore.
+     * @return true when the defragmentation finished
+     */
+    virtual bool end_defragmentation_pass(const std::vector<DefragmentationMove>& moves) = 0;
+
+    /**
+     * Finishes the defragmentation, also when passes are left.
+     * @return bytes freed by the defragmentation
+     */
+    virtual VkDeviceSize end_defragmentation() = 0;
+
+    /**
+     * Creates a buffer bound to the destination of a move.
+     */
+    virtual VkResult create_moved_buffer(const BufferCreateInfo *pBufferInfo,
+                                         const DefragmentationMove& move, VkBuffer *pOut) = 0;
+
+    virtual VkResult create_moved_image(const ImageCreateInfo *pImageInfo,
+                                        const DefragmentationMove& move, VkImage *pOut) = 0;
 };
@@ -29,8 +29,12 @@ public:
 
     }
 
+	/**
+	 * @param usage limits usage of the view, when the image has usages its format
+	 * does not support, 0 keeps the usage of the image
+	 */
 	ImageView create_view(const Gpu* gpu, VkFormat format,
-						  VkImageSubresourceRange subresource);
+						  VkImageSubresourceRange subresource, VkImageUsageFlags usage = 0);
 
     void set_debug_name(const Gpu* gpu, const std::string& name) const;
 };
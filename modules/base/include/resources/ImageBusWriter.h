@@ -1,54 +1,104 @@
 #pragma once
 
 #include "Gpu.hpp"
+#include "resources/UploadService.hpp"
 
+#include <vector>
+
+/**
+ * Writes data to images by using a staging buffer.
+ *
+ * Staging buffer is split into a ring of segments like in `BufferBusWriter`.
+ * Filled segment is recorded into the upload service and writing continues
+ * into the next one, so images are copied while the following are written.
+ * Writes larger than a segment get a staging buffer of their own, released
+ * once their upload finishes.
+ *
+ * Written images are released to the graphics queue in shader read only layout.
+ */
 class ImageBusWriter {
 private:
+    struct Write {
+        VkImage target;
+        VkBufferImageCopy region;
+    };
+
+    struct Segment {
+        size_t offset;
+        size_t usedSize;
+        // ticket of the last upload from the segment
+        UploadTicket ticket;
+        std::vector<Write> writes;
+    };
+
+    // staging buffer of a single oversized write
+    struct DedicatedStaging {
+        Buffer buffer;
+        UploadTicket ticket;
+    };
+
     const Gpu* m_gpu;
-	
-	/**
-	 * Image to which we are writing
-	 */
-	Image *m_pTarget;
-	uint32_t m_formatSize;
-	uint32_t m_imageSize;
-	
 
 	/**
 	 * Intermediate staging buffer to pass data from heap 3 to heap 0
 	 */
 	Buffer m_stagingBuffer;
-	size_t m_stagingBufferSize;
-	VkCommandBuffer m_stagingCommandBuffer;
+    size_t m_segmentSize;
 
 	/**
 	 * Pointing to where the staging buffer is mapped
 	 */
 	void *m_pMappedData;
 
+    std::vector<Segment> m_segments;
+    uint32_t m_segmentIdx;
 
-	std::vector<VkBufferImageCopy> m_writes;
-	uint32_t m_numWrites;
+    std::vector<DedicatedStaging> m_dedicatedStagings;
 
-	VkFence m_fence;
+    // ticket of the last upload recorded by the writer
+    UploadTicket m_lastTicket;
 
-	int create_staging_buffer(size_t size);
+	Buffer create_staging_buffer(size_t size, void** ppMapped);
 
-	int create_staging_command_buffer();
+    /**
+     * Records layout transitions, copies and releases of the writes from a staging buffer.
+     */
+    void record_writes(VkCommandBuffer commandBuffer, VkBuffer staging, const std::vector<Write>& writes);
 
-	int create_fence();
+    void write_dedicated(VkImage target, VkBufferImageCopy region, const void *pData, size_t size);
+
+    /**
+     * Destroys dedicated staging buffers of finished uploads.
+     */
+    void release_dedicated();
 
 public:
-	ImageBusWriter(const Gpu* gpu, Image *pImage,
-				   VkExtent2D extent, uint32_t formatSize,
-				   size_t maxWrites);
+    /**
+     * @param size size of the whole staging buffer
+     * @param numSegments number of segments the staging buffer is split into
+     */
+	ImageBusWriter(const Gpu* gpu, size_t size, uint32_t numSegments = 3);
+
+    ~ImageBusWriter();
+
+    // Forbid copy, the staging buffer is owned
+    ImageBusWriter(const ImageBusWriter&) = delete;
 
-	void write(VkBufferImageCopy region, void *pData, size_t size);
+    /**
+     * Copies data into staging memory and schedules transfer to the target.
+     * Previous content of the written subresources is discarded.
+     * @param region `bufferOffset` is ignored, data is tightly packed at `pData`
+     */
+	void write(const Image* pTarget, VkBufferImageCopy region, const void *pData, size_t size);
 
-    void set_target(Image *pTarget) {
-        flush();
-        m_pTarget = pTarget;
-    }
+	/**
+	 * Records pending writes into the upload service.
+	 * @return ticket of the upload finishing the writes
+	 */
+	UploadTicket flush();
 
-	void flush();
+    /**
+     * Submits pending writes and waits for all of them.
+     */
+    void wait();
 };
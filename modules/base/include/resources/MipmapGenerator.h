@@ -1,24 +1,123 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 #include <volk.h>
 
 #include "Gpu.hpp"
+#include "resources/UploadService.hpp"
+#include "shaders/Shader.hpp"
 
+/**
+ * Generates mip levels from the base level with blits or a compute shader.
+ * Both need a graphics queue, so the generation is submitted there and waits
+ * for the upload of the base level on the GPU.
+ *
+ * Generations are queued and recorded together into a single submission.
+ * The compute shader reduces up to `DOWNSAMPLE_LEVELS` levels per dispatch,
+ * the dispatches of all queued images are recorded in passes with a single
+ * barrier between them.
+ */
 class MipmapGenerator {
+public:
+    // levels generated by a single dispatch of the downsample shader
+    static constexpr uint32_t DOWNSAMPLE_LEVELS = 5;
+
 private:
+    struct Submission {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        // deletion queue frame of the submission, identifies its generation
+        uint64_t frame;
+
+        // descriptors of the downsample dispatches, released with the fence
+        VkDescriptorPool descriptorPool;
+        std::vector<VkImageView> views;
+    };
+
+    struct Generation {
+        Image image;
+        VkImageLayout oldLayout;
+        VkExtent2D extent;
+        VkImageSubresourceRange range;
+        // format of the image when downsampled by the compute shader, undefined for blits
+        VkFormat format;
+    };
+
     const Gpu* m_gpu;
 
-    VkCommandBuffer m_commandBuffer;
+    VkDescriptorSetLayout m_downsampleSetLayout;
+    VkPipelineLayout m_downsampleLayout;
+    // null without the downsample shader
+    VkPipeline m_downsamplePipeline;
+
+    // reused once their fence is signaled
+    std::vector<Submission> m_submissions;
+
+    std::vector<Generation> m_generations;
+    // upload of the base levels of the queued generations
+    UploadTicket m_ticket;
+
+    Submission& take_submission();
 
-    VkFence m_fence;
+    /**
+     * Destroys the descriptors of a finished submission.
+     */
+    void release(Submission& submission);
 
-    VkFence create_fence(const Gpu* gpu);
+    void record(VkCommandBuffer commandBuffer, const Generation& generation);
 
-    VkCommandBuffer create_command_buffer(const Gpu* gpu);
+    /**
+     * Records the compute generations of the queue, pass after pass.
+     */
+    void record_downsamples(Submission& submission);
 
 public:
-    explicit MipmapGenerator(const Gpu* gpu);
+    /**
+     * @param pDownsampleShader compute shader reducing RGBA8 levels, images
+     * are generated with blits without it
+     */
+    explicit MipmapGenerator(const Gpu* gpu, const Shader* pDownsampleShader = nullptr);
+
+    ~MipmapGenerator();
+
+    // Forbid copy, the command buffers are owned
+    MipmapGenerator(const MipmapGenerator&) = delete;
+
+    /**
+     * Queues generation of the mip levels, recorded with the next `flush`.
+     * @param ticket upload of the base level to wait for
+     */
+    void generate(Image image, VkImageLayout oldLayout, VkExtent2D extent, VkImageSubresourceRange range,
+                  UploadTicket ticket = 0);
+
+    /**
+     * Images of the format can be generated by the compute shader. They need
+     * storage usage, sRGB ones also mutable format for UNORM views of the levels.
+     */
+    [[nodiscard]] bool is_downsampled(VkFormat format) const;
+
+    /**
+     * Queues generation of all the levels with the compute shader, falls
+     * back to blits for other formats.
+     */
+    void downsample(Image image, VkFormat format, VkImageLayout oldLayout, VkExtent2D extent, uint32_t levelCount,
+                    UploadTicket ticket = 0);
+
+    [[nodiscard]] size_t num_queued() const {
+        return m_generations.size();
+    }
+
+    /**
+     * Submits the queued generations to the graphics queue.
+     * @param ticket upload to wait for, in addition to those passed to `generate`
+     * @return generation of the submission, 0 when nothing was queued
+     */
+    uint64_t flush(UploadTicket ticket = 0);
 
-    uint32_t generate(Image image, VkImageLayout oldLayout, VkExtent2D extent, VkImageSubresourceRange range);
+    /**
+     * Checks the fence of the submission without blocking.
+     * @param generation returned by `flush`
+     */
+    bool is_complete(uint64_t generation);
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include <volk.h>
+
+#include "props.hpp"
+
+/**
+ * Suballocates offsets within a linear range of a fixed size. It only does
+ * bookkeeping, the memory itself is owned by the user.
+ *
+ * Free ranges are kept sorted by offset and adjacent ones are merged, the
+ * first range large enough is used.
+ */
+class RangeAllocator {
+private:
+    struct FreeRange {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    VkDeviceSize m_size;
+    VkDeviceSize m_freeSize;
+    std::vector<FreeRange> m_freeRanges;
+
+public:
+    GET(m_size, size);
+    GET(m_freeSize, free_size);
+
+    explicit RangeAllocator(VkDeviceSize size);
+
+    /**
+     * @return offset of the allocated range, empty when no free range is large enough
+     */
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size);
+
+    void free(VkDeviceSize offset, VkDeviceSize size);
+
+    /**
+     * Marks everything free again.
+     */
+    void reset();
+
+    /**
+     * Size of the largest range that can be allocated at once.
+     */
+    [[nodiscard]] VkDeviceSize largest_free_range() const;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <volk.h>
+
+#include "props.hpp"
+#include "resources/Buffer.hpp"
+#include "resources/RangeAllocator.hpp"
+
+class Gpu;
+
+/**
+ * Range of a persistently mapped uniform block.
+ */
+struct UniformAllocation {
+    Buffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // points to the start of the range
+    void* pMapped;
+};
+
+/**
+ * Allocator of constant data for shaders.
+ *
+ * Persistent allocations are packed into large persistently mapped blocks,
+ * their data is written directly through `pMapped`.
+ *
+ * Data changing every frame is pushed into a ring with a region for each
+ * frame, bound once as a dynamic uniform buffer and addressed by dynamic
+ * offsets. The ring must have at least one frame more than there are frames
+ * in flight, so the region written by the CPU is never read by the GPU.
+ */
+class UniformAllocator {
+private:
+    struct Block {
+        Buffer buffer;
+        uint8_t* pMapped;
+        RangeAllocator ranges;
+    };
+
+    struct PendingFree {
+        // deletion queue frame after which the range is not used by GPU anymore
+        uint64_t frame;
+        uint32_t blockIdx;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    const Gpu* m_gpu;
+    VkDeviceSize m_alignment;
+    VkDeviceSize m_blockSize;
+
+    std::vector<Block> m_blocks;
+    std::vector<PendingFree> m_pendingFrees;
+
+    Buffer m_ring;
+    uint8_t* m_pRingMapped;
+    VkDeviceSize m_frameSize;
+    uint32_t m_numFrames;
+    uint32_t m_frameIdx;
+    VkDeviceSize m_frameOffset;
+
+    Block create_block(VkDeviceSize size, const char* name);
+
+    /**
+     * Returns ranges freed before the last completed frame back to their blocks.
+     */
+    void reclaim();
+
+public:
+    GET(m_ring, ring_buffer);
+    GET(m_frameSize, frame_size);
+    GET(m_alignment, alignment);
+
+    UniformAllocator(const Gpu* gpu,
+                     uint32_t numFrames,
+                     VkDeviceSize frameSize = 64 * 1024,
+                     VkDeviceSize blockSize = 256 * 1024);
+
+    ~UniformAllocator();
+
+    // Forbid copy, the blocks are owned
+    UniformAllocator(const UniformAllocator&) = delete;
+
+    /**
+     * Suballocates persistent uniform data. Data is written through the returned `pMapped`.
+     */
+    UniformAllocation allocate(VkDeviceSize size);
+
+    /**
+     * Range becomes reusable once the frames submitted so far are finished.
+     */
+    void free(const UniformAllocation& allocation);
+
+    /**
+     * Moves to the ring region of the next frame. Call once per frame before pushing.
+     */
+    void next_frame();
+
+    /**
+     * Copies data into the region of the current frame.
+     * @return dynamic offset to bind the ring buffer with
+     */
+    uint32_t push(const void* pData, VkDeviceSize size);
+
+    template<typename T>
+    uint32_t push(const T& data) {
+        return push(&data, sizeof(T));
+    }
+};
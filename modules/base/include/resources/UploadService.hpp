@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include <volk.h>
+
+#include "props.hpp"
+
+class Gpu;
+
+/**
+ * Identifies a submission of the upload service. Tickets are values of its
+ * timeline semaphore and are increasing in order of submission.
+ */
+typedef uint64_t UploadTicket;
+
+/**
+ * Batches transfer commands of all the writers into submissions to the
+ * transfer queue. Each submission signals the next value of a timeline
+ * semaphore, so consumers can wait for it on the GPU instead of the CPU.
+ *
+ * When the transfer queue belongs to a different family than the graphics
+ * queue, written resources are released by the transfer family. Matching
+ * acquire barriers are recorded by the consumer with `acquire`.
+ *
+ * Commands are recorded and submitted by the thread owning the service,
+ * tickets can be queried from any thread.
+ */
+class UploadService {
+private:
+    struct Batch {
+        VkCommandBuffer commandBuffer;
+        // timeline value signaled when the batch finishes
+        UploadTicket ticket;
+    };
+
+    struct PendingAcquire {
+        UploadTicket ticket;
+        std::vector<VkBufferMemoryBarrier2KHR> buffers;
+        std::vector<VkImageMemoryBarrier2KHR> images;
+    };
+
+    const Gpu* m_gpu;
+    VkSemaphore m_semaphore;
+
+    std::vector<Batch> m_batches;
+
+    // guards the batch index and the tickets submitted and completed,
+    // written only by the owning thread except for the completed one
+    mutable std::mutex m_ticketMutex;
+    // batch being recorded, -1 when none
+    int32_t m_batchIdx;
+
+    UploadTicket m_lastSubmitted;
+    UploadTicket m_lastCompleted;
+    UploadTicket m_lastAcquired;
+
+    // released at the end of the batch being recorded
+    std::vector<VkBufferMemoryBarrier2KHR> m_bufferReleases;
+    std::vector<VkImageMemoryBarrier2KHR> m_imageReleases;
+
+    // submitted batches waiting for the consumer to acquire them
+    std::vector<PendingAcquire> m_pendingAcquires;
+
+    VkSemaphore create_timeline_semaphore();
+
+    uint32_t take_batch();
+
+    [[nodiscard]] bool is_ownership_transferred() const;
+
+public:
+    GET(m_semaphore, semaphore);
+
+    explicit UploadService(const Gpu* gpu);
+
+    ~UploadService();
+
+    // Forbid copy, the semaphore is owned
+    UploadService(const UploadService&) = delete;
+
+    /**
+     * Command buffer on the transfer queue, commands recorded into it are
+     * submitted with the next `submit`. It is valid until then.
+     */
+    VkCommandBuffer record();
+
+    /**
+     * Ticket the commands recorded so far are going to signal.
+     */
+    [[nodiscard]] UploadTicket pending_ticket() const;
+
+    /**
+     * Ticket of the last submission.
+     */
+    [[nodiscard]] UploadTicket last_submitted() const;
+
+    /**
+     * Makes a buffer range written in the recorded commands available to the
+     * graphics queue.
+     * @param dstStage stages the consumer is going to access the buffer in
+     */
+    void release_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+                        VkPipelineStageFlags2KHR dstStage, VkAccessFlags2KHR dstAccess);
+
+    /**
+     * Makes an image written in the recorded commands available to the
+     * graphics queue, transitioning it from `oldLayout` to `newLayout`.
+     */
+    void release_image(VkImage image, VkImageSubresourceRange range,
+                       VkImageLayout oldLayout, VkImageLayout newLayout,
+                       VkPipelineStageFlags2KHR dstStage, VkAccessFlags2KHR dstAccess);
+
+    /**
+     * Submits the recorded commands. Does nothing when nothing was recorded.
+     * @return ticket of the submission, or of the last one
+     */
+    UploadTicket submit();
+
+    /**
+     * Checks whether the submission finished without blocking.
+     */
+    bool is_complete(UploadTicket ticket);
+
+    /**
+     * Last ticket known to be finished, polls the semaphore.
+     */
+    UploadTicket completed_ticket();
+
+    /**
+     * Waits on CPU until the submission finishes. Submits pending commands when needed.
+     */
+    void wait(UploadTicket ticket);
+
+    /**
+     * Records acquire barriers for resources of submissions up to `ticket`
+     * into a command buffer of the graphics queue. The commands must wait
+     * for the returned ticket on the semaphore.
+     * @param pTemporaries allocates the barriers, the frame arena only while recording a frame
+     * @return highest ticket acquired, 0 when nothing was acquired
+     */
+    UploadTicket acquire(VkCommandBuffer commandBuffer, UploadTicket ticket,
+                         std::pmr::memory_resource* pTemporaries = std::pmr::get_default_resource());
+
+    /**
+     * Resources of the submission were acquired by the graphics queue,
+     * commands submitted to it from now on can use them.
+     */
+    [[nodiscard]] bool is_acquired(UploadTicket ticket) const {
+        return ticket <= m_lastAcquired;
+    }
+};
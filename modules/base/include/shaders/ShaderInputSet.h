@@ -13,6 +13,7 @@
 
 #include "resources/Buffer.hpp"
 #include "resources/Image.hpp"
+#include "resources/UniformAllocator.hpp"
 #include "Gpu.hpp"
 
 
@@ -150,6 +151,23 @@ public:
         return *this;
     }
 
+    /**
+     * Binds persistent uniform data.
+     */
+    ShaderInputSetBuilder& uniform(const uint32_t binding, const UniformAllocation& allocation) {
+        return buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, binding, allocation.buffer,
+                      allocation.offset, allocation.size);
+    }
+
+    /**
+     * Binds the per frame ring of the allocator. Offset of the data is given
+     * by the dynamic offset returned from `UniformAllocator::push`.
+     * @param range size of the data pushed for the binding
+     */
+    ShaderInputSetBuilder& dynamic_uniform(const uint32_t binding, const UniformAllocator& allocator, const uint32_t range) {
+        return buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, binding, allocator.ring_buffer(), 0, range);
+    }
+
     /**
      * Allocates new descriptor sets from layout.
      * All the writes must be set already.
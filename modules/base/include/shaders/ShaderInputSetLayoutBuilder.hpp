@@ -35,6 +35,20 @@ public:
 		return *this;
 	}
 
+	ShaderInputSetLayoutBuilder& dynamic_uniform_buffer(
+            uint32_t binding,
+            VkShaderStageFlags shader_stages = VK_SHADER_STAGE_ALL
+    ) {
+		m_bindings.push_back({
+			.binding = binding,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.descriptorCount = 1,
+			.stageFlags = shader_stages,
+		});
+
+		return *this;
+	}
+
 	ShaderInputSetLayoutBuilder& image(
             uint32_t binding, 
             VkShaderStageFlags shader_stages = VK_SHADER_STAGE_ALL
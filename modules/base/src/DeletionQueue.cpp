@@ -0,0 +1,79 @@
+#include "DeletionQueue.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "Gpu.hpp"
+
+DeletionQueue::DeletionQueue(const Gpu* gpu) :
+    m_gpu(gpu) {
+
+}
+
+uint64_t DeletionQueue::frame() const {
+    std::lock_guard lock(m_mutex);
+    return m_frame;
+}
+
+uint64_t DeletionQueue::completed_frame() const {
+    std::lock_guard lock(m_mutex);
+    return m_completedFrame;
+}
+
+void DeletionQueue::push(std::function<void()> destroy) {
+    // objects are retired while the upload service is created and destroyed as well
+    UploadService* uploads = m_gpu->uploads();
+    UploadTicket ticket = uploads != nullptr ? uploads->pending_ticket() : 0;
+
+    std::lock_guard lock(m_mutex);
+    m_entries.push_back(Entry {
+        .frame = m_frame,
+        .ticket = std::max(ticket, m_entries.empty() ? 0 : m_entries.back().ticket),
+        .destroy = std::move(destroy)
+    });
+}
+
+uint64_t DeletionQueue::next_frame() {
+    std::lock_guard lock(m_mutex);
+    return ++m_frame;
+}
+
+void DeletionQueue::collect(uint64_t finished_frame) {
+    UploadService* uploads = m_gpu->uploads();
+    std::vector<std::function<void()>> destroys;
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_completedFrame = std::max(m_completedFrame, finished_frame);
+
+        // entries are pushed in order of frames and tickets
+        while(!m_entries.empty() && m_entries.front().frame <= m_completedFrame) {
+            UploadTicket ticket = m_entries.front().ticket;
+            if(ticket > 0 && (uploads == nullptr || !uploads->is_complete(ticket))) {
+                break;
+            }
+
+            destroys.push_back(std::move(m_entries.front().destroy));
+            m_entries.pop_front();
+        }
+    }
+
+    // destruction might retire other objects
+    for(auto& destroy : destroys) {
+        destroy();
+    }
+}
+
+void DeletionQueue::flush() {
+    std::deque<Entry> entries;
+    {
+        std::lock_guard lock(m_mutex);
+        m_completedFrame = m_frame;
+        entries = std::move(m_entries);
+        m_entries.clear();
+    }
+
+    for(auto& entry : entries) {
+        entry.destroy();
+    }
+}
@@ -1,23 +1,50 @@
 #include "Gpu.hpp"
 
+#include "FrameArena.hpp"
 #include "resources/DefaultAllocator.h"
+#include "resources/Defragmenter.hpp"
+#include "resources/UploadService.hpp"
 #include "result.hpp"
 
 #include <vector>
 #include <iostream>
 #include <memory>
 #include <cstring>
+#include <algorithm>
 #include <vulkan/vulkan_core.h>
 
 static const char *DEVICE_EXTENSIONS[] = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
         VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+        VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
         VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME
 };
 
 static const int NUM_DEVICE_EXTENSIONS = sizeof(DEVICE_EXTENSIONS) / sizeof(*DEVICE_EXTENSIONS);
 
+// enabled only when supported
+static const char *OPTIONAL_DEVICE_EXTENSIONS[] = {
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+};
+
+static const int NUM_OPTIONAL_DEVICE_EXTENSIONS = sizeof(OPTIONAL_DEVICE_EXTENSIONS) / sizeof(*OPTIONAL_DEVICE_EXTENSIONS);
+
+bool is_device_extension_supported(VkPhysicalDevice gpu, const char* name) {
+    uint32_t numExtensions = 0;
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &numExtensions, nullptr);
+    std::vector<VkExtensionProperties> extensions(numExtensions);
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &numExtensions, extensions.data());
+
+    for(auto& extension : extensions) {
+        if(!strcmp(extension.extensionName, name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 #if VK_LAYERS_ENABLE
 static const char* LAYERS[] = {
         "VK_LAYER_KHRONOS_validation"
@@ -33,19 +60,23 @@ static const int NUM_LAYERS = 0;
 
 
 int32_t get_graphics_score(VkQueueFamilyProperties props) {
-    bool isSupported = props.queueFlags | VK_QUEUE_GRAPHICS_BIT;
+    bool isSupported = props.queueFlags & VK_QUEUE_GRAPHICS_BIT;
     return isSupported;
 }
 
 int32_t get_transfer_score(VkQueueFamilyProperties props) {
-    bool isSupported = props.queueFlags | VK_QUEUE_TRANSFER_BIT;
-    bool isDedicated = props.queueFlags & ~(VK_QUEUE_GRAPHICS_BIT);
+    // graphics and compute queues support transfer implicitly
+    bool isSupported = props.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    bool isDedicated = !(props.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+    // family with transfers only is the copy engine
+    bool isTransferOnly = !(props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
 
-    return (isDedicated << 1) * isSupported;
+    return isSupported * (1 + isDedicated + isTransferOnly);
 }
 
 int32_t get_present_score(VkQueueFamilyProperties props, bool isPresentSupported) {
-    return isPresentSupported;
+    // presenting from the graphics family avoids ownership transfers of swapchain images
+    return isPresentSupported * (1 + get_graphics_score(props));
 }
 
 std::vector<int32_t> Gpu::get_queues(std::optional<VkSurfaceKHR> surface) {
@@ -67,8 +98,9 @@ std::vector<int32_t> Gpu::get_queues(std::optional<VkSurfaceKHR> surface) {
     int32_t presentQueue = -1;
     int32_t presentScore = 0;
 
-    uint32_t i = 0;
-    for(auto& prop : properties) {
+    for(uint32_t i = 0; i < numQueues; i++) {
+        auto& prop = properties[i];
+
         VkBool32 isPresentSupported = false;
         if(surface.has_value()) {
             vkGetPhysicalDeviceSurfaceSupportKHR(m_gpu, i, surface.value(), &isPresentSupported);
@@ -76,29 +108,27 @@ std::vector<int32_t> Gpu::get_queues(std::optional<VkSurfaceKHR> surface) {
             isPresentSupported = true;
         }
 
-        bool isTaken = false;
-        int32_t iterGraphicsScore = get_graphics_score(prop) * (graphicsQueue == -1);
-        int32_t iterTransferScore = get_transfer_score(prop);
-        int32_t iterPresentScore = get_present_score(prop, isPresentSupported);
-
-        if(iterGraphicsScore > 0) {
+        if(graphicsQueue == -1 && get_graphics_score(prop) > 0) {
             graphicsQueue = i;
-            isTaken = true;
         }
 
-        if((iterTransferScore | (!isTaken << 2)) > transferScore) {
+        int32_t iterTransferScore = get_transfer_score(prop);
+        if(iterTransferScore > transferScore) {
             transferQueue = i;
-            transferScore = (iterTransferScore & (!isTaken << 2));
-            isTaken = true;
+            transferScore = iterTransferScore;
         }
 
-        if((iterPresentScore | (!isTaken << 2)) > presentScore) {
+        int32_t iterPresentScore = get_present_score(prop, isPresentSupported);
+        if(iterPresentScore > presentScore) {
             presentQueue = i;
-            presentScore = (iterPresentScore & (!isTaken << 2));
-            isTaken = true;
+            presentScore = iterPresentScore;
         }
     }
 
+    if(graphicsQueue == -1) {
+        throw std::runtime_error("Failed to find graphics queue family");
+    }
+
     return { graphicsQueue, transferQueue, presentQueue };
 }
 
@@ -129,14 +159,21 @@ Result Gpu::create_logical_device(std::optional<VkSurfaceKHR> supportedSurface)
         x++;
     }
 
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+            .timelineSemaphore = true
+    };
+
     VkPhysicalDeviceSynchronization2Features syncFeatures = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+            .pNext = &timelineFeatures,
             .synchronization2 = true
     };
 
 	VkPhysicalDeviceFeatures gpuFeatures = { };
     
     vkGetPhysicalDeviceFeatures(m_gpu, &gpuFeatures);
+    m_isTextureCompressionBCEnabled = gpuFeatures.textureCompressionBC;
 
 	VkPhysicalDeviceCoherentMemoryFeaturesAMD coherentMemoryFeatures {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COHERENT_MEMORY_FEATURES_AMD,
@@ -144,6 +181,18 @@ Result Gpu::create_logical_device(std::optional<VkSurfaceKHR> supportedSurface)
 		.deviceCoherentMemory = true
 	};
 
+    std::vector<const char*> extensions(DEVICE_EXTENSIONS, DEVICE_EXTENSIONS + NUM_DEVICE_EXTENSIONS);
+    for(int i = 0; i < NUM_OPTIONAL_DEVICE_EXTENSIONS; i++) {
+        if(is_device_extension_supported(m_gpu, OPTIONAL_DEVICE_EXTENSIONS[i])) {
+            extensions.push_back(OPTIONAL_DEVICE_EXTENSIONS[i]);
+        }
+    }
+
+    m_isMemoryBudgetEnabled = std::find_if(extensions.begin(), extensions.end(),
+        [](const char* name) {
+            return !strcmp(name, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }) != extensions.end();
+
 	VkDeviceCreateInfo deviceInfo = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &syncFeatures, //&coherentMemoryFeatures,
@@ -153,8 +202,8 @@ Result Gpu::create_logical_device(std::optional<VkSurfaceKHR> supportedSurface)
 		.enabledLayerCount = NUM_LAYERS,
 		.ppEnabledLayerNames = LAYERS,
 #endif
-		.enabledExtensionCount = NUM_DEVICE_EXTENSIONS,
-		.ppEnabledExtensionNames = DEVICE_EXTENSIONS,
+		.enabledExtensionCount = (uint32_t)extensions.size(),
+		.ppEnabledExtensionNames = extensions.data(),
 		.pEnabledFeatures = &gpuFeatures
 	};
 
@@ -271,6 +320,9 @@ Result Gpu::create_descriptor_pool() {
         }, {
                 .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                 .descriptorCount = 1000
+        }, {
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .descriptorCount = 100
         }
     };
 
@@ -290,7 +342,10 @@ Result Gpu::create_descriptor_pool() {
 
 
 Gpu::Gpu(std::unique_ptr<const Instance> instance, std::optional<VkSurfaceKHR> supportedSurface) :
-    m_instance(std::move(instance)), m_pAllocator(nullptr) {
+    m_instance(std::move(instance)),
+    m_pDeletionQueue(std::make_unique<DeletionQueue>(this)),
+    m_pAllocator(nullptr),
+    m_pFrameArena(std::make_unique<lft::FrameArena>()) {
 
     lft::log::warn("Warning");
 
@@ -306,10 +361,18 @@ Gpu::Gpu(std::unique_ptr<const Instance> instance, std::optional<VkSurfaceKHR> s
         throw std::runtime_error("Failed to create descriptor pool");
     }
 
-    m_pAllocator = std::make_unique<DefaultAllocator>(DefaultAllocator(this));
+    m_pAllocator = std::make_unique<DefaultAllocator>(this);
+    m_pUploadService = std::make_unique<UploadService>(this);
+    m_pDefragmenter = std::make_unique<Defragmenter>(this);
 }
 
 Gpu::~Gpu() {
+    vkDeviceWaitIdle(m_dev);
+    m_pDefragmenter.reset();
+    m_pUploadService.reset();
+    m_pDeletionQueue->flush();
+    m_pAllocator.reset();
+
     vkDestroyDescriptorPool(m_dev, m_descriptorPool, nullptr);
     vkDestroyCommandPool(m_dev, m_graphicsCommandPool, nullptr);
     vkDestroyCommandPool(m_dev, m_transferCommandPool, nullptr);
@@ -332,3 +395,9 @@ void Gpu::enqueue_graphics(VkSubmitInfo2 *pSubmitInfo, VkFence fence) const {
 void Gpu::enqueue_transfer(VkSubmitInfo *pSubmitInfo, VkFence fence) const {
     vkQueueSubmit(m_transferQueue, 1, pSubmitInfo, fence);
 }
+
+void Gpu::enqueue_transfer(VkSubmitInfo2 *pSubmitInfo, VkFence fence) const {
+    if(vkQueueSubmit2KHR(m_transferQueue, 1, pSubmitInfo, fence)) {
+        throw std::runtime_error("Failed to submit to transfer queue");
+    }
+}
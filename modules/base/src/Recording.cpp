@@ -28,6 +28,21 @@ const RecordingBindPoint& RecordingBindPoint::bind_descriptor_set(
 }
 
 
+const RecordingBindPoint& RecordingBindPoint::bind_descriptor_set(
+        uint32_t set,
+        VkDescriptorSet descriptor_set,
+        std::initializer_list<uint32_t> dynamic_offsets
+) const {
+    vkCmdBindDescriptorSets(m_recording->cmdbuf(),
+            m_bind_point,
+            m_pipeline.pipeline_layout(),
+            set,
+            1, &descriptor_set,
+            dynamic_offsets.size(), dynamic_offsets.begin());
+
+    return *this;
+}
+
 const RecordingBindPoint& RecordingBindPoint::bind_descriptor_sets(
         uint32_t first_set,
         const std::vector<VkDescriptorSet>& descriptor_sets
@@ -3,7 +3,11 @@
 #include <string.h>
 #include <volk.h>
 #include <algorithm>
+#include <format>
+#include <stdexcept>
 
+// segments start aligned for any element type mapped into them
+static constexpr size_t SEGMENT_ALIGNMENT = 16;
 
 int
 BufferBusWriter::create_staging_buffer(size_t size) {
@@ -15,133 +19,268 @@ BufferBusWriter::create_staging_buffer(size_t size) {
 
 	MemoryAllocationInfo memoryAllocationInfo = {
 		.usage = MEMORY_USAGE_AUTO_PREFER_HOST,
-        .requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        .category = MEMORY_CATEGORY_STAGING
 	};
 
     m_gpu->memory()->create_buffer(&stagingBufferInfo, &memoryAllocationInfo,
 								&m_stagingBuffer);
+    m_gpu->memory()->map(m_stagingBuffer.allocation, &m_pData);
 
 	return 0;
 }
 
 
 
-int
-BufferBusWriter::create_staging_command_buffer() {
-	VkCommandBufferAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = m_gpu->transfer_command_pool(),
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
-	};
+BufferBusWriter::BufferBusWriter(const Gpu* gpu, size_t size, uint32_t numSegments,
+                                 VkPipelineStageFlags2KHR dstStage, VkAccessFlags2KHR dstAccess) :
+m_gpu(gpu), m_busSize(size), m_segmentSize(0), m_pData(nullptr), m_segmentIdx(0),
+m_lastTicket(0), m_dstStage(dstStage), m_dstAccess(dstAccess) {
+    if(numSegments == 0 || size / numSegments < SEGMENT_ALIGNMENT) {
+        throw std::runtime_error(std::format(
+            "Cannot split bus of {} bytes into {} segments", size, numSegments));
+    }
 
-	vkAllocateCommandBuffers(m_gpu->dev(), &allocInfo, &m_stagingCommandBuffer);
+    m_segmentSize = size / numSegments / SEGMENT_ALIGNMENT * SEGMENT_ALIGNMENT;
 
-	return 0;
+    m_segments.resize(numSegments);
+    for(uint32_t i = 0; i < numSegments; i++) {
+        m_segments[i] = Segment {
+            .offset = i * m_segmentSize,
+            .usedSize = 0,
+            .ticket = 0,
+        };
+    }
 }
 
 
 
-BufferBusWriter::BufferBusWriter(const Gpu* gpu, size_t size) :
-m_gpu(gpu), m_unflushedSize(0), m_busSize(size), m_numWrites(0) {
-	create_staging_buffer(size);
+void BufferBusWriter::acquire_segment(size_t minSize) {
+    if(m_segmentSize - m_segments[m_segmentIdx].usedSize < minSize) {
+        flush();
+    }
 
-	create_staging_command_buffer();
+    Segment& segment = m_segments[m_segmentIdx];
+    if(segment.usedSize == 0) {
+        // the data of the last upload might still be read by the transfer
+        m_gpu->uploads()->wait(segment.ticket);
+    }
+}
 
-    m_gpu->memory()->map(m_stagingBuffer.allocation, &m_pData);
 
-    VkFenceCreateInfo fenceInfo = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
 
-    vkCreateFence(m_gpu->dev(), &fenceInfo, nullptr, &m_fence);
+bool BufferBusWriter::write_direct(const Buffer* pTarget, const void *pData, size_t offset, size_t size) {
+    char* pMapped = (char*)m_gpu->memory()->mapped_data(pTarget->allocation);
+    if(pMapped == nullptr) {
+        return false;
+    }
+
+    memcpy(pMapped + offset, pData, size);
+
+    // host writes are visible to the commands submitted afterwards
+    GpuAllocation allocation = pTarget->allocation;
+    m_gpu->memory()->flush(allocation, offset, size);
+
+    return true;
 }
 
 
 
-void BufferBusWriter::write(Buffer* pTarget, void *pData, size_t offset, size_t size) {
-    char* pUploadData = (char*)pData;
+void BufferBusWriter::record_region(Segment& segment, VkBuffer target,
+                                    size_t srcOffset, size_t dstOffset, size_t size) {
+    // continuation of the previous write becomes part of the same region
+    if(!segment.writes.empty()) {
+        auto& [lastTarget, last] = segment.writes.back();
+        if(lastTarget == target &&
+           last.srcOffset + last.size == srcOffset &&
+           last.dstOffset + last.size == dstOffset) {
+            last.size += size;
+            segment.usedSize += size;
+            return;
+        }
+    }
+
+    segment.writes.emplace_back(target, VkBufferCopy {
+            .srcOffset = srcOffset,
+            .dstOffset = dstOffset,
+            .size = size,
+    });
+    segment.usedSize += size;
+}
+
+
+
+void BufferBusWriter::flush_mapped_range() {
+    if(!m_mappedRange.has_value()) {
+        return;
+    }
+
+    m_gpu->memory()->flush(m_mappedRange->allocation, m_mappedRange->offset, m_mappedRange->size);
+    m_mappedRange.reset();
+}
+
+
+
+void BufferBusWriter::write(const Buffer* pTarget, const void *pData, size_t offset, size_t size) {
+    flush_mapped_range();
+
+    if(write_direct(pTarget, pData, offset, size)) {
+        return;
+    }
+
+    if(m_pData == nullptr) {
+        create_staging_buffer(m_segmentSize * m_segments.size());
+    }
+
+    const char* pUploadData = (const char*)pData;
 
     while(size > 0) {
-        size_t uploadSize = std::min(m_busSize - m_unflushedSize, size);
+        acquire_segment();
+        Segment& segment = m_segments[m_segmentIdx];
 
-        memcpy((char*)m_pData + m_unflushedSize, pUploadData, uploadSize);
+        size_t uploadSize = std::min(m_segmentSize - segment.usedSize, size);
+        size_t srcOffset = segment.offset + segment.usedSize;
+
+        memcpy((char*)m_pData + srcOffset, pUploadData, uploadSize);
         pUploadData += uploadSize;
 
-        VkBufferCopy write = {
-                .srcOffset = m_unflushedSize,
-                .dstOffset = offset,
-                .size = uploadSize,
-        };
-        m_numWrites++;
-
-        if(m_writes.size() <= m_numWrites) {
-            m_writes.resize(m_numWrites * 2);
-        }
-        m_writes[m_numWrites - 1] = std::pair(pTarget, write);
-        m_unflushedSize += uploadSize;
+        record_region(segment, pTarget->buf, srcOffset, offset, uploadSize);
 
         offset += uploadSize;
         size -= uploadSize;
 
-        if(m_busSize - m_unflushedSize == 0) {
+        if(segment.usedSize == m_segmentSize) {
             flush();
-            // wait, because we are gonna overwrite the data
-            wait();
         }
     }
 }
 
 
 
-void BufferBusWriter::flush() {
-    if(m_numWrites == 0) {
-        m_unflushedSize = 0;
-        return;
+size_t BufferBusWriter::map(const Buffer* pTarget, size_t offset, size_t size, void** ppData, size_t elementSize) {
+    flush_mapped_range();
+
+    char* pMapped = (char*)m_gpu->memory()->mapped_data(pTarget->allocation);
+    if(pMapped != nullptr) {
+        *ppData = pMapped + offset;
+        m_mappedRange = MappedRange {
+            .allocation = pTarget->allocation,
+            .offset = offset,
+            .size = size,
+        };
+        return size;
     }
 
-    m_gpu->memory()->flush(m_stagingBuffer.allocation, 0, m_unflushedSize);
+    if(elementSize == 0 || elementSize > m_segmentSize) {
+        throw std::runtime_error(std::format(
+            "Elements of {} bytes do not fit into bus segment of {} bytes", elementSize, m_segmentSize));
+    }
 
-	wait();
-    vkResetFences(m_gpu->dev(), 1, &m_fence);
+    if(m_pData == nullptr) {
+        create_staging_buffer(m_segmentSize * m_segments.size());
+    }
 
-	VkCommandBufferBeginInfo beginInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
+    // writes leave the segment at any byte, typed pointers into it must be aligned
+    auto align = [elementSize](size_t usedSize) {
+        return (usedSize + elementSize - 1) / elementSize * elementSize;
+    };
+
+    size_t usedSize = m_segments[m_segmentIdx].usedSize;
+    acquire_segment(align(usedSize) - usedSize + elementSize);
+    Segment& segment = m_segments[m_segmentIdx];
+    // skipped bytes are never copied
+    segment.usedSize = align(segment.usedSize);
 
-	vkBeginCommandBuffer(m_stagingCommandBuffer, &beginInfo);
+    size_t available = m_segmentSize - segment.usedSize;
+    size_t mapSize = std::min(available, size) / elementSize * elementSize;
+    size_t srcOffset = segment.offset + segment.usedSize;
 
-    for(uint32_t i = 0; i < m_numWrites; i++) {
-        vkCmdCopyBuffer(m_stagingCommandBuffer, m_stagingBuffer.buf, m_writes[i].first->buf,
-                        1, &m_writes[i].second);
+    // copies must not be empty
+    if(mapSize == 0) {
+        *ppData = nullptr;
+        return 0;
     }
 
-	vkEndCommandBuffer(m_stagingCommandBuffer);
+    // the copy is recorded now, but submitted only with the next flush, after the data is written
+    record_region(segment, pTarget->buf, srcOffset, offset, mapSize);
+
+    *ppData = (char*)m_pData + srcOffset;
+    return mapSize;
+}
 
-	VkSubmitInfo submitInfo = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &m_stagingCommandBuffer,
-	};
 
-    m_gpu->enqueue_transfer(&submitInfo, m_fence);
 
-    m_unflushedSize = 0;
-	m_numWrites = 0;
+void BufferBusWriter::replace_target(VkBuffer from, VkBuffer to) {
+    for(auto& segment : m_segments) {
+        for(auto& [target, region] : segment.writes) {
+            if(target == from) {
+                target = to;
+            }
+        }
+    }
 }
 
 
 
-BufferBusWriter::~BufferBusWriter() {
-    flush();
-    wait();
+UploadTicket BufferBusWriter::flush() {
+    UploadService* uploads = m_gpu->uploads();
+
+    flush_mapped_range();
+
+    Segment& segment = m_segments[m_segmentIdx];
+    if(segment.writes.empty()) {
+        return m_lastTicket;
+    }
+
+    m_gpu->memory()->flush(m_stagingBuffer.allocation, segment.offset, segment.usedSize);
+
+    VkCommandBuffer commandBuffer = uploads->record();
 
-    m_gpu->memory()->destroy_buffer(&m_stagingBuffer);
+    // single copy command for each target
+    std::stable_sort(segment.writes.begin(), segment.writes.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(segment.writes.size());
+    for(size_t i = 0; i < segment.writes.size(); i++) {
+        const auto& [target, region] = segment.writes[i];
+        regions.push_back(region);
+        uploads->release_buffer(target, region.dstOffset, region.size, m_dstStage, m_dstAccess);
+
+        if(i + 1 == segment.writes.size() || segment.writes[i + 1].first != target) {
+            vkCmdCopyBuffer(commandBuffer, m_stagingBuffer.buf, target,
+                            regions.size(), regions.data());
+            regions.clear();
+        }
+    }
+
+    segment.ticket = uploads->pending_ticket();
+    m_lastTicket = segment.ticket;
+    segment.usedSize = 0;
+    segment.writes.clear();
+
+    m_segmentIdx = (m_segmentIdx + 1) % m_segments.size();
+
+    return segment.ticket;
 }
 
+
+
 void BufferBusWriter::wait() {
-    vkWaitForFences(m_gpu->dev(), 1, &m_fence, VK_TRUE, UINT64_MAX);
-    // vkDeviceWaitIdle(m_pGpu->dev());
+    flush();
+
+    for(auto& segment : m_segments) {
+        m_gpu->uploads()->wait(segment.ticket);
+    }
+}
+
+
+
+BufferBusWriter::~BufferBusWriter() {
+    wait();
+
+    if(m_pData != nullptr) {
+        m_gpu->memory()->unmap(m_stagingBuffer.allocation);
+        m_gpu->memory()->destroy_buffer(&m_stagingBuffer);
+    }
 }
@@ -4,7 +4,43 @@
 #include "vk_mem_alloc.h"
 #include "Gpu.hpp"
 
-DefaultAllocator::DefaultAllocator(Gpu *pGpu) {
+#include <algorithm>
+#include <stdexcept>
+
+static VkBufferCreateInfo get_buffer_create_info(const BufferCreateInfo *pBufferInfo) {
+    return VkBufferCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = pBufferInfo->size,
+            .usage = pBufferInfo->usage,
+            .sharingMode = pBufferInfo->isExclusive ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT
+    };
+}
+
+static VkImageCreateInfo get_image_create_info(const ImageCreateInfo *pImageInfo) {
+    return VkImageCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .flags = pImageInfo->flags,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = pImageInfo->format,
+            .extent = {
+                    pImageInfo->extent.width,
+                    pImageInfo->extent.height,
+                    1,
+            },
+            .mipLevels = pImageInfo->mipLevels,
+            .arrayLayers = pImageInfo->arrayLayers,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = pImageInfo->usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+}
+
+DefaultAllocator::DefaultAllocator(Gpu *pGpu) :
+    m_pDeletionQueue(pGpu->deletion_queue()),
+    m_defragmentation(VK_NULL_HANDLE),
+    m_defragmentationPass({}) {
     VmaVulkanFunctions vma_vulkan_func{};
     vma_vulkan_func.vkAllocateMemory                    = vkAllocateMemory;
     vma_vulkan_func.vkBindBufferMemory                  = vkBindBufferMemory;
@@ -25,16 +61,36 @@ DefaultAllocator::DefaultAllocator(Gpu *pGpu) {
     vma_vulkan_func.vkCmdCopyBuffer                     = vkCmdCopyBuffer;
     vma_vulkan_func.vkGetDeviceProcAddr                 = vkGetDeviceProcAddr;
     vma_vulkan_func.vkGetInstanceProcAddr               = vkGetInstanceProcAddr;
+    // core in 1.1, needed for dedicated allocations and budget queries
+    vma_vulkan_func.vkGetBufferMemoryRequirements2KHR   = vkGetBufferMemoryRequirements2;
+    vma_vulkan_func.vkGetImageMemoryRequirements2KHR    = vkGetImageMemoryRequirements2;
+    vma_vulkan_func.vkBindBufferMemory2KHR              = vkBindBufferMemory2;
+    vma_vulkan_func.vkBindImageMemory2KHR               = vkBindImageMemory2;
+    vma_vulkan_func.vkGetPhysicalDeviceMemoryProperties2KHR = vkGetPhysicalDeviceMemoryProperties2;
 
     VmaAllocatorCreateInfo allocatorCreateInfo = {
+            .flags = pGpu->is_memory_budget_enabled() ?
+                (VmaAllocatorCreateFlags)VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0,
             .physicalDevice = pGpu->gpu(),
             .device = pGpu->dev(),
             .pVulkanFunctions = &vma_vulkan_func,
             .instance = pGpu->instance()->instance(),
-            .vulkanApiVersion = VK_API_VERSION_1_0,
+            .vulkanApiVersion = VK_API_VERSION_1_1,
     };
 
-    vmaCreateAllocator(&allocatorCreateInfo, &m_allocator);
+    if(vmaCreateAllocator(&allocatorCreateInfo, &m_allocator)) {
+        throw std::runtime_error("Failed to create memory allocator");
+    }
+
+    const VkPhysicalDeviceMemoryProperties* pMemoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &pMemoryProperties);
+    m_peakUsages.resize(pMemoryProperties->memoryHeapCount, 0);
+    m_isOverBudget.resize(pMemoryProperties->memoryHeapCount, false);
+}
+
+DefaultAllocator::~DefaultAllocator() {
+    end_defragmentation();
+    vmaDestroyAllocator(m_allocator);
 }
 
 VmaMemoryUsage get_vma_memory_usage(MemoryUsage memoryUsage) {
@@ -45,57 +101,310 @@ VmaMemoryUsage get_vma_memory_usage(MemoryUsage memoryUsage) {
             return VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
         case MEMORY_USAGE_AUTO_PREFER_HOST:
             return VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+        case MEMORY_USAGE_GPU_LAZILY_ALLOCATED:
+            return VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
         default:
             return VMA_MEMORY_USAGE_AUTO;
     }
 }
 
 int DefaultAllocator::create_buffer(BufferCreateInfo *pBufferInfo, MemoryAllocationInfo *pAllocInfo, Buffer *pOut) {
-    VkBufferCreateInfo bufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = pBufferInfo->size,
-            .usage = pBufferInfo->usage,
-            .sharingMode = pBufferInfo->isExclusive ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT
-    };
+    VkBufferCreateInfo bufferInfo = get_buffer_create_info(pBufferInfo);
 
     VmaAllocationCreateInfo allocInfo = {
             .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
 			.usage = get_vma_memory_usage(pAllocInfo->usage),
 			.requiredFlags = pAllocInfo->requiredFlags,
+			.pUserData = (void*)(uintptr_t)pAllocInfo->category,
 	};
 
-    vmaCreateBuffer(m_allocator, &bufferInfo, &allocInfo, &pOut->buf, &pOut->allocation.allocation, nullptr);
+    // VMA picks host visible device memory when there is some and falls back
+    // to memory written by transfers, mapping is skipped for memory without host access
+    if(pAllocInfo->isHostWritePreferred) {
+        allocInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+                           VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    }
+
+    VkResult result = vmaCreateBuffer(m_allocator, &bufferInfo, &allocInfo, &pOut->buf, &pOut->allocation.allocation, nullptr);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    track_allocation(pOut->allocation.allocation, pAllocInfo->category);
 
     return 0;
 }
 
 int DefaultAllocator::create_image(ImageCreateInfo *pImageInfo, MemoryAllocationInfo *pAllocInfo, Image *pOut) {
-    VkImageCreateInfo imageInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-            .imageType = VK_IMAGE_TYPE_2D,
-            .format = pImageInfo->format,
-            .extent = {
-                    pImageInfo->extent.width,
-                    pImageInfo->extent.height,
-                    1,
-            },
-            .mipLevels = pImageInfo->mipLevels,
-            .arrayLayers = pImageInfo->arrayLayers,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .tiling = VK_IMAGE_TILING_OPTIMAL,
-            .usage = pImageInfo->usage,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
-    };
+    VkImageCreateInfo imageInfo = get_image_create_info(pImageInfo);
 
     VmaAllocationCreateInfo allocInfo = {};
     allocInfo.usage = get_vma_memory_usage(pAllocInfo->usage);
 	allocInfo.requiredFlags = pAllocInfo->requiredFlags;
+    allocInfo.pUserData = (void*)(uintptr_t)pAllocInfo->category;
+
+    VkResult result = vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &pOut->img, &pOut->allocation.allocation, nullptr);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
 
-    vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &pOut->img, &pOut->allocation.allocation, nullptr);
+    track_allocation(pOut->allocation.allocation, pAllocInfo->category);
 
     pOut->m_layer_count = imageInfo.arrayLayers;
     pOut->m_level_count = imageInfo.mipLevels;
 
     return 0;
 }
+
+void DefaultAllocator::destroy_buffer(Buffer *pBuffer) {
+    if(pBuffer->buf == VK_NULL_HANDLE) {
+        return;
+    }
+
+    m_pDeletionQueue->push([this,
+                            buffer = pBuffer->buf,
+                            allocation = pBuffer->allocation.allocation]() {
+        untrack_allocation(allocation);
+        vmaDestroyBuffer(m_allocator, buffer, allocation);
+    });
+
+    pBuffer->buf = VK_NULL_HANDLE;
+    pBuffer->allocation.allocation = nullptr;
+}
+
+void DefaultAllocator::destroy_image(Image *pImage) {
+    if(pImage->img == VK_NULL_HANDLE) {
+        return;
+    }
+
+    m_pDeletionQueue->push([this,
+                            image = pImage->img,
+                            allocation = pImage->allocation.allocation]() {
+        untrack_allocation(allocation);
+        vmaDestroyImage(m_allocator, image, allocation);
+    });
+
+    pImage->img = VK_NULL_HANDLE;
+    pImage->allocation.allocation = nullptr;
+}
+
+void DefaultAllocator::track_allocation(VmaAllocation allocation, MemoryCategory category) {
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(m_allocator, allocation, &info);
+
+    std::vector<std::pair<uint32_t, MemoryHeapBudget>> exceeded;
+    BudgetExceededCallback callback;
+    {
+        std::lock_guard lock(m_statisticsMutex);
+        auto& stats = m_categories[category];
+        stats.allocation_count++;
+        stats.size += info.size;
+        stats.peak_allocation_count = std::max(stats.peak_allocation_count, stats.allocation_count);
+        stats.peak_size = std::max(stats.peak_size, stats.size);
+
+        exceeded = check_budgets();
+        callback = m_budgetCallback;
+    }
+
+    // called unlocked, so the callback can query statistics or free memory
+    if(callback) {
+        for(auto& [heap_idx, heap] : exceeded) {
+            callback(heap_idx, heap);
+        }
+    }
+}
+
+void DefaultAllocator::untrack_allocation(VmaAllocation allocation) {
+    if(allocation == nullptr) {
+        return;
+    }
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(m_allocator, allocation, &info);
+
+    std::lock_guard lock(m_statisticsMutex);
+    auto& stats = m_categories[(MemoryCategory)(uintptr_t)info.pUserData];
+    stats.allocation_count--;
+    stats.size -= info.size;
+}
+
+std::vector<std::pair<uint32_t, MemoryHeapBudget>> DefaultAllocator::check_budgets() {
+    const VkPhysicalDeviceMemoryProperties* pMemoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &pMemoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(m_allocator, budgets);
+
+    std::vector<std::pair<uint32_t, MemoryHeapBudget>> exceeded;
+    for(uint32_t heap_idx = 0; heap_idx < m_peakUsages.size(); heap_idx++) {
+        auto& budget = budgets[heap_idx];
+        m_peakUsages[heap_idx] = std::max(m_peakUsages[heap_idx], budget.usage);
+
+        bool is_over_budget = budget.usage > budget.budget;
+        if(is_over_budget && !m_isOverBudget[heap_idx]) {
+            exceeded.push_back({heap_idx, MemoryHeapBudget {
+                .usage = budget.usage,
+                .budget = budget.budget,
+                .peak_usage = m_peakUsages[heap_idx],
+                .is_device_local = (bool)(pMemoryProperties->memoryHeaps[heap_idx].flags &
+                    VK_MEMORY_HEAP_DEVICE_LOCAL_BIT),
+            }});
+        }
+        m_isOverBudget[heap_idx] = is_over_budget;
+    }
+
+    return exceeded;
+}
+
+void* DefaultAllocator::mapped_data(const GpuAllocation& allocation) {
+    VkMemoryPropertyFlags properties = 0;
+    vmaGetAllocationMemoryProperties(m_allocator, allocation.allocation, &properties);
+    if(!(properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+        return nullptr;
+    }
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(m_allocator, allocation.allocation, &info);
+    return info.pMappedData;
+}
+
+MemoryStatistics DefaultAllocator::statistics() {
+    const VkPhysicalDeviceMemoryProperties* pMemoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &pMemoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(m_allocator, budgets);
+
+    std::lock_guard lock(m_statisticsMutex);
+    MemoryStatistics statistics = {
+        .heaps = std::vector<MemoryHeapBudget>(pMemoryProperties->memoryHeapCount),
+        .categories = m_categories,
+    };
+
+    for(uint32_t heap_idx = 0; heap_idx < pMemoryProperties->memoryHeapCount; heap_idx++) {
+        m_peakUsages[heap_idx] = std::max(m_peakUsages[heap_idx], budgets[heap_idx].usage);
+        statistics.heaps[heap_idx] = {
+            .usage = budgets[heap_idx].usage,
+            .budget = budgets[heap_idx].budget,
+            .peak_usage = m_peakUsages[heap_idx],
+            .is_device_local = (bool)(pMemoryProperties->memoryHeaps[heap_idx].flags &
+                VK_MEMORY_HEAP_DEVICE_LOCAL_BIT),
+        };
+    }
+
+    return statistics;
+}
+
+bool DefaultAllocator::begin_defragmentation(VkDeviceSize maxBytesPerPass) {
+    if(m_defragmentation != VK_NULL_HANDLE) {
+        return false;
+    }
+
+    VmaDefragmentationInfo info = {
+            .flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+            .maxBytesPerPass = maxBytesPerPass,
+    };
+
+    if(vmaBeginDefragmentation(m_allocator, &info, &m_defragmentation)) {
+        m_defragmentation = VK_NULL_HANDLE;
+        throw std::runtime_error("Failed to begin defragmentation");
+    }
+
+    return true;
+}
+
+std::vector<DefragmentationMove> DefaultAllocator::begin_defragmentation_pass() {
+    std::vector<DefragmentationMove> moves;
+    if(m_defragmentation == VK_NULL_HANDLE) {
+        return moves;
+    }
+
+    // success means there is nothing left to move
+    if(vmaBeginDefragmentationPass(m_allocator, m_defragmentation, &m_defragmentationPass) == VK_SUCCESS) {
+        m_defragmentationPass = {};
+        return moves;
+    }
+
+    moves.reserve(m_defragmentationPass.moveCount);
+    for(uint32_t i = 0; i < m_defragmentationPass.moveCount; i++) {
+        const VmaDefragmentationMove& move = m_defragmentationPass.pMoves[i];
+        moves.push_back(DefragmentationMove {
+            .allocation = { move.srcAllocation },
+            .destination = { move.dstTmpAllocation },
+            .isIgnored = false,
+        });
+    }
+
+    return moves;
+}
+
+bool DefaultAllocator::end_defragmentation_pass(const std::vector<DefragmentationMove>& moves) {
+    if(m_defragmentation == VK_NULL_HANDLE) {
+        return true;
+    }
+
+    // moves are returned in the order the pass proposed them
+    for(uint32_t i = 0; i < m_defragmentationPass.moveCount && i < moves.size(); i++) {
+        m_defragmentationPass.pMoves[i].operation = moves[i].isIgnored ?
+            VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE : VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY;
+    }
+
+    VkResult result = vmaEndDefragmentationPass(m_allocator, m_defragmentation, &m_defragmentationPass);
+    m_defragmentationPass = {};
+
+    return result == VK_SUCCESS;
+}
+
+VkDeviceSize DefaultAllocator::end_defragmentation() {
+    if(m_defragmentation == VK_NULL_HANDLE) {
+        return 0;
+    }
+
+    VmaDefragmentationStats stats = {};
+    vmaEndDefragmentation(m_allocator, m_defragmentation, &stats);
+    m_defragmentation = VK_NULL_HANDLE;
+
+    return stats.bytesFreed;
+}
+
+VkResult DefaultAllocator::create_moved_buffer(const BufferCreateInfo *pBufferInfo,
+                                               const DefragmentationMove& move, VkBuffer *pOut) {
+    VkBufferCreateInfo bufferInfo = get_buffer_create_info(pBufferInfo);
+
+    VmaAllocatorInfo allocatorInfo;
+    vmaGetAllocatorInfo(m_allocator, &allocatorInfo);
+
+    VkResult result = vkCreateBuffer(allocatorInfo.device, &bufferInfo, nullptr, pOut);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = vmaBindBufferMemory(m_allocator, move.destination.allocation, *pOut);
+    if(result != VK_SUCCESS) {
+        vkDestroyBuffer(allocatorInfo.device, *pOut, nullptr);
+        *pOut = VK_NULL_HANDLE;
+    }
+
+    return result;
+}
+
+VkResult DefaultAllocator::create_moved_image(const ImageCreateInfo *pImageInfo,
+                                              const DefragmentationMove& move, VkImage *pOut) {
+    VkImageCreateInfo imageInfo = get_image_create_info(pImageInfo);
+
+    VmaAllocatorInfo allocatorInfo;
+    vmaGetAllocatorInfo(m_allocator, &allocatorInfo);
+
+    VkResult result = vkCreateImage(allocatorInfo.device, &imageInfo, nullptr, pOut);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = vmaBindImageMemory(m_allocator, move.destination.allocation, *pOut);
+    if(result != VK_SUCCESS) {
+        vkDestroyImage(allocatorInfo.device, *pOut, nullptr);
+        *pOut = VK_NULL_HANDLE;
+    }
+
+    return result;
+}
@@ -0,0 +1,352 @@
+#include "resources/Defragmenter.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Gpu.hpp"
+
+Defragmenter::Defragmenter(const Gpu* gpu, VkDeviceSize maxBytesPerPass) :
+    m_gpu(gpu),
+    m_maxBytesPerPass(maxBytesPerPass),
+    m_isRunning(false),
+    m_numMoved(0),
+    m_commandBuffer(VK_NULL_HANDLE),
+    m_fence(VK_NULL_HANDLE) {
+    VkCommandBufferAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = m_gpu->graphics_command_pool(),
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+    };
+
+    if(vkAllocateCommandBuffers(m_gpu->dev(), &allocInfo, &m_commandBuffer)) {
+        throw std::runtime_error("Failed to allocate defragmentation command buffer");
+    }
+
+    m_fence = m_gpu->create_fence(false);
+}
+
+Defragmenter::~Defragmenter() {
+    // device is idle by now
+    if(m_retiringPass.has_value()) {
+        end_pass();
+    }
+    m_gpu->memory()->end_defragmentation();
+
+    vkDestroyFence(m_gpu->dev(), m_fence, nullptr);
+    vkFreeCommandBuffers(m_gpu->dev(), m_gpu->graphics_command_pool(), 1, &m_commandBuffer);
+}
+
+void Defragmenter::track_buffer(const Buffer& buffer, const BufferCreateInfo& info, BufferMovedCallback onMoved) {
+    m_buffers[buffer.allocation.allocation] = TrackedBuffer {
+        .buffer = buffer.buf,
+        .info = info,
+        .onMoved = std::move(onMoved),
+    };
+}
+
+void Defragmenter::track_image(const Image& image, const ImageCreateInfo& info, VkImageLayout layout,
+                               ImageMovedCallback onMoved) {
+    m_images[image.allocation.allocation] = TrackedImage {
+        .image = image.img,
+        .info = info,
+        .layout = layout,
+        .onMoved = std::move(onMoved),
+    };
+}
+
+void Defragmenter::untrack(const GpuAllocation& allocation) {
+    m_buffers.erase(allocation.allocation);
+    m_images.erase(allocation.allocation);
+
+    if(!m_retiringPass.has_value()) {
+        return;
+    }
+
+    // memory of the allocation must not be freed before the pass moving it ends
+    bool isMoved = std::any_of(m_retiringPass->moves.begin(), m_retiringPass->moves.end(),
+        [&allocation](const DefragmentationMove& move) {
+            return !move.isIgnored && move.allocation.allocation == allocation.allocation;
+        });
+
+    if(isMoved) {
+        vkQueueWaitIdle(m_gpu->graphics_queue());
+        end_pass();
+    }
+}
+
+void Defragmenter::start() {
+    if(m_isRunning) {
+        return;
+    }
+
+    m_isRunning = m_gpu->memory()->begin_defragmentation(m_maxBytesPerPass);
+}
+
+void Defragmenter::update() {
+    if(m_retiringPass.has_value()) {
+        if(m_gpu->deletion_queue()->completed_frame() < m_retiringPass->frame) {
+            return;
+        }
+
+        end_pass();
+    }
+
+    if(!m_isRunning) {
+        return;
+    }
+
+    // resources not acquired from the transfer queue yet cannot be copied on the graphics queue
+    UploadService* uploads = m_gpu->uploads();
+    if(uploads->pending_ticket() != uploads->last_submitted() ||
+       !uploads->is_acquired(uploads->last_submitted())) {
+        return;
+    }
+
+    if(!run_pass()) {
+        m_gpu->memory()->end_defragmentation();
+        m_isRunning = false;
+    }
+}
+
+bool Defragmenter::record_buffer_move(const DefragmentationMove& move, TrackedBuffer& tracked, VkBuffer* pOut) {
+    if(m_gpu->memory()->create_moved_buffer(&tracked.info, move, pOut)) {
+        return false;
+    }
+
+    VkBufferCopy region = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = tracked.info.size,
+    };
+    vkCmdCopyBuffer(m_commandBuffer, tracked.buffer, *pOut, 1, &region);
+
+    return true;
+}
+
+bool Defragmenter::record_image_move(const DefragmentationMove& move, TrackedImage& tracked, VkImage* pOut) {
+    if(m_gpu->memory()->create_moved_image(&tracked.info, move, pOut)) {
+        return false;
+    }
+
+    VkImageSubresourceRange range = {
+        .aspectMask = tracked.info.aspectMask,
+        .baseMipLevel = 0,
+        .levelCount = tracked.info.mipLevels,
+        .baseArrayLayer = 0,
+        .layerCount = tracked.info.arrayLayers,
+    };
+
+    VkImageMemoryBarrier barriers[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            .oldLayout = tracked.layout,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = tracked.image,
+            .subresourceRange = range,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = *pOut,
+            .subresourceRange = range,
+        }
+    };
+
+    vkCmdPipelineBarrier(m_commandBuffer,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr,
+                         0, nullptr,
+                         2, barriers);
+
+    std::vector<VkImageCopy> regions(tracked.info.mipLevels);
+    for(uint32_t level = 0; level < tracked.info.mipLevels; level++) {
+        VkImageSubresourceLayers subresource = {
+            .aspectMask = tracked.info.aspectMask,
+            .mipLevel = level,
+            .baseArrayLayer = 0,
+            .layerCount = tracked.info.arrayLayers,
+        };
+
+        regions[level] = VkImageCopy {
+            .srcSubresource = subresource,
+            .srcOffset = { 0, 0, 0 },
+            .dstSubresource = subresource,
+            .dstOffset = { 0, 0, 0 },
+            .extent = {
+                std::max(tracked.info.extent.width >> level, 1u),
+                std::max(tracked.info.extent.height >> level, 1u),
+                1
+            },
+        };
+    }
+
+    vkCmdCopyImage(m_commandBuffer,
+                   tracked.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   *pOut, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   regions.size(), regions.data());
+
+    // new image is left in the layout the old one was used in
+    VkImageMemoryBarrier barrier = barriers[1];
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = tracked.layout;
+
+    vkCmdPipelineBarrier(m_commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barrier);
+
+    return true;
+}
+
+bool Defragmenter::run_pass() {
+    GpuAllocator* memory = m_gpu->memory();
+
+    std::vector<DefragmentationMove> moves = memory->begin_defragmentation_pass();
+    if(moves.empty()) {
+        return false;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(m_commandBuffer, &beginInfo);
+
+    // writes of the frames and uploads so far are done before the copies
+    VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    };
+    vkCmdPipelineBarrier(m_commandBuffer,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    RetiringPass pass = {};
+    std::vector<std::pair<VmaAllocation, VkBuffer>> movedBuffers;
+    std::vector<std::pair<VmaAllocation, VkImage>> movedImages;
+
+    // resources nobody tracks stay in place
+    for(auto& move : moves) {
+        move.isIgnored = true;
+
+        // owners write mapped memory directly, the mapping is moved only
+        // once the pass ends, so writes until then would be lost
+        if(memory->mapped_data(move.allocation) != nullptr) {
+            continue;
+        }
+
+        auto buffer = m_buffers.find(move.allocation.allocation);
+        if(buffer != m_buffers.end()) {
+            VkBuffer moved = VK_NULL_HANDLE;
+            if(record_buffer_move(move, buffer->second, &moved)) {
+                movedBuffers.emplace_back(move.allocation.allocation, moved);
+                move.isIgnored = false;
+            }
+            continue;
+        }
+
+        auto image = m_images.find(move.allocation.allocation);
+        if(image != m_images.end()) {
+            VkImage moved = VK_NULL_HANDLE;
+            if(record_image_move(move, image->second, &moved)) {
+                movedImages.emplace_back(move.allocation.allocation, moved);
+                move.isIgnored = false;
+            }
+        }
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(m_commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    vkEndCommandBuffer(m_commandBuffer);
+
+    // nothing was recorded, the pass can end right away
+    if(movedBuffers.empty() && movedImages.empty()) {
+        return !memory->end_defragmentation_pass(moves);
+    }
+
+    VkCommandBufferSubmitInfoKHR commandBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR,
+            .commandBuffer = m_commandBuffer,
+    };
+
+    VkSubmitInfo2 submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+    };
+
+    vkResetFences(m_gpu->dev(), 1, &m_fence);
+    m_gpu->enqueue_graphics(&submitInfo, m_fence);
+    uint64_t frame = m_gpu->deletion_queue()->next_frame();
+
+    // waiting keeps the owners from writing into resources already copied
+    vkWaitForFences(m_gpu->dev(), 1, &m_fence, VK_TRUE, UINT64_MAX);
+    m_gpu->deletion_queue()->collect(frame);
+    if(!movedImages.empty()) {
+        // descriptor sets of the images are not used by any frame once idle
+        vkQueueWaitIdle(m_gpu->graphics_queue());
+    }
+
+    for(auto& [allocation, moved] : movedBuffers) {
+        TrackedBuffer& tracked = m_buffers[allocation];
+        pass.buffers.push_back(tracked.buffer);
+        tracked.buffer = moved;
+        tracked.onMoved(moved);
+    }
+
+    for(auto& [allocation, moved] : movedImages) {
+        TrackedImage& tracked = m_images[allocation];
+        pass.images.push_back(tracked.image);
+        tracked.image = moved;
+        tracked.onMoved(moved);
+    }
+
+    m_numMoved += movedBuffers.size() + movedImages.size();
+
+    // old resources are used by the frames submitted until now
+    pass.frame = m_gpu->deletion_queue()->frame();
+    pass.moves = std::move(moves);
+    m_retiringPass = std::move(pass);
+
+    return true;
+}
+
+void Defragmenter::end_pass() {
+    for(auto buffer : m_retiringPass->buffers) {
+        vkDestroyBuffer(m_gpu->dev(), buffer, nullptr);
+    }
+
+    for(auto image : m_retiringPass->images) {
+        vkDestroyImage(m_gpu->dev(), image, nullptr);
+    }
+
+    bool isFinished = m_gpu->memory()->end_defragmentation_pass(m_retiringPass->moves);
+    m_retiringPass.reset();
+
+    if(isFinished && m_isRunning) {
+        m_gpu->memory()->end_defragmentation();
+        m_isRunning = false;
+    }
+}
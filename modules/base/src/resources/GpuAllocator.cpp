@@ -0,0 +1,18 @@
+#include "resources/GpuAllocator.h"
+
+const char* memory_category_name(MemoryCategory category) {
+    switch(category) {
+        case MEMORY_CATEGORY_ATTACHMENT:
+            return "Attachments";
+        case MEMORY_CATEGORY_TEXTURE:
+            return "Textures";
+        case MEMORY_CATEGORY_MESH:
+            return "Meshes";
+        case MEMORY_CATEGORY_STAGING:
+            return "Staging";
+        case MEMORY_CATEGORY_UNIFORM:
+            return "Uniforms";
+        default:
+            return "Other";
+    }
+}
@@ -4,9 +4,15 @@
 
 ImageView 
 Image::create_view(const Gpu* gpu, VkFormat format,
-				   VkImageSubresourceRange subresource) {
+				   VkImageSubresourceRange subresource, VkImageUsageFlags usage) {
+	VkImageViewUsageCreateInfo usageInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+		.usage = usage,
+	};
+
 	VkImageViewCreateInfo viewInfo = {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.pNext = usage != 0 ? &usageInfo : nullptr,
 		.image = img,
 		.viewType = subresource.layerCount == 1 ? VK_IMAGE_VIEW_TYPE_2D : VK_IMAGE_VIEW_TYPE_2D_ARRAY,
 		.format = format,
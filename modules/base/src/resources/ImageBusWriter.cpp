@@ -2,9 +2,15 @@
 
 #include <string.h>
 #include <volk.h>
+#include <algorithm>
 #include <cmath>
+#include <format>
+#include <stdexcept>
 
-int ImageBusWriter::create_staging_buffer(size_t size) {
+// multiple of all texel and block sizes
+static constexpr size_t STAGING_ALIGNMENT = 16;
+
+Buffer ImageBusWriter::create_staging_buffer(size_t size, void** ppMapped) {
 	BufferCreateInfo stagingBufferInfo = {
 		.size = size,
 		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -12,86 +18,62 @@ int ImageBusWriter::create_staging_buffer(size_t size) {
 	};
 
 	MemoryAllocationInfo memoryAllocationInfo = {
-		.usage = MEMORY_USAGE_AUTO_PREFER_HOST
-	};
-
-	m_gpu->memory()->create_buffer(&stagingBufferInfo, &memoryAllocationInfo,
-								&m_stagingBuffer);
-
-    m_gpu->memory()->map(m_stagingBuffer.allocation, &m_pMappedData);
-
-	return 0;
-}
-
-int ImageBusWriter::create_staging_command_buffer() {
-	VkCommandBufferAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = m_gpu->transfer_command_pool(),
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
+		.usage = MEMORY_USAGE_AUTO_PREFER_HOST,
+		.category = MEMORY_CATEGORY_STAGING
 	};
 
-	vkAllocateCommandBuffers(m_gpu->dev(), &allocInfo,
-							 &m_stagingCommandBuffer);
-
-	return 0;
-}
-
-int ImageBusWriter::create_fence() {
-    VkFenceCreateInfo fenceInfo = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
+    Buffer buffer;
+	if(m_gpu->memory()->create_buffer(&stagingBufferInfo, &memoryAllocationInfo, &buffer)) {
+        throw std::runtime_error(std::format("Failed to create image staging buffer of {} bytes", size));
+    }
 
-    vkCreateFence(m_gpu->dev(), &fenceInfo, nullptr, &m_fence);
+    m_gpu->memory()->map(buffer.allocation, ppMapped);
 
-    return 0;
+	return buffer;
 }
 
-ImageBusWriter::ImageBusWriter(const Gpu* gpu, Image *pTarget,
-							   VkExtent2D extent, uint32_t formatSize,
-							   size_t maxWrites) :
+ImageBusWriter::ImageBusWriter(const Gpu* gpu, size_t size, uint32_t numSegments) :
 m_gpu(gpu),
-m_pTarget(pTarget),
-m_writes(maxWrites),
-m_numWrites(0),
-m_formatSize(formatSize),
-m_imageSize(extent.width * extent.height * formatSize) {
-	create_staging_buffer(extent.width * extent.height * formatSize);
-	create_staging_command_buffer();
-	create_fence();
-}
-
-void ImageBusWriter::write(VkBufferImageCopy write, void *pData, size_t size) {
-	write.bufferOffset = m_numWrites * m_imageSize;
-	m_writes[m_numWrites] = write;
-
-	memcpy((char*)m_pMappedData + m_numWrites * m_imageSize, pData, size);
+m_segmentSize(0),
+m_pMappedData(nullptr),
+m_segmentIdx(0),
+m_lastTicket(0) {
+    // segments start at offsets aligned for any texel or block size
+    if(numSegments == 0 || size / numSegments < STAGING_ALIGNMENT) {
+        throw std::runtime_error(std::format(
+            "Cannot split bus of {} bytes into {} segments", size, numSegments));
+    }
 
-	m_numWrites++;
+    m_segmentSize = size / numSegments / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
 
-	if(m_numWrites >= m_writes.size()) {
-		flush();
-	}
+    m_segments.resize(numSegments);
+    for(uint32_t i = 0; i < numSegments; i++) {
+        m_segments[i] = Segment {
+            .offset = i * m_segmentSize,
+            .usedSize = 0,
+            .ticket = 0,
+        };
+    }
 }
 
-void ImageBusWriter::flush() {
-	if(m_numWrites == 0) return;
-
-	vkWaitForFences(m_gpu->dev(), 1, &m_fence, VK_TRUE, UINT64_MAX);
-    vkResetFences(m_gpu->dev(), 1, &m_fence);
+ImageBusWriter::~ImageBusWriter() {
+    wait();
+    release_dedicated();
 
-    m_gpu->memory()->flush(m_stagingBuffer.allocation, 0,
-							m_imageSize * m_numWrites);
-
-	VkCommandBufferBeginInfo beginInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-	};
+    if(m_pMappedData != nullptr) {
+        m_gpu->memory()->unmap(m_stagingBuffer.allocation);
+        m_gpu->memory()->destroy_buffer(&m_stagingBuffer);
+    }
+}
 
-	vkBeginCommandBuffer(m_stagingCommandBuffer, &beginInfo);
+void ImageBusWriter::record_writes(VkCommandBuffer commandBuffer, VkBuffer staging,
+                                   const std::vector<Write>& writes) {
+    UploadService* uploads = m_gpu->uploads();
 
-    VkImageMemoryBarrier barrierInfo = {
+    std::vector<VkImageMemoryBarrier> barriers(writes.size());
+    for(uint32_t i = 0; i < writes.size(); i++) {
+        const auto& region = writes[i].region;
+        barriers[i] = VkImageMemoryBarrier {
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
             .srcAccessMask = 0,
             .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
@@ -99,23 +81,19 @@ void ImageBusWriter::flush() {
             .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = m_pTarget->img,
-    };
-
-    std::vector<VkImageMemoryBarrier> barriers(m_writes.size(), barrierInfo);
-
-    uint32_t i = 0;
-    for(auto& write : m_writes) {
-        barriers[i++].subresourceRange = {
-                .aspectMask = write.imageSubresource.aspectMask,
-                .baseMipLevel = write.imageSubresource.mipLevel,
-                .levelCount = VK_REMAINING_MIP_LEVELS,
-                .baseArrayLayer = write.imageSubresource.baseArrayLayer,
-                .layerCount = write.imageSubresource.layerCount,
+            .image = writes[i].target,
+            .subresourceRange = {
+                .aspectMask = region.imageSubresource.aspectMask,
+                // only the written level, others might be written separately
+                .baseMipLevel = region.imageSubresource.mipLevel,
+                .levelCount = 1,
+                .baseArrayLayer = region.imageSubresource.baseArrayLayer,
+                .layerCount = region.imageSubresource.layerCount,
+            },
         };
     }
 
-    vkCmdPipelineBarrier(m_stagingCommandBuffer,
+    vkCmdPipelineBarrier(commandBuffer,
                          VK_PIPELINE_STAGE_TRANSFER_BIT,
                          VK_PIPELINE_STAGE_TRANSFER_BIT,
                          0,
@@ -123,39 +101,114 @@ void ImageBusWriter::flush() {
                          0, nullptr,
                          barriers.size(), barriers.data());
 
-	vkCmdCopyBufferToImage(
-		m_stagingCommandBuffer,
-		m_stagingBuffer.buf,
-		m_pTarget->img,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		m_numWrites,
-		m_writes.data()
-	);
+    for(const auto& write : writes) {
+        vkCmdCopyBufferToImage(commandBuffer, staging, write.target,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &write.region);
+    }
 
+    // the release transitions the images for reading
     for(auto& barrier : barriers) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        uploads->release_image(barrier.image, barrier.subresourceRange,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                               VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+                               VK_ACCESS_2_TRANSFER_READ_BIT_KHR | VK_ACCESS_2_SHADER_READ_BIT_KHR);
     }
+}
 
-    vkCmdPipelineBarrier(m_stagingCommandBuffer,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         0,
-                         0, nullptr,
-                         0, nullptr,
-                         barriers.size(), barriers.data());
+void ImageBusWriter::write_dedicated(VkImage target, VkBufferImageCopy region, const void *pData, size_t size) {
+    UploadService* uploads = m_gpu->uploads();
+    release_dedicated();
 
-	vkEndCommandBuffer(m_stagingCommandBuffer);
+    void* pMapped = nullptr;
+    Buffer buffer = create_staging_buffer(size, &pMapped);
+    memcpy(pMapped, pData, size);
+    m_gpu->memory()->flush(buffer.allocation, 0, size);
+    m_gpu->memory()->unmap(buffer.allocation);
 
-	VkSubmitInfo submitInfo = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &m_stagingCommandBuffer
-	};
+    region.bufferOffset = 0;
+    record_writes(uploads->record(), buffer.buf, { Write { .target = target, .region = region } });
+
+    m_lastTicket = uploads->pending_ticket();
+    m_dedicatedStagings.push_back(DedicatedStaging {
+        .buffer = buffer,
+        .ticket = m_lastTicket,
+    });
+}
+
+void ImageBusWriter::release_dedicated() {
+    std::erase_if(m_dedicatedStagings, [this](DedicatedStaging& staging) {
+        if(!m_gpu->uploads()->is_complete(staging.ticket)) {
+            return false;
+        }
+
+        m_gpu->memory()->destroy_buffer(&staging.buffer);
+        return true;
+    });
+}
+
+void ImageBusWriter::write(const Image* pTarget, VkBufferImageCopy region, const void *pData, size_t size) {
+    if(size > m_segmentSize) {
+        write_dedicated(pTarget->img, region, pData, size);
+        return;
+    }
+
+    if(m_pMappedData == nullptr) {
+        m_stagingBuffer = create_staging_buffer(m_segmentSize * m_segments.size(), &m_pMappedData);
+    }
+
+    if(m_segmentSize - m_segments[m_segmentIdx].usedSize < size) {
+        flush();
+    }
+
+    Segment& segment = m_segments[m_segmentIdx];
+    if(segment.usedSize == 0) {
+        // the data of the last upload might still be read by the transfer
+        m_gpu->uploads()->wait(segment.ticket);
+    }
 
-    m_gpu->enqueue_transfer(&submitInfo, m_fence);
+	region.bufferOffset = segment.offset + segment.usedSize;
+	memcpy((char*)m_pMappedData + region.bufferOffset, pData, size);
 
-	m_numWrites = 0;
+    segment.writes.push_back(Write {
+        .target = pTarget->img,
+        .region = region,
+    });
+    // copies from the buffer must be aligned to the texel size
+    segment.usedSize = std::min((segment.usedSize + size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT,
+                                m_segmentSize);
+}
+
+UploadTicket ImageBusWriter::flush() {
+    UploadService* uploads = m_gpu->uploads();
+
+    Segment& segment = m_segments[m_segmentIdx];
+	if(segment.writes.empty()) {
+		return m_lastTicket;
+	}
+
+    m_gpu->memory()->flush(m_stagingBuffer.allocation, segment.offset, segment.usedSize);
+
+    record_writes(uploads->record(), m_stagingBuffer.buf, segment.writes);
+
+    segment.ticket = uploads->pending_ticket();
+    m_lastTicket = segment.ticket;
+    segment.usedSize = 0;
+    segment.writes.clear();
+
+    m_segmentIdx = (m_segmentIdx + 1) % m_segments.size();
+
+	return segment.ticket;
+}
+
+void ImageBusWriter::wait() {
+    flush();
+
+    for(auto& segment : m_segments) {
+        m_gpu->uploads()->wait(segment.ticket);
+    }
+
+    for(auto& staging : m_dedicatedStagings) {
+        m_gpu->uploads()->wait(staging.ticket);
+    }
 }
@@ -2,57 +2,161 @@
 #include "Gpu.hpp"
 #include "Recording.hpp"
 #include "TransferTaskPipeline.hpp"
+#include "shaders/ComputePipelineBuilder.hpp"
+#include "shaders/PipelineBuilder.h"
+#include "shaders/ShaderInputSetLayoutBuilder.hpp"
 #include <vulkan/vulkan_core.h>
 
-MipmapGenerator::MipmapGenerator(const Gpu* gpu) :
-m_gpu(gpu), m_commandBuffer(create_command_buffer(gpu)), m_fence(create_fence(gpu)) {
+#include <algorithm>
+#include <array>
+#include <stdexcept>
 
+// matches the push constants of the downsample shader
+struct DownsampleConstants {
+    int32_t sourceExtent[2];
+    uint32_t numLevels;
+    uint32_t isSrgb;
+};
+
+// levels are written through UNORM views, storage of sRGB formats is rarely supported
+static VkFormat storage_format(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_SRGB ? VK_FORMAT_R8G8B8A8_UNORM : format;
 }
 
-VkFence MipmapGenerator::create_fence(const Gpu* gpu) {
-    VkFenceCreateInfo fenceInfo = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
+MipmapGenerator::MipmapGenerator(const Gpu* gpu, const Shader* pDownsampleShader) :
+m_gpu(gpu),
+m_downsampleSetLayout(VK_NULL_HANDLE),
+m_downsampleLayout(VK_NULL_HANDLE),
+m_downsamplePipeline(VK_NULL_HANDLE),
+m_ticket(0) {
+    if(pDownsampleShader == nullptr) {
+        return;
+    }
+
+    m_downsampleSetLayout = ShaderInputSetLayoutBuilder()
+            .binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+            .binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, DOWNSAMPLE_LEVELS, VK_SHADER_STAGE_COMPUTE_BIT)
+            .build(gpu);
+
+    m_downsampleLayout = PipelineLayoutBuilder()
+            .input_set(0, m_downsampleSetLayout)
+            .push_constant_range(0, sizeof(DownsampleConstants), VK_SHADER_STAGE_COMPUTE_BIT)
+            .build(gpu);
+
+    m_downsamplePipeline = lft::ComputePipelineBuilder(pDownsampleShader, m_downsampleLayout)
+            .build(gpu)
+            .pipeline();
+}
+
+MipmapGenerator::~MipmapGenerator() {
+    flush();
+
+    for(auto& submission : m_submissions) {
+        vkWaitForFences(m_gpu->dev(), 1, &submission.fence, VK_TRUE, UINT64_MAX);
+        release(submission);
+        vkDestroyFence(m_gpu->dev(), submission.fence, nullptr);
+        vkFreeCommandBuffers(m_gpu->dev(), m_gpu->graphics_command_pool(), 1, &submission.commandBuffer);
+    }
+
+    vkDestroyPipeline(m_gpu->dev(), m_downsamplePipeline, nullptr);
+    vkDestroyPipelineLayout(m_gpu->dev(), m_downsampleLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_gpu->dev(), m_downsampleSetLayout, nullptr);
+}
 
-    VkFence fence = VK_NULL_HANDLE;
-    vkCreateFence(gpu->dev(), &fenceInfo, nullptr, &fence);
+void MipmapGenerator::release(Submission& submission) {
+    for(VkImageView view : submission.views) {
+        vkDestroyImageView(m_gpu->dev(), view, nullptr);
+    }
+    submission.views.clear();
 
-    return fence;
+    vkDestroyDescriptorPool(m_gpu->dev(), submission.descriptorPool, nullptr);
+    submission.descriptorPool = VK_NULL_HANDLE;
 }
 
-VkCommandBuffer MipmapGenerator::create_command_buffer(const Gpu* gpu) {
+MipmapGenerator::Submission& MipmapGenerator::take_submission() {
+    for(auto& submission : m_submissions) {
+        if(vkGetFenceStatus(m_gpu->dev(), submission.fence) == VK_SUCCESS) {
+            m_gpu->deletion_queue()->collect(submission.frame);
+            vkResetFences(m_gpu->dev(), 1, &submission.fence);
+            release(submission);
+            return submission;
+        }
+    }
+
     VkCommandBufferAllocateInfo allocInfo = {
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = gpu->transfer_command_pool(),
+            .commandPool = m_gpu->graphics_command_pool(),
             .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
             .commandBufferCount = 1,
     };
 
-    VkCommandBuffer cmdbuf = VK_NULL_HANDLE;
-    vkAllocateCommandBuffers(gpu->dev(), &allocInfo,
-                             &cmdbuf);
+    Submission submission = {
+        .commandBuffer = VK_NULL_HANDLE,
+        .fence = m_gpu->create_fence(false),
+        .frame = 0,
+        .descriptorPool = VK_NULL_HANDLE,
+    };
+
+    vkAllocateCommandBuffers(m_gpu->dev(), &allocInfo,
+                             &submission.commandBuffer);
 
-    return cmdbuf;
+    return m_submissions.emplace_back(submission);
 }
 
-uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExtent2D extent, VkImageSubresourceRange range) {
-    vkWaitForFences(m_gpu->dev(), 1, &m_fence, VK_TRUE, UINT64_MAX);
-    vkResetFences(m_gpu->dev(), 1, &m_fence);
+void MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExtent2D extent, VkImageSubresourceRange range,
+                               UploadTicket ticket) {
+    m_generations.push_back(Generation {
+        .image = image,
+        .oldLayout = oldLayout,
+        .extent = extent,
+        .range = range,
+        .format = VK_FORMAT_UNDEFINED,
+    });
+    m_ticket = std::max(m_ticket, ticket);
+}
 
+bool MipmapGenerator::is_downsampled(VkFormat format) const {
+    return m_downsamplePipeline != VK_NULL_HANDLE &&
+           (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB);
+}
 
-    VkCommandBufferBeginInfo beginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+void MipmapGenerator::downsample(Image image, VkFormat format, VkImageLayout oldLayout, VkExtent2D extent,
+                                 uint32_t levelCount, UploadTicket ticket) {
+    VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = levelCount,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
     };
 
-    vkBeginCommandBuffer(m_commandBuffer, &beginInfo);
+    if(!is_downsampled(format)) {
+        generate(image, oldLayout, extent, range, ticket);
+        return;
+    }
+
+    m_generations.push_back(Generation {
+        .image = image,
+        .oldLayout = oldLayout,
+        .extent = extent,
+        .range = range,
+        .format = format,
+    });
+    m_ticket = std::max(m_ticket, ticket);
+}
+
+void MipmapGenerator::record(VkCommandBuffer commandBuffer, const Generation& generation) {
+    const Image& image = generation.image;
+    VkImageLayout oldLayout = generation.oldLayout;
+    VkExtent2D extent = generation.extent;
+    const VkImageSubresourceRange& range = generation.range;
 
     VkImageMemoryBarrier barrier = {
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
             .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
             .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-            .oldLayout = oldLayout,
+            // only the base level was written, the rest is overwritten anyway
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
             .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
@@ -66,7 +170,7 @@ uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExten
             },
     };
 
-    vkCmdPipelineBarrier(m_commandBuffer,
+    vkCmdPipelineBarrier(commandBuffer,
                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
                          0, nullptr,
                          0, nullptr,
@@ -75,18 +179,19 @@ uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExten
     barrier.subresourceRange.levelCount = 1;
 
     int32_t width = extent.width;
+    int32_t height = extent.height;
     auto layout = oldLayout;
 
     for (uint32_t i = 1; i < range.levelCount; i++) {
         uint32_t from_level = i - 1;
         uint32_t to_level = i;
 
-        std::vector<VkImageMemoryBarrier> barriers(2, barrier);
+        std::array<VkImageMemoryBarrier, 2> barriers = { barrier, barrier };
         barriers[0].oldLayout = layout;
         barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
         barriers[0].subresourceRange.baseMipLevel = from_level;
 
-        vkCmdPipelineBarrier(m_commandBuffer,
+        vkCmdPipelineBarrier(commandBuffer,
                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
                              0, nullptr,
                              0, nullptr,
@@ -101,7 +206,7 @@ uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExten
                 },
                 .srcOffsets = {
                         { 0, 0, 0 },
-                        { width, width, 1 }
+                        { width, height, 1 }
                 },
                 .dstSubresource = {
                         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
@@ -113,13 +218,13 @@ uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExten
                         { 0, 0, 0 },
                         {
                             width > 1 ? width / 2 : 1,
-                            width > 1 ? width / 2 : 1, 
+                            height > 1 ? height / 2 : 1,
                             1
                         }
                 },
         };
 
-        vkCmdBlitImage(m_commandBuffer,
+        vkCmdBlitImage(commandBuffer,
                        image.img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
                        image.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                        1, &blit,
@@ -131,17 +236,18 @@ uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExten
         barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
         barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-        vkCmdPipelineBarrier(m_commandBuffer,
+        vkCmdPipelineBarrier(commandBuffer,
                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
                              0, nullptr,
                              0, nullptr,
                              1, barriers.data()); */
 
-        width /= 2;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
         layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     }
 
-    std::vector<VkImageMemoryBarrier> barriers(2, barrier);
+    std::array<VkImageMemoryBarrier, 2> barriers = { barrier, barrier };
 
     barriers[0].subresourceRange.baseMipLevel = 0;
     barriers[0].subresourceRange.levelCount = range.levelCount - 1;
@@ -160,22 +266,297 @@ uint32_t MipmapGenerator::generate(Image image, VkImageLayout oldLayout, VkExten
     barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
     barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-    vkCmdPipelineBarrier(m_commandBuffer,
+    vkCmdPipelineBarrier(commandBuffer,
                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
                          0, nullptr,
                          0, nullptr,
                          2, barriers.data());
+}
 
+void MipmapGenerator::record_downsamples(Submission& submission) {
+    std::vector<const Generation*> generations;
+    uint32_t numSets = 0;
+    for(const auto& generation : m_generations) {
+        if(generation.format == VK_FORMAT_UNDEFINED) {
+            continue;
+        }
 
-    vkEndCommandBuffer(m_commandBuffer);
+        generations.push_back(&generation);
+        numSets += (generation.range.levelCount - 1 + DOWNSAMPLE_LEVELS - 1) / DOWNSAMPLE_LEVELS;
+    }
 
-    VkSubmitInfo submitInfo = {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &m_commandBuffer
+    if(generations.empty()) {
+        return;
+    }
+
+    VkDescriptorPoolSize poolSize = {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = numSets * (1 + DOWNSAMPLE_LEVELS),
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = numSets,
+            .poolSizeCount = 1,
+            .pPoolSizes = &poolSize,
+    };
+
+    if(vkCreateDescriptorPool(m_gpu->dev(), &poolInfo, nullptr, &submission.descriptorPool)) {
+        throw std::runtime_error("Failed to create descriptor pool for mip generation");
+    }
+
+    VkCommandBuffer commandBuffer = submission.commandBuffer;
+
+    // only the base level was written, the rest is overwritten anyway
+    std::vector<VkImageMemoryBarrier> barriers;
+    for(const Generation* pGeneration : generations) {
+        VkImageMemoryBarrier barrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+                .oldLayout = pGeneration->oldLayout,
+                .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = pGeneration->image.img,
+                .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                },
+        };
+        barriers.push_back(barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.subresourceRange.baseMipLevel = 1;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barriers.push_back(barrier);
+    }
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr,
+                         0, nullptr,
+                         barriers.size(), barriers.data());
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_downsamplePipeline);
+
+    const VkMemoryBarrier passBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
     };
 
-    m_gpu->enqueue_transfer(&submitInfo, m_fence);
+    // each pass continues from the last level of the previous one in all the images
+    for(uint32_t baseLevel = 0;; baseLevel += DOWNSAMPLE_LEVELS) {
+        bool isRecorded = false;
+
+        for(const Generation* pGeneration : generations) {
+            uint32_t levelCount = pGeneration->range.levelCount;
+            if(baseLevel + 1 >= levelCount) {
+                continue;
+            }
+
+            if(!isRecorded && baseLevel > 0) {
+                vkCmdPipelineBarrier(commandBuffer,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                     1, &passBarrier,
+                                     0, nullptr,
+                                     0, nullptr);
+            }
+            isRecorded = true;
+
+            uint32_t numLevels = std::min(DOWNSAMPLE_LEVELS, levelCount - 1 - baseLevel);
+
+            Image image = pGeneration->image;
+            std::array<VkDescriptorImageInfo, 1 + DOWNSAMPLE_LEVELS> imageInfos;
+            for(uint32_t i = 0; i < imageInfos.size(); i++) {
+                // bindings past the last level repeat it, nothing is stored there
+                if(i > numLevels) {
+                    imageInfos[i] = imageInfos[numLevels];
+                    continue;
+                }
+
+                VkImageView view = image.create_view(m_gpu, storage_format(pGeneration->format), {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = baseLevel + i,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                }, VK_IMAGE_USAGE_STORAGE_BIT).view;
+                submission.views.push_back(view);
+
+                imageInfos[i] = {
+                    .sampler = VK_NULL_HANDLE,
+                    .imageView = view,
+                    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+                };
+            }
+
+            VkDescriptorSetAllocateInfo allocInfo = {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .descriptorPool = submission.descriptorPool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &m_downsampleSetLayout,
+            };
+
+            VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+            vkAllocateDescriptorSets(m_gpu->dev(), &allocInfo, &descriptorSet);
+
+            std::array<VkWriteDescriptorSet, 2> writes = {
+                VkWriteDescriptorSet {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = descriptorSet,
+                    .dstBinding = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .pImageInfo = &imageInfos[0],
+                },
+                VkWriteDescriptorSet {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = descriptorSet,
+                    .dstBinding = 1,
+                    .descriptorCount = DOWNSAMPLE_LEVELS,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .pImageInfo = &imageInfos[1],
+                },
+            };
+            vkUpdateDescriptorSets(m_gpu->dev(), writes.size(), writes.data(), 0, nullptr);
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_downsampleLayout,
+                                    0, 1, &descriptorSet, 0, nullptr);
+
+            VkExtent2D extent = pGeneration->extent;
+            DownsampleConstants constants = {
+                .sourceExtent = {
+                    (int32_t)std::max(extent.width >> baseLevel, 1u),
+                    (int32_t)std::max(extent.height >> baseLevel, 1u),
+                },
+                .numLevels = numLevels,
+                .isSrgb = pGeneration->format == VK_FORMAT_R8G8B8A8_SRGB,
+            };
+            vkCmdPushConstants(commandBuffer, m_downsampleLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                               0, sizeof(constants), &constants);
+
+            // a workgroup covers 16x16 texels of the first generated level
+            uint32_t width = std::max(extent.width >> (baseLevel + 1), 1u);
+            uint32_t height = std::max(extent.height >> (baseLevel + 1), 1u);
+            vkCmdDispatch(commandBuffer, (width + 15) / 16, (height + 15) / 16, 1);
+        }
+
+        if(!isRecorded) {
+            break;
+        }
+    }
+
+    barriers.clear();
+    for(const Generation* pGeneration : generations) {
+        barriers.push_back(VkImageMemoryBarrier {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                .newLayout = pGeneration->oldLayout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = pGeneration->image.img,
+                .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = VK_REMAINING_MIP_LEVELS,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                },
+        });
+    }
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                         0, nullptr,
+                         0, nullptr,
+                         barriers.size(), barriers.data());
+}
+
+uint64_t MipmapGenerator::flush(UploadTicket ticket) {
+    if(m_generations.empty()) {
+        return 0;
+    }
+
+    m_ticket = std::max(m_ticket, ticket);
+
+    UploadService* uploads = m_gpu->uploads();
+    // base levels must be submitted before the graphics queue waits for them
+    if(m_ticket > uploads->last_submitted()) {
+        uploads->submit();
+    }
+
+    Submission& submission = take_submission();
+    VkCommandBuffer commandBuffer = submission.commandBuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // takes ownership of the base levels from the transfer queue
+    UploadTicket acquired = uploads->acquire(commandBuffer, m_ticket);
+
+    for(const auto& generation : m_generations) {
+        if(generation.format == VK_FORMAT_UNDEFINED) {
+            record(commandBuffer, generation);
+        }
+    }
+
+    record_downsamples(submission);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkCommandBufferSubmitInfoKHR commandBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR,
+            .commandBuffer = commandBuffer,
+    };
+
+    VkSemaphoreSubmitInfoKHR waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .semaphore = uploads->semaphore(),
+            .value = acquired,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+    };
+
+    VkSubmitInfo2 submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .waitSemaphoreInfoCount = acquired > 0 ? 1u : 0u,
+            .pWaitSemaphoreInfos = &waitInfo,
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+    };
+
+    m_gpu->enqueue_graphics(&submitInfo, submission.fence);
+    // objects retired from now on might be used by the generation
+    submission.frame = m_gpu->deletion_queue()->next_frame();
+
+    m_generations.clear();
+    m_ticket = 0;
+    return submission.frame;
+}
+
+bool MipmapGenerator::is_complete(uint64_t generation) {
+    if(generation <= m_gpu->deletion_queue()->completed_frame()) {
+        return true;
+    }
+
+    for(auto& submission : m_submissions) {
+        if(submission.frame == generation) {
+            return vkGetFenceStatus(m_gpu->dev(), submission.fence) == VK_SUCCESS;
+        }
+    }
 
-    return 0;
+    // submissions are reused only once finished
+    return true;
 }
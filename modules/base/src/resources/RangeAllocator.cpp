@@ -0,0 +1,69 @@
+#include "resources/RangeAllocator.hpp"
+
+#include <algorithm>
+
+RangeAllocator::RangeAllocator(VkDeviceSize size) :
+    m_size(size),
+    m_freeSize(0) {
+    reset();
+}
+
+std::optional<VkDeviceSize> RangeAllocator::allocate(VkDeviceSize size) {
+    auto found = std::find_if(m_freeRanges.begin(), m_freeRanges.end(),
+        [size](const FreeRange& range) { return range.size >= size; });
+    if(found == m_freeRanges.end()) {
+        return {};
+    }
+
+    VkDeviceSize offset = found->offset;
+    found->offset += size;
+    found->size -= size;
+    if(found->size == 0) {
+        m_freeRanges.erase(found);
+    }
+
+    m_freeSize -= size;
+    return offset;
+}
+
+void RangeAllocator::free(VkDeviceSize offset, VkDeviceSize size) {
+    if(size == 0) {
+        return;
+    }
+
+    FreeRange range = { .offset = offset, .size = size };
+    auto next = std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), range,
+        [](const FreeRange& a, const FreeRange& b) { return a.offset < b.offset; });
+    next = m_freeRanges.insert(next, range);
+    m_freeSize += size;
+
+    // merge with the following range
+    if(next + 1 != m_freeRanges.end() &&
+        next->offset + next->size == (next + 1)->offset) {
+        next->size += (next + 1)->size;
+        m_freeRanges.erase(next + 1);
+    }
+
+    // merge with the preceding range
+    if(next != m_freeRanges.begin() &&
+        (next - 1)->offset + (next - 1)->size == next->offset) {
+        (next - 1)->size += next->size;
+        m_freeRanges.erase(next);
+    }
+}
+
+void RangeAllocator::reset() {
+    m_freeRanges.clear();
+    if(m_size > 0) {
+        m_freeRanges.push_back({ .offset = 0, .size = m_size });
+    }
+    m_freeSize = m_size;
+}
+
+VkDeviceSize RangeAllocator::largest_free_range() const {
+    VkDeviceSize largest = 0;
+    for(auto& range : m_freeRanges) {
+        largest = std::max(largest, range.size);
+    }
+    return largest;
+}
@@ -0,0 +1,145 @@
+#include "resources/UniformAllocator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "Gpu.hpp"
+
+static VkDeviceSize align_up(VkDeviceSize size, VkDeviceSize alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+UniformAllocator::Block UniformAllocator::create_block(VkDeviceSize size, const char* name) {
+    BufferCreateInfo bufferInfo = {
+        .size = size,
+        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        .isExclusive = true,
+    };
+
+    // coherent, so writes need no flush
+    MemoryAllocationInfo memoryInfo = {
+        .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        .category = MEMORY_CATEGORY_UNIFORM,
+    };
+
+    Block block = {
+        .pMapped = nullptr,
+        .ranges = RangeAllocator(size),
+    };
+
+    if(m_gpu->memory()->create_buffer(&bufferInfo, &memoryInfo, &block.buffer) ||
+        block.buffer.buf == VK_NULL_HANDLE) {
+        throw std::runtime_error(std::format("Failed to allocate uniform block of {} bytes", size));
+    }
+    block.buffer.set_debug_name(m_gpu, name);
+
+    m_gpu->memory()->map(block.buffer.allocation, (void**)&block.pMapped);
+
+    return block;
+}
+
+UniformAllocator::UniformAllocator(
+    const Gpu* gpu,
+    uint32_t numFrames,
+    VkDeviceSize frameSize,
+    VkDeviceSize blockSize
+) : m_gpu(gpu),
+    m_numFrames(numFrames),
+    m_frameIdx(0),
+    m_frameOffset(0) {
+    if(numFrames == 0) {
+        throw std::runtime_error("Uniform ring needs at least one frame");
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_gpu->gpu(), &properties);
+    m_alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+
+    m_blockSize = align_up(blockSize, m_alignment);
+    m_frameSize = align_up(frameSize, m_alignment);
+
+    Block ring = create_block(m_frameSize * m_numFrames, "uniform_ring");
+    m_ring = ring.buffer;
+    m_pRingMapped = ring.pMapped;
+}
+
+UniformAllocator::~UniformAllocator() {
+    for(auto& block : m_blocks) {
+        m_gpu->memory()->unmap(block.buffer.allocation);
+        m_gpu->memory()->destroy_buffer(&block.buffer);
+    }
+
+    m_gpu->memory()->unmap(m_ring.allocation);
+    m_gpu->memory()->destroy_buffer(&m_ring);
+}
+
+void UniformAllocator::reclaim() {
+    uint64_t completed = m_gpu->deletion_queue()->completed_frame();
+    std::erase_if(m_pendingFrees, [&](const PendingFree& pending) {
+        if(pending.frame > completed) {
+            return false;
+        }
+
+        m_blocks[pending.blockIdx].ranges.free(pending.offset, pending.size);
+        return true;
+    });
+}
+
+UniformAllocation UniformAllocator::allocate(VkDeviceSize size) {
+    reclaim();
+
+    VkDeviceSize alignedSize = align_up(std::max<VkDeviceSize>(size, 1), m_alignment);
+
+    for(auto& block : m_blocks) {
+        std::optional<VkDeviceSize> offset = block.ranges.allocate(alignedSize);
+        if(!offset.has_value()) {
+            continue;
+        }
+
+        return UniformAllocation {
+            .buffer = block.buffer,
+            .offset = *offset,
+            .size = size,
+            .pMapped = block.pMapped + *offset,
+        };
+    }
+
+    // allocations larger than a block get a block of their own
+    m_blocks.push_back(create_block(std::max(m_blockSize, alignedSize), "uniform_block"));
+    return allocate(size);
+}
+
+void UniformAllocator::free(const UniformAllocation& allocation) {
+    auto block = std::find_if(m_blocks.begin(), m_blocks.end(),
+        [&allocation](const Block& block) { return block.buffer.buf == allocation.buffer.buf; });
+    if(block == m_blocks.end()) {
+        throw std::runtime_error("Uniform allocation does not belong to the allocator");
+    }
+
+    m_pendingFrees.push_back(PendingFree {
+        .frame = m_gpu->deletion_queue()->frame(),
+        .blockIdx = (uint32_t)(block - m_blocks.begin()),
+        .offset = allocation.offset,
+        .size = align_up(std::max<VkDeviceSize>(allocation.size, 1), m_alignment),
+    });
+}
+
+void UniformAllocator::next_frame() {
+    m_frameIdx = (m_frameIdx + 1) % m_numFrames;
+    m_frameOffset = 0;
+}
+
+uint32_t UniformAllocator::push(const void* pData, VkDeviceSize size) {
+    if(m_frameOffset + size > m_frameSize) {
+        throw std::runtime_error(std::format("Uniform ring frame of {} bytes is full", m_frameSize));
+    }
+
+    VkDeviceSize offset = m_frameIdx * m_frameSize + m_frameOffset;
+    memcpy(m_pRingMapped + offset, pData, size);
+    m_frameOffset = align_up(m_frameOffset + size, m_alignment);
+
+    return (uint32_t)offset;
+}
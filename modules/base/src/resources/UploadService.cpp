@@ -0,0 +1,307 @@
+#include "resources/UploadService.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Gpu.hpp"
+
+UploadService::UploadService(const Gpu* gpu) :
+    m_gpu(gpu),
+    m_semaphore(VK_NULL_HANDLE),
+    m_batchIdx(-1),
+    m_lastSubmitted(0),
+    m_lastCompleted(0),
+    m_lastAcquired(0) {
+    m_semaphore = create_timeline_semaphore();
+}
+
+UploadService::~UploadService() {
+    wait(submit());
+
+    for(auto& batch : m_batches) {
+        vkFreeCommandBuffers(m_gpu->dev(), m_gpu->transfer_command_pool(), 1, &batch.commandBuffer);
+    }
+
+    vkDestroySemaphore(m_gpu->dev(), m_semaphore, nullptr);
+}
+
+VkSemaphore UploadService::create_timeline_semaphore() {
+    VkSemaphoreTypeCreateInfoKHR typeInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+        .initialValue = 0,
+    };
+
+    VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &typeInfo,
+    };
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    if(vkCreateSemaphore(m_gpu->dev(), &semaphoreInfo, nullptr, &semaphore)) {
+        throw std::runtime_error("Failed to create upload timeline semaphore");
+    }
+
+    return semaphore;
+}
+
+bool UploadService::is_ownership_transferred() const {
+    return m_gpu->transfer_queue_idx() != m_gpu->graphics_queue_idx();
+}
+
+uint32_t UploadService::take_batch() {
+    UploadTicket completed = completed_ticket();
+
+    for(uint32_t i = 0; i < m_batches.size(); i++) {
+        if(m_batches[i].ticket <= completed) {
+            return i;
+        }
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = m_gpu->transfer_command_pool(),
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    Batch batch = {
+        .commandBuffer = VK_NULL_HANDLE,
+        .ticket = 0,
+    };
+
+    if(vkAllocateCommandBuffers(m_gpu->dev(), &allocInfo, &batch.commandBuffer)) {
+        throw std::runtime_error("Failed to allocate upload command buffer");
+    }
+
+    m_batches.push_back(batch);
+    return m_batches.size() - 1;
+}
+
+VkCommandBuffer UploadService::record() {
+    if(m_batchIdx >= 0) {
+        return m_batches[m_batchIdx].commandBuffer;
+    }
+
+    uint32_t batchIdx = take_batch();
+    Batch& batch = m_batches[batchIdx];
+    // keeps the batch from being taken again until it finishes
+    batch.ticket = m_lastSubmitted + 1;
+
+    {
+        std::lock_guard lock(m_ticketMutex);
+        m_batchIdx = (int32_t)batchIdx;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    if(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo)) {
+        throw std::runtime_error("Failed to begin upload command buffer");
+    }
+
+    return batch.commandBuffer;
+}
+
+void UploadService::release_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+                                   VkPipelineStageFlags2KHR dstStage, VkAccessFlags2KHR dstAccess) {
+    bool isTransferred = is_ownership_transferred();
+
+    // destination scope of the release is ignored, the acquire provides it
+    m_bufferReleases.push_back(VkBufferMemoryBarrier2KHR {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR,
+        .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+        .dstStageMask = isTransferred ? VK_PIPELINE_STAGE_2_NONE_KHR : dstStage,
+        .dstAccessMask = isTransferred ? VK_ACCESS_2_NONE_KHR : dstAccess,
+        .srcQueueFamilyIndex = isTransferred ? m_gpu->transfer_queue_idx() : VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = isTransferred ? m_gpu->graphics_queue_idx() : VK_QUEUE_FAMILY_IGNORED,
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+    });
+}
+
+void UploadService::release_image(VkImage image, VkImageSubresourceRange range,
+                                  VkImageLayout oldLayout, VkImageLayout newLayout,
+                                  VkPipelineStageFlags2KHR dstStage, VkAccessFlags2KHR dstAccess) {
+    bool isTransferred = is_ownership_transferred();
+
+    m_imageReleases.push_back(VkImageMemoryBarrier2KHR {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+        .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+        .dstStageMask = isTransferred ? VK_PIPELINE_STAGE_2_NONE_KHR : dstStage,
+        .dstAccessMask = isTransferred ? VK_ACCESS_2_NONE_KHR : dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = isTransferred ? m_gpu->transfer_queue_idx() : VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = isTransferred ? m_gpu->graphics_queue_idx() : VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = range,
+    });
+}
+
+UploadTicket UploadService::submit() {
+    if(m_batchIdx < 0) {
+        return m_lastSubmitted;
+    }
+
+    Batch& batch = m_batches[m_batchIdx];
+
+    VkDependencyInfoKHR releaseInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+        .bufferMemoryBarrierCount = (uint32_t)m_bufferReleases.size(),
+        .pBufferMemoryBarriers = m_bufferReleases.data(),
+        .imageMemoryBarrierCount = (uint32_t)m_imageReleases.size(),
+        .pImageMemoryBarriers = m_imageReleases.data(),
+    };
+
+    if(!m_bufferReleases.empty() || !m_imageReleases.empty()) {
+        vkCmdPipelineBarrier2KHR(batch.commandBuffer, &releaseInfo);
+    }
+
+    if(vkEndCommandBuffer(batch.commandBuffer)) {
+        throw std::runtime_error("Failed to end upload command buffer");
+    }
+
+    {
+        // the batch is not pending anymore once its ticket is submitted
+        std::lock_guard lock(m_ticketMutex);
+        batch.ticket = ++m_lastSubmitted;
+        m_batchIdx = -1;
+    }
+
+    VkCommandBufferSubmitInfoKHR commandBufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR,
+        .commandBuffer = batch.commandBuffer,
+    };
+
+    VkSemaphoreSubmitInfoKHR signalInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+        .semaphore = m_semaphore,
+        .value = batch.ticket,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+    };
+
+    VkSubmitInfo2KHR submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR,
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &commandBufferInfo,
+        .signalSemaphoreInfoCount = 1,
+        .pSignalSemaphoreInfos = &signalInfo,
+    };
+
+    m_gpu->enqueue_transfer(&submitInfo, VK_NULL_HANDLE);
+
+    // acquire mirrors the release, on a single family only the wait is needed
+    PendingAcquire acquire = { .ticket = batch.ticket };
+    if(is_ownership_transferred()) {
+        acquire.buffers = std::move(m_bufferReleases);
+        acquire.images = std::move(m_imageReleases);
+
+        for(auto& barrier : acquire.buffers) {
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+            barrier.srcAccessMask = VK_ACCESS_2_NONE_KHR;
+        }
+
+        for(auto& barrier : acquire.images) {
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+            barrier.srcAccessMask = VK_ACCESS_2_NONE_KHR;
+        }
+    }
+    m_pendingAcquires.push_back(std::move(acquire));
+
+    m_bufferReleases.clear();
+    m_imageReleases.clear();
+
+    return batch.ticket;
+}
+
+UploadTicket UploadService::pending_ticket() const {
+    std::lock_guard lock(m_ticketMutex);
+    return m_batchIdx < 0 ? m_lastSubmitted : m_lastSubmitted + 1;
+}
+
+UploadTicket UploadService::last_submitted() const {
+    std::lock_guard lock(m_ticketMutex);
+    return m_lastSubmitted;
+}
+
+UploadTicket UploadService::completed_ticket() {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValueKHR(m_gpu->dev(), m_semaphore, &value);
+
+    std::lock_guard lock(m_ticketMutex);
+    m_lastCompleted = std::max(m_lastCompleted, value);
+    return m_lastCompleted;
+}
+
+bool UploadService::is_complete(UploadTicket ticket) {
+    {
+        std::lock_guard lock(m_ticketMutex);
+        if(ticket <= m_lastCompleted) {
+            return true;
+        }
+    }
+
+    return ticket <= completed_ticket();
+}
+
+void UploadService::wait(UploadTicket ticket) {
+    if(ticket > m_lastSubmitted) {
+        submit();
+    }
+
+    if(is_complete(ticket)) {
+        return;
+    }
+
+    VkSemaphoreWaitInfoKHR waitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+        .semaphoreCount = 1,
+        .pSemaphores = &m_semaphore,
+        .pValues = &ticket,
+    };
+
+    vkWaitSemaphoresKHR(m_gpu->dev(), &waitInfo, UINT64_MAX);
+
+    std::lock_guard lock(m_ticketMutex);
+    m_lastCompleted = std::max(m_lastCompleted, ticket);
+}
+
+UploadTicket UploadService::acquire(VkCommandBuffer commandBuffer, UploadTicket ticket,
+                                    std::pmr::memory_resource* pTemporaries) {
+    // side submissions acquire outside of frames, nothing resets the frame arena there
+    std::pmr::vector<VkBufferMemoryBarrier2KHR> buffers(pTemporaries);
+    std::pmr::vector<VkImageMemoryBarrier2KHR> images(pTemporaries);
+    UploadTicket acquired = 0;
+
+    // submissions are pending in order of their tickets
+    auto end = std::find_if(m_pendingAcquires.begin(), m_pendingAcquires.end(),
+        [ticket](const PendingAcquire& pending) { return pending.ticket > ticket; });
+
+    for(auto it = m_pendingAcquires.begin(); it != end; it++) {
+        buffers.insert(buffers.end(), it->buffers.begin(), it->buffers.end());
+        images.insert(images.end(), it->images.begin(), it->images.end());
+        acquired = it->ticket;
+    }
+    m_pendingAcquires.erase(m_pendingAcquires.begin(), end);
+
+    if(!buffers.empty() || !images.empty()) {
+        VkDependencyInfoKHR acquireInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+            .bufferMemoryBarrierCount = (uint32_t)buffers.size(),
+            .pBufferMemoryBarriers = buffers.data(),
+            .imageMemoryBarrierCount = (uint32_t)images.size(),
+            .pImageMemoryBarriers = images.data(),
+        };
+
+        vkCmdPipelineBarrier2KHR(commandBuffer, &acquireInfo);
+    }
+
+    m_lastAcquired = std::max(m_lastAcquired, acquired);
+    return acquired;
+}
@@ -0,0 +1,83 @@
+#include "FrameArena.hpp"
+
+#include <algorithm>
+
+namespace lft {
+
+FrameArena::FrameArena(size_t frame_size, std::pmr::memory_resource* upstream) :
+    m_upstream(upstream),
+    m_frame_size(frame_size),
+    m_current(nullptr) {
+    begin_frame(0);
+}
+
+FrameArena::~FrameArena() {
+    for(auto& region : m_regions) {
+        reset(*region);
+    }
+}
+
+void FrameArena::reset(Region& region) {
+    for(auto& overflow : region.overflows) {
+        m_upstream->deallocate(overflow.data, overflow.size, overflow.alignment);
+    }
+    region.overflows.clear();
+
+    // grows once, so the following frames fit into the region
+    size_t requested = region.requested.load(std::memory_order_relaxed);
+    if(requested > region.capacity) {
+        region.capacity = std::max(region.capacity * 2, requested);
+        region.data = std::make_unique<std::byte[]>(region.capacity);
+    }
+
+    region.offset.store(0, std::memory_order_relaxed);
+    region.requested.store(0, std::memory_order_relaxed);
+}
+
+void FrameArena::begin_frame(uint32_t frame_idx) {
+    while(m_regions.size() <= frame_idx) {
+        auto region = std::make_unique<Region>();
+        region->capacity = m_frame_size;
+        region->data = std::make_unique<std::byte[]>(m_frame_size);
+        m_regions.push_back(std::move(region));
+    }
+
+    m_current = m_regions[frame_idx].get();
+    reset(*m_current);
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment) {
+    Region& region = *m_current;
+    region.requested.fetch_add(bytes + alignment - 1, std::memory_order_relaxed);
+
+    uintptr_t base = (uintptr_t)region.data.get();
+    size_t offset = region.offset.load(std::memory_order_relaxed);
+    size_t end;
+    do {
+        uintptr_t start = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        end = start - base + bytes;
+        if(end > region.capacity) {
+            void* data = m_upstream->allocate(bytes, alignment);
+
+            std::lock_guard lock(region.overflow_mutex);
+            region.overflows.push_back(Overflow {
+                .data = data,
+                .size = bytes,
+                .alignment = alignment,
+            });
+            return data;
+        }
+    } while(!region.offset.compare_exchange_weak(offset, end, std::memory_order_relaxed));
+
+    return region.data.get() + (end - bytes);
+}
+
+void FrameArena::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    // memory is reclaimed all at once by the reset of the region
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace lft {
+
+/**
+ * Linear allocator of CPU temporaries, that live at most until their frame
+ * is finished. Each frame in flight has a region of its own, reset when the
+ * frame starts again, so nothing is freed individually.
+ *
+ * Allocating only bumps an atomic offset, threads recording in parallel do not
+ * contend on a lock. Requests not fitting into the region are served by the
+ * upstream resource and the region grows to the peak usage on its next reset.
+ */
+class FrameArena : public std::pmr::memory_resource {
+private:
+    struct Overflow {
+        void* data;
+        size_t size;
+        size_t alignment;
+    };
+
+    struct Region {
+        std::unique_ptr<std::byte[]> data;
+        size_t capacity = 0;
+        std::atomic<size_t> offset = 0;
+        // bytes requested during the frame, including those that did not fit
+        std::atomic<size_t> requested = 0;
+
+        std::mutex overflow_mutex;
+        std::vector<Overflow> overflows;
+    };
+
+    std::pmr::memory_resource* m_upstream;
+    size_t m_frame_size;
+
+    // regions are not movable, they are referenced by allocating threads
+    std::vector<std::unique_ptr<Region>> m_regions;
+    Region* m_current;
+
+    void reset(Region& region);
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+public:
+    /**
+     * @param frame_size initial size of the region of each frame
+     */
+    explicit FrameArena(size_t frame_size = 256 * 1024,
+                        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    ~FrameArena() override;
+
+    // Forbid copy, the regions are owned
+    FrameArena(const FrameArena&) = delete;
+
+    /**
+     * Makes the region of the frame current and resets it. Everything
+     * allocated from the region the last time the frame ran must be dead.
+     * Must not be called while other threads allocate.
+     */
+    void begin_frame(uint32_t frame_idx);
+
+    /**
+     * Bytes allocated from the current region so far.
+     */
+    size_t used() const {
+        return m_current->requested.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return m_current->capacity;
+    }
+};
+
+/**
+ * Vector of temporaries, allocated from the frame arena.
+ */
+template<typename T>
+using FrameVector = std::pmr::vector<T>;
+
+}
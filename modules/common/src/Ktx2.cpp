@@ -0,0 +1,304 @@
+#include "Ktx2.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+namespace lft::ktx2 {
+
+static constexpr uint8_t IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+struct Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(Header) == 80);
+
+struct LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// Khronos data format descriptor values
+static constexpr uint32_t DF_MODEL_BC1A = 128;
+static constexpr uint32_t DF_MODEL_BC3 = 130;
+static constexpr uint32_t DF_MODEL_BC5 = 132;
+static constexpr uint32_t DF_MODEL_BC7 = 134;
+static constexpr uint32_t DF_PRIMARIES_BT709 = 1;
+static constexpr uint32_t DF_TRANSFER_LINEAR = 1;
+static constexpr uint32_t DF_TRANSFER_SRGB = 2;
+static constexpr uint32_t DF_CHANNEL_RED = 0;
+static constexpr uint32_t DF_CHANNEL_GREEN = 1;
+static constexpr uint32_t DF_CHANNEL_ALPHA = 15;
+static constexpr uint32_t DF_QUALIFIER_LINEAR = 0x10;
+
+uint32_t block_size(uint32_t format) {
+    switch(format) {
+        case FORMAT_BC1_RGB_UNORM:
+        case FORMAT_BC1_RGB_SRGB:
+            return 8;
+        case FORMAT_BC3_UNORM:
+        case FORMAT_BC3_SRGB:
+        case FORMAT_BC5_UNORM:
+        case FORMAT_BC7_UNORM:
+        case FORMAT_BC7_SRGB:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+bool is_srgb(uint32_t format) {
+    return format == FORMAT_BC1_RGB_SRGB ||
+           format == FORMAT_BC3_SRGB ||
+           format == FORMAT_BC7_SRGB;
+}
+
+/**
+ * Basic descriptor block with a sample for each 64 bits of the block.
+ */
+static std::vector<uint32_t> create_dfd(uint32_t format) {
+    uint32_t model = 0;
+    // channel of each 64 bit half of the block
+    std::vector<uint32_t> channels;
+    switch(format) {
+        case FORMAT_BC1_RGB_UNORM:
+        case FORMAT_BC1_RGB_SRGB:
+            model = DF_MODEL_BC1A;
+            channels = { DF_CHANNEL_RED };
+            break;
+        case FORMAT_BC3_UNORM:
+        case FORMAT_BC3_SRGB:
+            model = DF_MODEL_BC3;
+            channels = { DF_CHANNEL_ALPHA | DF_QUALIFIER_LINEAR, DF_CHANNEL_RED };
+            break;
+        case FORMAT_BC5_UNORM:
+            model = DF_MODEL_BC5;
+            channels = { DF_CHANNEL_RED, DF_CHANNEL_GREEN };
+            break;
+        case FORMAT_BC7_UNORM:
+        case FORMAT_BC7_SRGB:
+            model = DF_MODEL_BC7;
+            channels = { DF_CHANNEL_RED };
+            break;
+        default:
+            throw std::runtime_error(std::format("Unsupported KTX2 format {}", format));
+    }
+
+    // whole block of BC7 is a single sample
+    uint32_t sampleBits = model == DF_MODEL_BC7 ? 128 : 64;
+    uint32_t blockSize = 24 + 16 * (uint32_t)channels.size();
+    uint32_t transfer = is_srgb(format) ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR;
+
+    std::vector<uint32_t> dfd = {
+        4 + blockSize,
+        0,
+        2 | (blockSize << 16),
+        model | (DF_PRIMARIES_BT709 << 8) | (transfer << 16),
+        3 | (3 << 8),
+        block_size(format),
+        0,
+    };
+
+    for(uint32_t i = 0; i < channels.size(); i++) {
+        dfd.push_back((i * sampleBits) | ((sampleBits - 1) << 16) | (channels[i] << 24));
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(UINT32_MAX);
+    }
+
+    return dfd;
+}
+
+/**
+ * Reads the header and the level index, level offsets are relative to the file.
+ */
+static Texture read_header(std::ifstream& file, const std::string& path) {
+    file.seekg(0, std::ios::end);
+    size_t fileSize = file.tellg();
+    file.seekg(0);
+
+    Header header;
+    if(fileSize < sizeof(Header) || !file.read((char*)&header, sizeof(Header))) {
+        throw std::runtime_error(std::format("{} is not a KTX2 file", path));
+    }
+
+    if(memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+        throw std::runtime_error(std::format("{} is not a KTX2 file", path));
+    }
+
+    if(block_size(header.vkFormat) == 0 || header.supercompressionScheme != 0 ||
+       header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+       header.levelCount == 0) {
+        throw std::runtime_error(std::format("Unsupported layout of KTX2 file {}", path));
+    }
+
+    std::vector<LevelIndex> indices(header.levelCount);
+    if(sizeof(Header) + indices.size() * sizeof(LevelIndex) > fileSize ||
+       !file.read((char*)indices.data(), indices.size() * sizeof(LevelIndex))) {
+        throw std::runtime_error(std::format("KTX2 file {} is truncated", path));
+    }
+
+    Texture texture = {
+        .format = header.vkFormat,
+        .width = header.pixelWidth,
+        .height = header.pixelHeight,
+    };
+
+    texture.levels.resize(header.levelCount);
+    for(uint32_t i = 0; i < header.levelCount; i++) {
+        if(indices[i].byteOffset + indices[i].byteLength > fileSize) {
+            throw std::runtime_error(std::format("KTX2 file {} is truncated", path));
+        }
+
+        texture.levels[i] = Level {
+            .offset = indices[i].byteOffset,
+            .size = indices[i].byteLength,
+        };
+    }
+
+    return texture;
+}
+
+static std::ifstream open(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        throw std::runtime_error(std::format("Failed to open {}", path));
+    }
+
+    return file;
+}
+
+Texture read_header(const std::string& path) {
+    std::ifstream file = open(path);
+    return read_header(file, path);
+}
+
+Texture read(const std::string& path, uint32_t firstLevel) {
+    std::ifstream file = open(path);
+    Texture header = read_header(file, path);
+    firstLevel = std::min(firstLevel, (uint32_t)header.levels.size() - 1);
+
+    Texture texture = {
+        .format = header.format,
+        .width = std::max(header.width >> firstLevel, 1u),
+        .height = std::max(header.height >> firstLevel, 1u),
+    };
+
+    // the levels can be stored in any order, the whole range covering them is read
+    size_t begin = SIZE_MAX, end = 0;
+    for(uint32_t i = firstLevel; i < header.levels.size(); i++) {
+        begin = std::min(begin, header.levels[i].offset);
+        end = std::max(end, header.levels[i].offset + header.levels[i].size);
+    }
+
+    texture.data.resize(end - begin);
+    file.seekg(begin);
+    if(!file.read((char*)texture.data.data(), texture.data.size())) {
+        throw std::runtime_error(std::format("Failed to read {}", path));
+    }
+
+    for(uint32_t i = firstLevel; i < header.levels.size(); i++) {
+        texture.levels.push_back(Level {
+            .offset = header.levels[i].offset - begin,
+            .size = header.levels[i].size,
+        });
+    }
+
+    return texture;
+}
+
+uint32_t first_level_within(const Texture& texture, uint32_t maxExtent) {
+    uint32_t level = 0;
+    while(level + 1 < texture.levels.size() &&
+          std::max(texture.width >> level, texture.height >> level) > maxExtent) {
+        level++;
+    }
+
+    return level;
+}
+
+void write(const std::string& path, const Texture& texture) {
+    uint32_t blockSize = block_size(texture.format);
+    std::vector<uint32_t> dfd = create_dfd(texture.format);
+
+    Header header = {
+        .vkFormat = texture.format,
+        .typeSize = 1,
+        .pixelWidth = texture.width,
+        .pixelHeight = texture.height,
+        .pixelDepth = 0,
+        .layerCount = 0,
+        .faceCount = 1,
+        .levelCount = (uint32_t)texture.levels.size(),
+        .supercompressionScheme = 0,
+        .dfdByteOffset = (uint32_t)(sizeof(Header) + texture.levels.size() * sizeof(LevelIndex)),
+        .dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t)),
+        .kvdByteOffset = 0,
+        .kvdByteLength = 0,
+        .sgdByteOffset = 0,
+        .sgdByteLength = 0,
+    };
+    memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+
+    // levels are stored from the smallest one, each aligned to the block size
+    std::vector<LevelIndex> indices(texture.levels.size());
+    size_t offset = header.dfdByteOffset + header.dfdByteLength;
+    for(size_t i = texture.levels.size(); i-- > 0;) {
+        offset = (offset + blockSize - 1) / blockSize * blockSize;
+        indices[i] = LevelIndex {
+            .byteOffset = offset,
+            .byteLength = texture.levels[i].size,
+            .uncompressedByteLength = texture.levels[i].size,
+        };
+        offset += texture.levels[i].size;
+    }
+
+    std::vector<uint8_t> bytes(offset, 0);
+    memcpy(bytes.data(), &header, sizeof(Header));
+    memcpy(bytes.data() + sizeof(Header), indices.data(), indices.size() * sizeof(LevelIndex));
+    memcpy(bytes.data() + header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+    for(size_t i = 0; i < texture.levels.size(); i++) {
+        auto level = texture.level(i);
+        memcpy(bytes.data() + indices[i].byteOffset, level.data(), level.size());
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if(!file.write((const char*)bytes.data(), bytes.size())) {
+        throw std::runtime_error(std::format("Failed to write {}", path));
+    }
+}
+
+std::string compressed_path(const std::string& path, const std::string& occlusionPath) {
+    std::filesystem::path result(path);
+    if(occlusionPath.empty()) {
+        return result.replace_extension(".ktx2").string();
+    }
+
+    // packed images are a pair, the same image might be used alone too
+    auto stem = result.stem().string() + "+" + std::filesystem::path(occlusionPath).stem().string();
+    return result.replace_filename(stem + ".ktx2").string();
+}
+
+}
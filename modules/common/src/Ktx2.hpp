@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * Minimal KTX2 container for block compressed 2D textures with a full chain
+ * of precomputed mip levels. Only uncompressed (not supercompressed) data
+ * is supported.
+ */
+namespace lft::ktx2 {
+
+/**
+ * Values of the Vulkan formats, common module does not depend on Vulkan.
+ */
+enum Format : uint32_t {
+    FORMAT_BC1_RGB_UNORM = 131,
+    FORMAT_BC1_RGB_SRGB = 132,
+    FORMAT_BC3_UNORM = 137,
+    FORMAT_BC3_SRGB = 138,
+    FORMAT_BC5_UNORM = 141,
+    FORMAT_BC7_UNORM = 145,
+    FORMAT_BC7_SRGB = 146,
+};
+
+/**
+ * Size in bytes of a 4x4 block, 0 for formats that are not supported.
+ */
+uint32_t block_size(uint32_t format);
+
+bool is_srgb(uint32_t format);
+
+struct Level {
+    size_t offset;
+    size_t size;
+};
+
+struct Texture {
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+
+    // levels in `data`, the base level first
+    std::vector<Level> levels;
+    std::vector<uint8_t> data;
+
+    [[nodiscard]] std::span<const uint8_t> level(uint32_t idx) const {
+        return { data.data() + levels[idx].offset, levels[idx].size };
+    }
+};
+
+/**
+ * Reads only the header and the level index. Levels point into the file and
+ * `data` stays empty.
+ */
+Texture read_header(const std::string& path);
+
+/**
+ * Reads a texture written by `write`, throws when the file is not supported.
+ * @param firstLevel levels above it are skipped, the texture starts with it
+ */
+Texture read(const std::string& path, uint32_t firstLevel = 0);
+
+/**
+ * First level of the texture, that is not larger than `maxExtent` in any
+ * dimension. The smallest level when none is.
+ */
+uint32_t first_level_within(const Texture& texture, uint32_t maxExtent);
+
+void write(const std::string& path, const Texture& texture);
+
+/**
+ * Path of the precompressed texture of an image, written next to it by `loft-texc`.
+ * @param occlusionPath image packed into the red channel, empty when there is none
+ */
+std::string compressed_path(const std::string& path, const std::string& occlusionPath = "");
+
+}
@@ -3,10 +3,16 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 #include "AdjacencyMatrix.hpp"
+#include "FrameArena.hpp"
 #include "Gpu.hpp"
+#include "resources/UploadService.hpp"
 #include "RenderGraphBuffer.hpp"
+#include "ResourceTable.hpp"
+#include "TaskTable.hpp"
 
 namespace lft::rg {
 
@@ -16,17 +22,50 @@ namespace lft::rg {
 class RenderGraph {
 private:
 	const Gpu* m_gpu;
-    
+
     std::string m_output_name;
 
 	AdjacencyMatrix* m_dependency_matrix;
+	const TaskTable* m_tasks;
+	const ResourceTable* m_resources;
 	std::vector<RenderGraphBuffer*> m_buffers;
-	std::vector<VkFence> m_fences;
 	uint32_t m_buffer_idx;
 
-	void create_fences();
+	// tasks in order of execution, shared by all the buffers
+	std::vector<TaskHandle> m_task_queue;
+	std::vector<const TaskInfo*> m_task_infos;
+	std::unordered_map<std::string, uint32_t> m_task_idxs;
+	std::vector<uint32_t> m_batch_task_offsets;
+	std::vector<uint32_t> m_optional_task_idxs;
+
+	// indices of previous batches each batch has to wait for
+	std::vector<std::vector<uint32_t>> m_batch_waits;
+	std::vector<bool> m_is_batch_writing_to_output;
+
+	std::vector<bool> m_is_task_enabled;
+	std::vector<bool> m_is_task_active;
+
+	bool m_is_capture_requested = false;
+	bool m_is_capturing = false;
+
+	void create_task_queue();
+
+	void create_batch_waits();
+
+	/**
+	 * Evaluates the enabled flags and predicates of optional tasks and capture request.
+	 * Patches render passes of the affected tasks, if anything changed since last frame.
+	 */
+	void update_active_tasks();
+
+	void patch_renderpasses();
 
-	std::vector<VkSemaphoreSubmitInfoKHR> get_wait_semaphores_for(
+	bool is_batch_active(const RenderGraphBuffer* pBuffer, uint32_t batch_idx) const;
+
+	/**
+	 * Semaphores of previous batches, allocated from the frame arena.
+	 */
+	FrameVector<VkSemaphoreSubmitInfoKHR> get_wait_semaphores_for(
 	        const RenderGraphBuffer* pBuffer,
 			uint32_t cmdbuf_idx
 	) const;
@@ -35,10 +74,15 @@ private:
 
 	bool is_recording_invalid(const RenderGraphBuffer& buffer, uint32_t cmdbuf_idx);
 
-	void record_command_buffer(
+	/**
+	 * @param upload_ticket uploads up to the ticket are acquired at the start, 0 for none
+	 * @return ticket the batch must wait for on the upload semaphore, 0 for none
+	 */
+	UploadTicket record_command_buffer(
             uint32_t buffer_idx,
            	uint32_t cmdbuf_idx,
-            uint32_t output_idx
+            uint32_t output_idx,
+            UploadTicket upload_ticket
 	);
 
 	void submit_command_buffer(
@@ -46,11 +90,13 @@ private:
 			uint32_t cmdbuf_idx,
             VkSemaphore wait_semaphore,
 			VkFence fence,
-			uint32_t output_idx
+			uint32_t output_idx,
+			bool is_active,
+			UploadTicket upload_wait
 	);
 
 
-    bool is_batch_writing_to_final_image(const Batch& buffer) const;
+    bool is_batch_writing_to_final_image(uint32_t batch_idx) const;
 
 
 public:
@@ -58,11 +104,48 @@ public:
 	    return *m_buffers[idx];
 	}
 
+	const TaskInfo& task(TaskHandle handle) const {
+	    return m_tasks->info(handle);
+	}
+
 	RenderGraph& invalidate(const std::string& name);
 
+	/**
+	 * Turns optional task on or off. Takes effect in the next `run`, without
+	 * rebuilding the graph. Load ops and layouts of attachments shared with
+	 * other tasks are switched to the matching precompiled render pass variant.
+	 */
+	RenderGraph& set_enabled(const std::string& name, bool is_enabled);
+
+	bool is_enabled(const std::string& name) const;
+
+	/**
+	 * Returns mapped memory of host written buffer, that will be used by the
+	 * next `run`. Waits until the GPU is done with the previous frame using it.
+	 */
+	void* map_buffer(const std::string& name);
+
+	/**
+	 * Next `run` stores all attachments, even those no task reads, so the
+	 * frame can be inspected in a graphics debugger. Following runs are not affected.
+	 */
+	RenderGraph& request_capture() {
+	    m_is_capture_requested = true;
+	    return *this;
+	}
+
+	/**
+	 * Semaphore signaled when the last `run` finished writing to the output image.
+	 */
+	VkSemaphore final_signal(uint32_t output_idx) const {
+	    return m_buffers[m_buffer_idx]->final_signal(output_idx);
+	}
+
 	RenderGraph(const Gpu* gpu,
                 const std::string& output_name,
 	            const std::vector<RenderGraphBuffer*>& buffers,
+	            const TaskTable* tasks,
+	            const ResourceTable* resources,
 				AdjacencyMatrix* dependencies
     );
 
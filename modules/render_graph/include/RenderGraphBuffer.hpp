@@ -1,11 +1,14 @@
 #pragma once
 
-#include <unordered_map>
+#include <optional>
+#include <span>
 #include <string>
 
 #include "RenderPass.hpp"
 #include "Resource.hpp"
+#include "ResourceTable.hpp"
 #include "Task.hpp"
+#include "TaskTable.hpp"
 
 namespace lft::rg {
 
@@ -17,7 +20,7 @@ struct BatchOutput {
 };
 
 struct Batch {
-    std::vector<Task> tasks;
+    std::vector<TaskHandle> tasks;
 	std::vector<uint32_t> barriers;
 	std::vector<BatchOutput> outputs;
 	VkSemaphore signal;
@@ -30,28 +33,44 @@ struct Batch {
 
 	Batch& invalidate_recordings();
 
-	Batch& insert_task(uint32_t idx, Task& task);
+	Batch& insert_task(uint32_t idx, TaskHandle task);
 
-	Batch& update_task(uint32_t idx, Task& task);
+	Batch& update_task(uint32_t idx, TaskHandle task);
 
 	Batch& remove_task(uint32_t idx);
 
-	bool equals(const Batch& rhs) const;
+	bool equals(const Batch& rhs, const TaskTable& tasks, const TaskTable& rhs_tasks) const;
 };
 
 class RenderGraphBuffer {
     const Gpu* m_gpu;
     uint32_t m_index;
-public:
-    std::unordered_map<std::string, BufferResource> m_buffer_resources;
-	std::unordered_map<std::string, ImageResource> m_image_resources;
-private:
+
+    // per resource data, indexed by ResourceHandle
+    std::vector<std::optional<BufferResource>> m_buffer_resources;
+	std::vector<std::optional<ImageResource>> m_image_resources;
+
+	// per task data, indexed by TaskHandle
+	std::vector<std::vector<TaskRenderPass>> m_render_passes;
+	std::vector<uint32_t> m_active_variants;
+	std::vector<std::vector<VkFramebuffer>> m_framebuffers;
+
 	std::vector<Batch> m_batches;
 
 	std::vector<VkSemaphore> m_final_semaphores;
 
+	// signaled when the last frame submitted from the buffer finishes
+	VkFence m_fence;
+	uint64_t m_submitted_frame = 0;
+
+	void retire_task(TaskHandle task);
+
+	void retire_batch(const Batch& batch);
+
 public:
     GET(m_index, index);
+    GET(m_fence, fence);
+    GET(m_submitted_frame, submitted_frame);
 
     RenderGraphBuffer(
         const Gpu* gpu,
@@ -74,35 +93,155 @@ public:
 
     void remove_batch(uint32_t idx);
 
+    /**
+     * Frame number given by the GPU deletion queue to the last submission from the buffer.
+     */
+    void set_submitted_frame(uint64_t frame) {
+        m_submitted_frame = frame;
+    }
+
+    /**
+     * Retires all the objects owned by the buffer to the deletion queue.
+     * Buffer resources are not owned by the buffer and are left untouched.
+     */
+    void retire();
+
     VkSemaphore final_signal(uint32_t output_idx) const {
         return m_final_semaphores[output_idx];
     }
 
+#pragma region TASKS
+
+    /**
+     * Sets render pass variants and framebuffers of the task. First variant is
+     * the one created for all tasks being enabled. Compute tasks have none.
+     */
+    void put_task(
+        TaskHandle task,
+        std::vector<TaskRenderPass> render_passes,
+        std::vector<VkFramebuffer> framebuffers
+    );
+
+    /**
+     * Retires render passes and framebuffers of a removed task.
+     */
+    void remove_task(TaskHandle task);
+
+    TaskRenderPass render_pass(TaskHandle task) const {
+        return m_render_passes[task].empty() ?
+            TaskRenderPass() : m_render_passes[task][0];
+    }
+
+    const std::vector<TaskRenderPass>& render_pass_variants(TaskHandle task) const {
+        return m_render_passes[task];
+    }
+
+    inline VkRenderPass active_render_pass(TaskHandle task) const {
+        return m_render_passes[task][m_active_variants[task]].render_pass;
+    }
+
+    inline uint32_t active_variant(TaskHandle task) const {
+        return m_active_variants[task];
+    }
+
+    void set_active_variant(TaskHandle task, uint32_t variant) {
+        m_active_variants[task] = variant;
+    }
+
+    /**
+     * Looks for a variant of the task's render pass with the same state.
+     */
+    std::optional<uint32_t> find_render_pass_variant(
+        TaskHandle task,
+        const TaskRenderPassState& state
+    ) const;
+
+    inline VkFramebuffer framebuffer(TaskHandle task, uint32_t output_idx) const {
+        return m_framebuffers[task][output_idx];
+    }
+
+    const std::vector<VkFramebuffer>& framebuffers(TaskHandle task) const {
+        return m_framebuffers[task];
+    }
+
+#pragma endregion
+
 #pragma region IMAGE RESOURCES
 
-	bool has_image_resource(const std::string& name) const {
-	    return m_image_resources.find(name) != m_image_resources.end();
+	bool has_image_resource(ResourceHandle handle) const {
+	    return handle < m_image_resources.size() &&
+	        m_image_resources[handle].has_value();
 	}
 
 	std::optional<const ImageResource*>
-	get_image_resource(const std::string& name) const {
-	    if(!has_image_resource(name)) {
+	get_image_resource(ResourceHandle handle) const {
+	    if(!has_image_resource(handle)) {
 			return {};
 		}
 
-		return &m_image_resources.find(name)->second;
+		return &m_image_resources[handle].value();
 	}
 
 	void put_image_resource(
-	    const std::string& name,
+	    ResourceHandle handle,
 	    const ImageResource& resource
 	) {
-        m_image_resources.insert({name, resource});
+	    if(handle >= m_image_resources.size()) {
+	        m_image_resources.resize(handle + 1);
+	    }
+
+        m_image_resources[handle] = resource;
+	}
+
+	/**
+	 * Retires the image, it is destroyed once frames using it finish.
+	 */
+	void remove_image_resource(ResourceHandle handle);
+
+	std::span<const std::optional<ImageResource>> image_resources() const {
+	    return m_image_resources;
+	}
+
+#pragma endregion
+
+#pragma region BUFFER RESOURCES
+
+	bool has_buffer_resource(ResourceHandle handle) const {
+	    return handle < m_buffer_resources.size() &&
+	        m_buffer_resources[handle].has_value();
+	}
+
+	std::optional<const BufferResource*>
+	get_buffer_resource(ResourceHandle handle) const {
+	    if(!has_buffer_resource(handle)) {
+			return {};
+		}
+
+		return &m_buffer_resources[handle].value();
+	}
+
+	void put_buffer_resource(
+	    ResourceHandle handle,
+	    const BufferResource& resource
+	) {
+	    if(handle >= m_buffer_resources.size()) {
+	        m_buffer_resources.resize(handle + 1);
+	    }
+
+        m_buffer_resources[handle] = resource;
+	}
+
+	std::span<const std::optional<BufferResource>> buffer_resources() const {
+	    return m_buffer_resources;
 	}
 
 #pragma endregion
 
-	bool equals(const RenderGraphBuffer& other) const;
+	bool equals(
+	    const RenderGraphBuffer& other,
+	    const TaskTable& tasks,
+	    const TaskTable& other_tasks
+	) const;
 };
 
 }
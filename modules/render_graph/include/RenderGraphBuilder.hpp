@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -10,9 +11,24 @@
 #include "ImageChain.hpp"
 #include "RenderPass.hpp"
 #include "RenderGraphAllocator.hpp"
+#include "ResourceTable.hpp"
+#include "TaskTable.hpp"
 
 namespace lft::rg {
 
+/**
+ * Memory shared by transient buffers, whose users are ordered by dependencies.
+ */
+struct TransientBufferSlot {
+	VkDeviceSize size;
+	VkBufferUsageFlags usage;
+	// queue indices of tasks using buffers of the slot
+	std::vector<uint32_t> users = {};
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	GpuAllocation allocation = {};
+};
+
 class BuilderAllocator {
 private:
 	const Gpu* m_gpu;
@@ -22,39 +38,92 @@ private:
 
 	std::vector<RenderGraphBuffer> m_buffers;
 
+	TaskTable m_tasks;
+	ResourceTable m_resources;
+
 	std::unordered_set<std::string> m_updated_tasks;
 	uint32_t m_num_buffers;
 
+	// buffers added by user are never allocated by the graph
+	std::unordered_set<ResourceHandle> m_external_buffers;
+	std::vector<BufferResourceDescription> m_host_buffers;
+	// descriptions of allocated persistent and host written buffers
+	std::unordered_map<ResourceHandle, BufferResourceDescription> m_buffer_descriptions;
+	// slots of transient buffers for each buffer
+	std::vector<std::vector<TransientBufferSlot>> m_transient_buffers;
+
+	// resources some task depends on, their content has to be stored
+	std::unordered_set<std::string> m_sampled_resources;
+	// images never leaving the render pass of their only writer
+	std::unordered_set<std::string> m_transient_images;
+
 	bool is_task_updated(const std::string& name) {
 		return std::find(m_updated_tasks.begin(),
 				m_updated_tasks.end(),
 				name) != m_updated_tasks.end();
 	}
 
-	Task create_graphics_task(
-	    const TaskInfo& task_info,
+	void create_graphics_task(
+	    TaskHandle task,
 	    RenderGraphBuffer* pBuffer,
-		TaskRenderPass render_pass
+		std::vector<TaskRenderPass> render_passes
 	);
 
-	Task create_compute_task(
-	    const TaskInfo& task_info,
+	void create_compute_task(
+	    TaskHandle task,
 	    RenderGraphBuffer* pBuffer
 	);
 
-	Task create_task(
-	    const TaskInfo& task_info,
+	void create_task(
+	    const std::vector<TaskHandle>& handles,
+	    const std::vector<const TaskInfo*>& queue,
+	    uint32_t queue_idx,
 		RenderGraphBuffer* pBuffer,
 		std::unordered_set<std::string>& cleared_resources,
         std::unordered_map<std::string, uint32_t>& resource_count_down
 	);
 
 	ImageResource allocate_image_resource(
-	    const ImageResourceDescription& desc
+	    const ImageResourceDescription& desc,
+	    bool is_transient
 	) const;
 
 	BufferResource allocate_buffer_resource(const BufferResourceDescription& desc) const;
 
+	/**
+	 * Hands a graph owned buffer over to the deletion queue.
+	 */
+	void retire_buffer_resource(const BufferResource& resource) const;
+
+	/**
+	 * Retires persistent or host written buffer allocated for the handle.
+	 */
+	void retire_owned_buffer_resource(
+	    ResourceHandle handle,
+	    const BufferResourceDescription& desc
+	) const;
+
+	/**
+	 * Marks tasks writing to or depending on the resource for rebuild.
+	 */
+	void mark_resource_users_updated(
+	    const std::vector<const TaskInfo*>& queue,
+	    const std::string& name
+	);
+
+	/**
+	 * Allocates buffers declared by tasks and host written buffers, that were
+	 * not allocated yet or their description changed. Transient buffers are
+	 * aliased by their lifetime in the queue.
+	 */
+	void allocate_buffer_resources(const std::vector<const TaskInfo*>& queue);
+
+	/**
+	 * Finds out which images are read by other tasks and which are transient.
+	 * Images that changed are reallocated and their users rebuilt.
+	 */
+	void update_image_usages(const std::vector<const TaskInfo*>& queue);
+
     ImageResourceDescription correct_resource_description(ImageResourceDescription desc);
 
 	/**
@@ -98,7 +167,8 @@ private:
 
 	void update_task_queue(
 	    RenderGraphBuffer* pBuffer,
-	    const std::vector<TaskInfo>& task_infos
+	    const std::vector<TaskHandle>& handles,
+	    const std::vector<const TaskInfo*>& queue
 	);
 
 	VkViewport get_viewport() {
@@ -110,18 +180,13 @@ private:
             };
 	}
 
-	void update_task_buffer(const Task& task, const RenderGraphBuffer* pBuffer);
-	bool m_store_all_images = false;
+	void update_task_buffer(TaskHandle task, const RenderGraphBuffer* pBuffer);
 
 public:
     void remove_task(const std::string& name) {
         m_updated_tasks.insert(name);
     }
 
-    void set_store_all_images(bool value) {
-        m_store_all_images = value;
-    }
-
 	GET(m_num_buffers, num_buffers);
 
 	BuilderAllocator(const Gpu* gpu,
@@ -131,13 +196,19 @@ public:
 		m_gpu(gpu),
 		m_output_chain(output_chain),
 		m_output_name(output_name),
-		m_num_buffers(num_buffers)
+		m_num_buffers(num_buffers),
+		m_transient_buffers(num_buffers)
 	{
 	    for(uint32_t i = 0; i < num_buffers; i++) {
 	        m_buffers.emplace_back(m_gpu, i, m_output_chain.count());
 		}
 	}
 
+	~BuilderAllocator();
+
+	// Forbid copy, the allocated objects are owned
+	BuilderAllocator(const BuilderAllocator&) = delete;
+
 	void mark_task_updated(const std::string& name) {
         m_updated_tasks.insert(name);
 	}
@@ -153,11 +224,22 @@ public:
 			throw std::runtime_error("Buffer count must be a multiple of output chain count");
 		} */
 
+		ResourceHandle handle = m_resources.get_or_create(name);
+		m_external_buffers.insert(handle);
 		for(uint32_t i = 0; i < m_buffers.size(); i++) {
-			m_buffers[i].m_buffer_resources.insert({name, BufferResource(buffers[i % buffers.size()].buf, size)});
+			auto& buffer = buffers[i % buffers.size()];
+			m_buffers[i].put_buffer_resource(handle, BufferResource(buffer.buf, size, buffer.allocation, nullptr));
 		}
 	}
 
+	void add_host_buffer_resource(const BufferResourceDescription& desc) {
+		m_host_buffers.erase(std::remove_if(m_host_buffers.begin(), m_host_buffers.end(),
+			[&desc](const BufferResourceDescription& buffer) {
+				return buffer.name() == desc.name();
+			}), m_host_buffers.end());
+		m_host_buffers.push_back(desc);
+	}
+
 	void add_image_resource(
 	    const std::string& name,
 		const std::vector<ImageResource> images
@@ -169,14 +251,15 @@ public:
 		}
 
 		for(uint32_t i = 0; i < m_buffers.size(); i++) {
-			// m_buffers[i].m_image_resources[name] = images[i % images.size()];
+			// m_buffers[i].put_image_resource(m_resources.get_or_create(name), images[i % images.size()]);
 		}
 	}
 
 	VkAttachmentDescription2 create_attachment_description(
 			const ImageResourceDescription& definition,
 			bool is_first_write,
-			bool is_last_write
+			bool is_last_write,
+			bool is_capture
 	);
 
 	TaskRenderPass allocate_renderpass(
@@ -185,8 +268,23 @@ public:
 			std::unordered_set<std::string>& cleared_resources
 	);
 
+	TaskRenderPass create_renderpass(
+			const TaskInfo& task,
+			TaskRenderPassState state
+	);
+
+	/**
+	 * Creates render passes for every state the task at queue_idx can end up in
+	 * by disabling optional tasks. The render_pass is reused as the first variant.
+	 */
+	std::vector<TaskRenderPass> allocate_renderpass_variants(
+			const std::vector<const TaskInfo*>& queue,
+			uint32_t queue_idx,
+			const TaskRenderPass& render_pass
+	);
+
 	VkFramebuffer create_framebuffer(
-			const TaskInfo& task_info,
+			TaskHandle task,
 			VkRenderPass renderpass,
 			RenderGraphBuffer* pBuffer,
 			uint32_t output_idx
@@ -221,19 +319,17 @@ private:
 		return m_tasks[m_name_to_task_idx[name]];
 	}
 
-	bool m_store_all_images;
-
 public:
-    void store_all_images() {
-        m_store_all_images = true;
-    }
-
+	/**
+	 * @param num_buffers number of frames the graph can have in flight
+	 */
 	Builder(const Gpu* gpu,
 			ImageChain output_chain,
-			const std::string& output_name
+			const std::string& output_name,
+			uint32_t num_buffers = 1
 	) :
 		m_output_name(output_name),
-		m_allocator(gpu, output_chain, output_name, 1)
+		m_allocator(gpu, output_chain, output_name, num_buffers)
 	{
 	}
 
@@ -255,6 +351,19 @@ public:
 		m_allocator.add_image_resource(name, images);
 	}
 
+	/**
+	 * Adds buffer written from CPU. Each buffer in flight gets its own copy,
+	 * write to it through `RenderGraph::map_buffer`.
+	 */
+	void add_host_buffer_resource(
+	    const std::string& name,
+	    VkDeviceSize size,
+	    VkBufferUsageFlags usage
+	) {
+		m_allocator.add_host_buffer_resource(
+		    BufferResourceDescription(name, size, usage, BUFFER_LIFETIME_HOST_WRITTEN));
+	}
+
 	bool is_task_ok(const TaskInfo& task) {
 		for(auto& dependency : task.dependencies()) {
 			for(auto& output : task.color_outputs()) {
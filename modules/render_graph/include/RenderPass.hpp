@@ -7,10 +7,14 @@
 #include <optional>
 #include <memory>
 #include <iostream>
+#include <span>
+#include <format>
+#include <stdexcept>
 
 #include "Gpu.hpp"
 #include "props.hpp"
 #include "Resource.hpp"
+#include "ResourceTable.hpp"
 #include "Recording.hpp"
 
 #include <volk.h>
@@ -65,25 +69,92 @@ public:
 	}
 };
 
+enum BufferLifetime {
+	// single copy shared by all buffers, content is kept between frames
+	BUFFER_LIFETIME_PERSISTENT,
+	// lives only between first write and last read in a frame, memory is reused
+	BUFFER_LIFETIME_TRANSIENT,
+	// written from CPU, each buffer in flight gets its own mapped copy
+	BUFFER_LIFETIME_HOST_WRITTEN
+};
+
 struct BufferResourceDescription {
 private:
 	std::string m_name;
 	VkDeviceSize m_size;
+	VkBufferUsageFlags m_usage;
+	BufferLifetime m_lifetime;
 
 public:
 	REF(m_name, name);
 	GET(m_size, size);
+	GET(m_usage, usage);
+	GET(m_lifetime, lifetime);
 
 	BufferResourceDescription(
 			const std::string& name,
-			VkDeviceSize size
+			VkDeviceSize size,
+			VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			BufferLifetime lifetime = BUFFER_LIFETIME_PERSISTENT
 		) :
 		m_name(name),
-		m_size(size) {
+		m_size(size),
+		m_usage(usage),
+		m_lifetime(lifetime) {
 	}
 
 	bool equals(const BufferResourceDescription& other) const {
-	    return m_name == other.m_name && m_size == other.m_size;
+	    return m_name == other.m_name &&
+	        m_size == other.m_size &&
+	        m_usage == other.m_usage &&
+	        m_lifetime == other.m_lifetime;
+	}
+};
+
+/**
+ * Resources of a single buffer, indexed by ResourceHandle.
+ */
+class TaskResources {
+	const ResourceTable* m_table;
+	std::span<const std::optional<ImageResource>> m_images;
+	std::span<const std::optional<BufferResource>> m_buffers;
+
+public:
+	TaskResources(
+			const ResourceTable* table,
+			std::span<const std::optional<ImageResource>> images,
+			std::span<const std::optional<BufferResource>> buffers) :
+		m_table(table),
+		m_images(images),
+		m_buffers(buffers) {
+	}
+
+	/**
+	 * Resolves the handle of resource. Meant to be used while building, not every frame.
+	 */
+	ResourceHandle handle(const std::string& name) const {
+		auto handle = m_table->find(name);
+		if(!handle.has_value()) {
+			throw std::runtime_error(std::format("Resource {} does not exist", name));
+		}
+
+		return handle.value();
+	}
+
+	inline const ImageResource& image(ResourceHandle handle) const {
+		if(handle >= m_images.size() || !m_images[handle].has_value()) {
+			throw std::runtime_error(std::format("Resource {} is not an image", m_table->name(handle)));
+		}
+
+		return m_images[handle].value();
+	}
+
+	inline const BufferResource& buffer(ResourceHandle handle) const {
+		if(handle >= m_buffers.size() || !m_buffers[handle].has_value()) {
+			throw std::runtime_error(std::format("Resource {} is not a buffer", m_table->name(handle)));
+		}
+
+		return m_buffers[handle].value();
 	}
 };
 
@@ -92,22 +163,34 @@ class TaskRecordInfo {
     lft::Recording m_recording;
 	uint32_t m_buffer_idx;
 	uint32_t m_image_idx;
+	TaskResources m_resources;
 
 public:
 	GET(m_gpu, gpu);
 	REF(m_recording, recording);
 	GET(m_image_idx, image_idx);
 	GET(m_buffer_idx, buffer_idx);
+	REF(m_resources, resources);
+
+	inline const ImageResource& get_image_resource(ResourceHandle handle) const {
+		return m_resources.image(handle);
+	}
+
+	inline const BufferResource& get_buffer_resource(ResourceHandle handle) const {
+		return m_resources.buffer(handle);
+	}
 
 	TaskRecordInfo(
 			const Gpu* gpu,
 			lft::Recording recording,
 			uint32_t buffer_idx,
-			uint32_t image_in_flight_idx) :
+			uint32_t image_in_flight_idx,
+			TaskResources resources) :
 		m_recording(recording),
 		m_image_idx(image_in_flight_idx),
 		m_buffer_idx(buffer_idx),
-		m_gpu(gpu) {
+		m_gpu(gpu),
+		m_resources(resources) {
 	}
 };
 
@@ -119,7 +202,7 @@ class TaskBuildInfo {
 	VkViewport m_viewport;
 	VkRenderPass m_renderpass;
 
-	std::unordered_map<std::string, ImageResource> m_resources;
+	TaskResources m_resources;
 
 public:
 	GET(m_gpu, gpu);
@@ -127,11 +210,24 @@ public:
 	GET(m_buffer_idx, buffer_idx);
 	GET(m_viewport, viewport);
 	GET(m_renderpass, renderpass);
+	REF(m_resources, resources);
+
+	inline ResourceHandle get_resource_handle(
+			const std::string& name
+	) const {
+		return m_resources.handle(name);
+	}
 
 	inline ImageResource get_resource(
 			const std::string& name
 	) const {
-		return m_resources.find(name)->second;
+		return m_resources.image(m_resources.handle(name));
+	}
+
+	inline BufferResource get_buffer_resource(
+			const std::string& name
+	) const {
+		return m_resources.buffer(m_resources.handle(name));
 	}
 
 	TaskBuildInfo(
@@ -140,7 +236,7 @@ public:
 			uint32_t num_buffers,
 			VkViewport viewport,
 			VkRenderPass renderpass,
-			std::unordered_map<std::string, ImageResource> resources) :
+			TaskResources resources) :
 		m_gpu(gpu),
 		m_buffer_idx(buffer_idx),
 		m_num_buffers(num_buffers),
@@ -158,15 +254,21 @@ enum TaskType {
 
 
 struct TaskInfo {
-	typedef std::function<void(const TaskBuildInfo&, void*)> TaskBuildFunc;
-	typedef std::function<void(const TaskRecordInfo&, void*)> TaskRecordFunc;
+	typedef void (*TaskBuildFunc)(const TaskBuildInfo&, void*);
+	typedef void (*TaskRecordFunc)(const TaskRecordInfo&, void*);
 
 	std::string m_name;
 	TaskType m_type;
 
+	/**
+	 * Callbacks are plain function pointers called with m_pContext, so
+	 * recording a task costs a single indirect call.
+	 */
 	void *m_pContext;
 	TaskBuildFunc m_build_func;
 	TaskRecordFunc m_record_func;
+	// keeps alive whatever m_pContext points to when the task owns it
+	std::shared_ptr<void> m_pOwnedContext;
 
 	std::vector<std::string> m_dependencies;
 	std::vector<std::string> m_recording_dependencies;
@@ -177,6 +279,13 @@ struct TaskInfo {
 
 	VkExtent2D m_extent;
 
+	/**
+	 * Optional tasks can be turned on and off at runtime without rebuilding the graph.
+	 */
+	bool m_is_optional = false;
+	bool m_is_enabled = true;
+	std::function<bool()> m_enabled_predicate;
+
 	REF(m_name, name);
 	GET(m_type, type);
 	REF(m_build_func, build_func);
@@ -186,22 +295,30 @@ struct TaskInfo {
 	REF(m_buffer_outputs, buffer_outputs);
 	REF(m_color_outputs, color_outputs);
 	REF(m_depth_output, depth_output);
-
-	TaskInfo() {
+	GET(m_is_optional, is_optional);
+	GET(m_is_enabled, is_enabled);
+	REF(m_enabled_predicate, enabled_predicate);
+
+	TaskInfo() :
+		m_pContext(nullptr),
+		m_build_func(nullptr),
+		m_record_func(nullptr)
+	{
 	}
 
-	template<typename T>
 	TaskInfo(const std::string& name,
 			TaskType type,
-			T *pContext,
-			std::function<void(const TaskBuildInfo&, T*)> build_func,
-			std::function<void(const TaskRecordInfo&, T*)> record_func
+			void *pContext,
+			TaskBuildFunc build_func,
+			TaskRecordFunc record_func,
+			std::shared_ptr<void> pOwnedContext = nullptr
 	) :
 		m_name(name),
 		m_type(type),
 		m_pContext(pContext),
 		m_build_func(build_func),
 		m_record_func(record_func),
+		m_pOwnedContext(std::move(pOwnedContext)),
 		m_extent(0, 0)
 	{
 
@@ -268,6 +385,18 @@ struct TaskInfo {
 		return *this;
 	}
 
+	TaskInfo& set_optional(bool is_enabled = true) {
+		m_is_optional = true;
+		m_is_enabled = is_enabled;
+		return *this;
+	}
+
+	TaskInfo& set_enabled_predicate(std::function<bool()> predicate) {
+		m_is_optional = true;
+		m_enabled_predicate = predicate;
+		return *this;
+	}
+
 	bool equals(const TaskInfo& other) const {
 	    if(this->name() != other.name()) {
 			std::cout << "Names are not the same: " << name() << " != " << other.name() << std::endl;
@@ -345,15 +474,22 @@ private:
 public:
 	ComputeTaskBuilder(const std::string& name,
 			void *pContext,
-			std::function<void(const TaskBuildInfo&, void*)> build_func,
-			std::function<void(const TaskRecordInfo&, void*)> record_func
+			TaskInfo::TaskBuildFunc build_func,
+			TaskInfo::TaskRecordFunc record_func,
+			std::shared_ptr<void> pOwnedContext = nullptr
 	) :
-		m_task_info(name, COMPUTE_TASK, pContext, build_func, record_func) {
+		m_task_info(name, COMPUTE_TASK, pContext, build_func, record_func, std::move(pOwnedContext)) {
 	}
 
+	/**
+	 * Buffer written by the task. Allocated by the graph, unless added with
+	 * `Builder::add_buffer_resource`.
+	 */
 	ComputeTaskBuilder& add_buffer_output(const std::string& name,
-			VkDeviceSize size) {
-		m_task_info.m_buffer_outputs.emplace_back(name, size);
+			VkDeviceSize size,
+			VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			BufferLifetime lifetime = BUFFER_LIFETIME_PERSISTENT) {
+		m_task_info.m_buffer_outputs.emplace_back(name, size, usage, lifetime);
 		return *this;
 	}
 
@@ -367,6 +503,22 @@ public:
 		return *this;
 	}
 
+	/**
+	 * Allows the task to be turned on and off with `RenderGraph::set_enabled`.
+	 */
+	ComputeTaskBuilder& set_optional(bool is_enabled = true) {
+		m_task_info.set_optional(is_enabled);
+		return *this;
+	}
+
+	/**
+	 * The task is skipped in every frame the predicate returns false. Implies `set_optional`.
+	 */
+	ComputeTaskBuilder& set_enabled_predicate(std::function<bool()> predicate) {
+		m_task_info.set_enabled_predicate(predicate);
+		return *this;
+	}
+
 	TaskInfo build() {
 		return m_task_info;
 	}
@@ -381,10 +533,11 @@ private:
 public:
 	RenderTaskBuilder(const std::string& name,
 			void* pContext,
-			std::function<void(const TaskBuildInfo&, void*)> build_func,
-			std::function<void(const TaskRecordInfo&, void*)> record_func
+			TaskInfo::TaskBuildFunc build_func,
+			TaskInfo::TaskRecordFunc record_func,
+			std::shared_ptr<void> pOwnedContext = nullptr
 	) :
-		m_task_info(name, GRAPHICS_TASK, pContext, build_func, record_func) {
+		m_task_info(name, GRAPHICS_TASK, pContext, build_func, record_func, std::move(pOwnedContext)) {
 	}
 
 	RenderTaskBuilder& add_color_output(const std::string& name,
@@ -426,27 +579,83 @@ public:
 		return *this;
 	}
 
+	/**
+	 * Allows the task to be turned on and off with `RenderGraph::set_enabled`.
+	 * Render pass variants for every combination of optional writers of the
+	 * same attachments are created upfront, so toggling never rebuilds the graph.
+	 * Images sampled by other tasks or presented also need a writer that is not
+	 * optional, the builder rejects the graph otherwise.
+	 */
+	RenderTaskBuilder& set_optional(bool is_enabled = true) {
+		m_task_info.set_optional(is_enabled);
+		return *this;
+	}
+
+	/**
+	 * The task is skipped in every frame the predicate returns false. Implies `set_optional`.
+	 */
+	RenderTaskBuilder& set_enabled_predicate(std::function<bool()> predicate) {
+		m_task_info.set_enabled_predicate(predicate);
+		return *this;
+	}
+
 	TaskInfo build() {
 		return m_task_info;
 	}
 
 };
 
+/**
+ * Context of tasks created from std::function callbacks. Passed to the task
+ * instead of the user context, so the callbacks are not wrapped again.
+ */
+template<typename T>
+struct TaskCallbacks {
+	T* pContext;
+	std::function<void(const TaskBuildInfo&, T*)> build_func;
+	std::function<void(const TaskRecordInfo&, T*)> record_func;
+
+	static void build(const TaskBuildInfo& info, void* pCallbacks) {
+		auto callbacks = static_cast<TaskCallbacks<T>*>(pCallbacks);
+		callbacks->build_func(info, callbacks->pContext);
+	}
+
+	static void record(const TaskRecordInfo& info, void* pCallbacks) {
+		auto callbacks = static_cast<TaskCallbacks<T>*>(pCallbacks);
+		callbacks->record_func(info, callbacks->pContext);
+	}
+};
+
+template<typename T>
+void build_context_task(const TaskBuildInfo& info, void* pContext) {
+	static_cast<T*>(pContext)->build(info);
+}
+
+template<typename T>
+void record_context_task(const TaskRecordInfo& info, void* pContext) {
+	static_cast<T*>(pContext)->record(info);
+}
+
 template<typename T>
 RenderTaskBuilder render_task(const std::string& name,
 			T* pContext,
 			std::function<void(const TaskBuildInfo&, T*)> build_func,
 			std::function<void(const TaskRecordInfo&, T*)> record_func
 ) {
-	return RenderTaskBuilder(name, (void*)pContext,
-			[build_func, pContext](const TaskBuildInfo& info, void* ctx) {
-				build_func(info, pContext);
-			},
-			[record_func, pContext](const TaskRecordInfo& info, void* ctx) {
-				record_func(info, pContext);
-			});
+	auto callbacks = std::make_shared<TaskCallbacks<T>>(pContext, build_func, record_func);
+	return RenderTaskBuilder(name, callbacks.get(),
+			TaskCallbacks<T>::build, TaskCallbacks<T>::record, callbacks);
 }
 
+/**
+ * Creates task dispatching directly to `T::build(const TaskBuildInfo&)` and
+ * `T::record(const TaskRecordInfo&)`. Preferred for tasks recorded every frame.
+ */
+template<typename T>
+RenderTaskBuilder render_task(const std::string& name, T* pContext) {
+	return RenderTaskBuilder(name, (void*)pContext,
+			build_context_task<T>, record_context_task<T>);
+}
 
 template<typename T>
 ComputeTaskBuilder compute_task(const std::string& name,
@@ -454,13 +663,18 @@ ComputeTaskBuilder compute_task(const std::string& name,
 			std::function<void(const TaskBuildInfo&, T*)> build_func,
 			std::function<void(const TaskRecordInfo&, T*)> record_func
 ) {
+	auto callbacks = std::make_shared<TaskCallbacks<T>>(pContext, build_func, record_func);
+	return ComputeTaskBuilder(name, callbacks.get(),
+			TaskCallbacks<T>::build, TaskCallbacks<T>::record, callbacks);
+}
+
+/**
+ * Compute variant of `render_task(name, pContext)`.
+ */
+template<typename T>
+ComputeTaskBuilder compute_task(const std::string& name, T* pContext) {
 	return ComputeTaskBuilder(name, (void*)pContext,
-			[build_func, pContext](const TaskBuildInfo& info, void* ctx) {
-				build_func(info, pContext);
-			},
-			[record_func, pContext](const TaskRecordInfo& info, void* ctx) {
-				record_func(info, pContext);
-			});
+			build_context_task<T>, record_context_task<T>);
 }
 
 }
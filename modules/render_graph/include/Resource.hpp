@@ -2,18 +2,30 @@
 
 #include <volk.h>
 
+#include "resources/Buffer.hpp"
+
 class ImageResource {
 public:
 	VkImage image;
 	VkImageView image_view;
+	GpuAllocation allocation;
 
 	ImageResource(const ImageResource&) = default;
 	ImageResource(ImageResource&) = default;
 	ImageResource(ImageResource&&) = default;
 
+	ImageResource& operator=(const ImageResource&) = default;
+
 	ImageResource(VkImage image, VkImageView image_view) :
 		image(image),
-		image_view(image_view) {
+		image_view(image_view),
+		allocation({}) {
+	};
+
+	ImageResource(VkImage image, VkImageView image_view, GpuAllocation allocation) :
+		image(image),
+		image_view(image_view),
+		allocation(allocation) {
 	};
 };
 
@@ -21,9 +33,25 @@ class BufferResource {
 public:
 	VkBuffer buffer;
 	VkDeviceSize size;
+	GpuAllocation allocation;
+	// persistently mapped memory of host written buffers, null otherwise
+	void* pMapped;
 
 	BufferResource(VkBuffer buffer, VkDeviceSize size) :
 		buffer(buffer),
-		size(size) {
+		size(size),
+		allocation({}),
+		pMapped(nullptr) {
 	};
+
+	BufferResource(VkBuffer buffer, VkDeviceSize size, GpuAllocation allocation, void* pMapped) :
+		buffer(buffer),
+		size(size),
+		allocation(allocation),
+		pMapped(pMapped) {
+	};
+
+	Buffer as_buffer() const {
+		return Buffer(buffer, allocation);
+	}
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lft::rg {
+
+typedef uint32_t ResourceHandle;
+
+/**
+ * Assigns dense handles to resource names. Names are resolved only while
+ * building the graph, everything used per frame is indexed by the handle.
+ */
+class ResourceTable {
+private:
+	std::vector<std::string> m_names;
+	std::unordered_map<std::string, ResourceHandle> m_handles;
+
+public:
+	ResourceHandle get_or_create(const std::string& name) {
+		auto found = m_handles.find(name);
+		if(found != m_handles.end()) {
+			return found->second;
+		}
+
+		ResourceHandle handle = m_names.size();
+		m_names.push_back(name);
+		m_handles.insert({name, handle});
+		return handle;
+	}
+
+	std::optional<ResourceHandle> find(const std::string& name) const {
+		auto found = m_handles.find(name);
+		if(found == m_handles.end()) {
+			return {};
+		}
+
+		return found->second;
+	}
+
+	const std::string& name(ResourceHandle handle) const {
+		return m_names[handle];
+	}
+
+	uint32_t size() const {
+		return m_names.size();
+	}
+};
+
+}
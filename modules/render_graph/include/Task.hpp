@@ -3,6 +3,7 @@
 #include <cassert>
 #include <vector>
 #include <iostream>
+#include <optional>
 
 #include <volk.h>
 
@@ -12,19 +13,26 @@ namespace lft::rg {
 
 #define MAX_ATTACHMENT_COUNT 9
 #define MAX_COLOR_ATTACHMENT_COUNT MAX_ATTACHMENT_COUNT - 1
+// every combination of optional writers gets a render pass variant
+#define MAX_OPTIONAL_WRITER_COUNT 8
 
 struct TaskRenderPassState {
     uint32_t num_attachments : 4;
     uint32_t resource_flags : 18;
+    // all attachments are stored, so they can be inspected in a frame capture
+    uint32_t is_capture : 1;
 
-    TaskRenderPassState() {
+    TaskRenderPassState() :
+        num_attachments(0),
+        resource_flags(0),
+        is_capture(0) {
 
     }
 
     TaskRenderPassState(
         uint32_t num_color_attachments,
         bool has_depth_attachment
-    ) {
+    ) : resource_flags(0), is_capture(0) {
         assert(num_color_attachments <= MAX_COLOR_ATTACHMENT_COUNT);
         num_attachments = num_color_attachments + has_depth_attachment;
     }
@@ -48,6 +56,12 @@ struct TaskRenderPassState {
         assert(resource_idx < MAX_ATTACHMENT_COUNT);
         return resource_flags & (1 << (resource_idx + 9));
     }
+
+    inline bool equals(const TaskRenderPassState& other) const {
+        return num_attachments == other.num_attachments &&
+            resource_flags == other.resource_flags &&
+            is_capture == other.is_capture;
+    }
 };
 
 struct TaskRenderPass {
@@ -67,27 +81,14 @@ struct TaskRenderPass {
     }
 };
 
-struct Task {
-   	TaskInfo pDefinition;
-
-   	TaskRenderPass render_pass;
-    std::vector<uint32_t> rp_attachment_states;
-   	std::vector<VkFramebuffer> framebuffer;
-
-   	VkExtent2D extent;
-
-    bool equals(const Task& other) const {
-        if(!pDefinition.equals(other.pDefinition)) {
-            return false;
-        }
-
-        if(framebuffer.size() != other.framebuffer.size()) {
-            std::cout << "Number of framebuffers is not equal" << std::endl;
-            return false;
-        }
-
-        return true;
-    }
-};
+/**
+ * Resolves which attachments of the task at queue_idx are first and last
+ * written to in a frame, when only the tasks marked in is_enabled are run.
+ */
+TaskRenderPassState resolve_renderpass_state(
+    const std::vector<const TaskInfo*>& queue,
+    uint32_t queue_idx,
+    const std::vector<bool>& is_enabled
+);
 
 }
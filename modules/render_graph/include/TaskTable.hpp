@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RenderPass.hpp"
+#include "ResourceTable.hpp"
+
+namespace lft::rg {
+
+typedef uint32_t TaskHandle;
+
+/**
+ * Definitions of all tasks in the graph, shared by all buffers. Stored as
+ * structure of arrays indexed by TaskHandle, so data needed for recording
+ * each frame is kept apart from full definitions used only when building.
+ * Handle of a task is kept as long as a task with the same name exists.
+ */
+class TaskTable {
+private:
+	std::vector<TaskInfo> m_infos;
+
+	std::vector<TaskType> m_types;
+	std::vector<VkExtent2D> m_extents;
+	std::vector<TaskInfo::TaskRecordFunc> m_record_funcs;
+	std::vector<void*> m_contexts;
+	std::vector<std::vector<VkClearValue>> m_clear_values;
+	std::vector<std::vector<ResourceHandle>> m_attachments;
+	std::vector<bool> m_is_alive;
+
+	std::unordered_map<std::string, TaskHandle> m_handles;
+	std::vector<TaskHandle> m_free_handles;
+
+	TaskHandle allocate_handle(const std::string& name);
+
+public:
+	/**
+	 * Inserts the task or overwrites definition of the task with the same name.
+	 */
+	TaskHandle put(const TaskInfo& task_info, ResourceTable& resources);
+
+	/**
+	 * Releases the handle, so it can be reused by another task.
+	 */
+	void remove(TaskHandle handle);
+
+	std::optional<TaskHandle> find(const std::string& name) const;
+
+	inline const TaskInfo& info(TaskHandle handle) const {
+		return m_infos[handle];
+	}
+
+	inline const std::string& name(TaskHandle handle) const {
+		return m_infos[handle].name();
+	}
+
+	inline TaskType type(TaskHandle handle) const {
+		return m_types[handle];
+	}
+
+	inline VkExtent2D extent(TaskHandle handle) const {
+		return m_extents[handle];
+	}
+
+	inline void record(TaskHandle handle, const TaskRecordInfo& info) const {
+		m_record_funcs[handle](info, m_contexts[handle]);
+	}
+
+	inline std::span<const VkClearValue> clear_values(TaskHandle handle) const {
+		return m_clear_values[handle];
+	}
+
+	/**
+	 * Color attachments followed by depth attachment, if there is any.
+	 */
+	inline std::span<const ResourceHandle> attachments(TaskHandle handle) const {
+		return m_attachments[handle];
+	}
+
+	inline bool is_alive(TaskHandle handle) const {
+		return handle < m_is_alive.size() && m_is_alive[handle];
+	}
+
+	inline uint32_t size() const {
+		return m_infos.size();
+	}
+};
+
+}
@@ -4,29 +4,13 @@
 #include "RenderGraphBuffer.hpp"
 #include "RenderPass.hpp"
 #include <algorithm>
+#include <format>
+#include <optional>
 #include <print>
 #include <vulkan/vulkan_core.h>
 
 namespace lft::rg {
 
-void RenderGraph::create_fences() {
-	VkFenceCreateInfo fence_info = {
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-		.flags = VK_FENCE_CREATE_SIGNALED_BIT
-	};
-
-	m_fences.resize(m_buffers.size());
-	for(uint32_t fence_idx = 0;
-		fence_idx < m_buffers.size();
-		fence_idx++
-	) {
-		if(vkCreateFence(m_gpu->dev(),
-			&fence_info, nullptr, &m_fences[fence_idx])) {
-			throw std::runtime_error("Failed to create fence");
-		}
-	}
-}
-
 RenderGraph& RenderGraph::invalidate(const std::string& name) {
 	/* for(auto& buffer : m_buffers) {
 		for(uint32_t i = 0; i < buffer.m_command_buffers.size(); i++) {
@@ -37,15 +21,184 @@ RenderGraph& RenderGraph::invalidate(const std::string& name) {
 	return *this;
 }
 
+RenderGraph& RenderGraph::set_enabled(const std::string& name, bool is_enabled) {
+    auto found = m_task_idxs.find(name);
+    if(found == m_task_idxs.end()) {
+        throw std::runtime_error(std::format("Task {} does not exist", name));
+    }
+
+    if(!m_task_infos[found->second]->is_optional()) {
+        throw std::runtime_error(std::format("Task {} is not optional. Mark it with `set_optional` before building the graph.", name));
+    }
+
+    m_is_task_enabled[found->second] = is_enabled;
+    return *this;
+}
+
+bool RenderGraph::is_enabled(const std::string& name) const {
+    auto found = m_task_idxs.find(name);
+    if(found == m_task_idxs.end()) {
+        throw std::runtime_error(std::format("Task {} does not exist", name));
+    }
+
+    return m_is_task_enabled[found->second];
+}
+
+void* RenderGraph::map_buffer(const std::string& name) {
+    auto handle = m_resources->find(name);
+    if(!handle.has_value()) {
+        throw std::runtime_error(std::format("Buffer {} does not exist", name));
+    }
+
+    uint32_t buffer_idx = (m_buffer_idx + 1) % m_buffers.size();
+    auto resource = m_buffers[buffer_idx]->get_buffer_resource(handle.value());
+    if(!resource.has_value() || resource.value()->pMapped == nullptr) {
+        throw std::runtime_error(std::format("Buffer {} is not host written. Add it with `add_host_buffer_resource`.", name));
+    }
+
+    // the fence is reset only in run, so waiting here does not break it
+    VkFence fence = m_buffers[buffer_idx]->fence();
+    vkWaitForFences(m_gpu->dev(), 1, &fence, VK_TRUE, UINT64_MAX);
+    return resource.value()->pMapped;
+}
+
+void RenderGraph::create_task_queue() {
+    // the order of tasks is the same in each buffer
+    RenderGraphBuffer* pBuffer = m_buffers[0];
+    for(uint32_t batch_idx = 0; batch_idx < pBuffer->num_batches(); batch_idx++) {
+        m_batch_task_offsets.push_back(m_task_queue.size());
+
+        for(TaskHandle task : pBuffer->batch(batch_idx).tasks) {
+            const TaskInfo& task_info = m_tasks->info(task);
+            if(task_info.is_optional()) {
+                m_optional_task_idxs.push_back(m_task_queue.size());
+            }
+
+            m_task_idxs[task_info.name()] = m_task_queue.size();
+            m_task_queue.push_back(task);
+            m_task_infos.push_back(&task_info);
+            m_is_task_enabled.push_back(task_info.is_enabled());
+        }
+    }
+
+    // render passes are created for all tasks being enabled
+    m_is_task_active = std::vector<bool>(m_task_queue.size(), true);
+    for(auto& buffer : m_buffers) {
+        for(TaskHandle task : m_task_queue) {
+            if(m_tasks->type(task) == GRAPHICS_TASK) {
+                buffer->set_active_variant(task, 0);
+            }
+        }
+    }
+}
+
+void RenderGraph::create_batch_waits() {
+    RenderGraphBuffer* pBuffer = m_buffers[0];
+    m_batch_waits.resize(pBuffer->num_batches());
+    m_is_batch_writing_to_output.resize(pBuffer->num_batches());
+
+    for(uint32_t batch_idx = 0; batch_idx < pBuffer->num_batches(); batch_idx++) {
+        auto& batch = pBuffer->batch(batch_idx);
+
+        m_is_batch_writing_to_output[batch_idx] = std::any_of(batch.tasks.begin(), batch.tasks.end(),
+            [this](TaskHandle task) {
+                return m_tasks->info(task).has_output(m_output_name);
+            });
+
+        for(TaskHandle task : batch.tasks) {
+            auto dependencies = m_dependency_matrix->get_dependencies(m_tasks->name(task));
+
+            for(int32_t i = batch_idx - 1; i >= 0; i--) {
+                auto& other = pBuffer->batch(i);
+                bool is_depending = std::any_of(other.tasks.begin(), other.tasks.end(),
+                    [&](TaskHandle other_task) {
+                        return std::find(dependencies.begin(), dependencies.end(),
+                            m_tasks->name(other_task)) != dependencies.end();
+                    });
+
+                auto& waits = m_batch_waits[batch_idx];
+                if(is_depending && std::find(waits.begin(), waits.end(), (uint32_t)i) == waits.end()) {
+                    waits.push_back(i);
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::update_active_tasks() {
+    bool is_changed = m_is_capturing != m_is_capture_requested;
+    m_is_capturing = m_is_capture_requested;
+    m_is_capture_requested = false;
+
+    for(uint32_t idx : m_optional_task_idxs) {
+        auto& predicate = m_task_infos[idx]->enabled_predicate();
+        bool is_active = m_is_task_enabled[idx] && (!predicate || predicate());
+
+        if(is_active != m_is_task_active[idx]) {
+            m_is_task_active[idx] = is_active;
+            is_changed = true;
+        }
+    }
+
+    if(is_changed) {
+        patch_renderpasses();
+    }
+}
+
+void RenderGraph::patch_renderpasses() {
+    std::vector<std::optional<TaskRenderPassState>> states(m_task_queue.size());
+    for(uint32_t idx = 0; idx < m_task_queue.size(); idx++) {
+        if(m_tasks->type(m_task_queue[idx]) == GRAPHICS_TASK) {
+            states[idx] = resolve_renderpass_state(m_task_infos, idx, m_is_task_active);
+            states[idx]->is_capture = m_is_capturing;
+        }
+    }
+
+    for(auto& buffer : m_buffers) {
+        for(uint32_t idx = 0; idx < m_task_queue.size(); idx++) {
+            if(!states[idx].has_value()) {
+                continue;
+            }
+
+            TaskHandle task = m_task_queue[idx];
+            auto variant = buffer->find_render_pass_variant(task, states[idx].value());
+            if(!variant.has_value()) {
+                throw std::runtime_error(std::format("Missing render pass variant for task {}", m_tasks->name(task)));
+            }
+
+            buffer->set_active_variant(task, variant.value());
+        }
+
+        for(uint32_t batch_idx = 0; batch_idx < buffer->num_batches(); batch_idx++) {
+            buffer->batch(batch_idx).invalidate_recordings();
+        }
+    }
+}
+
+bool RenderGraph::is_batch_active(const RenderGraphBuffer* pBuffer, uint32_t batch_idx) const {
+    uint32_t offset = m_batch_task_offsets[batch_idx];
+    for(uint32_t idx = 0; idx < pBuffer->batch(batch_idx).tasks.size(); idx++) {
+        if(m_is_task_active[offset + idx]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 RenderGraph::RenderGraph(
 		const Gpu* gpu,
         const std::string& output_name,
 		const std::vector<RenderGraphBuffer*>& buffers,
+		const TaskTable* tasks,
+		const ResourceTable* resources,
 		AdjacencyMatrix* dependencies
 ) :
 	m_gpu(gpu),
     m_output_name(output_name),
 	m_buffers(std::move(buffers)),
+	m_tasks(tasks),
+	m_resources(resources),
 	m_buffer_idx(0),
 	m_dependency_matrix(dependencies)
 {
@@ -53,23 +206,30 @@ RenderGraph::RenderGraph(
         throw std::runtime_error("Number of buffers cannot be 0");
     }
 
-	create_fences();
+	create_task_queue();
+	create_batch_waits();
 }
 
 void RenderGraph::wait_for_previous_frame(uint32_t buffer_idx) {
+    RenderGraphBuffer* pBuffer = m_buffers[buffer_idx];
+    VkFence fence = pBuffer->fence();
     vkWaitForFences(m_gpu->dev(),
         1,
-        &m_fences[buffer_idx],
+        &fence,
         VK_TRUE, UINT64_MAX);
     vkResetFences(m_gpu->dev(),
         1,
-        &m_fences[buffer_idx]);
+        &fence);
+
+    // objects retired before the frame was submitted are not used anymore
+    m_gpu->deletion_queue()->collect(pBuffer->submitted_frame());
 }
 
-void RenderGraph::record_command_buffer(
+UploadTicket RenderGraph::record_command_buffer(
 		uint32_t buffer_idx,
 		uint32_t batch_idx,
-		uint32_t output_idx
+		uint32_t output_idx,
+		UploadTicket upload_ticket
 ) {
     RenderGraphBuffer* pBuffer = m_buffers[buffer_idx];
 	VkCommandBuffer cmdbuf = pBuffer->batch(batch_idx).output(output_idx).cmdbuf;
@@ -83,35 +243,36 @@ void RenderGraph::record_command_buffer(
 		throw std::runtime_error("Failed to begin command buffer");
 	}
 
+	// resources written by the transfer queue are taken over before any task uses them
+	UploadTicket upload_wait = upload_ticket > 0 ?
+	    m_gpu->uploads()->acquire(cmdbuf, upload_ticket, m_gpu->frame_arena()) : 0;
+
 	TaskRecordInfo record_info(
 		m_gpu,
-		lft::Recording(cmdbuf),
+		lft::Recording(cmdbuf, m_gpu->frame_arena()),
 		buffer_idx,
-		output_idx);
+		output_idx,
+		TaskResources(m_resources, pBuffer->image_resources(), pBuffer->buffer_resources()));
 
 	auto& tasks = pBuffer->batch(batch_idx).tasks;
-	for(auto& task : tasks) {
-	    if(task.pDefinition.type() == GRAPHICS_TASK) {
-    		std::vector<VkClearValue> clear_values(
-    		        task.pDefinition.color_outputs().size() +
-    				task.pDefinition.depth_output().has_value()
-    		);
-    		for(uint32_t i = 0; i < task.pDefinition.color_outputs().size(); i++) {
-    			clear_values[i] = task.pDefinition.color_outputs()[i].clear_value();
-    		}
-
-    		if(task.pDefinition.depth_output().has_value()) {
-    			clear_values[task.pDefinition.color_outputs().size()] =
-    				task.pDefinition.depth_output()->clear_value();
-    		}
+	uint32_t task_idx = m_batch_task_offsets[batch_idx];
+	for(TaskHandle task : tasks) {
+	    // disabled tasks are skipped, render passes of others were already patched
+	    if(!m_is_task_active[task_idx++]) {
+	        continue;
+	    }
+
+	    bool is_graphics = m_tasks->type(task) == GRAPHICS_TASK;
+	    if(is_graphics) {
+	        auto clear_values = m_tasks->clear_values(task);
 
     		VkRenderPassBeginInfo render_pass_begin_info = {
     			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-    			.renderPass = task.render_pass.render_pass,
-    			.framebuffer = task.framebuffer[output_idx],
+    			.renderPass = pBuffer->active_render_pass(task),
+    			.framebuffer = pBuffer->framebuffer(task, output_idx),
     			.renderArea = {
     				.offset = {0, 0},
-    				.extent = task.extent,
+    				.extent = m_tasks->extent(task),
     			},
     			.clearValueCount = (uint32_t)clear_values.size(),
     			.pClearValues = clear_values.data(),
@@ -121,9 +282,9 @@ void RenderGraph::record_command_buffer(
     				&render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 		}
 
-		task.pDefinition.m_record_func(record_info, task.pDefinition.m_pContext);
+		m_tasks->record(task, record_info);
 
-		if(task.pDefinition.type() == GRAPHICS_TASK) {
+		if(is_graphics) {
 		    vkCmdEndRenderPass(cmdbuf);
 		}
 	}
@@ -131,6 +292,8 @@ void RenderGraph::record_command_buffer(
 	if(vkEndCommandBuffer(cmdbuf)) {
 		throw std::runtime_error("Failed to end command buffer");
 	}
+
+	return upload_wait;
 }
 
 VkSemaphoreSubmitInfoKHR create_simple_semaphore_submit(VkSemaphore signal) {
@@ -143,26 +306,16 @@ VkSemaphoreSubmitInfoKHR create_simple_semaphore_submit(VkSemaphore signal) {
     };
 }
 
-std::vector<VkSemaphoreSubmitInfoKHR> RenderGraph::get_wait_semaphores_for(
+FrameVector<VkSemaphoreSubmitInfoKHR> RenderGraph::get_wait_semaphores_for(
 		const RenderGraphBuffer* pBuffer,
 		uint32_t batch_idx
 ) const {
-	std::vector<VkSemaphoreSubmitInfoKHR> semaphores;
-
-	for(auto& task : pBuffer->batch(batch_idx).tasks) {
-	    auto dependencies = m_dependency_matrix->get_dependencies(task.pDefinition.name());
-
-  		for(int32_t i = batch_idx - 1; i >= 0; i--) {
-            for(auto dependency : dependencies) {
-    		    if(std::find_if(pBuffer->batch(i).tasks.begin(), pBuffer->batch(i).tasks.end(),
-				[dependency](const Task& other) {
-				    return other.pDefinition.name() == dependency;
-				}) != pBuffer->batch(i).tasks.end()) {
-				    semaphores.push_back(create_simple_semaphore_submit(pBuffer->batch(i).signal));
-					break;
-                }
-    		}
-		}
+	FrameVector<VkSemaphoreSubmitInfoKHR> semaphores(m_gpu->frame_arena());
+	// the swapchain and upload semaphores might follow
+	semaphores.reserve(m_batch_waits[batch_idx].size() + 2);
+
+	for(uint32_t wait_idx : m_batch_waits[batch_idx]) {
+	    semaphores.push_back(create_simple_semaphore_submit(pBuffer->batch(wait_idx).signal));
 	}
 
 	return semaphores;
@@ -173,7 +326,9 @@ void RenderGraph::submit_command_buffer(
 	uint32_t batch_idx,
     VkSemaphore wait_semaphore,
 	VkFence fence,
-	uint32_t output_idx
+	uint32_t output_idx,
+	bool is_active,
+	UploadTicket upload_wait
 ) {
     RenderGraphBuffer* pBuffer = m_buffers[buffer_idx];
 
@@ -198,11 +353,22 @@ void RenderGraph::submit_command_buffer(
         wait_on_semaphores.push_back(create_simple_semaphore_submit(wait_semaphore));
     }
 
+    if(upload_wait > 0) {
+        wait_on_semaphores.push_back({
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .semaphore = m_gpu->uploads()->semaphore(),
+            .value = upload_wait,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+            .deviceIndex = 0
+        });
+    }
+
 	VkSubmitInfo2 submit_info = {
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
 			.waitSemaphoreInfoCount = (uint32_t)wait_on_semaphores.size(),
 			.pWaitSemaphoreInfos = wait_on_semaphores.data(),
-			.commandBufferInfoCount = 1,
+			// batch with all tasks disabled only passes the semaphores on
+			.commandBufferInfoCount = is_active ? 1u : 0u,
 			.pCommandBufferInfos = &cmdbuf,
 			.signalSemaphoreInfoCount = 1,
 			.pSignalSemaphoreInfos = &signal_info,
@@ -218,11 +384,8 @@ bool RenderGraph::is_recording_invalid(const RenderGraphBuffer& buffer,
 }
 
 
-bool RenderGraph::is_batch_writing_to_final_image(const Batch& buffer) const {
-    return std::any_of(buffer.tasks.begin(), buffer.tasks.end(),
-            [this](const Task& task) {
-                return task.pDefinition.has_output(m_output_name);
-            });
+bool RenderGraph::is_batch_writing_to_final_image(uint32_t batch_idx) const {
+    return m_is_batch_writing_to_output[batch_idx];
 }
 
 void RenderGraph::run(uint32_t chainImageIdx,
@@ -235,28 +398,45 @@ void RenderGraph::run(uint32_t chainImageIdx,
     // the render graph manages it's resource and must therefore itself wait
     // for them to be free for write.
 	wait_for_previous_frame(buffer_idx);
+	// temporaries of the frame last recorded into the buffer are dead now
+	m_gpu->frame_arena()->begin_frame(buffer_idx);
+	update_active_tasks();
     bool is_fence_reset = false;
 
+    // uploads recorded so far go out, those already finished are acquired by
+    // the first active batch, so the frame never waits for a running transfer
+    UploadService* uploads = m_gpu->uploads();
+    uploads->submit();
+    UploadTicket upload_ticket = uploads->completed_ticket();
+
 	for(uint32_t idx = 0; idx < buffer->num_batches(); idx++) {
+	    bool is_active = is_batch_active(buffer, idx);
+	    UploadTicket upload_wait = 0;
 		// if(is_recording_invalid(buffer, idx - 1)) {
-			record_command_buffer(buffer_idx, idx, chainImageIdx);
+		if(is_active) {
+			upload_wait = record_command_buffer(buffer_idx, idx, chainImageIdx, upload_ticket);
+			upload_ticket = 0;
+		}
 		// }
         
 		VkFence fence = idx == buffer->num_batches() - 1 ?
-			m_fences[buffer_idx] : VK_NULL_HANDLE;
+			buffer->fence() : VK_NULL_HANDLE;
         VkSemaphore wait_semaphore = VK_NULL_HANDLE;
-        if (!is_fence_reset && fence_signal_for_final_image && is_batch_writing_to_final_image(buffer->batch(idx))) {
+        if (!is_fence_reset && fence_signal_for_final_image && is_batch_writing_to_final_image(idx)) {
             vkWaitForFences(m_gpu->dev(), 1, &fence_signal_for_final_image, VK_TRUE, UINT64_MAX);
             vkResetFences(m_gpu->dev(), 1, &fence_signal_for_final_image);
             is_fence_reset = true;
         }
 
-        if(semaphore_signal_for_final_image && is_batch_writing_to_final_image(buffer->batch(idx))) {
+        if(semaphore_signal_for_final_image && is_batch_writing_to_final_image(idx)) {
             wait_semaphore = semaphore_signal_for_final_image;
         }
 
-		submit_command_buffer(buffer_idx, idx, wait_semaphore, fence, chainImageIdx);
+		submit_command_buffer(buffer_idx, idx, wait_semaphore, fence, chainImageIdx, is_active, upload_wait);
 	}
+
+	buffer->set_submitted_frame(m_gpu->deletion_queue()->next_frame());
+	m_buffer_idx = buffer_idx;
 }
 
 }
@@ -1,7 +1,6 @@
 #include "RenderGraphBuffer.hpp"
 
 #include <iterator>
-#include <unordered_map>
 #include <iostream>
 #include <algorithm>
 
@@ -56,13 +55,13 @@ std::vector<BatchOutput> create_batch_outputs(const Gpu* gpu, uint32_t count) {
         return *this;
     }
 
-    Batch& Batch::insert_task(uint32_t idx, Task& task) {
+    Batch& Batch::insert_task(uint32_t idx, TaskHandle task) {
         tasks.insert(tasks.begin() + idx, task);
         invalidate_recordings();
         return *this;
     }
 
-    Batch& Batch::update_task(uint32_t idx, Task& task) {
+    Batch& Batch::update_task(uint32_t idx, TaskHandle task) {
         tasks[idx] = task;
         invalidate_recordings();
         return *this;
@@ -74,13 +73,13 @@ std::vector<BatchOutput> create_batch_outputs(const Gpu* gpu, uint32_t count) {
         return *this;
     }
 
-    bool Batch::equals(const Batch& rhs) const {
+    bool Batch::equals(const Batch& rhs, const TaskTable& task_table, const TaskTable& rhs_task_table) const {
         if(tasks.size() != rhs.tasks.size()) {
             return false;
         }
 
         for(uint32_t i = 0; i < tasks.size(); i++) {
-            if(!tasks[i].equals(rhs.tasks[i])) {
+            if(!task_table.info(tasks[i]).equals(rhs_task_table.info(rhs.tasks[i]))) {
                 return false;
             }
         }
@@ -110,6 +109,70 @@ std::vector<BatchOutput> create_batch_outputs(const Gpu* gpu, uint32_t count) {
         for(uint32_t i = 0; i < num_outputs; i++) {
             m_final_semaphores[i] = m_gpu->create_semaphore();
         }
+
+        m_fence = m_gpu->create_fence(true);
+    }
+
+    void RenderGraphBuffer::retire_task(TaskHandle task) {
+        if(task >= m_render_passes.size()) {
+            return;
+        }
+
+        VkDevice dev = m_gpu->dev();
+        for(auto& render_pass : m_render_passes[task]) {
+            m_gpu->deletion_queue()->push([dev, render_pass = render_pass.render_pass]() {
+                vkDestroyRenderPass(dev, render_pass, nullptr);
+            });
+        }
+
+        for(VkFramebuffer framebuffer : m_framebuffers[task]) {
+            m_gpu->deletion_queue()->push([dev, framebuffer]() {
+                vkDestroyFramebuffer(dev, framebuffer, nullptr);
+            });
+        }
+
+        m_render_passes[task].clear();
+        m_framebuffers[task].clear();
+    }
+
+    void RenderGraphBuffer::retire_batch(const Batch& batch) {
+        std::vector<VkCommandBuffer> cmdbufs(batch.outputs.size());
+        std::transform(batch.outputs.begin(), batch.outputs.end(), cmdbufs.begin(),
+            [](const BatchOutput& output) { return output.cmdbuf; });
+
+        m_gpu->deletion_queue()->push([dev = m_gpu->dev(),
+                                       pool = m_gpu->graphics_command_pool(),
+                                       cmdbufs = std::move(cmdbufs),
+                                       signal = batch.signal]() {
+            vkFreeCommandBuffers(dev, pool, cmdbufs.size(), cmdbufs.data());
+            vkDestroySemaphore(dev, signal, nullptr);
+        });
+    }
+
+    void RenderGraphBuffer::retire() {
+        for(TaskHandle task = 0; task < m_render_passes.size(); task++) {
+            retire_task(task);
+        }
+
+        for(auto& batch : m_batches) {
+            retire_batch(batch);
+        }
+        m_batches.clear();
+
+        for(ResourceHandle handle = 0; handle < m_image_resources.size(); handle++) {
+            remove_image_resource(handle);
+        }
+
+        m_gpu->deletion_queue()->push([dev = m_gpu->dev(),
+                                       semaphores = std::move(m_final_semaphores),
+                                       fence = m_fence]() {
+            for(VkSemaphore semaphore : semaphores) {
+                vkDestroySemaphore(dev, semaphore, nullptr);
+            }
+            vkDestroyFence(dev, fence, nullptr);
+        });
+        m_final_semaphores.clear();
+        m_fence = VK_NULL_HANDLE;
     }
 
     Batch& RenderGraphBuffer::insert_batch(uint32_t idx, uint32_t num_outputs) {
@@ -119,30 +182,71 @@ std::vector<BatchOutput> create_batch_outputs(const Gpu* gpu, uint32_t count) {
     }
 
     void RenderGraphBuffer::remove_batch(uint32_t idx) {
+        retire_batch(m_batches[idx]);
         m_batches.erase(m_batches.begin() + idx);
     }
 
-bool is_buffer_resources_equal(
-    std::unordered_map<std::string, BufferResource> lhs,
-    std::unordered_map<std::string, BufferResource> rhs
-) {
-    for(auto& value : rhs) {
-        if(!lhs.contains(value.first)) {
-            std::cout << "Missing buffer resource: " << value.first << std::endl;
-            return false;
+    void RenderGraphBuffer::put_task(
+        TaskHandle task,
+        std::vector<TaskRenderPass> render_passes,
+        std::vector<VkFramebuffer> framebuffers
+    ) {
+        if(task >= m_render_passes.size()) {
+            m_render_passes.resize(task + 1);
+            m_active_variants.resize(task + 1, 0);
+            m_framebuffers.resize(task + 1);
         }
+
+        // frames in flight might still use the previous ones
+        retire_task(task);
+
+        m_render_passes[task] = std::move(render_passes);
+        m_active_variants[task] = 0;
+        m_framebuffers[task] = std::move(framebuffers);
     }
 
-    return true;
-}
+    void RenderGraphBuffer::remove_task(TaskHandle task) {
+        retire_task(task);
+    }
+
+    void RenderGraphBuffer::remove_image_resource(ResourceHandle handle) {
+        if(handle >= m_image_resources.size() || !m_image_resources[handle].has_value()) {
+            return;
+        }
+
+        auto& resource = m_image_resources[handle].value();
+        m_gpu->deletion_queue()->push([dev = m_gpu->dev(), view = resource.image_view]() {
+            vkDestroyImageView(dev, view, nullptr);
+        });
+
+        Image image(resource.image, resource.allocation);
+        m_gpu->memory()->destroy_image(&image);
+
+        m_image_resources[handle].reset();
+    }
+
+    std::optional<uint32_t> RenderGraphBuffer::find_render_pass_variant(
+        TaskHandle task,
+        const TaskRenderPassState& state
+    ) const {
+        auto& variants = m_render_passes[task];
+        for(uint32_t i = 0; i < variants.size(); i++) {
+            if(variants[i].state.equals(state)) {
+                return i;
+            }
+        }
+
+        return {};
+    }
 
-bool is_image_resources_equal(
-    std::unordered_map<std::string, ImageResource> lhs,
-    std::unordered_map<std::string, ImageResource> rhs
+template<typename T>
+bool is_resources_equal(
+    std::span<const std::optional<T>> lhs,
+    std::span<const std::optional<T>> rhs
 ) {
-    for(auto& value : rhs) {
-        if(!lhs.contains(value.first)) {
-            std::cout << "Missing image resource: " << value.first << std::endl;
+    for(uint32_t handle = 0; handle < rhs.size(); handle++) {
+        if(rhs[handle].has_value() && (handle >= lhs.size() || !lhs[handle].has_value())) {
+            std::cout << "Missing resource: " << handle << std::endl;
             return false;
         }
     }
@@ -150,25 +254,29 @@ bool is_image_resources_equal(
     return true;
 }
 
-bool RenderGraphBuffer::equals(const RenderGraphBuffer& other) const {
+bool RenderGraphBuffer::equals(
+    const RenderGraphBuffer& other,
+    const TaskTable& tasks,
+    const TaskTable& other_tasks
+) const {
     if(m_batches.size() != other.m_batches.size()) {
         std::cout << "Some batches are missing" << std::endl;
         return false;
     }
 
     for(uint32_t i = 0; i < m_batches.size(); i++) {
-        if(!m_batches[i].equals(other.m_batches[i])) {
+        if(!m_batches[i].equals(other.m_batches[i], tasks, other_tasks)) {
             std::cout << "Task queues are not the same" << std::endl;
             return false;
         }
     }
 
     // compare resources
-    /* if(!is_buffer_resources_equal(m_buffer_resources, other.m_buffer_resources)) {
+    /* if(!is_resources_equal(buffer_resources(), other.buffer_resources())) {
         return false;
         } */
 
-    if(!is_image_resources_equal(m_image_resources, other.m_image_resources)) {
+    if(!is_resources_equal(image_resources(), other.image_resources())) {
         return false;
     }
 
@@ -3,6 +3,7 @@
 #include <format>
 #include <ostream>
 #include <iostream>
+#include <numeric>
 #include <queue>
 #include <stdexcept>
 #include <unordered_map>
@@ -34,9 +35,10 @@ std::vector<std::string> get_task_names(
 }
 
 
-std::unordered_map<std::string, uint32_t> count_resource_image_writes(const std::vector<TaskInfo>& tasks) {
+std::unordered_map<std::string, uint32_t> count_resource_image_writes(const std::vector<const TaskInfo*>& queue) {
 	std::unordered_map<std::string, uint32_t> resource_count_down;
-	for(auto& task : tasks) {
+	for(auto pTask : queue) {
+		const TaskInfo& task = *pTask;
 		for(auto& color_output : task.color_outputs()) {
 			if(resource_count_down.find(color_output.name()) == resource_count_down.end()) {
 				resource_count_down[color_output.name()] = 1;
@@ -75,7 +77,8 @@ inline bool is_last_resource_write(
 VkAttachmentDescription2 BuilderAllocator::create_attachment_description(
 		const ImageResourceDescription& definition,
 		bool is_first_write,
-		bool is_last_write
+		bool is_last_write,
+		bool is_capture
 ) {
 
 	VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -105,8 +108,10 @@ VkAttachmentDescription2 BuilderAllocator::create_attachment_description(
 		initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	}
 
-	// store op is dont care for the last one and store for every other
-	VkAttachmentStoreOp store_op = is_last_write && (!m_store_all_images) ?
+	// after the last write, the content is needed only if some task reads it
+	bool is_read = definition.name() == m_output_name ||
+		m_sampled_resources.contains(definition.name());
+	VkAttachmentStoreOp store_op = is_last_write && !is_read && !is_capture ?
 		VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
 
 	return {
@@ -123,32 +128,73 @@ VkAttachmentDescription2 BuilderAllocator::create_attachment_description(
 }
 
 
-TaskRenderPass BuilderAllocator::allocate_renderpass(
+TaskRenderPassState get_renderpass_state(
 		const TaskInfo& task,
 		std::unordered_map<std::string, uint32_t>& resource_count_down,
 		std::unordered_set<std::string>& cleared_resources
 ) {
-	size_t num_attachments = task.color_outputs().size() + task.depth_output().has_value();
-	std::vector<VkAttachmentDescription2> descriptions(num_attachments);
-    std::vector<VkAttachmentReference2> references(num_attachments);
-
     TaskRenderPassState state(task.color_outputs().size(), task.depth_output().has_value());
 
 	uint32_t i = 0;
 	for(auto& output : task.color_outputs()) {
-    	bool is_first_write = is_first_resource_write(cleared_resources, output.name());
-        bool is_last_write = is_last_resource_write(resource_count_down, output.name());
+        if(is_first_resource_write(cleared_resources, output.name())) {
+            state.set_resource_is_first(i);
+        } if(is_last_resource_write(resource_count_down, output.name())) {
+            state.set_resource_is_last(i);
+        }
+		i++;
+	}
 
-        if(is_first_write) {
+	if (task.depth_output().has_value()) {
+        if(is_first_resource_write(cleared_resources, task.depth_output()->name())) {
             state.set_resource_is_first(i);
-        } if(is_last_write) {
+        } if(is_last_resource_write(resource_count_down, task.depth_output()->name())) {
             state.set_resource_is_last(i);
         }
+	}
+
+	return state;
+}
+
+void mark_resources_written(
+		const TaskInfo& task,
+		std::unordered_map<std::string, uint32_t>& resource_count_down,
+		std::unordered_set<std::string>& cleared_resources
+) {
+    for(auto& output : task.color_outputs()) {
+        resource_count_down[output.name()]--;
+        cleared_resources.insert(output.name());
+    }
+
+    if(task.depth_output().has_value()) {
+        resource_count_down[task.depth_output()->name()]--;
+        cleared_resources.insert(task.depth_output()->name());
+    }
+}
+
+TaskRenderPass BuilderAllocator::allocate_renderpass(
+		const TaskInfo& task,
+		std::unordered_map<std::string, uint32_t>& resource_count_down,
+		std::unordered_set<std::string>& cleared_resources
+) {
+	return create_renderpass(task, get_renderpass_state(task, resource_count_down, cleared_resources));
+}
+
+TaskRenderPass BuilderAllocator::create_renderpass(
+		const TaskInfo& task,
+		TaskRenderPassState state
+) {
+	size_t num_attachments = task.color_outputs().size() + task.depth_output().has_value();
+	std::vector<VkAttachmentDescription2> descriptions(num_attachments);
+    std::vector<VkAttachmentReference2> references(num_attachments);
 
+	uint32_t i = 0;
+	for(auto& output : task.color_outputs()) {
 		descriptions[i] = create_attachment_description(
 				output,
-				is_first_write,
-				is_last_write
+				state.is_resource_first(i),
+				state.is_resource_last(i),
+				state.is_capture
 		);
 
 		// ignore sub passes, so one reference per attachment
@@ -161,18 +207,11 @@ TaskRenderPass BuilderAllocator::allocate_renderpass(
 	}
 
 	if (task.depth_output().has_value()) {
-	    bool is_first_write = is_first_resource_write(cleared_resources, task.depth_output()->name());
-        bool is_last_write = is_last_resource_write(resource_count_down, task.depth_output()->name());
-
-        if(is_first_write) {
-            state.set_resource_is_first(i);
-        } if(is_last_write) {
-            state.set_resource_is_last(i);
-        }
-
 		descriptions[i] = create_attachment_description(
 				task.depth_output().value(),
-				is_first_write, is_last_write);
+				state.is_resource_first(i),
+				state.is_resource_last(i),
+				state.is_capture);
 
         references[i] = {
                 .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
@@ -237,17 +276,117 @@ TaskRenderPass BuilderAllocator::allocate_renderpass(
 }
 
 
+/**
+ * Collects all states the render pass of task at queue_idx can end up in,
+ * when any of the optional tasks writing to the same attachments are disabled.
+ * Each state has a capture counterpart, used by `RenderGraph::request_capture`.
+ */
+std::vector<TaskRenderPassState> get_renderpass_variant_states(
+		const std::vector<const TaskInfo*>& queue,
+		uint32_t queue_idx
+) {
+    const TaskInfo* task = queue[queue_idx];
+
+    // only optional tasks writing to the same attachments affect load/store ops and layouts
+    std::vector<uint32_t> optional_writers;
+    for(uint32_t i = 0; i < queue.size(); i++) {
+        if(i == queue_idx || !queue[i]->is_optional()) {
+            continue;
+        }
+
+        bool is_writing_to_attachment = std::any_of(
+            task->color_outputs().begin(), task->color_outputs().end(),
+            [&](const ImageResourceDescription& output) {
+                return queue[i]->has_output(output.name());
+            }) ||
+            (task->depth_output().has_value() && queue[i]->has_output(task->depth_output()->name()));
+
+        if(is_writing_to_attachment) {
+            optional_writers.push_back(i);
+        }
+    }
+
+    if(optional_writers.size() > MAX_OPTIONAL_WRITER_COUNT) {
+        throw std::runtime_error(std::format("Too many optional tasks write to attachments of {}", task->name()));
+    }
+
+    std::vector<TaskRenderPassState> states;
+    std::vector<bool> is_enabled(queue.size(), true);
+    for(uint32_t mask = 0; mask < (1u << optional_writers.size()); mask++) {
+        for(uint32_t bit = 0; bit < optional_writers.size(); bit++) {
+            is_enabled[optional_writers[bit]] = !(mask & (1u << bit));
+        }
+
+        auto state = resolve_renderpass_state(queue, queue_idx, is_enabled);
+        if(std::none_of(states.begin(), states.end(),
+            [&state](const TaskRenderPassState& other) {
+                return other.equals(state);
+            })) {
+            states.push_back(state);
+        }
+    }
+
+    uint32_t num_states = states.size();
+    for(uint32_t i = 0; i < num_states; i++) {
+        states.push_back(states[i]);
+        states.back().is_capture = 1;
+    }
+
+    return states;
+}
+
+bool is_renderpass_variant_missing(
+		const RenderGraphBuffer* pBuffer,
+		TaskHandle task,
+		const std::vector<const TaskInfo*>& queue,
+		uint32_t queue_idx
+) {
+    if(queue[queue_idx]->type() != GRAPHICS_TASK) {
+        return false;
+    }
+
+    auto states = get_renderpass_variant_states(queue, queue_idx);
+    return std::any_of(states.begin(), states.end(),
+        [&](const TaskRenderPassState& state) {
+            return !pBuffer->find_render_pass_variant(task, state).has_value();
+        });
+}
+
+std::vector<TaskRenderPass> BuilderAllocator::allocate_renderpass_variants(
+		const std::vector<const TaskInfo*>& queue,
+		uint32_t queue_idx,
+		const TaskRenderPass& render_pass
+) {
+    std::vector<TaskRenderPass> variants = { render_pass };
+
+    for(auto& state : get_renderpass_variant_states(queue, queue_idx)) {
+        if(!state.equals(render_pass.state)) {
+            variants.push_back(create_renderpass(*queue[queue_idx], state));
+        }
+    }
+
+    return variants;
+}
+
 ImageResource BuilderAllocator::allocate_image_resource(
-    const ImageResourceDescription& desc
+    const ImageResourceDescription& desc,
+    bool is_transient
 ) const {
+    // content of transient attachments never leaves the render pass, so
+    // tiled GPUs do not need to back them with memory at all
     MemoryAllocationInfo memory_info = {
-            .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE
+            .usage = is_transient ?
+                MEMORY_USAGE_GPU_LAZILY_ALLOCATED :
+                MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .category = MEMORY_CATEGORY_ATTACHMENT
     };
 
 	ImageCreateInfo image_info = {
             .extent = desc.extent(),
             .format = desc.format(),
-            .usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+            .usage = (VkImageUsageFlags)(is_transient ?
+                        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT :
+                        VK_IMAGE_USAGE_SAMPLED_BIT) |
                         (VkImageUsageFlags)(desc.is_color() ?
 						 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT :
 						 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT),
@@ -259,7 +398,16 @@ ImageResource BuilderAllocator::allocate_image_resource(
     };
 
 	Image image = {};
-	m_gpu->memory()->create_image(&image_info, &memory_info, &image);
+	bool is_failed = m_gpu->memory()->create_image(&image_info, &memory_info, &image);
+	if(is_failed && is_transient) {
+	    // not every device has lazily allocated memory
+	    memory_info.usage = MEMORY_USAGE_AUTO_PREFER_DEVICE;
+		is_failed = m_gpu->memory()->create_image(&image_info, &memory_info, &image);
+	}
+
+	if(is_failed || image.img == VK_NULL_HANDLE) {
+		throw std::runtime_error(std::format("Failed to allocate image resource {}", desc.name()));
+	}
 
 	ImageView view = {};
 	view = image.create_view(m_gpu, desc.format(), {
@@ -270,13 +418,322 @@ ImageResource BuilderAllocator::allocate_image_resource(
 			.layerCount = 1,
 	});
 
-	return ImageResource(image.img, view.view);
+	return ImageResource(image.img, view.view, image.allocation);
 }
 
 BufferResource BuilderAllocator::allocate_buffer_resource(
     const BufferResourceDescription& desc
 ) const {
+    bool is_host_written = desc.lifetime() == BUFFER_LIFETIME_HOST_WRITTEN;
+
+    BufferCreateInfo buffer_info = {
+            .size = desc.size(),
+            .usage = desc.usage(),
+            .isExclusive = true,
+    };
 
+    // host written buffers are coherent, so writes through map_buffer need no flush,
+    // device local memory is still preferred, so on UMA and resizable BAR
+    // devices shaders read them from VRAM
+    MemoryAllocationInfo memory_info = {
+            .usage = MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = is_host_written ?
+                (VkMemoryPropertyFlags)(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) :
+                0,
+            .category = is_host_written ?
+                MEMORY_CATEGORY_UNIFORM :
+                MEMORY_CATEGORY_ATTACHMENT,
+    };
+
+    Buffer buffer;
+    if(m_gpu->memory()->create_buffer(&buffer_info, &memory_info, &buffer) ||
+        buffer.buf == VK_NULL_HANDLE) {
+        throw std::runtime_error(std::format("Failed to allocate buffer resource {}", desc.name()));
+    }
+
+    VkDebugUtilsObjectNameInfoEXT buffer_dbg_info = {
+        .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+        .objectType = VK_OBJECT_TYPE_BUFFER,
+        .objectHandle = (uint64_t)buffer.buf,
+        .pObjectName = strdup(std::format("[BUF]{}", desc.name()).c_str()),
+    };
+    vkSetDebugUtilsObjectNameEXT(m_gpu->dev(), &buffer_dbg_info);
+
+    void* pMapped = nullptr;
+    if(is_host_written) {
+        m_gpu->memory()->map(buffer.allocation, &pMapped);
+    }
+
+    return BufferResource(buffer.buf, desc.size(), buffer.allocation, pMapped);
+}
+
+void BuilderAllocator::retire_buffer_resource(const BufferResource& resource) const {
+    Buffer buffer = resource.as_buffer();
+    if(resource.pMapped != nullptr) {
+        m_gpu->memory()->unmap(buffer.allocation);
+    }
+
+    m_gpu->memory()->destroy_buffer(&buffer);
+}
+
+void BuilderAllocator::retire_owned_buffer_resource(
+    ResourceHandle handle,
+    const BufferResourceDescription& desc
+) const {
+    // persistent buffers share the resource, host written ones have one per buffer
+    uint32_t num_owned = desc.lifetime() == BUFFER_LIFETIME_HOST_WRITTEN ?
+        m_buffers.size() : 1;
+    for(uint32_t buffer_idx = 0; buffer_idx < num_owned; buffer_idx++) {
+        auto resource = m_buffers[buffer_idx].get_buffer_resource(handle);
+        if(resource.has_value()) {
+            retire_buffer_resource(*resource.value());
+        }
+    }
+}
+
+void BuilderAllocator::mark_resource_users_updated(
+    const std::vector<const TaskInfo*>& queue,
+    const std::string& name
+) {
+    for(auto task : queue) {
+        if(task->has_output(name) ||
+            std::find(task->dependencies().begin(), task->dependencies().end(), name) != task->dependencies().end()) {
+            m_updated_tasks.insert(task->name());
+        }
+    }
+}
+
+void BuilderAllocator::update_image_usages(
+    const std::vector<const TaskInfo*>& queue
+) {
+    std::unordered_set<std::string> sampled_resources;
+    for(auto task : queue) {
+        sampled_resources.insert(task->dependencies().begin(), task->dependencies().end());
+    }
+
+    // images written by a single task and never read do not need to leave the render pass
+    std::unordered_set<std::string> transient_images;
+    for(auto& [name, count] : count_resource_image_writes(queue)) {
+        if(count == 1 && name != m_output_name && !sampled_resources.contains(name)) {
+            transient_images.insert(name);
+        }
+    }
+
+    for(auto task : queue) {
+        auto update_image = [&](const std::string& name) {
+            if(sampled_resources.contains(name) != m_sampled_resources.contains(name)) {
+                // store op of writers changes
+                mark_resource_users_updated(queue, name);
+            }
+
+            if(transient_images.contains(name) != m_transient_images.contains(name)) {
+                // usage of the image changes, so it has to be allocated again
+                auto handle = m_resources.get_or_create(name);
+                for(auto& buffer : m_buffers) {
+                    buffer.remove_image_resource(handle);
+                }
+                mark_resource_users_updated(queue, name);
+            }
+        };
+
+        for(auto& output : task->color_outputs()) {
+            update_image(output.name());
+        }
+
+        if(task->depth_output().has_value()) {
+            update_image(task->depth_output()->name());
+        }
+    }
+
+    m_sampled_resources = std::move(sampled_resources);
+    m_transient_images = std::move(transient_images);
+}
+
+bool is_depending_on(const TaskInfo& task, const TaskInfo& depends_on);
+bool has_common_write(const TaskInfo& task1, const TaskInfo& task2);
+
+/**
+ * Finds which tasks of the queue are ordered before each other on the GPU.
+ * @return reachable[a][b] is true when a path of dependencies leads from a to b
+ */
+static std::vector<std::vector<bool>> build_reachability(const std::vector<const TaskInfo*>& queue) {
+    std::vector<std::vector<bool>> reachable(queue.size(), std::vector<bool>(queue.size()));
+    // queue is sorted, dependencies of a task are always before it
+    for(uint32_t to = 0; to < queue.size(); to++) {
+        for(uint32_t from = 0; from < to; from++) {
+            if(!is_depending_on(*queue[to], *queue[from]) && !has_common_write(*queue[to], *queue[from])) {
+                continue;
+            }
+
+            reachable[from][to] = true;
+            for(uint32_t x = 0; x < from; x++) {
+                if(reachable[x][from]) {
+                    reachable[x][to] = true;
+                }
+            }
+        }
+    }
+
+    return reachable;
+}
+
+void BuilderAllocator::allocate_buffer_resources(
+    const std::vector<const TaskInfo*>& queue
+) {
+    // queue indices of tasks writing or reading each buffer
+    std::vector<BufferResourceDescription> descs = m_host_buffers;
+    // host written buffers are used by the whole queue
+    std::vector<uint32_t> all_tasks(queue.size());
+    std::iota(all_tasks.begin(), all_tasks.end(), 0);
+    std::vector<std::vector<uint32_t>> users(descs.size(), all_tasks);
+
+    for(uint32_t idx = 0; idx < queue.size(); idx++) {
+        for(auto& output : queue[idx]->buffer_outputs()) {
+            auto found = std::find_if(descs.begin(), descs.end(),
+                [&output](const BufferResourceDescription& desc) {
+                    return desc.name() == output.name();
+                });
+
+            if(found == descs.end()) {
+                descs.push_back(output);
+                users.push_back({idx});
+                continue;
+            }
+
+            if(output.size() > found->size()) {
+                *found = output;
+            }
+
+            users[found - descs.begin()].push_back(idx);
+        }
+    }
+
+    for(uint32_t idx = 0; idx < queue.size(); idx++) {
+        for(auto& dependency : queue[idx]->dependencies()) {
+            for(uint32_t i = 0; i < descs.size(); i++) {
+                if(descs[i].name() == dependency) {
+                    users[i].push_back(idx);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> transient_idxs;
+    for(uint32_t i = 0; i < descs.size(); i++) {
+        auto& desc = descs[i];
+        ResourceHandle handle = m_resources.get_or_create(desc.name());
+        if(m_external_buffers.contains(handle)) {
+            continue;
+        }
+
+        auto found = m_buffer_descriptions.find(handle);
+        if(found != m_buffer_descriptions.end() && found->second.equals(desc)) {
+            continue;
+        }
+
+        if(found != m_buffer_descriptions.end()) {
+            retire_owned_buffer_resource(handle, found->second);
+            m_buffer_descriptions.erase(found);
+        }
+
+        if(desc.lifetime() == BUFFER_LIFETIME_TRANSIENT) {
+            transient_idxs.push_back(i);
+            continue;
+        }
+
+        if(desc.lifetime() == BUFFER_LIFETIME_PERSISTENT) {
+            auto resource = allocate_buffer_resource(desc);
+            for(auto& buffer : m_buffers) {
+                buffer.put_buffer_resource(handle, resource);
+            }
+        } else {
+            for(auto& buffer : m_buffers) {
+                buffer.put_buffer_resource(handle, allocate_buffer_resource(desc));
+            }
+        }
+
+        m_buffer_descriptions.insert_or_assign(handle, desc);
+        mark_resource_users_updated(queue, desc.name());
+    }
+
+    // greedy assignment, a buffer shares a slot only when all the previous
+    // users of the slot are finished on the GPU before any of its own users
+    // start. Tasks without a path of dependencies between them may overlap
+    // even when they are far apart in the queue.
+    auto reachable = build_reachability(queue);
+    std::sort(transient_idxs.begin(), transient_idxs.end(),
+        [&users](uint32_t a, uint32_t b) {
+            return *std::min_element(users[a].begin(), users[a].end()) <
+                *std::min_element(users[b].begin(), users[b].end());
+        });
+
+    std::vector<TransientBufferSlot> slots;
+    std::vector<uint32_t> slot_idxs(descs.size());
+    for(uint32_t i : transient_idxs) {
+        auto found = std::find_if(slots.begin(), slots.end(),
+            [&](const TransientBufferSlot& slot) {
+                return std::all_of(slot.users.begin(), slot.users.end(), [&](uint32_t previous) {
+                    return std::all_of(users[i].begin(), users[i].end(), [&](uint32_t user) {
+                        return reachable[previous][user];
+                    });
+                });
+            });
+
+        if(found == slots.end()) {
+            slots.push_back({ .size = 0, .usage = 0 });
+            found = slots.end() - 1;
+        }
+
+        found->size = std::max(found->size, descs[i].size());
+        found->usage |= descs[i].usage();
+        found->users.insert(found->users.end(), users[i].begin(), users[i].end());
+        slot_idxs[i] = found - slots.begin();
+    }
+
+    for(auto& buffer : m_buffers) {
+        auto& buffers = m_transient_buffers[buffer.index()];
+        for(uint32_t slot_idx = 0; slot_idx < slots.size(); slot_idx++) {
+            auto& slot = slots[slot_idx];
+            if(slot_idx < buffers.size() &&
+                buffers[slot_idx].size >= slot.size &&
+                (buffers[slot_idx].usage & slot.usage) == slot.usage) {
+                continue;
+            }
+
+            auto resource = allocate_buffer_resource(BufferResourceDescription(
+                std::format("transient{}", slot_idx), slot.size, slot.usage, BUFFER_LIFETIME_TRANSIENT));
+            TransientBufferSlot allocated = {
+                .size = slot.size,
+                .usage = slot.usage,
+                .buffer = resource.buffer,
+                .allocation = resource.allocation
+            };
+
+            if(slot_idx < buffers.size()) {
+                retire_buffer_resource(BufferResource(buffers[slot_idx].buffer,
+                    buffers[slot_idx].size, buffers[slot_idx].allocation, nullptr));
+                buffers[slot_idx] = allocated;
+            } else {
+                buffers.push_back(allocated);
+            }
+        }
+
+        for(uint32_t i : transient_idxs) {
+            ResourceHandle handle = m_resources.get_or_create(descs[i].name());
+            auto& slot = buffers[slot_idxs[i]];
+
+            auto previous = buffer.get_buffer_resource(handle);
+            if(!previous.has_value() ||
+                previous.value()->buffer != slot.buffer ||
+                previous.value()->size != descs[i].size()) {
+                mark_resource_users_updated(queue, descs[i].name());
+            }
+
+            buffer.put_buffer_resource(handle,
+                BufferResource(slot.buffer, descs[i].size(), slot.allocation, nullptr));
+        }
+    }
 }
 
 ImageResourceDescription BuilderAllocator::correct_resource_description(ImageResourceDescription desc) {
@@ -303,9 +760,11 @@ ImageView BuilderAllocator::get_attachment(
 		return m_output_chain.views()[output_idx];
 	}
 
-	auto attachment = pBuffer->get_image_resource(desc.name());
+	ResourceHandle handle = m_resources.get_or_create(desc.name());
+	auto attachment = pBuffer->get_image_resource(handle);
 	if(!attachment.has_value()) {
-	    auto resource = allocate_image_resource(correct_resource_description(desc));
+	    auto resource = allocate_image_resource(correct_resource_description(desc),
+	        m_transient_images.contains(desc.name()));
 
 		VkDebugUtilsObjectNameInfoEXT img_dbg_info = {
             .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
@@ -323,7 +782,7 @@ ImageView BuilderAllocator::get_attachment(
         };
         vkSetDebugUtilsObjectNameEXT(m_gpu->dev(), &img_view_dbg_info);
 
-	    pBuffer->put_image_resource(desc.name(), resource);
+	    pBuffer->put_image_resource(handle, resource);
 		return resource.image_view;
 	}
 
@@ -331,11 +790,12 @@ ImageView BuilderAllocator::get_attachment(
 }
 
 VkFramebuffer BuilderAllocator::create_framebuffer(
-		const TaskInfo& task_info,
+		TaskHandle task,
 		VkRenderPass renderpass,
 		RenderGraphBuffer *pBuffer,
 		uint32_t output_idx
 ) {
+	const TaskInfo& task_info = m_tasks.info(task);
 	uint32_t num_attachments = task_info.color_outputs().size() +
 		task_info.depth_output().has_value();
 	std::vector<ImageView> attachments(num_attachments);
@@ -365,13 +825,11 @@ VkFramebuffer BuilderAllocator::create_framebuffer(
 	return fb.framebuffer;
 }
 
-Task BuilderAllocator::create_graphics_task(
-    const TaskInfo& task_info,
+void BuilderAllocator::create_graphics_task(
+    TaskHandle task,
     RenderGraphBuffer* pBuffer,
-    TaskRenderPass render_pass
+    std::vector<TaskRenderPass> render_passes
 ) {
-    Task task = {.pDefinition = task_info, .render_pass = render_pass};
-
     // create framebuffer for each image in output chain
     std::vector<VkFramebuffer> framebuffers(m_output_chain.count());
 	for(
@@ -379,88 +837,74 @@ Task BuilderAllocator::create_graphics_task(
 		image_idx < m_output_chain.count();
 		image_idx++
 	) {
-		auto fb = create_framebuffer(task_info, task.render_pass.render_pass, pBuffer, image_idx);
-		framebuffers[image_idx] = fb;
+		framebuffers[image_idx] = create_framebuffer(task, render_passes[0].render_pass, pBuffer, image_idx);
 	}
 
-	task.framebuffer = framebuffers;
-	task.extent = m_output_chain.extent();
-
-	return task;
+	pBuffer->put_task(task, std::move(render_passes), std::move(framebuffers));
 }
 
-Task BuilderAllocator::create_compute_task(
-    const TaskInfo& task_info,
+void BuilderAllocator::create_compute_task(
+    TaskHandle task,
     RenderGraphBuffer* pBuffer
 ) {
-    Task task = {.pDefinition = task_info};
-
-	return task;
+    pBuffer->put_task(task, {}, {});
 }
 
-Task BuilderAllocator::create_task(
-    const TaskInfo& task_info,
+void BuilderAllocator::create_task(
+    const std::vector<TaskHandle>& handles,
+    const std::vector<const TaskInfo*>& queue,
+    uint32_t queue_idx,
     RenderGraphBuffer* pBuffer,
     std::unordered_set<std::string>& cleared_resources,
     std::unordered_map<std::string, uint32_t>& resource_count_down
 ) {
+    const TaskInfo& task_info = *queue[queue_idx];
     if(task_info.type() == GRAPHICS_TASK) {
         auto render_pass = allocate_renderpass(task_info, resource_count_down, cleared_resources);
-        return create_graphics_task(task_info, pBuffer, render_pass);
+        create_graphics_task(handles[queue_idx], pBuffer,
+            allocate_renderpass_variants(queue, queue_idx, render_pass));
     } else if(task_info.type() == COMPUTE_TASK) {
-        return create_compute_task(task_info, pBuffer);
+        create_compute_task(handles[queue_idx], pBuffer);
     } else {
         throw std::runtime_error(std::format("Unknown task type for {}", task_info.name()));
     }
 }
 
-bool is_render_pass_updated(const Task& old_task,
-    std::unordered_set<std::string> cleared_resources,
-    std::unordered_map<std::string, uint32_t> resource_count_down
+bool is_render_pass_updated(
+    const TaskInfo& task_info,
+    const TaskRenderPass& render_pass,
+    std::unordered_set<std::string>& cleared_resources,
+    std::unordered_map<std::string, uint32_t>& resource_count_down
 ) {
-    uint32_t i = 0;
-    for(; i < old_task.pDefinition.m_color_outputs.size(); i++) {
-        if(old_task.render_pass.state.is_resource_first(i) != is_first_resource_write(cleared_resources, old_task.pDefinition.m_color_outputs[i].name())) {
-            return true;
-        } else if(old_task.render_pass.state.is_resource_last(i) != is_last_resource_write(resource_count_down, old_task.pDefinition.m_color_outputs[i].name())) {
-            return true;
-        }
-    }
-
-    if(old_task.pDefinition.depth_output().has_value()) {
-        if(old_task.render_pass.state.is_resource_first(i) != is_first_resource_write(cleared_resources, old_task.pDefinition.depth_output()->name())) {
-            return true;
-        } else if(old_task.render_pass.state.is_resource_last(i) != is_last_resource_write(resource_count_down, old_task.pDefinition.depth_output()->name())) {
-            return true;
-        }
+    if(task_info.type() != GRAPHICS_TASK) {
+        return false;
     }
 
-    return false;
+    return !render_pass.state.equals(get_renderpass_state(task_info, resource_count_down, cleared_resources));
 }
 
-void BuilderAllocator::update_task_buffer(const Task& task, const RenderGraphBuffer* pBuffer) {
+void BuilderAllocator::update_task_buffer(TaskHandle task, const RenderGraphBuffer* pBuffer) {
     TaskBuildInfo task_build_info(
 	    m_gpu,
 		pBuffer->index(),
 		num_buffers(),
 	    get_viewport(),
-		task.render_pass.render_pass,
-		pBuffer->m_image_resources
+		pBuffer->render_pass(task).render_pass,
+		TaskResources(&m_resources, pBuffer->image_resources(), pBuffer->buffer_resources())
 	);
-	task.pDefinition.build_func()(task_build_info, task.pDefinition.m_pContext);
+
+	const TaskInfo& task_info = m_tasks.info(task);
+	task_info.build_func()(task_build_info, task_info.m_pContext);
 }
 
 void BuilderAllocator::update_task_queue(
     RenderGraphBuffer* pBuffer,
-    const std::vector<TaskInfo>& task_infos
+    const std::vector<TaskHandle>& handles,
+    const std::vector<const TaskInfo*>& queue
 ) {
-    std::unordered_map<std::string, uint32_t> resource_count_down = count_resource_image_writes(task_infos);
+    std::unordered_map<std::string, uint32_t> resource_count_down = count_resource_image_writes(queue);
 	std::unordered_set<std::string> cleared_resources;
 
-	uint32_t cmdbuf_idx = 0;
-
-	int32_t remaining_tasks_in_cmdbuf = pBuffer->num_batches() == 0 ? 0 : pBuffer->batch(0).tasks.size();
-
     // lookahead method
     uint32_t next_task_idx = 0;
     uint32_t next_batch_idx = 0;
@@ -469,58 +913,56 @@ void BuilderAllocator::update_task_queue(
 
     while(next_batch_idx < pBuffer->num_batches()) {
         Batch* next_batch = &pBuffer->batch(next_batch_idx);
-        Task* next_task = &next_batch->tasks[next_task_idx];
+        TaskHandle next_task = next_batch->tasks[next_task_idx];
 
-        if(queue_idx >= task_infos.size()) {
+        if(queue_idx >= queue.size()) {
             next_batch->remove_task(next_task_idx);
-            next_task_idx--;
 
             if(next_batch->tasks.size() == 0) {
                 pBuffer->remove_batch(next_batch_idx);
                 next_task_idx = 0;
-
-                continue;
             }
+
+            continue;
         } else {
             // if next_task and next_queue_item does not match, we have to
-            if(task_infos[queue_idx].name() != next_task->pDefinition.name()) {
+            if(handles[queue_idx] != next_task) {
                 // if task that should be there is updated, it means it was inserted
                 // if it would be updated, there would not be a name mismatch
-                if(is_task_updated(task_infos[queue_idx].name())) {
-                    auto task = create_task(task_infos[queue_idx], pBuffer, cleared_resources, resource_count_down);
+                if(is_task_updated(queue[queue_idx]->name())) {
+                    create_task(handles, queue, queue_idx, pBuffer, cleared_resources, resource_count_down);
                     // insert batch instead of new
          			pBuffer->insert_batch(next_batch_idx, m_output_chain.count())
                                 // insert the new task
-               					.insert_task(0, task);
+               					.insert_task(0, handles[queue_idx]);
                     // notify about update
-         			update_task_buffer(task, pBuffer);
+         			update_task_buffer(handles[queue_idx], pBuffer);
 
                     // now the next_task and task_infos[queue_idx] should match, let us move on to the next
                 }
                 // if task that should be there is not updated (it was already in the queue)
                 // but task that is actually there is updated, we should remove the current task,
                 // because the wanted task is next
-                else if(is_task_updated(next_task->pDefinition.name())) {
+                else if(is_task_updated(m_tasks.name(next_task))) {
                     next_batch->remove_task(next_task_idx);
                     if(next_batch->tasks.size() == 0) {
                         pBuffer->remove_batch(next_batch_idx);
-                        continue;
                     }
+                    continue;
                 }
             }
             // if tasks match, but task is marked as updated, we should rebuild the task
-            else if(is_task_updated(task_infos[queue_idx].name()) ||
-                    is_render_pass_updated(*next_task, cleared_resources, resource_count_down)
+            else if(is_task_updated(queue[queue_idx]->name()) ||
+                    is_render_pass_updated(*queue[queue_idx], pBuffer->render_pass(next_task), cleared_resources, resource_count_down) ||
+                    is_renderpass_variant_missing(pBuffer, next_task, queue, queue_idx)
             ) {
-                auto task = create_task(task_infos[queue_idx], pBuffer, cleared_resources, resource_count_down);
-    			next_batch->update_task(next_task_idx, task);
+                create_task(handles, queue, queue_idx, pBuffer, cleared_resources, resource_count_down);
+    			next_batch->update_task(next_task_idx, next_task);
+    			update_task_buffer(next_task, pBuffer);
             }
         }
 
-        for(auto& output : task_infos[queue_idx].color_outputs()) {
-            resource_count_down[output.name()]--;
-            cleared_resources.insert(output.name());
-        }
+        mark_resources_written(*queue[queue_idx], resource_count_down, cleared_resources);
 
         next_batch = &pBuffer->batch(next_batch_idx);
 
@@ -532,16 +974,13 @@ void BuilderAllocator::update_task_queue(
         queue_idx++;
     }
 
-    for(; queue_idx < task_infos.size(); queue_idx++) {
-	    auto task = create_task(task_infos[queue_idx], pBuffer, cleared_resources, resource_count_down);
+    for(; queue_idx < queue.size(); queue_idx++) {
+	    create_task(handles, queue, queue_idx, pBuffer, cleared_resources, resource_count_down);
 		pBuffer->insert_batch(pBuffer->num_batches(), m_output_chain.count())
-                .insert_task(0, task);
-		update_task_buffer(task, pBuffer);
+                .insert_task(0, handles[queue_idx]);
+		update_task_buffer(handles[queue_idx], pBuffer);
 
-		for(auto& output : task_infos[queue_idx].color_outputs()) {
-            resource_count_down[output.name()]--;
-            cleared_resources.insert(output.name());
-        }
+		mark_resources_written(*queue[queue_idx], resource_count_down, cleared_resources);
 	}
 }
 
@@ -559,15 +998,55 @@ RenderGraph BuilderAllocator::allocate(
         }
     }
 
+    std::vector<TaskHandle> handles(task_infos.size());
+    for(uint32_t i = 0; i < task_infos.size(); i++) {
+        handles[i] = m_tasks.put(task_infos[i], m_resources);
+    }
+
+    // table is not resized anymore, pointers stay valid
+    std::vector<const TaskInfo*> queue(handles.size());
+    std::transform(handles.begin(), handles.end(), queue.begin(),
+        [this](TaskHandle handle) { return &m_tasks.info(handle); });
+
+    update_image_usages(queue);
+    allocate_buffer_resources(queue);
+
 	std::vector<RenderGraphBuffer*> buffers(num_buffers());
 	for(uint32_t buffer_idx = 0; buffer_idx < num_buffers(); buffer_idx++) {
-	    update_task_queue(&m_buffers[buffer_idx], task_infos);
+	    update_task_queue(&m_buffers[buffer_idx], handles, queue);
 		buffers[buffer_idx] = &m_buffers[buffer_idx];
 	}
 
+	// release handles of removed tasks
+	for(TaskHandle handle = 0; handle < m_tasks.size(); handle++) {
+	    if(m_tasks.is_alive(handle) &&
+	        std::find(handles.begin(), handles.end(), handle) == handles.end()) {
+	        for(auto& buffer : m_buffers) {
+	            buffer.remove_task(handle);
+	        }
+	        m_tasks.remove(handle);
+	    }
+	}
+
 	m_updated_tasks.clear();
 
-	return RenderGraph(m_gpu, m_output_name, buffers, dependencies);
+	return RenderGraph(m_gpu, m_output_name, buffers, &m_tasks, &m_resources, dependencies);
+}
+
+BuilderAllocator::~BuilderAllocator() {
+    for(auto& buffer : m_buffers) {
+        buffer.retire();
+    }
+
+    for(auto& [handle, desc] : m_buffer_descriptions) {
+        retire_owned_buffer_resource(handle, desc);
+    }
+
+    for(auto& slots : m_transient_buffers) {
+        for(auto& slot : slots) {
+            retire_buffer_resource(BufferResource(slot.buffer, slot.size, slot.allocation, nullptr));
+        }
+    }
 }
 
 bool BuilderAllocator::equals(const BuilderAllocator& other) const {
@@ -587,7 +1066,7 @@ bool BuilderAllocator::equals(const BuilderAllocator& other) const {
     }
 
     for(uint32_t i = 0; i < m_buffers.size(); i++) {
-        if(!m_buffers[i].equals(other.m_buffers[i])) {
+        if(!m_buffers[i].equals(other.m_buffers[i], m_tasks, other.m_tasks)) {
             std::cout << "Buffer mismatch at index " << i << std::endl;
             return false;
         }
@@ -780,11 +1259,45 @@ std::vector<TaskInfo> topology_sort(std::vector<TaskInfo>& tasks, const std::str
 
 #pragma endregion
 
+/**
+ * Optional tasks can be disabled at runtime, images sampled by other tasks or
+ * presented as the output would then never be written. Each of them needs a
+ * writer that is always enabled.
+ */
+static void validate_optional_writers(const std::vector<TaskInfo>& tasks, const std::string& output_name) {
+    std::unordered_set<std::string> read_images = { output_name };
+    for(auto& task : tasks) {
+        read_images.insert(task.dependencies().begin(), task.dependencies().end());
+    }
+
+    std::unordered_map<std::string, bool> is_always_written;
+    for(auto& task : tasks) {
+        auto add_write = [&](const std::string& name) {
+            if(read_images.contains(name)) {
+                is_always_written[name] |= !task.is_optional();
+            }
+        };
+
+        for(auto& output : task.color_outputs()) {
+            add_write(output.name());
+        }
+
+        if(task.depth_output().has_value()) {
+            add_write(task.depth_output()->name());
+        }
+    }
+
+    for(auto& [name, is_written] : is_always_written) {
+        if(!is_written) {
+            throw std::runtime_error(std::format("Image {} is read but only written by optional tasks. Its contents are undefined when they are disabled.", name));
+        }
+    }
+}
+
 RenderGraph Builder::build() {
+	validate_optional_writers(m_tasks, m_output_name);
 	auto sorted_tasks = topology_sort(m_tasks, m_output_name);
 
-	m_allocator.set_store_all_images(m_store_all_images);
-
 	auto dependencies = build_adj_matrix(m_tasks, m_output_name);
 	return m_allocator.allocate(sorted_tasks, dependencies);
 }
@@ -0,0 +1,48 @@
+#include "Task.hpp"
+
+namespace lft::rg {
+
+TaskRenderPassState resolve_renderpass_state(
+    const std::vector<const TaskInfo*>& queue,
+    uint32_t queue_idx,
+    const std::vector<bool>& is_enabled
+) {
+    const TaskInfo* task = queue[queue_idx];
+    TaskRenderPassState state(task->color_outputs().size(), task->depth_output().has_value());
+
+    auto resolve_attachment = [&](uint32_t attachment_idx, const std::string& name) {
+        bool is_first_write = true;
+        bool is_last_write = true;
+
+        for(uint32_t i = 0; i < queue.size(); i++) {
+            if(i == queue_idx || !is_enabled[i] || !queue[i]->has_output(name)) {
+                continue;
+            }
+
+            if(i < queue_idx) {
+                is_first_write = false;
+            } else {
+                is_last_write = false;
+            }
+        }
+
+        if(is_first_write) {
+            state.set_resource_is_first(attachment_idx);
+        } if(is_last_write) {
+            state.set_resource_is_last(attachment_idx);
+        }
+    };
+
+    uint32_t i = 0;
+    for(auto& output : task->color_outputs()) {
+        resolve_attachment(i++, output.name());
+    }
+
+    if(task->depth_output().has_value()) {
+        resolve_attachment(i, task->depth_output()->name());
+    }
+
+    return state;
+}
+
+}
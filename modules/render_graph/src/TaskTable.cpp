@@ -0,0 +1,82 @@
+#include "TaskTable.hpp"
+
+namespace lft::rg {
+
+TaskHandle TaskTable::allocate_handle(const std::string& name) {
+    auto found = m_handles.find(name);
+    if(found != m_handles.end()) {
+        return found->second;
+    }
+
+    TaskHandle handle;
+    if(!m_free_handles.empty()) {
+        handle = m_free_handles.back();
+        m_free_handles.pop_back();
+    } else {
+        handle = m_infos.size();
+
+        m_infos.emplace_back();
+        m_types.push_back(GRAPHICS_TASK);
+        m_extents.push_back({0, 0});
+        m_record_funcs.emplace_back();
+        m_contexts.push_back(nullptr);
+        m_clear_values.emplace_back();
+        m_attachments.emplace_back();
+        m_is_alive.push_back(false);
+    }
+
+    m_handles.insert({name, handle});
+    return handle;
+}
+
+TaskHandle TaskTable::put(const TaskInfo& task_info, ResourceTable& resources) {
+    TaskHandle handle = allocate_handle(task_info.name());
+
+    m_infos[handle] = task_info;
+    m_types[handle] = task_info.type();
+    m_extents[handle] = task_info.m_extent;
+    m_record_funcs[handle] = task_info.record_func();
+    m_contexts[handle] = task_info.m_pContext;
+    m_is_alive[handle] = true;
+
+    auto& clear_values = m_clear_values[handle];
+    auto& attachments = m_attachments[handle];
+    clear_values.clear();
+    attachments.clear();
+
+    for(auto& output : task_info.color_outputs()) {
+        clear_values.push_back(output.clear_value());
+        attachments.push_back(resources.get_or_create(output.name()));
+    }
+
+    if(task_info.depth_output().has_value()) {
+        clear_values.push_back(task_info.depth_output()->clear_value());
+        attachments.push_back(resources.get_or_create(task_info.depth_output()->name()));
+    }
+
+    return handle;
+}
+
+void TaskTable::remove(TaskHandle handle) {
+    if(!is_alive(handle)) {
+        return;
+    }
+
+    m_handles.erase(m_infos[handle].name());
+    m_infos[handle] = TaskInfo();
+    m_record_funcs[handle] = nullptr;
+    m_contexts[handle] = nullptr;
+    m_is_alive[handle] = false;
+    m_free_handles.push_back(handle);
+}
+
+std::optional<TaskHandle> TaskTable::find(const std::string& name) const {
+    auto found = m_handles.find(name);
+    if(found == m_handles.end()) {
+        return {};
+    }
+
+    return found->second;
+}
+
+}
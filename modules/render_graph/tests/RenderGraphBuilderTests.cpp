@@ -47,7 +47,7 @@ void test_render_graph_push() {
 
     ASSERT(rg.m_buffers[0]->num_batches() == 1);
     ASSERT(rg.m_buffers[0]->batch(0).tasks.size() == 1);
-    ASSERT(rg.m_buffers[0]->batch(0).tasks[0].pDefinition.equals(task1));
+    ASSERT(rg.task(rg.m_buffers[0]->batch(0).tasks[0]).equals(task1));
 
     auto task2 = lft::rg::render_task<Struct>(
             "task2", &data,
@@ -64,10 +64,10 @@ void test_render_graph_push() {
 
     ASSERT(rg.m_buffers[0]->num_batches() == 2);
     ASSERT(rg.m_buffers[0]->batch(0).tasks.size() == 1);
-    ASSERT(rg.m_buffers[0]->batch(0).tasks[0].pDefinition.equals(task1));
+    ASSERT(rg.task(rg.m_buffers[0]->batch(0).tasks[0]).equals(task1));
 
     ASSERT(rg.m_buffers[0]->batch(1).tasks.size() == 1);
-    ASSERT(rg.m_buffers[0]->batch(1).tasks[0].pDefinition.equals(task2));
+    ASSERT(rg.task(rg.m_buffers[0]->batch(1).tasks[0]).equals(task2));
 
     auto deps1 = rg.m_dependency_matrix->get_dependencies(1);
     ASSERT(deps1.size() == 1);
@@ -132,9 +132,9 @@ void test_render_graph_insert_begin() {
     lft::rg::RenderGraph rg = builder.build();
 
     ASSERT(rg.buffer(0).num_batches() == 3);
-    ASSERT(rg.buffer(0).batch(0).tasks[0].pDefinition.name() == "task1");
-    ASSERT(rg.buffer(0).batch(1).tasks[0].pDefinition.name() == "task2");
-    ASSERT(rg.buffer(0).batch(2).tasks[0].pDefinition.name() == "task3");
+    ASSERT(rg.task(rg.buffer(0).batch(0).tasks[0]).name() == "task1");
+    ASSERT(rg.task(rg.buffer(0).batch(1).tasks[0]).name() == "task2");
+    ASSERT(rg.task(rg.buffer(0).batch(2).tasks[0]).name() == "task3");
 }
 
 
@@ -185,9 +185,9 @@ void test_render_graph_insert_middle() {
     lft::rg::RenderGraph rg = builder.build();
 
     ASSERT(rg.buffer(0).num_batches() == 3);
-    ASSERT(rg.buffer(0).batch(0).tasks[0].pDefinition.name() == "task1");
-    ASSERT(rg.buffer(0).batch(1).tasks[0].pDefinition.name() == "task2");
-    ASSERT(rg.buffer(0).batch(2).tasks[0].pDefinition.name() == "task3");
+    ASSERT(rg.task(rg.buffer(0).batch(0).tasks[0]).name() == "task1");
+    ASSERT(rg.task(rg.buffer(0).batch(1).tasks[0]).name() == "task2");
+    ASSERT(rg.task(rg.buffer(0).batch(2).tasks[0]).name() == "task3");
 }
 
 void test_render_graph_extent() {
@@ -227,13 +227,13 @@ void test_render_graph_extent() {
 
     ASSERT(rg.buffer(0).num_batches() == 2);
     // equals tests the extent
-    ASSERT(!rg.buffer(0).batch(0).tasks[0].pDefinition.equals(task1));
-    ASSERT(!rg.buffer(0).batch(1).tasks[0].pDefinition.equals(task2));
+    ASSERT(!rg.task(rg.buffer(0).batch(0).tasks[0]).equals(task1));
+    ASSERT(!rg.task(rg.buffer(0).batch(1).tasks[0]).equals(task2));
 
-    ASSERT(rg.buffer(0).batch(0).tasks[0].extent.width == extent.width &&
-        rg.buffer(0).batch(0).tasks[0].extent.height == extent.height);
-    ASSERT(rg.buffer(0).batch(1).tasks[0].extent.width == extent.width &&
-        rg.buffer(0).batch(1).tasks[0].extent.height == extent.height);
+    ASSERT(rg.m_tasks->extent(rg.buffer(0).batch(0).tasks[0]).width == extent.width &&
+        rg.m_tasks->extent(rg.buffer(0).batch(0).tasks[0]).height == extent.height);
+    ASSERT(rg.m_tasks->extent(rg.buffer(0).batch(1).tasks[0]).width == extent.width &&
+        rg.m_tasks->extent(rg.buffer(0).batch(1).tasks[0]).height == extent.height);
 }
 
 void test_render_graph_update_renderpass() {
@@ -278,8 +278,8 @@ void test_render_graph_update_renderpass() {
 
     builder.add_task(task1);
 
-    VkRenderPass previous_rp = rg.buffer(0).batch(0).tasks[0].render_pass.render_pass;
-    auto previous_fb = rg.buffer(0).batch(0).tasks[0].framebuffer;
+    VkRenderPass previous_rp = rg.buffer(0).render_pass(rg.buffer(0).batch(0).tasks[0]).render_pass;
+    auto previous_fb = rg.buffer(0).framebuffers(rg.buffer(0).batch(0).tasks[0]);
     builder.build();
 
     ASSERT(rg.buffer(0).num_batches() == 2);
@@ -287,11 +287,11 @@ void test_render_graph_update_renderpass() {
     auto _task2 = rg.buffer(0).batch(1).tasks[0];
 
     // equals tests the extent
-    ASSERT(_task1.pDefinition.equals(task1));
-    ASSERT(_task2.pDefinition.equals(task2));
+    ASSERT(rg.task(_task1).equals(task1));
+    ASSERT(rg.task(_task2).equals(task2));
 
-    ASSERT(_task1.render_pass.render_pass != previous_rp);
-    ASSERT(_task1.framebuffer != previous_fb);
+    ASSERT(rg.buffer(0).render_pass(_task1).render_pass != previous_rp);
+    ASSERT(rg.buffer(0).framebuffers(_task1) != previous_fb);
 }
 
 void test_render_graph_remove() {
@@ -495,8 +495,8 @@ void test_compute() {
     auto rg = builder.build();
 
     ASSERT(is_build_func_called);
-    ASSERT(rg.buffer(0).batch(0).tasks[0].pDefinition.name() == "task1");
-    ASSERT(rg.buffer(0).batch(1).tasks[0].pDefinition.name() == "task2");
+    ASSERT(rg.task(rg.buffer(0).batch(0).tasks[0]).name() == "task1");
+    ASSERT(rg.task(rg.buffer(0).batch(1).tasks[0]).name() == "task2");
 }
 
 void test_render_graph2() {
@@ -561,25 +561,25 @@ void test_render_graph2() {
     auto rg = builder.build();
 
     auto wait1 = rg.get_wait_semaphores_for(&rg.buffer(0), 0);
-    ASSERT(rg.buffer(0).batch(0).tasks[0].pDefinition.name() == "task3");
+    ASSERT(rg.task(rg.buffer(0).batch(0).tasks[0]).name() == "task3");
     ASSERT(wait1.empty());
 
     auto wait2 = rg.get_wait_semaphores_for(&rg.buffer(0), 1);
-    ASSERT(rg.buffer(0).batch(1).tasks[0].pDefinition.name() == "task1");
+    ASSERT(rg.task(rg.buffer(0).batch(1).tasks[0]).name() == "task1");
     ASSERT(wait2.empty());
 
     auto wait3 = rg.get_wait_semaphores_for(&rg.buffer(0), 2);
-    ASSERT(rg.buffer(0).batch(2).tasks[0].pDefinition.name() == "task2");
+    ASSERT(rg.task(rg.buffer(0).batch(2).tasks[0]).name() == "task2");
     ASSERT(wait3.size() == 1);
     ASSERT(wait3[0].semaphore == rg.buffer(0).batch(1).signal);
 
     auto wait4 = rg.get_wait_semaphores_for(&rg.buffer(0), 3);
-    ASSERT(rg.buffer(0).batch(3).tasks[0].pDefinition.name() == "task5");
+    ASSERT(rg.task(rg.buffer(0).batch(3).tasks[0]).name() == "task5");
     ASSERT(wait4.size() == 1);
     ASSERT(wait4[0].semaphore == rg.buffer(0).batch(2).signal);
 
     auto wait5 = rg.get_wait_semaphores_for(&rg.buffer(0), 4);
-    ASSERT(rg.buffer(0).batch(4).tasks[0].pDefinition.name() == "task4");
+    ASSERT(rg.task(rg.buffer(0).batch(4).tasks[0]).name() == "task4");
     ASSERT(wait5.size() == 2);
     ASSERT(wait5[0].semaphore == rg.buffer(0).batch(2).signal ||
         wait5[0].semaphore == rg.buffer(0).batch(0).signal);
@@ -587,6 +587,255 @@ void test_render_graph2() {
         wait5[1].semaphore == rg.buffer(0).batch(2).signal);
 }
 
+void test_optional_task() {
+    VkExtent2D extent = {
+            .width = 1024,
+            .height = 1024
+    };
+
+    auto gpu = create_mock_gpu();
+
+    VkFormat fmt = VK_FORMAT_R8G8B8A8_UNORM;
+    ImageChain image_chain = create_mock_image_chain(gpu.get(), 1, extent, fmt);
+
+    lft::rg::Builder builder(gpu.get(), image_chain, "output");
+
+    Struct data = {};
+    auto task1 = lft::rg::render_task<Struct>(
+            "task1", &data,
+            [](const lft::rg::TaskBuildInfo& info, Struct* ctx) {},
+            [](const lft::rg::TaskRecordInfo& info, Struct* ctx) {})
+            .add_color_output("output", fmt, extent, {})
+            .build();
+
+    auto task2 = lft::rg::render_task<Struct>(
+            "task2", &data,
+            [](const lft::rg::TaskBuildInfo& info, Struct* ctx) {},
+            [](const lft::rg::TaskRecordInfo& info, Struct* ctx) {})
+            .add_color_output("output", fmt, extent, {})
+            .add_dependency("task1")
+            .set_optional()
+            .build();
+
+    builder.add_task(task1);
+    builder.add_task(task2);
+    auto rg = builder.build();
+
+    auto& buffer = rg.buffer(0);
+    auto _task1 = buffer.batch(0).tasks[0];
+    ASSERT(rg.task(_task1).name() == "task1");
+    // both variants have a capture counterpart
+    ASSERT(buffer.render_pass_variants(_task1).size() == 4);
+    ASSERT(!buffer.render_pass(_task1).state.is_resource_last(0));
+
+    rg.set_enabled("task2", false);
+    rg.update_active_tasks();
+
+    ASSERT(!rg.is_batch_active(&rg.buffer(0), 1));
+    ASSERT(buffer.render_pass_variants(_task1)[buffer.active_variant(_task1)].state.is_resource_last(0));
+    ASSERT(buffer.active_render_pass(_task1) != buffer.render_pass(_task1).render_pass);
+
+    rg.set_enabled("task2", true);
+    rg.update_active_tasks();
+
+    ASSERT(rg.is_batch_active(&rg.buffer(0), 1));
+    ASSERT(buffer.active_render_pass(_task1) == buffer.render_pass(_task1).render_pass);
+
+    rg.request_capture();
+    rg.update_active_tasks();
+
+    ASSERT(buffer.render_pass_variants(_task1)[buffer.active_variant(_task1)].state.is_capture);
+
+    // capture lasts a single frame
+    rg.update_active_tasks();
+    ASSERT(buffer.active_render_pass(_task1) == buffer.render_pass(_task1).render_pass);
+}
+
+struct CountingContext {
+    uint32_t num_builds = 0;
+
+    void build(const lft::rg::TaskBuildInfo& info) {
+        num_builds++;
+    }
+
+    void record(const lft::rg::TaskRecordInfo& info) {
+    }
+};
+
+void test_context_task() {
+    VkExtent2D extent = {
+            .width = 1024,
+            .height = 1024
+    };
+
+    auto gpu = create_mock_gpu();
+
+    VkFormat fmt = VK_FORMAT_R8G8B8A8_UNORM;
+    ImageChain image_chain = create_mock_image_chain(gpu.get(), 1, extent, fmt);
+
+    lft::rg::Builder builder(gpu.get(), image_chain, "output");
+
+    CountingContext context = {};
+    auto task1 = lft::rg::render_task("task1", &context)
+            .add_color_output("output", fmt, extent, {})
+            .build();
+
+    builder.add_task(task1);
+    auto rg = builder.build();
+
+    auto handle = rg.buffer(0).batch(0).tasks[0];
+    ASSERT(rg.m_tasks->m_contexts[handle] == &context);
+    ASSERT(rg.m_tasks->m_record_funcs[handle] == lft::rg::record_context_task<CountingContext>);
+    ASSERT(context.num_builds == rg.m_buffers.size());
+}
+
+void test_transient_buffers() {
+    VkExtent2D extent = {
+            .width = 1024,
+            .height = 1024
+    };
+
+    auto gpu = create_mock_gpu();
+
+    VkFormat fmt = VK_FORMAT_R8G8B8A8_UNORM;
+    ImageChain image_chain = create_mock_image_chain(gpu.get(), 1, extent, fmt);
+
+    lft::rg::Builder builder(gpu.get(), image_chain, "output");
+
+    Struct data = {};
+    auto empty_build = [](const lft::rg::TaskBuildInfo& info, Struct* ctx) {};
+    auto empty_record = [](const lft::rg::TaskRecordInfo& info, Struct* ctx) {};
+
+    builder.add_task(lft::rg::compute_task<Struct>("task1", &data, empty_build, empty_record)
+            .add_buffer_output("buffer1", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_TRANSIENT)
+            .build());
+    builder.add_task(lft::rg::compute_task<Struct>("task2", &data, empty_build, empty_record)
+            .add_dependency("buffer1")
+            .add_buffer_output("buffer2", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_TRANSIENT)
+            .build());
+    builder.add_task(lft::rg::compute_task<Struct>("task3", &data, empty_build, empty_record)
+            .add_dependency("buffer2")
+            .add_buffer_output("buffer3", 512, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_TRANSIENT)
+            .build());
+    builder.add_task(lft::rg::render_task<Struct>("task4", &data, empty_build, empty_record)
+            .add_dependency("buffer3")
+            .add_color_output("output", fmt, extent, {})
+            .build());
+
+    auto rg = builder.build();
+
+    auto& buffer = rg.buffer(0);
+    auto buffer1 = buffer.get_buffer_resource(rg.m_resources->find("buffer1").value()).value();
+    auto buffer2 = buffer.get_buffer_resource(rg.m_resources->find("buffer2").value()).value();
+    auto buffer3 = buffer.get_buffer_resource(rg.m_resources->find("buffer3").value()).value();
+
+    // buffer1 is not used anymore when buffer3 is written
+    ASSERT(buffer1->buffer == buffer3->buffer);
+    ASSERT(buffer1->buffer != buffer2->buffer);
+    ASSERT(buffer3->size == 512);
+}
+
+void test_transient_buffers_independent() {
+    VkExtent2D extent = {
+            .width = 1024,
+            .height = 1024
+    };
+
+    auto gpu = create_mock_gpu();
+
+    VkFormat fmt = VK_FORMAT_R8G8B8A8_UNORM;
+    ImageChain image_chain = create_mock_image_chain(gpu.get(), 1, extent, fmt);
+
+    lft::rg::Builder builder(gpu.get(), image_chain, "output");
+
+    Struct data = {};
+    auto empty_build = [](const lft::rg::TaskBuildInfo& info, Struct* ctx) {};
+    auto empty_record = [](const lft::rg::TaskRecordInfo& info, Struct* ctx) {};
+
+    // two chains without any dependency between them
+    builder.add_task(lft::rg::compute_task<Struct>("task1", &data, empty_build, empty_record)
+            .add_buffer_output("buffer1", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_TRANSIENT)
+            .build());
+    builder.add_task(lft::rg::compute_task<Struct>("task2", &data, empty_build, empty_record)
+            .add_dependency("buffer1")
+            .add_buffer_output("result1", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_PERSISTENT)
+            .build());
+    builder.add_task(lft::rg::compute_task<Struct>("task3", &data, empty_build, empty_record)
+            .add_buffer_output("buffer2", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_TRANSIENT)
+            .build());
+    builder.add_task(lft::rg::compute_task<Struct>("task4", &data, empty_build, empty_record)
+            .add_dependency("buffer2")
+            .add_buffer_output("result2", 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lft::rg::BUFFER_LIFETIME_PERSISTENT)
+            .build());
+    builder.add_task(lft::rg::render_task<Struct>("task5", &data, empty_build, empty_record)
+            .add_dependency("result1")
+            .add_dependency("result2")
+            .add_color_output("output", fmt, extent, {})
+            .build());
+
+    auto rg = builder.build();
+
+    auto& buffer = rg.buffer(0);
+    auto buffer1 = buffer.get_buffer_resource(rg.m_resources->find("buffer1").value()).value();
+    auto buffer2 = buffer.get_buffer_resource(rg.m_resources->find("buffer2").value()).value();
+
+    // the chains may run at the same time on the GPU, whatever their order in the queue is
+    ASSERT(buffer1->buffer != buffer2->buffer);
+}
+
+void test_optional_writers_of_sampled_image() {
+    VkExtent2D extent = {
+            .width = 1024,
+            .height = 1024
+    };
+
+    auto gpu = create_mock_gpu();
+
+    VkFormat fmt = VK_FORMAT_R8G8B8A8_UNORM;
+    ImageChain image_chain = create_mock_image_chain(gpu.get(), 1, extent, fmt);
+
+    lft::rg::Builder builder(gpu.get(), image_chain, "output");
+
+    Struct data = {};
+    auto empty_build = [](const lft::rg::TaskBuildInfo& info, Struct* ctx) {};
+    auto empty_record = [](const lft::rg::TaskRecordInfo& info, Struct* ctx) {};
+
+    builder.add_task(lft::rg::render_task<Struct>("task1", &data, empty_build, empty_record)
+            .add_color_output("gbuf", fmt, extent, {})
+            .set_optional()
+            .build());
+    builder.add_task(lft::rg::render_task<Struct>("task2", &data, empty_build, empty_record)
+            .add_color_output("gbuf", fmt, extent, {})
+            .add_dependency("task1")
+            .set_optional()
+            .build());
+    builder.add_task(lft::rg::render_task<Struct>("task3", &data, empty_build, empty_record)
+            .add_dependency("gbuf")
+            .add_color_output("output", fmt, extent, {})
+            .build());
+
+    // disabling both writers would leave the sampled image undefined
+    bool is_rejected = false;
+    try {
+        builder.build();
+    } catch(const std::runtime_error& error) {
+        is_rejected = true;
+    }
+    ASSERT(is_rejected);
+
+    builder.add_task(lft::rg::render_task<Struct>("task2", &data, empty_build, empty_record)
+            .add_color_output("gbuf", fmt, extent, {})
+            .add_dependency("task1")
+            .build());
+
+    auto rg = builder.build();
+    rg.set_enabled("task1", false);
+    rg.update_active_tasks();
+
+    ASSERT(!rg.is_batch_active(&rg.buffer(0), 0));
+    ASSERT(rg.is_batch_active(&rg.buffer(0), 1));
+}
+
 int main() {
     /* test_render_graph_extent();
 	test_render_graph_push();
@@ -597,4 +846,9 @@ int main() {
 	test_buffer_idxs();
 	test_compute(); */
 	test_render_graph2();
+	test_optional_task();
+	test_context_task();
+	test_transient_buffers();
+	test_transient_buffers_independent();
+	test_optional_writers_of_sampled_image();
 }
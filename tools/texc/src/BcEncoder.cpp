@@ -0,0 +1,546 @@
+#include "BcEncoder.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LFT_TEXC_SSE2 1
+#endif
+
+namespace lft::texc {
+
+static constexpr uint32_t NUM_TEXELS = 16;
+
+// BC7 interpolation weights of 4 bit indices, out of 64
+static constexpr int32_t BC7_WEIGHTS[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+/**
+ * Texels of a block split by channels, so they can be processed four at once.
+ */
+struct Block {
+    alignas(16) float channels[4][NUM_TEXELS];
+};
+
+static Block load_block(const uint8_t* pTexels) {
+    Block block;
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        for(uint32_t c = 0; c < 4; c++) {
+            block.channels[c][i] = pTexels[i * 4 + c];
+        }
+    }
+    return block;
+}
+
+/**
+ * Projects texels of the first `numChannels` channels onto an axis going through `origin`.
+ */
+static void project(const Block& block, uint32_t numChannels, const float origin[4], const float axis[4],
+                    float out[NUM_TEXELS]) {
+#if LFT_TEXC_SSE2
+    for(uint32_t i = 0; i < NUM_TEXELS; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for(uint32_t c = 0; c < numChannels; c++) {
+            __m128 value = _mm_sub_ps(_mm_load_ps(&block.channels[c][i]), _mm_set1_ps(origin[c]));
+            sum = _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(axis[c])));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#else
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        float sum = 0.0f;
+        for(uint32_t c = 0; c < numChannels; c++) {
+            sum += (block.channels[c][i] - origin[c]) * axis[c];
+        }
+        out[i] = sum;
+    }
+#endif
+}
+
+/**
+ * Fits a line through the texels by the principal axis of their covariance.
+ * @param pStart outputs the texel value at the lowest projection
+ * @param pEnd outputs the texel value at the highest projection
+ */
+static void fit_line(const Block& block, uint32_t numChannels, float* pStart, float* pEnd) {
+    float mean[4] = {};
+    float min[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+    float max[4] = {};
+    for(uint32_t c = 0; c < numChannels; c++) {
+        for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+            mean[c] += block.channels[c][i];
+            min[c] = std::min(min[c], block.channels[c][i]);
+            max[c] = std::max(max[c], block.channels[c][i]);
+        }
+        mean[c] /= NUM_TEXELS;
+    }
+
+    float covariance[4][4] = {};
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        for(uint32_t x = 0; x < numChannels; x++) {
+            for(uint32_t y = x; y < numChannels; y++) {
+                covariance[x][y] += (block.channels[x][i] - mean[x]) * (block.channels[y][i] - mean[y]);
+            }
+        }
+    }
+
+    // power iteration, starting at the diagonal of the bounding box
+    float axis[4] = {};
+    for(uint32_t c = 0; c < numChannels; c++) {
+        axis[c] = max[c] - min[c];
+    }
+
+    for(uint32_t iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for(uint32_t x = 0; x < numChannels; x++) {
+            for(uint32_t y = 0; y < numChannels; y++) {
+                next[x] += covariance[std::min(x, y)][std::max(x, y)] * axis[y];
+            }
+            length = std::max(length, std::abs(next[x]));
+        }
+
+        // uniform block
+        if(length < 1e-6f) {
+            break;
+        }
+
+        for(uint32_t c = 0; c < numChannels; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float lengthSq = 0.0f;
+    for(uint32_t c = 0; c < numChannels; c++) {
+        lengthSq += axis[c] * axis[c];
+    }
+
+    if(lengthSq < 1e-12f) {
+        std::copy(mean, mean + numChannels, pStart);
+        std::copy(mean, mean + numChannels, pEnd);
+        return;
+    }
+
+    for(uint32_t c = 0; c < numChannels; c++) {
+        axis[c] /= std::sqrt(lengthSq);
+    }
+
+    float projections[NUM_TEXELS];
+    project(block, numChannels, mean, axis, projections);
+    float low = *std::min_element(projections, projections + NUM_TEXELS);
+    float high = *std::max_element(projections, projections + NUM_TEXELS);
+
+    for(uint32_t c = 0; c < numChannels; c++) {
+        pStart[c] = std::clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+        pEnd[c] = std::clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+    }
+}
+
+/**
+ * Positions of the texels along the segment from `start` to `end`, 0 at the start, 1 at the end.
+ */
+static void interpolants(const Block& block, uint32_t numChannels, const float* start, const float* end,
+                         float out[NUM_TEXELS]) {
+    float axis[4] = {};
+    float lengthSq = 0.0f;
+    for(uint32_t c = 0; c < numChannels; c++) {
+        axis[c] = end[c] - start[c];
+        lengthSq += axis[c] * axis[c];
+    }
+
+    if(lengthSq == 0.0f) {
+        std::fill(out, out + NUM_TEXELS, 0.0f);
+        return;
+    }
+
+    for(uint32_t c = 0; c < numChannels; c++) {
+        axis[c] /= lengthSq;
+    }
+
+    project(block, numChannels, start, axis, out);
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        out[i] = std::clamp(out[i], 0.0f, 1.0f);
+    }
+}
+
+/**
+ * Endpoints minimizing the squared error for the given interpolants.
+ * @return false when the system is singular and the endpoints were kept
+ */
+static bool refine_endpoints(const Block& block, uint32_t numChannels, const float weights[NUM_TEXELS],
+                             float* pStart, float* pEnd) {
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float x[4] = {}, y[4] = {};
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        float w = weights[i];
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        c += w * w;
+        for(uint32_t ch = 0; ch < numChannels; ch++) {
+            x[ch] += (1.0f - w) * block.channels[ch][i];
+            y[ch] += w * block.channels[ch][i];
+        }
+    }
+
+    float det = a * c - b * b;
+    if(std::abs(det) < 1e-6f) {
+        return false;
+    }
+
+    for(uint32_t ch = 0; ch < numChannels; ch++) {
+        pStart[ch] = std::clamp((c * x[ch] - b * y[ch]) / det, 0.0f, 255.0f);
+        pEnd[ch] = std::clamp((a * y[ch] - b * x[ch]) / det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+/**
+ * Writes bits of a block from the least significant one.
+ */
+class BitWriter {
+private:
+    uint8_t* m_pOut;
+    uint32_t m_pos;
+
+public:
+    explicit BitWriter(uint8_t* pOut, uint32_t size) : m_pOut(pOut), m_pos(0) {
+        memset(pOut, 0, size);
+    }
+
+    void write(uint64_t value, uint32_t numBits) {
+        for(uint32_t i = 0; i < numBits; i++, m_pos++) {
+            m_pOut[m_pos / 8] |= ((value >> i) & 1) << (m_pos % 8);
+        }
+    }
+};
+
+/**
+ * Single channel block of BC3 alpha and BC5.
+ */
+static void encode_bc4(const uint8_t* pTexels, uint32_t channel, uint8_t* pOut) {
+    uint8_t values[NUM_TEXELS];
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        values[i] = pTexels[i * 4 + channel];
+    }
+
+    uint8_t min = 255, max = 0;
+#if LFT_TEXC_SSE2
+    __m128i v = _mm_loadu_si128((const __m128i*)values);
+    // halves folded onto each other, the first byte ends up with the result
+    __m128i vMin = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+    __m128i vMax = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 4));
+    vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 4));
+    vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 2));
+    vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 2));
+    vMin = _mm_min_epu8(vMin, _mm_srli_si128(vMin, 1));
+    vMax = _mm_max_epu8(vMax, _mm_srli_si128(vMax, 1));
+    min = (uint8_t)_mm_cvtsi128_si32(vMin);
+    max = (uint8_t)_mm_cvtsi128_si32(vMax);
+#else
+    for(uint8_t value : values) {
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+#endif
+
+    BitWriter writer(pOut, 8);
+    // 8 values mode, the first endpoint is the larger one
+    writer.write(max, 8);
+    writer.write(min, 8);
+
+    if(min == max) {
+        writer.write(0, 48);
+        return;
+    }
+
+    uint32_t range = max - min;
+    for(uint8_t value : values) {
+        // steps from the first endpoint, rounded
+        uint32_t step = ((max - value) * 14 + range) / (2 * range);
+        uint32_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+        writer.write(index, 3);
+    }
+}
+
+static uint16_t to_565(const float* color) {
+    uint32_t r = (uint32_t)std::lround(color[0] * 31.0f / 255.0f);
+    uint32_t g = (uint32_t)std::lround(color[1] * 63.0f / 255.0f);
+    uint32_t b = (uint32_t)std::lround(color[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void from_565(uint16_t packed, float* color) {
+    uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+}
+
+/**
+ * Squared error of a BC1 block quantized to the endpoints, writes the indices.
+ */
+static float bc1_indices(const Block& block, uint16_t color0, uint16_t color1, uint32_t* pIndices) {
+    float start[3], end[3];
+    from_565(color0, start);
+    from_565(color1, end);
+
+    float positions[NUM_TEXELS];
+    interpolants(block, 3, start, end, positions);
+
+    // order of the palette, the interpolated entries follow the endpoints
+    static constexpr uint32_t ORDER[4] = { 0, 2, 3, 1 };
+
+    float error = 0.0f;
+    uint32_t indices = 0;
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        uint32_t step = color0 == color1 ? 0 : (uint32_t)std::lround(positions[i] * 3.0f);
+        indices |= ORDER[step] << (i * 2);
+
+        float w = step / 3.0f;
+        for(uint32_t c = 0; c < 3; c++) {
+            float value = start[c] + (end[c] - start[c]) * w;
+            float diff = value - block.channels[c][i];
+            error += diff * diff;
+        }
+    }
+
+    *pIndices = indices;
+    return error;
+}
+
+/**
+ * Color block of BC1 and BC3, always in the four colors mode.
+ */
+static void encode_bc1(const uint8_t* pTexels, uint8_t* pOut) {
+    Block block = load_block(pTexels);
+
+    float start[3], end[3];
+    fit_line(block, 3, start, end);
+
+    uint16_t bestColors[2] = {};
+    uint32_t bestIndices = 0;
+    float bestError = INFINITY;
+
+    for(uint32_t iteration = 0; iteration < 2; iteration++) {
+        uint16_t color0 = to_565(end);
+        uint16_t color1 = to_565(start);
+        // four colors mode needs the first endpoint to be larger
+        if(color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        uint32_t indices;
+        float error = bc1_indices(block, color0, color1, &indices);
+        if(error < bestError) {
+            bestError = error;
+            bestColors[0] = color0;
+            bestColors[1] = color1;
+            bestIndices = indices;
+        }
+
+        float quantized0[3], quantized1[3], positions[NUM_TEXELS];
+        from_565(color0, quantized0);
+        from_565(color1, quantized1);
+        interpolants(block, 3, quantized1, quantized0, positions);
+        for(float& position : positions) {
+            position = std::round(position * 3.0f) / 3.0f;
+        }
+
+        if(!refine_endpoints(block, 3, positions, start, end)) {
+            break;
+        }
+    }
+
+    memcpy(pOut, bestColors, 4);
+    memcpy(pOut + 4, &bestIndices, 4);
+}
+
+struct Bc7Endpoint {
+    uint8_t values[4];
+    uint32_t pbit;
+};
+
+/**
+ * Quantizes an endpoint to 7 bits per channel with a shared low bit.
+ */
+static Bc7Endpoint quantize_bc7(const float* endpoint) {
+    Bc7Endpoint best = {};
+    float bestError = INFINITY;
+    for(uint32_t pbit = 0; pbit < 2; pbit++) {
+        Bc7Endpoint candidate = { .pbit = pbit };
+        float error = 0.0f;
+        for(uint32_t c = 0; c < 4; c++) {
+            int32_t high = std::clamp((int32_t)std::lround((endpoint[c] - pbit) / 2.0f), 0, 127);
+            candidate.values[c] = (uint8_t)high;
+            float diff = (float)((high << 1) | pbit) - endpoint[c];
+            error += diff * diff;
+        }
+
+        if(error < bestError) {
+            bestError = error;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+/**
+ * Squared error of a BC7 block with the endpoints, writes the indices.
+ */
+static float bc7_indices(const Block& block, const Bc7Endpoint& e0, const Bc7Endpoint& e1, uint8_t* pIndices) {
+    float start[4], end[4];
+    for(uint32_t c = 0; c < 4; c++) {
+        start[c] = (float)((e0.values[c] << 1) | e0.pbit);
+        end[c] = (float)((e1.values[c] << 1) | e1.pbit);
+    }
+
+    float positions[NUM_TEXELS];
+    interpolants(block, 4, start, end, positions);
+
+    float error = 0.0f;
+    for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+        // nearest weight around the rounded position
+        int32_t guess = std::clamp((int32_t)std::lround(positions[i] * 15.0f), 0, 15);
+        float bestError = INFINITY;
+        for(int32_t idx = std::max(guess - 1, 0); idx <= std::min(guess + 1, 15); idx++) {
+            int32_t w = BC7_WEIGHTS[idx];
+            float texelError = 0.0f;
+            for(uint32_t c = 0; c < 4; c++) {
+                int32_t value = (((64 - w) * (int32_t)start[c] + w * (int32_t)end[c] + 32) >> 6);
+                float diff = value - block.channels[c][i];
+                texelError += diff * diff;
+            }
+
+            if(texelError < bestError) {
+                bestError = texelError;
+                pIndices[i] = idx;
+            }
+        }
+        error += bestError;
+    }
+
+    return error;
+}
+
+/**
+ * BC7 mode 6, a single subset with 7 bit RGBA endpoints and 4 bit indices.
+ */
+static void encode_bc7(const uint8_t* pTexels, uint8_t* pOut) {
+    Block block = load_block(pTexels);
+
+    float start[4], end[4];
+    fit_line(block, 4, start, end);
+
+    Bc7Endpoint bestEndpoints[2] = {};
+    uint8_t bestIndices[NUM_TEXELS] = {};
+    float bestError = INFINITY;
+
+    for(uint32_t iteration = 0; iteration < 2; iteration++) {
+        Bc7Endpoint e0 = quantize_bc7(start);
+        Bc7Endpoint e1 = quantize_bc7(end);
+
+        uint8_t indices[NUM_TEXELS];
+        float error = bc7_indices(block, e0, e1, indices);
+        if(error < bestError) {
+            bestError = error;
+            bestEndpoints[0] = e0;
+            bestEndpoints[1] = e1;
+            std::copy(indices, indices + NUM_TEXELS, bestIndices);
+        }
+
+        float weights[NUM_TEXELS];
+        for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+            weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+        }
+
+        if(!refine_endpoints(block, 4, weights, start, end)) {
+            break;
+        }
+    }
+
+    // most significant bit of the first index is implicitly zero
+    if(bestIndices[0] & 8) {
+        std::swap(bestEndpoints[0], bestEndpoints[1]);
+        for(uint8_t& index : bestIndices) {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter writer(pOut, 16);
+    writer.write(1 << 6, 7);
+    for(uint32_t c = 0; c < 4; c++) {
+        writer.write(bestEndpoints[0].values[c], 7);
+        writer.write(bestEndpoints[1].values[c], 7);
+    }
+    writer.write(bestEndpoints[0].pbit, 1);
+    writer.write(bestEndpoints[1].pbit, 1);
+
+    writer.write(bestIndices[0], 3);
+    for(uint32_t i = 1; i < NUM_TEXELS; i++) {
+        writer.write(bestIndices[i], 4);
+    }
+}
+
+uint32_t block_size(BcFormat format) {
+    return format == BcFormat::BC1 ? 8 : 16;
+}
+
+void encode_block(BcFormat format, const uint8_t* pTexels, uint8_t* pOut) {
+    switch(format) {
+        case BcFormat::BC1:
+            encode_bc1(pTexels, pOut);
+            break;
+        case BcFormat::BC3:
+            encode_bc4(pTexels, 3, pOut);
+            encode_bc1(pTexels, pOut + 8);
+            break;
+        case BcFormat::BC5:
+            encode_bc4(pTexels, 0, pOut);
+            encode_bc4(pTexels, 1, pOut + 8);
+            break;
+        case BcFormat::BC7:
+            encode_bc7(pTexels, pOut);
+            break;
+    }
+}
+
+std::vector<uint8_t> encode_image(BcFormat format, const uint8_t* pTexels,
+                                  uint32_t width, uint32_t height, uint32_t numThreads) {
+    uint32_t numBlocksX = (width + 3) / 4;
+    uint32_t numBlocksY = (height + 3) / 4;
+    uint32_t blockSize = block_size(format);
+
+    std::vector<uint8_t> blocks((size_t)numBlocksX * numBlocksY * blockSize);
+    std::atomic<uint32_t> nextRow = 0;
+
+    auto encode_rows = [&]() {
+        uint8_t texels[NUM_TEXELS * 4];
+        for(uint32_t by = nextRow++; by < numBlocksY; by = nextRow++) {
+            for(uint32_t bx = 0; bx < numBlocksX; bx++) {
+                for(uint32_t i = 0; i < NUM_TEXELS; i++) {
+                    uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+                    uint32_t y = std::min(by * 4 + i / 4, height - 1);
+                    memcpy(texels + i * 4, pTexels + ((size_t)y * width + x) * 4, 4);
+                }
+
+                encode_block(format, texels, blocks.data() + ((size_t)by * numBlocksX + bx) * blockSize);
+            }
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    for(uint32_t i = 1; i < std::min(numThreads, numBlocksY); i++) {
+        workers.emplace_back(encode_rows);
+    }
+    encode_rows();
+
+    return blocks;
+}
+
+}
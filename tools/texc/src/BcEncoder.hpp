@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace lft::texc {
+
+enum class BcFormat {
+    // opaque color
+    BC1,
+    // color with smooth alpha
+    BC3,
+    // two independent channels, used for normal maps
+    BC5,
+    // high quality color with alpha
+    BC7,
+};
+
+/**
+ * Size in bytes of an encoded 4x4 block.
+ */
+uint32_t block_size(BcFormat format);
+
+/**
+ * Encodes a block of 4x4 RGBA8 texels stored row by row.
+ */
+void encode_block(BcFormat format, const uint8_t* pTexels, uint8_t* pOut);
+
+/**
+ * Encodes an RGBA8 image. Blocks over the edge repeat the last row and
+ * column. Rows of blocks are split between the threads.
+ */
+std::vector<uint8_t> encode_image(BcFormat format, const uint8_t* pTexels,
+                                  uint32_t width, uint32_t height, uint32_t numThreads);
+
+}
@@ -0,0 +1,93 @@
+#include "Image.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace lft::texc {
+
+static float srgb_to_linear(float value) {
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float value) {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static const std::array<float, 256>& srgb_table() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values;
+        for(uint32_t i = 0; i < 256; i++) {
+            values[i] = srgb_to_linear(i / 255.0f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+static uint8_t to_unorm(float value) {
+    return (uint8_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+Image downsample(const Image& image, TextureKind kind) {
+    const auto& srgb = srgb_table();
+
+    Image result = {
+        .width = std::max(image.width / 2, 1u),
+        .height = std::max(image.height / 2, 1u),
+    };
+    result.texels.resize((size_t)result.width * result.height * 4);
+
+    for(uint32_t y = 0; y < result.height; y++) {
+        for(uint32_t x = 0; x < result.width; x++) {
+            float sum[4] = {};
+
+            // odd sizes drop the last row or column
+            for(uint32_t i = 0; i < 4; i++) {
+                uint32_t sx = std::min(x * 2 + i % 2, image.width - 1);
+                uint32_t sy = std::min(y * 2 + i / 2, image.height - 1);
+                const uint8_t* texel = image.texels.data() + ((size_t)sy * image.width + sx) * 4;
+
+                for(uint32_t c = 0; c < 4; c++) {
+                    bool isSrgb = kind == TextureKind::COLOR && c < 3;
+                    float value = isSrgb ? srgb[texel[c]] : texel[c] / 255.0f;
+                    sum[c] += value / 4.0f;
+                }
+            }
+
+            if(kind == TextureKind::NORMAL) {
+                float normal[3], length = 0.0f;
+                for(uint32_t c = 0; c < 3; c++) {
+                    normal[c] = sum[c] * 2.0f - 1.0f;
+                    length += normal[c] * normal[c];
+                }
+
+                length = std::sqrt(length);
+                for(uint32_t c = 0; c < 3 && length > 0.0f; c++) {
+                    sum[c] = normal[c] / length * 0.5f + 0.5f;
+                }
+            }
+
+            uint8_t* out = result.texels.data() + ((size_t)y * result.width + x) * 4;
+            for(uint32_t c = 0; c < 4; c++) {
+                bool isSrgb = kind == TextureKind::COLOR && c < 3;
+                out[c] = to_unorm(isSrgb ? linear_to_srgb(sum[c]) : sum[c]);
+            }
+        }
+    }
+
+    return result;
+}
+
+std::vector<Image> create_mip_chain(Image image, TextureKind kind) {
+    std::vector<Image> levels;
+    levels.push_back(std::move(image));
+
+    while(levels.back().width > 1 || levels.back().height > 1) {
+        levels.push_back(downsample(levels.back(), kind));
+    }
+
+    return levels;
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace lft::texc {
+
+enum class TextureKind {
+    // sRGB encoded color with linear alpha
+    COLOR,
+    // linear data, like metallic and roughness
+    LINEAR,
+    // tangent space normals, only X and Y are kept
+    NORMAL,
+};
+
+/**
+ * RGBA8 image.
+ */
+struct Image {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> texels;
+};
+
+/**
+ * Halves the image with a box filter. Colors are averaged in linear space,
+ * normals are renormalized.
+ */
+Image downsample(const Image& image, TextureKind kind);
+
+/**
+ * Full chain of mip levels, the image itself first.
+ */
+std::vector<Image> create_mip_chain(Image image, TextureKind kind);
+
+}
@@ -0,0 +1,236 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#define CGLTF_IMPLEMENTATION
+#include <cgltf.h>
+
+#include "BcEncoder.hpp"
+#include "Image.hpp"
+#include "Ktx2.hpp"
+
+#include <filesystem>
+#include <format>
+#include <map>
+#include <print>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace lft::texc;
+
+struct Options {
+    uint32_t numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    BcFormat colorFormat = BcFormat::BC7;
+    // kind of the textures passed directly
+    TextureKind kind = TextureKind::COLOR;
+    std::vector<std::filesystem::path> inputs;
+};
+
+static void print_usage() {
+    std::println("usage: loft-texc [options] <scene.gltf|image>...");
+    std::println("  -j <threads>          number of encoding threads");
+    std::println("  --color bc1|bc3|bc7   format of color textures, bc7 by default");
+    std::println("  --linear              images are linear data instead of sRGB color");
+    std::println("  --normal              images are tangent space normal maps");
+    std::println("Textures of glTF scenes are compressed by their use. Each texture is");
+    std::println("written next to the source image with the .ktx2 extension, occlusion");
+    std::println("is packed into the metallic roughness texture as <image>+<occlusion>.ktx2.");
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options options = {};
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if(arg == "-j" && i + 1 < argc) {
+            options.numThreads = std::max(std::stoi(argv[++i]), 1);
+        } else if(arg == "--color" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if(format == "bc1") {
+                options.colorFormat = BcFormat::BC1;
+            } else if(format == "bc3") {
+                options.colorFormat = BcFormat::BC3;
+            } else if(format == "bc7") {
+                options.colorFormat = BcFormat::BC7;
+            } else {
+                throw std::runtime_error(std::format("Unknown color format {}", format));
+            }
+        } else if(arg == "--linear") {
+            options.kind = TextureKind::LINEAR;
+        } else if(arg == "--normal") {
+            options.kind = TextureKind::NORMAL;
+        } else if(arg.starts_with("-")) {
+            throw std::runtime_error(std::format("Unknown option {}", arg));
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    return options;
+}
+
+static uint32_t ktx2_format(BcFormat format, TextureKind kind) {
+    bool isSrgb = kind == TextureKind::COLOR;
+    switch(format) {
+        case BcFormat::BC1:
+            return isSrgb ? lft::ktx2::FORMAT_BC1_RGB_SRGB : lft::ktx2::FORMAT_BC1_RGB_UNORM;
+        case BcFormat::BC3:
+            return isSrgb ? lft::ktx2::FORMAT_BC3_SRGB : lft::ktx2::FORMAT_BC3_UNORM;
+        case BcFormat::BC5:
+            return lft::ktx2::FORMAT_BC5_UNORM;
+        case BcFormat::BC7:
+            return isSrgb ? lft::ktx2::FORMAT_BC7_SRGB : lft::ktx2::FORMAT_BC7_UNORM;
+    }
+
+    throw std::runtime_error("Unknown format");
+}
+
+static Image load_image(const std::filesystem::path& path) {
+    int width, height, channels;
+    uint8_t* pTexels = stbi_load(path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if(pTexels == nullptr) {
+        throw std::runtime_error(std::format("Failed to load {}: {}", path.string(), stbi_failure_reason()));
+    }
+
+    Image image = {
+        .width = (uint32_t)width,
+        .height = (uint32_t)height,
+        .texels = std::vector<uint8_t>(pTexels, pTexels + (size_t)width * height * 4),
+    };
+    stbi_image_free(pTexels);
+    return image;
+}
+
+/**
+ * Copies the red channel of the occlusion into the red channel of the image,
+ * sampling the nearest texel when the sizes differ.
+ */
+static void pack_occlusion(Image& image, const Image& occlusion) {
+    for(uint32_t y = 0; y < image.height; y++) {
+        uint32_t occlusionY = (uint64_t)y * occlusion.height / image.height;
+        for(uint32_t x = 0; x < image.width; x++) {
+            uint32_t occlusionX = (uint64_t)x * occlusion.width / image.width;
+            image.texels[((size_t)y * image.width + x) * 4] =
+                    occlusion.texels[((size_t)occlusionY * occlusion.width + occlusionX) * 4];
+        }
+    }
+}
+
+/**
+ * @param occlusionPath packed into the red channel, empty when there is none
+ */
+static void compress(const std::filesystem::path& path, const std::filesystem::path& occlusionPath,
+                     TextureKind kind, const Options& options) {
+    Image image = load_image(path);
+    if(!occlusionPath.empty()) {
+        pack_occlusion(image, load_image(occlusionPath));
+    }
+
+    BcFormat format = kind == TextureKind::NORMAL ? BcFormat::BC5 :
+                      kind == TextureKind::COLOR ? options.colorFormat : BcFormat::BC7;
+
+    lft::ktx2::Texture texture = {
+        .format = ktx2_format(format, kind),
+        .width = image.width,
+        .height = image.height,
+    };
+
+    for(const Image& level : create_mip_chain(std::move(image), kind)) {
+        auto blocks = encode_image(format, level.texels.data(), level.width, level.height, options.numThreads);
+        texture.levels.push_back(lft::ktx2::Level {
+            .offset = texture.data.size(),
+            .size = blocks.size(),
+        });
+        texture.data.insert(texture.data.end(), blocks.begin(), blocks.end());
+    }
+
+    auto output = lft::ktx2::compressed_path(path.string(), occlusionPath.string());
+    lft::ktx2::write(output, texture);
+    std::println("{} -> {} ({} levels)", path.string(), output, texture.levels.size());
+}
+
+// image and the occlusion packed into it
+typedef std::pair<std::filesystem::path, std::filesystem::path> TextureSource;
+
+/**
+ * Collects images used by materials of the scene together with their use.
+ * Occlusion of a material is packed into its metallic roughness texture,
+ * unless both are already the same image.
+ */
+static std::map<TextureSource, TextureKind> collect_scene_textures(const std::filesystem::path& path) {
+    cgltf_options options = {};
+    cgltf_data* pData = nullptr;
+    if(cgltf_parse_file(&options, path.string().c_str(), &pData) != cgltf_result_success) {
+        throw std::runtime_error(std::format("Failed to parse {}", path.string()));
+    }
+
+    auto image_path = [&](const cgltf_texture_view& view) -> std::filesystem::path {
+        if(view.texture == nullptr || view.texture->image == nullptr ||
+           view.texture->image->uri == nullptr) {
+            return {};
+        }
+
+        return path.parent_path() / view.texture->image->uri;
+    };
+
+    std::map<TextureSource, TextureKind> textures;
+    auto add = [&](const std::filesystem::path& imagePath, const std::filesystem::path& occlusionPath,
+                   TextureKind kind) {
+        if(imagePath.empty()) {
+            return;
+        }
+
+        auto [it, isInserted] = textures.emplace(TextureSource(imagePath, occlusionPath), kind);
+        if(!isInserted && it->second != kind) {
+            std::println("Warning: {} has more uses, keeping the first one", imagePath.string());
+        }
+    };
+
+    for(uint32_t m = 0; m < pData->materials_count; m++) {
+        const cgltf_material& material = pData->materials[m];
+        add(image_path(material.normal_texture), {}, TextureKind::NORMAL);
+
+        if(material.has_pbr_metallic_roughness) {
+            add(image_path(material.pbr_metallic_roughness.base_color_texture), {}, TextureKind::COLOR);
+
+            auto metallicRoughnessPath = image_path(material.pbr_metallic_roughness.metallic_roughness_texture);
+            auto occlusionPath = image_path(material.occlusion_texture);
+            if(occlusionPath == metallicRoughnessPath) {
+                occlusionPath.clear();
+            }
+            add(metallicRoughnessPath, occlusionPath, TextureKind::LINEAR);
+        }
+    }
+
+    cgltf_free(pData);
+    return textures;
+}
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parse_options(argc, argv);
+        if(options.inputs.empty()) {
+            print_usage();
+            return 1;
+        }
+
+        for(const auto& input : options.inputs) {
+            auto extension = input.extension();
+            if(extension == ".gltf" || extension == ".glb") {
+                for(const auto& [source, kind] : collect_scene_textures(input)) {
+                    compress(source.first, source.second, kind, options);
+                }
+            } else {
+                compress(input, {}, options.kind, options);
+            }
+        }
+    } catch(const std::exception& e) {
+        std::println(stderr, "{}", e.what());
+        return 1;
+    }
+
+    return 0;
+}